@@ -0,0 +1,25 @@
+#ifndef _BENCHPAGE_H_
+#define _BENCHPAGE_H_
+#include <windows.h>
+
+// Objects shared by LifecycleBench and the FakeChild processes it starts
+// through the wrapper. Global, because the service runs in session 0.
+#define BENCH_PAGE_NAME TEXT("Global\\SvcWrapperBench")
+#define BENCH_STOP_EVENT TEXT("Global\\SvcWrapperBench.stop")
+#define BENCH_CRASH_EVENT TEXT("Global\\SvcWrapperBench.crash")
+
+/**
+ * Written by the fake child, read by the bench. Times are
+ * QueryPerformanceCounter values, which are the same in every process.
+ */
+struct BenchPage
+{
+    // Bumped each time a child reports ready
+    volatile LONG generation;
+    volatile LONG pid;
+    volatile LONGLONG readyTime;
+    // Set by a child right before it exits
+    volatile LONGLONG exitTime;
+};
+
+#endif /* _BENCHPAGE_H_ */
@@ -0,0 +1,113 @@
+/*
+ * Crash loop scenario of the supervision, on a virtual clock.
+ *
+ * Runs the service in test mode with FakeChild as a service process that
+ * exits with code 1 before it is ever up, and checks that the wrapper
+ * starts it RESTART_LIMIT times, RESTART_DELAY of virtual time apart,
+ * then gives up and stops. The restart delays pass in as long as the
+ * code takes to run. Exits with 0 when every check passes.
+ *
+ *   CrashLoopTest [--fakechild path]
+ */
+#include <stdio.h>
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "../src/strings.h"
+#include "../src/Descriptor.h"
+#include "TestService.h"
+
+// RESTART_LIMIT and RESTART_DELAY of SampleService.cpp
+#define EXPECTED_STARTS 3
+#define EXPECTED_DELAY 3000
+
+static int s_failures = 0;
+
+static void Check(bool condition, const char* what)
+{
+    printf("%s %s\n", condition ? "ok" : "FAILED", what);
+    if (!condition)
+    {
+        s_failures++;
+    }
+}
+
+static String GetDirectory(const String& path)
+{
+    return path.substr(0, path.find_last_of(TEXT('\\')));
+}
+
+static DWORD WINAPI RunService(LPVOID param)
+{
+    ((TestService*)param)->Test();
+    return 0;
+}
+
+#include "../mingw-unicode-main/mingw-unicode.c"
+int _tmain(int argc, TCHAR **argv)
+{
+    TCHAR szPath[MAX_PATH];
+    Descriptor d;
+    ChildClock clock;
+
+    GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath));
+    String fakeChild = GetDirectory(szPath) + TEXT("\\FakeChild.exe");
+    if (argc == 3 && _tcsicmp(argv[1], TEXT("--fakechild")) == 0)
+    {
+        fakeChild = argv[2];
+    }
+    GetTempPath(ARRAYSIZE(szPath), szPath);
+    d.id = TEXT("SvcWrapperCrashLoop");
+    d.name = d.id;
+    d.executable = fakeChild;
+    // Dies before its readiness wait is over, so it is never up
+    d.startargument.push_back(TEXT("--exit-after"));
+    d.startargument.push_back(TEXT("1"));
+    d.directory = GetDirectory(fakeChild);
+    d.logpath = String(szPath) + d.id;
+    d.logmode = TEXT("none");
+    d.history = 0;
+    // Longer than the whole loop, so that only the limit ends it
+    d.starttimeout = EXPECTED_STARTS * EXPECTED_DELAY * 10;
+    CreateDirectory(d.logpath.c_str(), NULL);
+
+    TestService service(&d, &clock);
+    ClockDriver* driver = NULL;
+    HANDLE hThread = CreateThread(NULL, 0, RunService, &service, 0, NULL);
+    HANDLE events[2] = { service.RestartEvent(), hThread };
+
+    // The clock only moves for the restart delays. Waiting on it by then:
+    // the test thread in OnStart, the worker and the status thread.
+    if (WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0)
+    {
+        DWORD waiters = service.Find(TEXT("Open status page failed")).empty() ? 3 : 2;
+        driver = new ClockDriver(&clock, waiters);
+    }
+    WaitForSingleObject(hThread, INFINITE);
+    CloseHandle(hThread);
+    delete driver;
+
+    std::vector<TestEvent> exits = service.Find(TEXT("Service stopped unexpectedly"));
+    std::vector<TestEvent> all = service.Events();
+    size_t restarts = 0;
+    bool stopped = false;
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        restarts += all[i].state == SERVICE_START_PENDING && all[i].code != 0;
+        stopped = stopped || all[i].state == SERVICE_STOPPED;
+    }
+    printf("starts=%u restarts=%u virtual_ms=%llu\n", (UINT)exits.size(),
+           (UINT)restarts, clock.Now());
+    Check(exits.size() == EXPECTED_STARTS, "child started RESTART_LIMIT times");
+    Check(restarts == EXPECTED_STARTS - 1, "no restart delay after the last start");
+    Check(!service.Find(TEXT("w/err 0x00000001")).empty(), "exit code of the child reported");
+    bool delays = exits.size() == EXPECTED_STARTS;
+    for (size_t i = 1; i < exits.size(); i++)
+    {
+        printf("delay %u: %llu ms\n", (UINT)i, exits[i].time - exits[i - 1].time);
+        delays = delays && exits[i].time - exits[i - 1].time == EXPECTED_DELAY;
+    }
+    Check(delays, "starts RESTART_DELAY apart in virtual time");
+    Check(stopped, "service stopped after the limit");
+    return s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/*
+ * Configurable service process for LifecycleBench.
+ *
+ *   FakeChild [--ready-after ms] [--bind port] [--bind-after ms]
+ *             [--exit-after ms] [--flood kb/s] [--ignore-stop]
+ *   FakeChild --signal stop|crash
+ *
+ * It reports READY=1 to the wrapper after --ready-after, or once its port
+ * is bound when --bind is given, and sends WATCHDOG=1 when the wrapper
+ * asks for heartbeats. It exits when the stop event is set, unless
+ * --ignore-stop, and with exit code 1 when the crash event is set or
+ * --exit-after expires. --signal sets one of the events, as the stop
+ * executable of the service or from the command line.
+ */
+#include <winsock2.h>
+#include <stdio.h>
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "../src/strings.h"
+#include "BenchPage.h"
+
+static SOCKET s_notify = INVALID_SOCKET;
+static struct sockaddr_in s_notifyAddr;
+static std::string s_notifyToken;
+
+static void OpenNotify()
+{
+    char address[64];
+    char token[64];
+    char* colon;
+
+    if (GetEnvironmentVariableA("NOTIFY_SOCKET", address, sizeof(address)) == 0 ||
+        (colon = strrchr(address, ':')) == NULL)
+    {
+        return;
+    }
+    if (GetEnvironmentVariableA("NOTIFY_TOKEN", token, sizeof(token)) > 0)
+    {
+        s_notifyToken = std::string("TOKEN=") + token + "\n";
+    }
+    *colon = 0;
+    ZeroMemory(&s_notifyAddr, sizeof(s_notifyAddr));
+    s_notifyAddr.sin_family = AF_INET;
+    s_notifyAddr.sin_addr.s_addr = inet_addr(address);
+    s_notifyAddr.sin_port = htons((USHORT)strtoul(colon + 1, NULL, 10));
+    s_notify = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+}
+
+static void Notify(const char* message)
+{
+    if (s_notify != INVALID_SOCKET)
+    {
+        std::string datagram = s_notifyToken + message;
+        sendto(s_notify, datagram.c_str(), (int)datagram.size(), 0,
+               (struct sockaddr*)&s_notifyAddr, sizeof(s_notifyAddr));
+    }
+}
+
+static SOCKET Bind(USHORT port)
+{
+    struct sockaddr_in addr;
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    ZeroMemory(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (s == INVALID_SOCKET ||
+        bind(s, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(s, SOMAXCONN) == SOCKET_ERROR)
+    {
+        fprintf(stderr, "bind %u failed w/err %d\n", (UINT)port, WSAGetLastError());
+        if (s != INVALID_SOCKET)
+        {
+            closesocket(s);
+        }
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+
+static int Signal(const TCHAR* name)
+{
+    HANDLE hEvent = OpenEvent(EVENT_MODIFY_STATE, FALSE,
+                              _tcsicmp(name, TEXT("crash")) == 0 ?
+                              BENCH_CRASH_EVENT : BENCH_STOP_EVENT);
+    if (hEvent == NULL)
+    {
+        return 1;
+    }
+    SetEvent(hEvent);
+    CloseHandle(hEvent);
+    return 0;
+}
+
+#include "../mingw-unicode-main/mingw-unicode.c"
+int _tmain(int argc, TCHAR **argv)
+{
+    WSADATA wsaData;
+    DWORD readyAfter = 0, bindAfter = 0, exitAfter = 0, flood = 0;
+    USHORT port = 0;
+    BOOL ignoreStop = FALSE, ready = FALSE;
+    SOCKET listener = INVALID_SOCKET;
+    HANDLE hStop, hCrash, hPage;
+    BenchPage* page = NULL;
+    DWORD watchdog = 0;
+    TCHAR value[32];
+    LARGE_INTEGER now;
+    std::string line(1023, 'x');
+    ULONGLONG start = GetTickCount64(), lastBeat = start;
+    ULONGLONG written = 0;
+    std::vector<HANDLE> events;
+    DWORD result;
+    int exitCode = 0;
+
+    line.push_back('\n');
+    for (int i = 1; i < argc; i++)
+    {
+        DWORD arg = i + 1 < argc ? _tcstoul(argv[i + 1], NULL, 10) : 0;
+        if (_tcsicmp(argv[i], TEXT("--signal")) == 0 && i + 1 < argc)
+        {
+            return Signal(argv[i + 1]);
+        }
+        else if (_tcsicmp(argv[i], TEXT("--ignore-stop")) == 0)
+        {
+            ignoreStop = TRUE;
+            continue;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--ready-after")) == 0)
+        {
+            readyAfter = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--bind")) == 0)
+        {
+            port = (USHORT)arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--bind-after")) == 0)
+        {
+            bindAfter = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--exit-after")) == 0)
+        {
+            exitAfter = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--flood")) == 0)
+        {
+            flood = arg;
+        }
+        i++;
+    }
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+    OpenNotify();
+    if (GetEnvironmentVariable(TEXT("WATCHDOG_USEC"), value, ARRAYSIZE(value)) > 0)
+    {
+        // Twice per period, as sd_notify users do
+        watchdog = (DWORD)(_tcstoul(value, NULL, 10) / 2000);
+    }
+    hStop = OpenEvent(SYNCHRONIZE, FALSE, BENCH_STOP_EVENT);
+    hCrash = OpenEvent(SYNCHRONIZE, FALSE, BENCH_CRASH_EVENT);
+    hPage = OpenFileMapping(FILE_MAP_WRITE, FALSE, BENCH_PAGE_NAME);
+    if (hPage != NULL)
+    {
+        page = (BenchPage*)MapViewOfFile(hPage, FILE_MAP_WRITE, 0, 0, sizeof(BenchPage));
+    }
+    if (hCrash != NULL)
+    {
+        events.push_back(hCrash);
+    }
+    if (hStop != NULL && !ignoreStop)
+    {
+        events.push_back(hStop);
+    }
+    while (true)
+    {
+        ULONGLONG elapsed = GetTickCount64() - start;
+        if (port != 0 && listener == INVALID_SOCKET && elapsed >= bindAfter)
+        {
+            listener = Bind(port);
+        }
+        if (!ready && elapsed >= readyAfter &&
+            (port == 0 || listener != INVALID_SOCKET))
+        {
+            ready = TRUE;
+            Notify("READY=1\n");
+            if (page != NULL)
+            {
+                QueryPerformanceCounter(&now);
+                page->readyTime = now.QuadPart;
+                page->pid = (LONG)GetCurrentProcessId();
+                InterlockedIncrement(&page->generation);
+            }
+        }
+        if (watchdog > 0 && GetTickCount64() - lastBeat >= watchdog)
+        {
+            lastBeat = GetTickCount64();
+            Notify("WATCHDOG=1\n");
+        }
+        if (exitAfter > 0 && elapsed >= exitAfter)
+        {
+            exitCode = 1;
+            break;
+        }
+        // Catch up with the flood rate, one line of 1 KB at a time
+        while (flood > 0 && written * 1000 < (GetTickCount64() - start) * flood)
+        {
+            fwrite(line.data(), 1, line.size(), stdout);
+            written++;
+        }
+        fflush(stdout);
+        result = events.empty() ? WAIT_TIMEOUT :
+                 WaitForMultipleObjects((DWORD)events.size(), &events[0], FALSE, 1);
+        if (result == WAIT_OBJECT_0 && events[0] == hCrash)
+        {
+            exitCode = 1;
+            break;
+        }
+        if (result < WAIT_OBJECT_0 + events.size())
+        {
+            break;
+        }
+        if (events.empty())
+        {
+            Sleep(1);
+        }
+    }
+    if (page != NULL)
+    {
+        QueryPerformanceCounter(&now);
+        page->exitTime = now.QuadPart;
+    }
+    return exitCode;
+}
@@ -0,0 +1,246 @@
+/*
+ * Fault scenarios of the supervision, for a build with FAULTS=1.
+ *
+ * Runs the service in test mode with FakeChild as its service process
+ * under each <faults> schedule below, on the clock the wrapper uses, and
+ * checks from what it logged, its history and its event log entries:
+ *   no_orphans       every service process it started is gone
+ *   no_lost_events   every start has its exit, and the failed exits, the
+ *                    restart events and the restart counter agree
+ *   restart_rate     restarts after a failure stay RESTART_DELAY apart
+ *   injected         the schedule was hit
+ * Exits with 0 when every check passes.
+ *
+ *   FaultTest [--fakechild path]
+ */
+#include <stdio.h>
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "../src/strings.h"
+#include "../src/Descriptor.h"
+#include "../src/Faults.h"
+#include "../src/History.h"
+#include "TestService.h"
+
+// RESTART_DELAY of SampleService.cpp
+#define EXPECTED_DELAY 3000
+// The history keeps the system time, the delay is counted on the tick
+// count; the two drift apart by a few milliseconds
+#define DELAY_TOLERANCE 100
+// Longest a scenario may take once the service is asked to stop
+#define SCENARIO_TIMEOUT 60000
+
+struct Scenario
+{
+    const TCHAR* name;
+    const TCHAR* faults;
+    // Arguments of FakeChild, separated by spaces
+    const TCHAR* arguments;
+    const TCHAR* logmode;
+    // Time after which the test stops the service, 0 to let it end
+    DWORD stopAfter;
+};
+
+static const Scenario s_scenarios[] =
+{
+    // Up, crashes, then its restart can't be spawned: the wrapper gives up
+    { TEXT("spawn_failures"), TEXT("spawn@2-3=fail"),
+      TEXT("--exit-after 1500"), TEXT("none"), 0 },
+    // Ignores the stop and the stop command is late: killed at escalation
+    { TEXT("stop_hang"), TEXT("signal@1=stall:2000"),
+      TEXT("--ignore-stop"), TEXT("none"), 2000 },
+    // Floods a capture pipe read slowly, crashes and is restarted
+    { TEXT("pipe_stall"), TEXT("read@2-40=stall:50"),
+      TEXT("--flood 256 --exit-after 4000"), TEXT("reset"), 8000 },
+};
+
+static int s_failures = 0;
+
+static void Check(const Scenario& scenario, bool condition, const char* what)
+{
+    printf("%s %ls %s\n", condition ? "ok" : "FAILED", scenario.name, what);
+    if (!condition)
+    {
+        s_failures++;
+    }
+}
+
+static String GetDirectory(const String& path)
+{
+    return path.substr(0, path.find_last_of(TEXT('\\')));
+}
+
+static ULONGLONG GetSystemTime64()
+{
+    FILETIME ft;
+
+    GetSystemTimeAsFileTime(&ft);
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static DWORD WINAPI RunService(LPVOID param)
+{
+    ((TestService*)param)->Test();
+    return 0;
+}
+
+//
+//   FUNCTION: CheckCounters
+//
+//   PURPOSE: Check the invariants of a scenario from the history of the
+//   service and from its event log entries.
+//
+static void CheckCounters(const Scenario& scenario, const Descriptor& d,
+                          TestService& service, ULONGLONG from)
+{
+    std::vector<HistoryRecord> records;
+    std::vector<TestEvent> found;
+    std::vector<DWORD> pids;
+    size_t exits = 0, failedExits = 0, orphans = 0;
+    ULONG planned = 0, failed = 0;
+    LONG injected = 0;
+    bool rate = true, lastFailed = false;
+    ULONGLONG lastStart = 0;
+
+    ReadHistory(d.logpath, d.id, from, GetSystemTime64(), &records);
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].kind == HISTORY_START)
+        {
+            if (lastFailed &&
+                records[i].time - lastStart <
+                (ULONGLONG)(EXPECTED_DELAY - DELAY_TOLERANCE) * 10000)
+            {
+                rate = false;
+            }
+            pids.push_back(records[i].value);
+            lastStart = records[i].time;
+        }
+        else if (records[i].kind == HISTORY_EXIT)
+        {
+            exits++;
+            failedExits += records[i].failed != 0;
+            lastFailed = records[i].failed != 0;
+        }
+    }
+    for (size_t i = 0; i < pids.size(); i++)
+    {
+        HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pids[i]);
+        if (hProcess != NULL)
+        {
+            orphans += WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+            CloseHandle(hProcess);
+        }
+    }
+    found = service.Find(TEXT("times after a failure"));
+    if (!found.empty())
+    {
+        _stscanf(found[0].message.c_str(),
+                 TEXT("Service process restarted %lu times on purpose and %lu times after a failure"),
+                 &planned, &failed);
+    }
+    found = service.Find(TEXT("Fault injection:"));
+    if (!found.empty())
+    {
+        _stscanf(found[0].message.c_str(), TEXT("Fault injection: %ld faults injected"),
+                 &injected);
+    }
+    size_t restarts = service.Find(TEXT("waiting to restart")).size();
+    printf("%ls: starts=%u exits=%u failed_exits=%u restarts=%u failed_restarts=%lu "
+           "planned_restarts=%lu injected=%ld\n", scenario.name, (UINT)pids.size(),
+           (UINT)exits, (UINT)failedExits, (UINT)restarts, failed, planned, injected);
+    Check(scenario, !pids.empty() && orphans == 0, "no_orphans");
+    Check(scenario, exits == pids.size() && failedExits == restarts &&
+          failedExits == failed, "no_lost_events");
+    Check(scenario, rate, "restart_rate");
+    Check(scenario, injected > 0, "injected");
+}
+
+//
+//   FUNCTION: RunScenario
+//
+//   PURPOSE: Run the service under the schedule of the scenario until it
+//   ends on its own or is stopped, then check it.
+//
+static void RunScenario(const Scenario& scenario, const String& fakeChild,
+                        const String& logpath, Clock* clock)
+{
+    Descriptor d;
+    String arguments = scenario.arguments;
+    size_t start = 0;
+
+    d.id = String(TEXT("SvcWrapperFaults.")) + scenario.name;
+    d.name = d.id;
+    d.executable = fakeChild;
+    while (start < arguments.size())
+    {
+        size_t end = arguments.find(TEXT(' '), start);
+        if (end == String::npos)
+        {
+            end = arguments.size();
+        }
+        d.startargument.push_back(arguments.substr(start, end - start));
+        start = end + 1;
+    }
+    d.stopexecutable = fakeChild;
+    d.stoparguments = TEXT("--signal stop");
+    d.stoptimeout = 4000;
+    d.directory = GetDirectory(fakeChild);
+    d.logpath = logpath;
+    d.logmode = scenario.logmode;
+    d.faults = scenario.faults;
+    if (!Faults::Load(d.faults))
+    {
+        printf("FAILED %ls schedule w/err 0x%08lx\n", scenario.name, GetLastError());
+        s_failures++;
+        return;
+    }
+
+    // History records are kept to the millisecond
+    ULONGLONG from = GetSystemTime64() - 10000;
+    TestService service(&d, clock);
+    HANDLE hThread = CreateThread(NULL, 0, RunService, &service, 0, NULL);
+    if (scenario.stopAfter > 0 &&
+        WaitForSingleObject(hThread, scenario.stopAfter) == WAIT_TIMEOUT)
+    {
+        service.Stop();
+    }
+    if (WaitForSingleObject(hThread, SCENARIO_TIMEOUT) == WAIT_TIMEOUT)
+    {
+        // Still running on its thread, the service can't be destroyed
+        printf("FAILED %ls service did not end\n", scenario.name);
+        ExitProcess(1);
+    }
+    CloseHandle(hThread);
+    CheckCounters(scenario, d, service, from);
+}
+
+#include "../mingw-unicode-main/mingw-unicode.c"
+int _tmain(int argc, TCHAR **argv)
+{
+    TCHAR szPath[MAX_PATH];
+    // Waits go through the fault clock, as in the wrapper
+    FaultClock clock(Clock::System());
+
+    // Refused unless the wrapper objects were built with FAULT_INJECTION
+    if (!Faults::Load(TEXT("spawn@1=fail")))
+    {
+        printf("skipped, the fault scenarios need a build with FAULTS=1\n");
+        return 0;
+    }
+    GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath));
+    String fakeChild = GetDirectory(szPath) + TEXT("\\FakeChild.exe");
+    if (argc == 3 && _tcsicmp(argv[1], TEXT("--fakechild")) == 0)
+    {
+        fakeChild = argv[2];
+    }
+    GetTempPath(ARRAYSIZE(szPath), szPath);
+    String logpath = String(szPath) + TEXT("SvcWrapperFaults");
+    CreateDirectory(logpath.c_str(), NULL);
+    for (size_t i = 0; i < ARRAYSIZE(s_scenarios); i++)
+    {
+        RunScenario(s_scenarios[i], fakeChild, logpath, &clock);
+    }
+    return s_failures == 0 ? 0 : 1;
+}
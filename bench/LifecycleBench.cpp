@@ -0,0 +1,418 @@
+/*
+ * Lifecycle benchmark of the wrapper, run elevated.
+ *
+ * Installs a copy of the wrapper as the SvcWrapperBench service, with
+ * FakeChild as its service process, and times through the SCM:
+ *   start_to_ready   StartService until the service runs, after READY=1
+ *   crash_to_ready   exit of the child until its replacement is ready
+ *   reload           upgrade, a new wrapper taking the child over
+ *   stop             ControlService(STOP) until the service is stopped
+ * then measures the CPU and memory of the wrapper for a while under the
+ * child output. Prints one JSON object per line.
+ *
+ *   LifecycleBench [--runs n] [--wrapper path] [--ready-after ms]
+ *                  [--flood kb/s] [--ignore-stop] [--stoptimeout ms]
+ *                  [--steady s]
+ */
+#include <stdio.h>
+#include <windows.h>
+#include <mmsystem.h>
+#include <psapi.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../src/strings.h"
+#include "../src/Handover.h"
+#include "BenchPage.h"
+
+#define BENCH_SERVICE TEXT("SvcWrapperBench")
+// Longest a single transition may take before the bench gives up
+#define BENCH_TIMEOUT 60000
+
+struct BenchOptions
+{
+    DWORD runs;
+    String wrapper;
+    DWORD readyAfter;
+    DWORD flood;
+    BOOL ignoreStop;
+    DWORD stopTimeout;
+    DWORD steady;
+};
+
+static LARGE_INTEGER s_frequency;
+
+static double Elapsed(LONGLONG from, LONGLONG to)
+{
+    return (double)(to - from) * 1000.0 / (double)s_frequency.QuadPart;
+}
+
+static LONGLONG Now()
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static String GetDirectory(const String& path)
+{
+    return path.substr(0, path.find_last_of(TEXT('\\')));
+}
+
+static bool RunCommand(const String& exe, const TCHAR* argument)
+{
+    String cmdLine = TEXT("\"") + exe + TEXT("\" ") + argument;
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    if (!CreateProcess(NULL, &cmdLine[0], NULL, NULL, FALSE, 0, NULL,
+                       GetDirectory(exe).c_str(), &si, &pi))
+    {
+        return false;
+    }
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    return true;
+}
+
+static bool WriteDescriptor(const String& filename, const String& fakeChild,
+                            const String& logpath, const BenchOptions& options)
+{
+    TCHAR buff[64];
+    String xml = TEXT("<service>\n")
+        TEXT("  <id>") BENCH_SERVICE TEXT("</id>\n")
+        TEXT("  <name>") BENCH_SERVICE TEXT("</name>\n")
+        TEXT("  <description>SvcWrapper lifecycle benchmark</description>\n")
+        TEXT("  <executable>") + fakeChild + TEXT("</executable>\n")
+        TEXT("  <logpath>") + logpath + TEXT("</logpath>\n")
+        TEXT("  <logmode>roll</logmode>\n")
+        TEXT("  <notify>true</notify>\n")
+        TEXT("  <stopexecutable>") + fakeChild + TEXT("</stopexecutable>\n")
+        TEXT("  <stoparguments>--signal stop</stoparguments>\n");
+
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%lu"), options.readyAfter);
+    xml += TEXT("  <startargument>--ready-after</startargument>\n")
+           TEXT("  <startargument>") + String(buff) + TEXT("</startargument>\n");
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%lu"), options.flood);
+    xml += TEXT("  <startargument>--flood</startargument>\n")
+           TEXT("  <startargument>") + String(buff) + TEXT("</startargument>\n");
+    if (options.ignoreStop)
+    {
+        xml += TEXT("  <startargument>--ignore-stop</startargument>\n");
+    }
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%lu"), options.stopTimeout);
+    xml += TEXT("  <stoptimeout>") + String(buff) + TEXT("</stoptimeout>\n");
+    xml += TEXT("</service>\n");
+
+    int size = WideCharToMultiByte(CP_UTF8, 0, xml.c_str(), (int)xml.size(),
+                                   NULL, 0, NULL, NULL);
+    std::string utf8(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, xml.c_str(), (int)xml.size(), &utf8[0],
+                        size, NULL, NULL);
+    HANDLE hFile = CreateFile(filename.c_str(), GENERIC_WRITE, 0, NULL,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    DWORD written;
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    BOOL result = WriteFile(hFile, utf8.data(), (DWORD)utf8.size(), &written, NULL);
+    CloseHandle(hFile);
+    return result && written == utf8.size();
+}
+
+//
+//   FUNCTION: WaitForState
+//
+//   PURPOSE: Poll the service every millisecond until it reaches state,
+//   run by another process than notPid when it isn't 0.
+//
+static bool WaitForState(SC_HANDLE schService, DWORD state, DWORD notPid,
+                         SERVICE_STATUS_PROCESS* ssp)
+{
+    DWORD dwBytesNeeded;
+    ULONGLONG deadline = GetTickCount64() + BENCH_TIMEOUT;
+
+    while (GetTickCount64() < deadline)
+    {
+        if (!QueryServiceStatusEx(schService, SC_STATUS_PROCESS_INFO,
+                                  (LPBYTE)ssp, sizeof(*ssp), &dwBytesNeeded))
+        {
+            return false;
+        }
+        if (ssp->dwCurrentState == state &&
+            (notPid == 0 || ssp->dwProcessId != notPid))
+        {
+            return true;
+        }
+        Sleep(1);
+    }
+    SetLastError(ERROR_TIMEOUT);
+    return false;
+}
+
+static void Report(const char* metric, std::vector<double>& samples)
+{
+    size_t n = samples.size();
+
+    if (n == 0)
+    {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    // Nearest rank
+    size_t p50 = (n * 50 + 99) / 100 - 1;
+    size_t p99 = (n * 99 + 99) / 100 - 1;
+    printf("{\"metric\":\"%s\",\"unit\":\"ms\",\"runs\":%u,"
+           "\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}\n",
+           metric, (UINT)n, samples[p50], samples[p99], samples[n - 1]);
+}
+
+static ULONGLONG GetCpuTime(HANDLE hProcess)
+{
+    FILETIME creation, exit, kernel, user;
+
+    if (!GetProcessTimes(hProcess, &creation, &exit, &kernel, &user))
+    {
+        return 0;
+    }
+    return ((((ULONGLONG)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+            (((ULONGLONG)user.dwHighDateTime << 32) | user.dwLowDateTime)) / 10000;
+}
+
+//
+//   FUNCTION: MeasureSteady
+//
+//   PURPOSE: CPU and memory of the wrapper supervising a running child
+//   for the given number of seconds.
+//
+static bool MeasureSteady(DWORD pid, DWORD seconds)
+{
+    PROCESS_MEMORY_COUNTERS pmc;
+    ULONGLONG cpuTime;
+    HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
+                                  FALSE, pid);
+    if (hProcess == NULL)
+    {
+        return false;
+    }
+    cpuTime = GetCpuTime(hProcess);
+    Sleep(seconds * 1000);
+    cpuTime = GetCpuTime(hProcess) - cpuTime;
+    ZeroMemory(&pmc, sizeof(pmc));
+    pmc.cb = sizeof(pmc);
+    GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc));
+    CloseHandle(hProcess);
+    printf("{\"metric\":\"supervisor_cpu\",\"unit\":\"ms/s\",\"value\":%.3f}\n",
+           (double)cpuTime / seconds);
+    printf("{\"metric\":\"supervisor_rss\",\"unit\":\"KB\",\"value\":%u,\"peak\":%u,\"private\":%u}\n",
+           (UINT)(pmc.WorkingSetSize / 1024), (UINT)(pmc.PeakWorkingSetSize / 1024),
+           (UINT)(pmc.PagefileUsage / 1024));
+    return true;
+}
+
+//
+//   FUNCTION: RunBench
+//
+//   PURPOSE: Go through start, crash, reload and stop runs times, then
+//   start once more for the steady measure. Stops at the first failure.
+//
+static bool RunBench(SC_HANDLE schService, BenchPage* page, HANDLE hCrash,
+                     const BenchOptions& options)
+{
+    std::vector<double> start, crash, reload, stop;
+    SERVICE_STATUS ssSvcStatus;
+    SERVICE_STATUS_PROCESS ssp;
+    LONGLONG t0;
+    LONG generation;
+    ULONGLONG deadline;
+    bool result = false;
+
+    for (DWORD run = 0; run < options.runs; run++)
+    {
+        t0 = Now();
+        if (!StartService(schService, 0, NULL) ||
+            !WaitForState(schService, SERVICE_RUNNING, 0, &ssp))
+        {
+            fprintf(stderr, "start failed w/err 0x%08lx\n", GetLastError());
+            goto Report;
+        }
+        start.push_back(Elapsed(t0, Now()));
+
+        generation = page->generation;
+        deadline = GetTickCount64() + BENCH_TIMEOUT;
+        SetEvent(hCrash);
+        while (page->generation == generation && GetTickCount64() < deadline)
+        {
+            Sleep(1);
+        }
+        if (page->generation == generation)
+        {
+            fprintf(stderr, "no restart after a crash\n");
+            goto Report;
+        }
+        crash.push_back(Elapsed(page->exitTime, page->readyTime));
+        // Start pending again while the wrapper waited to restart
+        if (!WaitForState(schService, SERVICE_RUNNING, 0, &ssp))
+        {
+            fprintf(stderr, "not running after a crash w/err 0x%08lx\n", GetLastError());
+            goto Report;
+        }
+
+        t0 = Now();
+        if (!ControlService(schService, SERVICE_CONTROL_HANDOVER, &ssSvcStatus) ||
+            !WaitForState(schService, SERVICE_RUNNING, ssp.dwProcessId, &ssp))
+        {
+            fprintf(stderr, "reload failed w/err 0x%08lx\n", GetLastError());
+            goto Report;
+        }
+        reload.push_back(Elapsed(t0, Now()));
+
+        t0 = Now();
+        if (!ControlService(schService, SERVICE_CONTROL_STOP, &ssSvcStatus) ||
+            !WaitForState(schService, SERVICE_STOPPED, 0, &ssp))
+        {
+            fprintf(stderr, "stop failed w/err 0x%08lx\n", GetLastError());
+            goto Report;
+        }
+        stop.push_back(Elapsed(t0, Now()));
+    }
+    result = true;
+    if (options.steady > 0)
+    {
+        result = StartService(schService, 0, NULL) &&
+                 WaitForState(schService, SERVICE_RUNNING, 0, &ssp) &&
+                 MeasureSteady(ssp.dwProcessId, options.steady);
+        ControlService(schService, SERVICE_CONTROL_STOP, &ssSvcStatus);
+        WaitForState(schService, SERVICE_STOPPED, 0, &ssp);
+    }
+
+Report:
+    Report("start_to_ready", start);
+    Report("crash_to_ready", crash);
+    Report("reload", reload);
+    Report("stop", stop);
+    return result;
+}
+
+#include "../mingw-unicode-main/mingw-unicode.c"
+int _tmain(int argc, TCHAR **argv)
+{
+    BenchOptions options;
+    TCHAR szPath[MAX_PATH];
+    TCHAR szTemp[MAX_PATH];
+    SC_HANDLE schSCManager = NULL;
+    SC_HANDLE schService = NULL;
+    HANDLE hPage, hStop, hCrash;
+    BenchPage* page;
+    int exitCode = 1;
+
+    GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath));
+    String benchDir = GetDirectory(szPath);
+    options.runs = 20;
+    options.wrapper = benchDir + TEXT("\\..\\bin\\x64\\SvcWrapper.exe");
+    options.readyAfter = 0;
+    options.flood = 0;
+    options.ignoreStop = FALSE;
+    options.stopTimeout = 15000;
+    options.steady = 10;
+    for (int i = 1; i < argc; i++)
+    {
+        DWORD arg = i + 1 < argc ? _tcstoul(argv[i + 1], NULL, 10) : 0;
+        if (_tcsicmp(argv[i], TEXT("--ignore-stop")) == 0)
+        {
+            options.ignoreStop = TRUE;
+            continue;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--wrapper")) == 0 && i + 1 < argc)
+        {
+            options.wrapper = argv[i + 1];
+        }
+        else if (_tcsicmp(argv[i], TEXT("--runs")) == 0)
+        {
+            options.runs = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--ready-after")) == 0)
+        {
+            options.readyAfter = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--flood")) == 0)
+        {
+            options.flood = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--stoptimeout")) == 0)
+        {
+            options.stopTimeout = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--steady")) == 0)
+        {
+            options.steady = arg;
+        }
+        i++;
+    }
+    QueryPerformanceFrequency(&s_frequency);
+    timeBeginPeriod(1);
+
+    // The wrapper reads the descriptor named after its binary
+    GetTempPath(ARRAYSIZE(szTemp), szTemp);
+    String workDir = String(szTemp) + BENCH_SERVICE;
+    String exe = workDir + TEXT("\\") + BENCH_SERVICE + TEXT(".exe");
+    CreateDirectory(workDir.c_str(), NULL);
+    if (!CopyFile(options.wrapper.c_str(), exe.c_str(), FALSE) ||
+        !WriteDescriptor(workDir + TEXT("\\") + BENCH_SERVICE + TEXT(".xml"),
+                         benchDir + TEXT("\\FakeChild.exe"),
+                         workDir + TEXT("\\logs"), options))
+    {
+        fprintf(stderr, "setup in %ls failed w/err 0x%08lx\n", workDir.c_str(),
+                GetLastError());
+        return 1;
+    }
+    hPage = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                              sizeof(BenchPage), BENCH_PAGE_NAME);
+    hStop = CreateEvent(NULL, FALSE, FALSE, BENCH_STOP_EVENT);
+    hCrash = CreateEvent(NULL, FALSE, FALSE, BENCH_CRASH_EVENT);
+    page = hPage != NULL ?
+        (BenchPage*)MapViewOfFile(hPage, FILE_MAP_WRITE, 0, 0, sizeof(BenchPage)) : NULL;
+    if (page == NULL || hStop == NULL || hCrash == NULL ||
+        !RunCommand(exe, TEXT("install")))
+    {
+        fprintf(stderr, "setup failed w/err 0x%08lx, run elevated\n", GetLastError());
+        return 1;
+    }
+    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
+    if (schSCManager != NULL)
+    {
+        schService = OpenService(schSCManager, BENCH_SERVICE,
+            SERVICE_START | SERVICE_STOP | SERVICE_QUERY_STATUS |
+            SERVICE_USER_DEFINED_CONTROL);
+    }
+    if (schService == NULL)
+    {
+        fprintf(stderr, "OpenService failed w/err 0x%08lx\n", GetLastError());
+    }
+    else
+    {
+        printf("{\"bench\":\"lifecycle\",\"runs\":%lu,"
+               "\"ready_after_ms\":%lu,\"flood_kbs\":%lu,\"ignore_stop\":%s,"
+               "\"stoptimeout_ms\":%lu}\n",
+               options.runs,
+               options.readyAfter, options.flood,
+               options.ignoreStop ? "true" : "false", options.stopTimeout);
+        if (RunBench(schService, page, hCrash, options))
+        {
+            exitCode = 0;
+        }
+        CloseServiceHandle(schService);
+    }
+    if (schSCManager != NULL)
+    {
+        CloseServiceHandle(schSCManager);
+    }
+    RunCommand(exe, TEXT("uninstall"));
+    timeEndPeriod(1);
+    return exitCode;
+}
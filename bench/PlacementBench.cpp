@@ -0,0 +1,156 @@
+/*
+ * Benchmark child for the cpu settings of the wrapper.
+ *
+ * Starts one worker per core (or the given count) twice, first anywhere,
+ * then spread with the same CpuPlacement code the wrapper uses, and
+ * prints the throughput of each round. Each worker sweeps its own buffer
+ * and exits with the MB/s it reached.
+ *
+ *   PlacementBench [workers] [seconds] [kb] [core|node]
+ *   PlacementBench --worker <seconds> <kb>
+ */
+#include <stdio.h>
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "../src/strings.h"
+#include "../src/Placement.h"
+
+static DWORD RunWorker(DWORD seconds, DWORD kb)
+{
+    size_t count = (size_t)kb * 1024 / sizeof(ULONGLONG);
+    std::vector<ULONGLONG> buffer(count, 1);
+    ULONGLONG bytes = 0;
+    ULONGLONG start = GetTickCount64();
+    ULONGLONG elapsed;
+    volatile ULONGLONG sink = 0;
+
+    do
+    {
+        ULONGLONG sum = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            buffer[i] += sum;
+            sum += buffer[i];
+        }
+        sink += sum;
+        bytes += count * sizeof(ULONGLONG);
+        elapsed = GetTickCount64() - start;
+    }
+    while (elapsed < (ULONGLONG)seconds * 1000);
+    return (DWORD)(bytes * 1000 / elapsed / (1024 * 1024));
+}
+
+//
+//   FUNCTION: RunRound
+//
+//   PURPOSE: Start the workers suspended, place them when a placement is
+//   given, let them all go at once and collect their MB/s.
+//
+static bool RunRound(const TCHAR* name, CpuPlacement* placement,
+                     DWORD workers, DWORD seconds, DWORD kb)
+{
+    TCHAR szPath[MAX_PATH];
+    TCHAR cmdLine[MAX_PATH + 64];
+    STARTUPINFO si;
+    std::vector<PROCESS_INFORMATION> children;
+    std::vector<HANDLE> handles;
+    DWORD total = 0, lowest = 0, highest = 0;
+
+    GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath));
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    for (DWORD i = 0; i < workers; i++)
+    {
+        PROCESS_INFORMATION pi;
+        _sntprintf(cmdLine, ARRAYSIZE(cmdLine), TEXT("\"%s\" --worker %lu %lu"),
+                   szPath, seconds, kb);
+        if (!CreateProcess(NULL, cmdLine, NULL, NULL, FALSE, CREATE_SUSPENDED,
+                           NULL, NULL, &si, &pi))
+        {
+            _tprintf(TEXT("CreateProcess failed w/err 0x%08lx\n"), GetLastError());
+            break;
+        }
+        if (placement != NULL)
+        {
+            placement->Attach(NULL, i);
+            if (!placement->Apply(pi.hProcess))
+            {
+                _tprintf(TEXT("Apply failed w/err 0x%08lx\n"), GetLastError());
+            }
+        }
+        children.push_back(pi);
+        handles.push_back(pi.hProcess);
+    }
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        ResumeThread(children[i].hThread);
+    }
+    for (size_t i = 0; i < handles.size(); i += MAXIMUM_WAIT_OBJECTS)
+    {
+        size_t count = handles.size() - i;
+        if (count > MAXIMUM_WAIT_OBJECTS)
+        {
+            count = MAXIMUM_WAIT_OBJECTS;
+        }
+        WaitForMultipleObjects((DWORD)count, &handles[i], TRUE, INFINITE);
+    }
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        DWORD rate = 0;
+        GetExitCodeProcess(children[i].hProcess, &rate);
+        total += rate;
+        lowest = i == 0 || rate < lowest ? rate : lowest;
+        highest = rate > highest ? rate : highest;
+        CloseHandle(children[i].hProcess);
+        CloseHandle(children[i].hThread);
+    }
+    _tprintf(TEXT("placement=%s workers=%lu total_mbs=%lu min_mbs=%lu max_mbs=%lu\n"),
+             name, (DWORD)children.size(), total, lowest, highest);
+    return children.size() == workers;
+}
+
+#include "../mingw-unicode-main/mingw-unicode.c"
+int _tmain(int argc, TCHAR **argv)
+{
+    CpuPlacement placement;
+    DWORD workers, seconds = 10, kb = 2048;
+    const TCHAR* spread = TEXT("core");
+
+    if (argc == 4 && _tcsicmp(argv[1], TEXT("--worker")) == 0)
+    {
+        return RunWorker(_tcstoul(argv[2], NULL, 10), _tcstoul(argv[3], NULL, 10));
+    }
+    if (argc > 4)
+    {
+        spread = argv[4];
+    }
+    if (!placement.Configure(TEXT(""), spread, TEXT(""), TEXT("")) ||
+        placement.Units() == 0)
+    {
+        _tprintf(TEXT("Can't spread over %s\n"), spread);
+        return 1;
+    }
+    workers = argc > 1 ? _tcstoul(argv[1], NULL, 10) : placement.Units();
+    if (argc > 2)
+    {
+        seconds = _tcstoul(argv[2], NULL, 10);
+    }
+    if (argc > 3)
+    {
+        kb = _tcstoul(argv[3], NULL, 10);
+    }
+    if (workers == 0 || seconds == 0 || kb == 0)
+    {
+        _tprintf(TEXT("Usage: PlacementBench [workers] [seconds] [kb] [core|node]\n"));
+        return 1;
+    }
+    _tprintf(TEXT("units=%lu workers=%lu seconds=%lu kb=%lu\n"),
+             placement.Units(), workers, seconds, kb);
+    if (!RunRound(TEXT("none"), NULL, workers, seconds, kb) ||
+        !RunRound(spread, &placement, workers, seconds, kb))
+    {
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,650 @@
+/*
+ * Scaling benchmark of the wrapper: what the supervision of one child
+ * costs when hundreds or thousands of services share a box.
+ *
+ * For each count, starts that many wrappers in test mode, each
+ * supervising a ScaleBench child that prints timestamped lines, captured
+ * by the wrapper to a pipe sink served by the bench. Reports per count:
+ *   start_all            first wrapper started until every child runs
+ *   supervisor_rss       working set and private bytes of the wrappers,
+ *                        per child
+ *   supervisor_cpu       CPU of the wrappers per child
+ *   loop_latency         a child printing a line until its wrapper
+ *                        delivered it to the sink
+ *   exit_to_replacement  kill of a child until its replacement runs, with
+ *                        the restart delay of the wrapper
+ *   log_throughput       bytes delivered by all the wrappers per second
+ * Prints one JSON object per line.
+ *
+ *   ScaleBench [--counts 100,1000,10000] [--wrapper path] [--rate lines/s]
+ *              [--seconds s] [--kills n]
+ *   ScaleBench --child <index> <rate>
+ */
+#include <stdio.h>
+#include <windows.h>
+#include <mmsystem.h>
+#include <psapi.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../src/strings.h"
+
+#define SCALE_NAME TEXT("SvcWrapperScale")
+#define SCALE_PAGE_NAME TEXT("Local\\SvcWrapperScale")
+#define SCALE_PIPE_NAME TEXT("\\\\.\\pipe\\SvcWrapperScale")
+// Bytes of each line a child prints, newline included
+#define SCALE_LINE_SIZE 100
+// Latency samples kept per round
+#define MAX_SAMPLES (1 << 20)
+// Longest the children of a round may take to start, plus 10 ms each
+#define SCALE_TIMEOUT 60000
+
+/**
+ * Written by the child of a wrapper, read by the bench. Times are
+ * QueryPerformanceCounter values, which are the same in every process.
+ */
+struct ScaleSlot
+{
+    volatile LONG pid;
+    volatile LONGLONG startTime;
+};
+
+struct ScaleOptions
+{
+    std::vector<DWORD> counts;
+    String wrapper;
+    DWORD rate;
+    DWORD seconds;
+    DWORD kills;
+};
+
+/**
+ * One instance of the sink pipe, connected to by one wrapper.
+ */
+struct PipeInstance
+{
+    OVERLAPPED ov;
+    HANDLE hPipe;
+    bool connected;
+    char buff[4096];
+    std::string carry;
+};
+
+/**
+ * What the reader saw of the captured lines since the last Reset.
+ */
+struct PipeStats
+{
+    CRITICAL_SECTION lock;
+    ULONGLONG bytes;
+    std::vector<double> latencies;
+};
+
+static LARGE_INTEGER s_frequency;
+static PipeStats s_stats;
+static HANDLE s_port;
+
+static double Elapsed(LONGLONG from, LONGLONG to)
+{
+    return (double)(to - from) * 1000.0 / (double)s_frequency.QuadPart;
+}
+
+static LONGLONG Now()
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static String GetDirectory(const String& path)
+{
+    return path.substr(0, path.find_last_of(TEXT('\\')));
+}
+
+//
+//   FUNCTION: RunChild
+//
+//   PURPOSE: The service process: report the start in the slot, then
+//   print rate lines per second, each with the time it was printed, until
+//   the bench kills it.
+//
+static int RunChild(DWORD index, DWORD rate)
+{
+    HANDLE hPage = OpenFileMapping(FILE_MAP_WRITE, FALSE, SCALE_PAGE_NAME);
+    ScaleSlot* slots;
+    char line[SCALE_LINE_SIZE + 1];
+    DWORD interval = rate > 0 && rate < 1000 ? 1000 / rate : 1;
+
+    if (hPage == NULL ||
+        (slots = (ScaleSlot*)MapViewOfFile(hPage, FILE_MAP_WRITE, 0, 0, 0)) == NULL)
+    {
+        return 1;
+    }
+    slots[index].startTime = Now();
+    InterlockedExchange(&slots[index].pid, (LONG)GetCurrentProcessId());
+    memset(line, 'x', SCALE_LINE_SIZE);
+    line[SCALE_LINE_SIZE - 1] = '\n';
+    line[SCALE_LINE_SIZE] = 0;
+    while (true)
+    {
+        int size = _snprintf(line, SCALE_LINE_SIZE - 1, "%I64d %lu ", Now(), index);
+        line[size] = 'x';
+        fwrite(line, 1, SCALE_LINE_SIZE, stdout);
+        fflush(stdout);
+        Sleep(interval);
+    }
+    return 0;
+}
+
+static bool Listen(PipeInstance* instance)
+{
+    ZeroMemory(&instance->ov, sizeof(instance->ov));
+    instance->connected = false;
+    instance->carry.clear();
+    if (ConnectNamedPipe(instance->hPipe, &instance->ov))
+    {
+        return true;
+    }
+    switch (GetLastError())
+    {
+        case ERROR_IO_PENDING:
+            return true;
+        case ERROR_PIPE_CONNECTED:
+            // Connected before the call, no completion comes for it
+            return PostQueuedCompletionStatus(s_port, 0, (ULONG_PTR)instance,
+                                              &instance->ov) != FALSE;
+        case ERROR_NO_DATA:
+            // Connected and gone again before the call
+            DisconnectNamedPipe(instance->hPipe);
+            return Listen(instance);
+        default:
+            return false;
+    }
+}
+
+//
+//   FUNCTION: ParseLines
+//
+//   PURPOSE: Take the latency of every complete line of the buffer, the
+//   rest waits for the next read.
+//
+static void ParseLines(PipeInstance* instance, DWORD bytes)
+{
+    LONGLONG now = Now();
+    size_t start = 0, end;
+
+    instance->carry.append(instance->buff, bytes);
+    EnterCriticalSection(&s_stats.lock);
+    s_stats.bytes += bytes;
+    while ((end = instance->carry.find('\n', start)) != std::string::npos)
+    {
+        LONGLONG printed = _atoi64(instance->carry.c_str() + start);
+        if (printed > 0 && s_stats.latencies.size() < MAX_SAMPLES)
+        {
+            s_stats.latencies.push_back(Elapsed(printed, now));
+        }
+        start = end + 1;
+    }
+    LeaveCriticalSection(&s_stats.lock);
+    instance->carry.erase(0, start);
+}
+
+//
+//   FUNCTION: ReaderThread
+//
+//   PURPOSE: Serve every instance of the sink pipe from one completion
+//   port, as a log collector would. A broken connection is listened to
+//   again for the replacement of the wrapper.
+//
+static DWORD WINAPI ReaderThread(LPVOID lpParam)
+{
+    DWORD bytes;
+    ULONG_PTR key;
+    LPOVERLAPPED ov;
+
+    while (true)
+    {
+        BOOL result = GetQueuedCompletionStatus(s_port, &bytes, &key, &ov, INFINITE);
+        PipeInstance* instance = (PipeInstance*)key;
+        if (instance == NULL)
+        {
+            return 0;
+        }
+        if (!result)
+        {
+            DisconnectNamedPipe(instance->hPipe);
+            Listen(instance);
+            continue;
+        }
+        if (instance->connected)
+        {
+            ParseLines(instance, bytes);
+        }
+        instance->connected = true;
+        ZeroMemory(&instance->ov, sizeof(instance->ov));
+        if (!ReadFile(instance->hPipe, instance->buff, sizeof(instance->buff),
+                      NULL, &instance->ov) &&
+            GetLastError() != ERROR_IO_PENDING)
+        {
+            DisconnectNamedPipe(instance->hPipe);
+            Listen(instance);
+        }
+    }
+}
+
+static bool CreateInstances(std::vector<PipeInstance*>& instances, size_t count)
+{
+    while (instances.size() < count)
+    {
+        PipeInstance* instance = new PipeInstance();
+        instance->hPipe = CreateNamedPipe(SCALE_PIPE_NAME,
+            PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED,
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+            PIPE_UNLIMITED_INSTANCES, 0, sizeof(instance->buff), 0, NULL);
+        if (instance->hPipe == INVALID_HANDLE_VALUE ||
+            CreateIoCompletionPort(instance->hPipe, s_port, (ULONG_PTR)instance, 0) == NULL)
+        {
+            delete instance;
+            return false;
+        }
+        instances.push_back(instance);
+        if (!Listen(instance))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool WriteDescriptor(const String& filename, DWORD index,
+                            const String& bench, const String& logpath,
+                            const ScaleOptions& options)
+{
+    TCHAR buff[64];
+    String xml;
+
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%s%lu"), SCALE_NAME, index);
+    xml = TEXT("<service>\n")
+          TEXT("  <id>") + String(buff) + TEXT("</id>\n")
+          TEXT("  <name>") + String(buff) + TEXT("</name>\n")
+          TEXT("  <executable>") + bench + TEXT("</executable>\n")
+          TEXT("  <logpath>") + logpath + TEXT("</logpath>\n")
+          TEXT("  <log stream=\"stdout\" type=\"pipe\" path=\"") SCALE_PIPE_NAME TEXT("\"/>\n")
+          TEXT("  <startargument>--child</startargument>\n");
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%lu"), index);
+    xml += TEXT("  <startargument>") + String(buff) + TEXT("</startargument>\n");
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%lu"), options.rate);
+    xml += TEXT("  <startargument>") + String(buff) + TEXT("</startargument>\n");
+    xml += TEXT("</service>\n");
+
+    int size = WideCharToMultiByte(CP_UTF8, 0, xml.c_str(), (int)xml.size(),
+                                   NULL, 0, NULL, NULL);
+    std::string utf8(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, xml.c_str(), (int)xml.size(), &utf8[0],
+                        size, NULL, NULL);
+    HANDLE hFile = CreateFile(filename.c_str(), GENERIC_WRITE, 0, NULL,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    DWORD written;
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    BOOL result = WriteFile(hFile, utf8.data(), (DWORD)utf8.size(), &written, NULL);
+    CloseHandle(hFile);
+    return result && written == utf8.size();
+}
+
+//
+//   FUNCTION: Setup
+//
+//   PURPOSE: Give each wrapper its own name, a hard link to the wrapper
+//   when the volume allows it, since it reads the descriptor named after
+//   its binary.
+//
+static bool Setup(const String& workDir, const String& bench, DWORD count,
+                  const ScaleOptions& options)
+{
+    TCHAR buff[64];
+
+    CreateDirectory(workDir.c_str(), NULL);
+    for (DWORD i = 0; i < count; i++)
+    {
+        _sntprintf(buff, ARRAYSIZE(buff), TEXT("\\%s%lu"), SCALE_NAME, i);
+        String exe = workDir + buff + TEXT(".exe");
+        DeleteFile(exe.c_str());
+        if ((!CreateHardLink(exe.c_str(), options.wrapper.c_str(), NULL) &&
+             !CopyFile(options.wrapper.c_str(), exe.c_str(), FALSE)) ||
+            !WriteDescriptor(workDir + buff + TEXT(".xml"), i, bench,
+                             workDir + TEXT("\\logs"), options))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void Report(const char* metric, DWORD count, std::vector<double>& samples)
+{
+    size_t n = samples.size();
+
+    if (n == 0)
+    {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    // Nearest rank
+    size_t p50 = (n * 50 + 99) / 100 - 1;
+    size_t p99 = (n * 99 + 99) / 100 - 1;
+    printf("{\"metric\":\"%s\",\"children\":%lu,\"unit\":\"ms\",\"samples\":%u,"
+           "\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}\n",
+           metric, count, (UINT)n, samples[p50], samples[p99], samples[n - 1]);
+}
+
+static ULONGLONG GetCpuTime(const std::vector<HANDLE>& processes)
+{
+    FILETIME creation, exit, kernel, user;
+    ULONGLONG total = 0;
+
+    for (size_t i = 0; i < processes.size(); i++)
+    {
+        if (GetProcessTimes(processes[i], &creation, &exit, &kernel, &user))
+        {
+            total += ((((ULONGLONG)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+                      (((ULONGLONG)user.dwHighDateTime << 32) | user.dwLowDateTime)) / 10000;
+        }
+    }
+    return total;
+}
+
+//
+//   FUNCTION: MeasureExits
+//
+//   PURPOSE: Kill children spread over the slots one at a time and time
+//   until their wrapper has a replacement running.
+//
+static void MeasureExits(ScaleSlot* slots, DWORD count, DWORD kills,
+                         std::vector<double>& samples)
+{
+    for (DWORD k = 0; k < kills && k < count; k++)
+    {
+        DWORD index = (DWORD)((ULONGLONG)k * count / kills);
+        HANDLE hChild = OpenProcess(PROCESS_TERMINATE, FALSE, slots[index].pid);
+        ULONGLONG deadline = GetTickCount64() + SCALE_TIMEOUT;
+        LONGLONG killTime;
+
+        if (hChild == NULL)
+        {
+            continue;
+        }
+        InterlockedExchange(&slots[index].pid, 0);
+        killTime = Now();
+        TerminateProcess(hChild, 1);
+        CloseHandle(hChild);
+        while (slots[index].pid == 0 && GetTickCount64() < deadline)
+        {
+            Sleep(1);
+        }
+        if (slots[index].pid == 0)
+        {
+            fprintf(stderr, "no replacement for child %lu\n", index);
+            return;
+        }
+        samples.push_back(Elapsed(killTime, slots[index].startTime));
+    }
+}
+
+//
+//   FUNCTION: RunRound
+//
+//   PURPOSE: Start count wrappers in one job, wait for all the children,
+//   measure, then kill the job with every wrapper and child in it.
+//
+static bool RunRound(const String& workDir, ScaleSlot* slots, DWORD count,
+                     const ScaleOptions& options)
+{
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+    HANDLE hJob = CreateJobObject(NULL, NULL);
+    HANDLE hNul;
+    SECURITY_ATTRIBUTES sa;
+    STARTUPINFO si;
+    std::vector<HANDLE> wrappers;
+    std::vector<double> start, latencies, exits;
+    PROCESS_MEMORY_COUNTERS_EX pmc;
+    ULONGLONG workingSet = 0, privateBytes = 0, cpuTime, bytes;
+    ULONGLONG deadline;
+    DWORD running = 0;
+    TCHAR buff[64];
+    LONGLONG t0;
+    bool result = false;
+
+    ZeroMemory(&limits, sizeof(limits));
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+    hNul = CreateFile(TEXT("NUL"), GENERIC_READ | GENERIC_WRITE,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+    if (hJob == NULL || hNul == INVALID_HANDLE_VALUE ||
+        !SetInformationJobObject(hJob, JobObjectExtendedLimitInformation,
+                                 &limits, sizeof(limits)))
+    {
+        fprintf(stderr, "job setup failed w/err 0x%08lx\n", GetLastError());
+        return false;
+    }
+    ZeroMemory(slots, count * sizeof(ScaleSlot));
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = si.hStdOutput = si.hStdError = hNul;
+
+    t0 = Now();
+    for (DWORD i = 0; i < count; i++)
+    {
+        PROCESS_INFORMATION pi;
+        _sntprintf(buff, ARRAYSIZE(buff), TEXT("\\%s%lu"), SCALE_NAME, i);
+        String exe = workDir + buff + TEXT(".exe");
+        String cmdLine = TEXT("\"") + exe + TEXT("\" test");
+        // Suspended until in the job, so no wrapper outlives the bench
+        if (!CreateProcess(exe.c_str(), &cmdLine[0], NULL, NULL, TRUE,
+                           CREATE_SUSPENDED | CREATE_NO_WINDOW, NULL,
+                           workDir.c_str(), &si, &pi))
+        {
+            fprintf(stderr, "start of wrapper %lu failed w/err 0x%08lx\n", i,
+                    GetLastError());
+            goto Done;
+        }
+        AssignProcessToJobObject(hJob, pi.hProcess);
+        ResumeThread(pi.hThread);
+        CloseHandle(pi.hThread);
+        wrappers.push_back(pi.hProcess);
+    }
+    deadline = GetTickCount64() + SCALE_TIMEOUT + count * 10;
+    while (running < count && GetTickCount64() < deadline)
+    {
+        running = 0;
+        for (DWORD i = 0; i < count; i++)
+        {
+            running += slots[i].pid != 0 ? 1 : 0;
+        }
+        Sleep(10);
+    }
+    if (running < count)
+    {
+        fprintf(stderr, "%lu of %lu children running\n", running, count);
+        goto Done;
+    }
+    start.push_back(Elapsed(t0, Now()));
+    // Let the wrappers connect to the sink before counting
+    Sleep(1000);
+
+    EnterCriticalSection(&s_stats.lock);
+    s_stats.bytes = 0;
+    s_stats.latencies.clear();
+    LeaveCriticalSection(&s_stats.lock);
+    cpuTime = GetCpuTime(wrappers);
+    Sleep(options.seconds * 1000);
+    cpuTime = GetCpuTime(wrappers) - cpuTime;
+    EnterCriticalSection(&s_stats.lock);
+    bytes = s_stats.bytes;
+    latencies.swap(s_stats.latencies);
+    LeaveCriticalSection(&s_stats.lock);
+    for (size_t i = 0; i < wrappers.size(); i++)
+    {
+        ZeroMemory(&pmc, sizeof(pmc));
+        pmc.cb = sizeof(pmc);
+        if (GetProcessMemoryInfo(wrappers[i], (PROCESS_MEMORY_COUNTERS*)&pmc,
+                                 sizeof(pmc)))
+        {
+            workingSet += pmc.WorkingSetSize;
+            privateBytes += pmc.PrivateUsage;
+        }
+    }
+    MeasureExits(slots, count, options.kills, exits);
+    result = true;
+
+    Report("start_all", count, start);
+    printf("{\"metric\":\"supervisor_rss\",\"children\":%lu,\"unit\":\"KB\","
+           "\"per_child\":%.1f,\"private_per_child\":%.1f}\n",
+           count, (double)workingSet / 1024 / count,
+           (double)privateBytes / 1024 / count);
+    printf("{\"metric\":\"supervisor_cpu\",\"children\":%lu,\"unit\":\"ms/s\","
+           "\"per_child\":%.4f,\"total\":%.3f}\n",
+           count, (double)cpuTime / options.seconds / count,
+           (double)cpuTime / options.seconds);
+    Report("loop_latency", count, latencies);
+    Report("exit_to_replacement", count, exits);
+    printf("{\"metric\":\"log_throughput\",\"children\":%lu,\"unit\":\"KB/s\","
+           "\"value\":%.1f,\"expected\":%.1f}\n",
+           count, (double)bytes / 1024 / options.seconds,
+           (double)count * options.rate * SCALE_LINE_SIZE / 1024);
+
+Done:
+    TerminateJobObject(hJob, 0);
+    for (size_t i = 0; i < wrappers.size(); i += MAXIMUM_WAIT_OBJECTS)
+    {
+        size_t n = wrappers.size() - i;
+        WaitForMultipleObjects((DWORD)(n < MAXIMUM_WAIT_OBJECTS ? n : MAXIMUM_WAIT_OBJECTS),
+                               &wrappers[i], TRUE, SCALE_TIMEOUT);
+    }
+    for (size_t i = 0; i < wrappers.size(); i++)
+    {
+        CloseHandle(wrappers[i]);
+    }
+    CloseHandle(hJob);
+    CloseHandle(hNul);
+    return result;
+}
+
+#include "../mingw-unicode-main/mingw-unicode.c"
+int _tmain(int argc, TCHAR **argv)
+{
+    ScaleOptions options;
+    TCHAR szPath[MAX_PATH];
+    TCHAR szTemp[MAX_PATH];
+    std::vector<PipeInstance*> instances;
+    HANDLE hPage, hReader;
+    ScaleSlot* slots;
+    DWORD maxCount = 0;
+    int exitCode = 0;
+
+    QueryPerformanceFrequency(&s_frequency);
+    if (argc == 4 && _tcsicmp(argv[1], TEXT("--child")) == 0)
+    {
+        return RunChild(_tcstoul(argv[2], NULL, 10), _tcstoul(argv[3], NULL, 10));
+    }
+    GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath));
+    options.wrapper = GetDirectory(szPath) + TEXT("\\..\\bin\\x64\\SvcWrapper.exe");
+    options.rate = 10;
+    options.seconds = 10;
+    options.kills = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        DWORD arg = i + 1 < argc ? _tcstoul(argv[i + 1], NULL, 10) : 0;
+        if (_tcsicmp(argv[i], TEXT("--counts")) == 0 && i + 1 < argc)
+        {
+            TCHAR* p = argv[i + 1];
+            TCHAR* end;
+            while (*p != 0)
+            {
+                DWORD count = _tcstoul(p, &end, 10);
+                if (end == p)
+                {
+                    break;
+                }
+                options.counts.push_back(count);
+                p = *end == TEXT(',') ? end + 1 : end;
+            }
+        }
+        else if (_tcsicmp(argv[i], TEXT("--wrapper")) == 0 && i + 1 < argc)
+        {
+            options.wrapper = argv[i + 1];
+        }
+        else if (_tcsicmp(argv[i], TEXT("--rate")) == 0)
+        {
+            options.rate = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--seconds")) == 0)
+        {
+            options.seconds = arg;
+        }
+        else if (_tcsicmp(argv[i], TEXT("--kills")) == 0)
+        {
+            options.kills = arg;
+        }
+        i++;
+    }
+    if (options.counts.empty())
+    {
+        options.counts.push_back(100);
+        options.counts.push_back(1000);
+        options.counts.push_back(10000);
+    }
+    for (size_t i = 0; i < options.counts.size(); i++)
+    {
+        maxCount = options.counts[i] > maxCount ? options.counts[i] : maxCount;
+    }
+    if (maxCount == 0 || options.rate == 0 || options.seconds == 0)
+    {
+        _tprintf(TEXT("Usage: ScaleBench [--counts 100,1000,10000] [--wrapper path] [--rate lines/s]\n")
+                 TEXT("                  [--seconds s] [--kills n]\n"));
+        return 1;
+    }
+    timeBeginPeriod(1);
+    InitializeCriticalSection(&s_stats.lock);
+    s_stats.bytes = 0;
+
+    GetTempPath(ARRAYSIZE(szTemp), szTemp);
+    String workDir = String(szTemp) + SCALE_NAME;
+    hPage = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                              maxCount * sizeof(ScaleSlot), SCALE_PAGE_NAME);
+    slots = hPage != NULL ?
+        (ScaleSlot*)MapViewOfFile(hPage, FILE_MAP_WRITE, 0, 0, 0) : NULL;
+    s_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (slots == NULL || s_port == NULL ||
+        !Setup(workDir, szPath, maxCount, options) ||
+        !CreateInstances(instances, maxCount))
+    {
+        fprintf(stderr, "setup in %ls failed w/err 0x%08lx\n", workDir.c_str(),
+                GetLastError());
+        return 1;
+    }
+    hReader = CreateThread(NULL, 0, ReaderThread, NULL, 0, NULL);
+    printf("{\"bench\":\"scale\",\"rate_lines\":%lu,\"line_bytes\":%u,"
+           "\"seconds\":%lu,\"kills\":%lu}\n",
+           options.rate, (UINT)SCALE_LINE_SIZE, options.seconds, options.kills);
+    fflush(stdout);
+    for (size_t i = 0; i < options.counts.size(); i++)
+    {
+        if (!RunRound(workDir, slots, options.counts[i], options))
+        {
+            exitCode = 2;
+            break;
+        }
+        fflush(stdout);
+    }
+    PostQueuedCompletionStatus(s_port, 0, 0, NULL);
+    WaitForSingleObject(hReader, INFINITE);
+    timeEndPeriod(1);
+    return exitCode;
+}
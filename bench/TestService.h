@@ -0,0 +1,189 @@
+#ifndef _TESTSERVICE_H_
+#define _TESTSERVICE_H_
+#include <windows.h>
+#include <vector>
+#include "../src/strings.h"
+#include "../src/Clock.h"
+#include "../src/SampleService.h"
+
+// Longest a child of a scenario may take to exit on its own, in real time
+#define CHILD_EXIT_TIMEOUT 10000
+
+/**
+ * Virtual clock for children that exit on their own. A timed wait on a
+ * process first lets it exit in real time, so that no virtual time passes
+ * while a child runs, and a wait already over returns without becoming a
+ * waiter the driver could advance the time for.
+ */
+class ChildClock : public VirtualClock
+{
+    public:
+        DWORD Wait(DWORD count, const HANDLE* handles, DWORD timeout)
+        {
+            for (DWORD i = 0; i < count && timeout != 0; i++)
+            {
+                if (GetProcessId(handles[i]) != 0)
+                {
+                    WaitForSingleObject(handles[i], CHILD_EXIT_TIMEOUT);
+                }
+            }
+            DWORD result = VirtualClock::Wait(count, handles, 0);
+            if (result != WAIT_TIMEOUT || timeout == 0)
+            {
+                return result;
+            }
+            return VirtualClock::Wait(count, handles, timeout);
+        }
+};
+
+/**
+ * What the service logged or reported, at the time of its clock.
+ */
+struct TestEvent
+{
+    ULONGLONG time;
+    // SERVICE_* for a status, 0 for a log entry
+    DWORD state;
+    DWORD code;
+    String message;
+};
+
+/**
+ * The service in test mode, recording its events and status changes for
+ * the scenarios to check.
+ */
+class TestService : public CSampleService
+{
+    public:
+        TestService(Descriptor* d, Clock* clock)
+            : CSampleService(d, d->name.c_str(), TRUE, TRUE, FALSE, clock),
+              m_clock(clock)
+        {
+            InitializeCriticalSection(&m_lock);
+            // Set on each restart delay, when the service goes back to
+            // start pending
+            m_hRestart = CreateEvent(NULL, TRUE, FALSE, NULL);
+        }
+
+        virtual ~TestService()
+        {
+            CloseHandle(m_hRestart);
+            DeleteCriticalSection(&m_lock);
+        }
+
+        HANDLE RestartEvent()
+        {
+            return m_hRestart;
+        }
+
+        std::vector<TestEvent> Events()
+        {
+            EnterCriticalSection(&m_lock);
+            std::vector<TestEvent> events = m_events;
+            LeaveCriticalSection(&m_lock);
+            return events;
+        }
+
+        // Log entries containing text
+        std::vector<TestEvent> Find(const TCHAR* text)
+        {
+            std::vector<TestEvent> events = Events();
+            std::vector<TestEvent> found;
+
+            for (size_t i = 0; i < events.size(); i++)
+            {
+                if (events[i].state == 0 &&
+                    events[i].message.find(text) != String::npos)
+                {
+                    found.push_back(events[i]);
+                }
+            }
+            return found;
+        }
+
+    protected:
+        virtual void SetServiceStatus(DWORD dwCurrentState,
+                                      DWORD dwWin32ExitCode = NO_ERROR,
+                                      DWORD dwWaitHint = 0)
+        {
+            CSampleService::SetServiceStatus(dwCurrentState, dwWin32ExitCode,
+                                             dwWaitHint);
+            Record(dwCurrentState, dwWin32ExitCode, TEXT(""));
+            // Start sets start pending with no error, a restart with the
+            // exit code of the child
+            if (dwCurrentState == SERVICE_START_PENDING && dwWin32ExitCode != 0)
+            {
+                SetEvent(m_hRestart);
+            }
+        }
+
+        virtual void WriteEventLogEntry(PCTSTR pszMessage, WORD wType)
+        {
+            CSampleService::WriteEventLogEntry(pszMessage, wType);
+            Record(0, wType, pszMessage);
+        }
+
+    private:
+        void Record(DWORD state, DWORD code, PCTSTR pszMessage)
+        {
+            TestEvent event;
+
+            event.time = m_clock->Now();
+            event.state = state;
+            event.code = code;
+            event.message = pszMessage;
+            EnterCriticalSection(&m_lock);
+            m_events.push_back(event);
+            LeaveCriticalSection(&m_lock);
+        }
+
+        Clock* m_clock;
+        CRITICAL_SECTION m_lock;
+        HANDLE m_hRestart;
+        std::vector<TestEvent> m_events;
+};
+
+/**
+ * Steps a virtual clock on its own thread: each time waiters threads wait
+ * on it, moves it to the end of the earliest wait.
+ */
+class ClockDriver
+{
+    public:
+        ClockDriver(VirtualClock* clock, DWORD waiters)
+            : m_clock(clock), m_waiters(waiters)
+        {
+            m_hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+            m_hThread = CreateThread(NULL, 0, &ClockDriver::Run, this, 0, NULL);
+        }
+
+        ~ClockDriver()
+        {
+            SetEvent(m_hDone);
+            WaitForSingleObject(m_hThread, INFINITE);
+            CloseHandle(m_hThread);
+            CloseHandle(m_hDone);
+        }
+
+    private:
+        static DWORD WINAPI Run(LPVOID param)
+        {
+            ClockDriver* driver = (ClockDriver*)param;
+
+            while (WaitForSingleObject(driver->m_hDone, 0) == WAIT_TIMEOUT)
+            {
+                if (driver->m_clock->Settle(driver->m_waiters, 10))
+                {
+                    driver->m_clock->AdvanceToNext();
+                }
+            }
+            return 0;
+        }
+
+        VirtualClock* m_clock;
+        DWORD m_waiters;
+        HANDLE m_hDone;
+        HANDLE m_hThread;
+};
+
+#endif /* _TESTSERVICE_H_ */
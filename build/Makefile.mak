@@ -1,39 +1,175 @@
-CPP    = g++
-RM     = rm -f
-OBJS   = ../src/CppWindowsService.o \
-         ../src/SampleService.o \
-         ../src/utils.o \
-         ../src/ServiceInstaller.o \
-         ../src/ServiceBase.o
-
-LIBS   = -m64 -std=c++11
-CFLAGS = -m64 -std=c++11 -DUNICODE -D_UNICODE -I..\vendor\rapidxml -fno-diagnostics-show-option
-
-.PHONY: all
-
-all: ../bin/x64/SvcWrapper.exe
-
-clean:
-	$(RM) $(OBJS) ../bin/x64/SvcWrapper.exe
-
-clear:
-	$(RM) $(OBJS)
-
-../bin/x64/SvcWrapper.exe: $(OBJS)
-	$(CPP) -Wall -s -O2 -o $@ $(OBJS) $(LIBS)
-
-../src/CppWindowsService.o: ../src/CppWindowsService.cpp ../src/ServiceInstaller.h ../src/ServiceBase.h ../src/SampleService.h ../vendor/rapidxml/rapidxml.hpp ../src/strings.h ../src/Descriptor.h ../src/utils.h ../vendor/mingw-unicode-main/mingw-unicode.c
-	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
-
-../src/SampleService.o: ../src/SampleService.cpp ../src/SampleService.h ../src/ThreadPool.h
-	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
-
-../src/utils.o: ../src/utils.cpp ../src/utils.h ../src/strings.h ../src/Descriptor.h
-	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
-
-../src/ServiceInstaller.o: ../src/ServiceInstaller.cpp ../src/ServiceInstaller.h ../src/strings.h
-	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
-
-../src/ServiceBase.o: ../src/ServiceBase.cpp ../src/ServiceBase.h ../src/nsis_tchar.h
-	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
-
+CPP    = g++
+RM     = rm -f
+OBJS   = ../src/CppWindowsService.o \
+         ../src/SampleService.o \
+         ../src/utils.o \
+         ../src/ServiceInstaller.o \
+         ../src/ServiceBase.o \
+         ../src/LogSink.o \
+         ../src/OutputTrigger.o \
+         ../src/NotifySocket.o \
+         ../src/Handover.o \
+         ../src/StateFile.o \
+         ../src/Proxy.o \
+         ../src/Scheduler.o \
+         ../src/ProcessTree.o \
+         ../src/Placement.o \
+         ../src/Clock.o \
+         ../src/Faults.o \
+         ../src/ChildTable.o \
+         ../src/StatusPage.o \
+         ../src/Trace.o \
+         ../src/Histogram.o \
+         ../src/History.o \
+         ../src/LogArchive.o
+BENCH  = ../bench/PlacementBench.exe \
+         ../bench/LifecycleBench.exe \
+         ../bench/FakeChild.exe \
+         ../bench/ScaleBench.exe \
+         ../bench/LogSinkBench.exe
+# Scenario tests of the supervision, run by make test. FaultTest only runs
+# its scenarios once everything was built with FAULTS=1, after a clean.
+TESTS  = ../bench/CrashLoopTest.exe \
+         ../bench/FaultTest.exe
+# The wrapper without its command line, for the tests to drive
+SVCOBJS = $(filter-out ../src/CppWindowsService.o,$(OBJS))
+
+AR     = ar
+LIBS   = -m64 -std=c++11 -lws2_32 -lpsapi -lcabinet
+BENCHLIBS = $(LIBS) -lwinmm
+CFLAGS = -m64 -std=c++11 -DUNICODE -D_UNICODE -I..\vendor\rapidxml -fno-diagnostics-show-option
+# FAULTS=1 builds a wrapper that injects the <faults> schedule of its xml
+ifdef FAULTS
+CFLAGS += -DFAULT_INJECTION
+endif
+
+.PHONY: all bench test
+
+# libsvcstatus.a with StatusPage.h lets monitoring tools read the status page
+all: ../bin/x64/SvcWrapper.exe ../bin/x64/libsvcstatus.a
+
+bench: $(BENCH)
+
+test: $(TESTS) ../bench/FakeChild.exe
+	../bench/CrashLoopTest.exe
+	../bench/FaultTest.exe
+
+clean:
+	$(RM) $(OBJS) ../bin/x64/SvcWrapper.exe ../bin/x64/libsvcstatus.a ../bench/*.o $(BENCH) $(TESTS)
+
+clear:
+	$(RM) $(OBJS)
+
+../bin/x64/SvcWrapper.exe: $(OBJS)
+	$(CPP) -Wall -s -O2 -o $@ $(OBJS) $(LIBS)
+
+../bin/x64/libsvcstatus.a: ../src/StatusPage.o
+	$(AR) rcs $@ $^
+
+../src/CppWindowsService.o: ../src/CppWindowsService.cpp ../src/ServiceInstaller.h ../src/ServiceBase.h ../src/SampleService.h ../vendor/rapidxml/rapidxml.hpp ../src/strings.h ../src/Descriptor.h ../src/utils.h ../src/Faults.h ../src/Clock.h ../src/StatusPage.h ../src/Histogram.h ../src/Trace.h ../src/History.h ../src/LogArchive.h ../vendor/mingw-unicode-main/mingw-unicode.c
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/SampleService.o: ../src/SampleService.cpp ../src/SampleService.h ../src/ThreadPool.h ../src/LogSink.h ../src/LogArchive.h ../src/OutputTrigger.h ../src/NotifySocket.h ../src/Handover.h ../src/StateFile.h ../src/Proxy.h ../src/Scheduler.h ../src/ProcessTree.h ../src/Placement.h ../src/Clock.h ../src/ChildTable.h ../src/StatusPage.h ../src/Histogram.h ../src/History.h ../src/utils.h ../src/Faults.h ../src/Trace.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/utils.o: ../src/utils.cpp ../src/utils.h ../src/strings.h ../src/Descriptor.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/ServiceInstaller.o: ../src/ServiceInstaller.cpp ../src/ServiceInstaller.h ../src/Handover.h ../src/NotifySocket.h ../src/Histogram.h ../src/Trace.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/ServiceBase.o: ../src/ServiceBase.cpp ../src/ServiceBase.h ../src/nsis_tchar.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/LogSink.o: ../src/LogSink.cpp ../src/LogSink.h ../src/LogArchive.h ../src/Histogram.h ../src/ThreadPool.h ../src/Faults.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/OutputTrigger.o: ../src/OutputTrigger.cpp ../src/OutputTrigger.h ../src/LogSink.h ../src/LogArchive.h ../src/Histogram.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/NotifySocket.o: ../src/NotifySocket.cpp ../src/NotifySocket.h ../src/ThreadPool.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Handover.o: ../src/Handover.cpp ../src/Handover.h ../src/NotifySocket.h ../src/Histogram.h ../src/Faults.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/StateFile.o: ../src/StateFile.cpp ../src/StateFile.h ../src/NotifySocket.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Proxy.o: ../src/Proxy.cpp ../src/Proxy.h ../src/Histogram.h ../src/Clock.h ../src/ThreadPool.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Scheduler.o: ../src/Scheduler.cpp ../src/Scheduler.h ../src/Histogram.h ../src/LogSink.h ../src/LogArchive.h ../src/ProcessTree.h ../src/ChildTable.h ../src/StateFile.h ../src/NotifySocket.h ../src/ThreadPool.h ../src/Descriptor.h ../src/Faults.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/ProcessTree.o: ../src/ProcessTree.cpp ../src/ProcessTree.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Placement.o: ../src/Placement.cpp ../src/Placement.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Clock.o: ../src/Clock.cpp ../src/Clock.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Faults.o: ../src/Faults.cpp ../src/Faults.h ../src/Clock.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/ChildTable.o: ../src/ChildTable.cpp ../src/ChildTable.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/StatusPage.o: ../src/StatusPage.cpp ../src/StatusPage.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Trace.o: ../src/Trace.cpp ../src/Trace.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/Histogram.o: ../src/Histogram.cpp ../src/Histogram.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/History.o: ../src/History.cpp ../src/History.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../src/LogArchive.o: ../src/LogArchive.cpp ../src/LogArchive.h ../src/ThreadPool.h ../src/Faults.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../bench/PlacementBench.exe: ../bench/PlacementBench.o ../src/Placement.o
+	$(CPP) -Wall -s -O2 -o $@ $^ $(LIBS)
+
+../bench/PlacementBench.o: ../bench/PlacementBench.cpp ../src/Placement.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../bench/LifecycleBench.exe: ../bench/LifecycleBench.o
+	$(CPP) -Wall -s -O2 -o $@ $^ $(BENCHLIBS)
+
+../bench/LifecycleBench.o: ../bench/LifecycleBench.cpp ../bench/BenchPage.h ../src/Handover.h ../src/NotifySocket.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../bench/FakeChild.exe: ../bench/FakeChild.o
+	$(CPP) -Wall -s -O2 -o $@ $^ $(LIBS)
+
+../bench/FakeChild.o: ../bench/FakeChild.cpp ../bench/BenchPage.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../bench/ScaleBench.exe: ../bench/ScaleBench.o
+	$(CPP) -Wall -s -O2 -o $@ $^ $(BENCHLIBS)
+
+../bench/ScaleBench.o: ../bench/ScaleBench.cpp ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../bench/LogSinkBench.exe: ../bench/LogSinkBench.o ../src/LogSink.o ../src/LogArchive.o ../src/Faults.o ../src/Clock.o ../src/Histogram.o
+	$(CPP) -Wall -s -O2 -o $@ $^ $(LIBS)
+
+../bench/LogSinkBench.o: ../bench/LogSinkBench.cpp ../src/LogSink.h ../src/LogArchive.h ../src/Histogram.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../bench/CrashLoopTest.exe: ../bench/CrashLoopTest.o $(SVCOBJS)
+	$(CPP) -Wall -s -O2 -o $@ $^ $(LIBS)
+
+../bench/CrashLoopTest.o: ../bench/CrashLoopTest.cpp ../bench/TestService.h ../src/SampleService.h ../src/ServiceBase.h ../src/Descriptor.h ../src/Clock.h ../src/LogSink.h ../src/LogArchive.h ../src/OutputTrigger.h ../src/NotifySocket.h ../src/Proxy.h ../src/Scheduler.h ../src/Placement.h ../src/ProcessTree.h ../src/Handover.h ../src/StateFile.h ../src/ChildTable.h ../src/StatusPage.h ../src/History.h ../src/Histogram.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
+
+../bench/FaultTest.exe: ../bench/FaultTest.o $(SVCOBJS)
+	$(CPP) -Wall -s -O2 -o $@ $^ $(LIBS)
+
+../bench/FaultTest.o: ../bench/FaultTest.cpp ../bench/TestService.h ../src/SampleService.h ../src/ServiceBase.h ../src/Descriptor.h ../src/Clock.h ../src/Faults.h ../src/LogSink.h ../src/LogArchive.h ../src/OutputTrigger.h ../src/NotifySocket.h ../src/Proxy.h ../src/Scheduler.h ../src/Placement.h ../src/ProcessTree.h ../src/Handover.h ../src/StateFile.h ../src/ChildTable.h ../src/StatusPage.h ../src/History.h ../src/Histogram.h ../src/strings.h
+	$(CPP) -Wall -s -O2 -c $< -o $@ $(CFLAGS)
@@ -0,0 +1,128 @@
+#include "ChildTable.h"
+
+ChildTable::ChildTable(DWORD capacity)
+    : m_state(capacity, CHILD_IDLE), m_kind(capacity, CHILD_SERVICE),
+      m_pid(capacity, 0), m_started(capacity, 0), m_deadline(capacity, 0),
+      m_heartbeat(capacity, 0), m_starts(capacity, 0), m_exits(capacity, 0),
+      m_failures(capacity, 0), m_exitCode(capacity, 0), m_used(0)
+{
+}
+
+DWORD ChildTable::Alloc(ChildKind kind)
+{
+    DWORD slot = m_used;
+
+    if (slot >= m_state.size())
+    {
+        return CHILD_NONE;
+    }
+    m_kind[slot] = (BYTE)kind;
+    // Sweeps stop at the highest slot used
+    m_used = slot + 1;
+    return slot;
+}
+
+void ChildTable::Start(DWORD slot, DWORD pid, ULONGLONG now, ChildState state)
+{
+    m_state[slot] = (BYTE)state;
+    m_pid[slot] = pid;
+    m_started[slot] = now;
+    m_deadline[slot] = 0;
+    m_exitCode[slot] = STILL_ACTIVE;
+    InterlockedExchange64(&m_heartbeat[slot], (LONGLONG)now);
+    if (state == CHILD_RUNNING)
+    {
+        m_starts[slot]++;
+    }
+}
+
+void ChildTable::SetState(DWORD slot, ChildState state)
+{
+    m_state[slot] = (BYTE)state;
+}
+
+void ChildTable::Exit(DWORD slot, DWORD exitCode, bool failed)
+{
+    m_state[slot] = CHILD_EXITED;
+    m_exitCode[slot] = exitCode;
+    m_deadline[slot] = 0;
+    m_exits[slot]++;
+    if (failed)
+    {
+        m_failures[slot]++;
+    }
+}
+
+void ChildTable::Clear(DWORD slot)
+{
+    m_state[slot] = CHILD_IDLE;
+    m_pid[slot] = 0;
+    m_deadline[slot] = 0;
+}
+
+void ChildTable::Beat(DWORD slot, ULONGLONG now)
+{
+    InterlockedExchange64(&m_heartbeat[slot], (LONGLONG)now);
+}
+
+void ChildTable::SetDeadline(DWORD slot, ULONGLONG deadline)
+{
+    m_deadline[slot] = deadline;
+}
+
+ChildState ChildTable::State(DWORD slot)
+{
+    return (ChildState)m_state[slot];
+}
+
+DWORD ChildTable::Pid(DWORD slot)
+{
+    return m_pid[slot];
+}
+
+ULONGLONG ChildTable::Started(DWORD slot)
+{
+    return m_started[slot];
+}
+
+ULONGLONG ChildTable::Heartbeat(DWORD slot)
+{
+    return (ULONGLONG)m_heartbeat[slot];
+}
+
+ULONGLONG ChildTable::Deadline(DWORD slot)
+{
+    return m_deadline[slot];
+}
+
+DWORD ChildTable::ExitCode(DWORD slot)
+{
+    return m_exitCode[slot];
+}
+
+void ChildTable::Count(ChildCounts* counts)
+{
+    ZeroMemory(counts, sizeof(*counts));
+    counts->slots = m_used;
+    // One array at a time, so each loop streams through a single one
+    for (DWORD i = 0; i < m_used; i++)
+    {
+        counts->running += m_state[i] == CHILD_RUNNING ? 1 : 0;
+        counts->stopping += m_state[i] == CHILD_STOPPING ? 1 : 0;
+        counts->jobs += m_state[i] == CHILD_RUNNING && m_kind[i] == CHILD_JOB ? 1 : 0;
+    }
+    for (DWORD i = 0; i < m_used; i++)
+    {
+        counts->starts += m_starts[i];
+        counts->exits += m_exits[i];
+        counts->failures += m_failures[i];
+    }
+    for (DWORD i = 0; i < m_used; i++)
+    {
+        if ((m_state[i] == CHILD_RUNNING || m_state[i] == CHILD_STOPPING) &&
+            (counts->oldestStart == 0 || m_started[i] < counts->oldestStart))
+        {
+            counts->oldestStart = m_started[i];
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef _CHILDTABLE_H_
+#define _CHILDTABLE_H_
+#include <windows.h>
+#include <vector>
+
+// Slot returned when the table is full
+#define CHILD_NONE 0xFFFFFFFF
+
+enum ChildKind
+{
+    CHILD_SERVICE,
+    CHILD_JOB
+};
+
+enum ChildState
+{
+    // No process in the slot
+    CHILD_IDLE,
+    // Not used, kept so that the values match StatusChildState
+    CHILD_SUSPENDED,
+    CHILD_RUNNING,
+    CHILD_STOPPING,
+    CHILD_EXITED
+};
+
+/**
+ * Totals of the table, taken by sweeping the arrays.
+ */
+struct ChildCounts
+{
+    DWORD slots;
+    DWORD running;
+    DWORD stopping;
+    // Job runs among the running
+    DWORD jobs;
+    ULONG starts;
+    ULONG exits;
+    ULONG failures;
+    // Start of the longest running process, 0 if none runs
+    ULONGLONG oldestStart;
+};
+
+/**
+ * Hot state of every process the wrapper supervises, the service process
+ * and the job runs, kept field by field in dense arrays indexed by a slot
+ * that never moves. The sweep for the metrics reads a
+ * few contiguous arrays and allocates nothing; the configuration stays
+ * with the owner of the slot.
+ *
+ * The arrays are sized once. Slots are taken while the owners are set up
+ * and kept for the life of the wrapper, each slot is then written by its
+ * owner only, except the heartbeat, which is written atomically.
+ */
+class ChildTable
+{
+    public:
+        ChildTable(DWORD capacity);
+
+        DWORD Alloc(ChildKind kind);
+
+        // Times are the milliseconds of the clock of the owner
+        void Start(DWORD slot, DWORD pid, ULONGLONG now,
+                   ChildState state = CHILD_RUNNING);
+        void SetState(DWORD slot, ChildState state);
+        // failed: the exit was not asked for
+        void Exit(DWORD slot, DWORD exitCode, bool failed);
+        // Back to idle, keeping the counters
+        void Clear(DWORD slot);
+        void Beat(DWORD slot, ULONGLONG now);
+        // 0 for none
+        void SetDeadline(DWORD slot, ULONGLONG deadline);
+
+        ChildState State(DWORD slot);
+        DWORD Pid(DWORD slot);
+        ULONGLONG Started(DWORD slot);
+        ULONGLONG Heartbeat(DWORD slot);
+        ULONGLONG Deadline(DWORD slot);
+        DWORD ExitCode(DWORD slot);
+
+        void Count(ChildCounts* counts);
+
+    private:
+        std::vector<BYTE> m_state;
+        std::vector<BYTE> m_kind;
+        std::vector<DWORD> m_pid;
+        std::vector<ULONGLONG> m_started;
+        std::vector<ULONGLONG> m_deadline;
+        std::vector<LONGLONG> m_heartbeat;
+        std::vector<ULONG> m_starts;
+        std::vector<ULONG> m_exits;
+        std::vector<ULONG> m_failures;
+        std::vector<DWORD> m_exitCode;
+        DWORD m_used;
+};
+
+#endif /* _CHILDTABLE_H_ */
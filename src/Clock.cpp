@@ -0,0 +1,175 @@
+#include "Clock.h"
+
+// Deadline of the waits without a timeout
+#define NO_DEADLINE 0xFFFFFFFFFFFFFFFFULL
+
+Clock* Clock::System()
+{
+    static SystemClock clock;
+    return &clock;
+}
+
+ULONGLONG SystemClock::Now()
+{
+    return GetTickCount64();
+}
+
+DWORD SystemClock::Wait(DWORD count, const HANDLE* handles, DWORD timeout)
+{
+    if (count == 0)
+    {
+        ::Sleep(timeout);
+        return WAIT_TIMEOUT;
+    }
+    return WaitForMultipleObjects(count, handles, FALSE, timeout);
+}
+
+VirtualClock::VirtualClock(ULONGLONG start)
+    : m_now(start)
+{
+    InitializeCriticalSection(&m_lock);
+}
+
+VirtualClock::~VirtualClock()
+{
+    DeleteCriticalSection(&m_lock);
+}
+
+ULONGLONG VirtualClock::Now()
+{
+    ULONGLONG now;
+
+    EnterCriticalSection(&m_lock);
+    now = m_now;
+    LeaveCriticalSection(&m_lock);
+    return now;
+}
+
+//
+//   FUNCTION: VirtualClock::Wait(DWORD, const HANDLE*, DWORD)
+//
+//   PURPOSE: Block on the handles and on a wake event of this wait, which
+//   the driver sets once the virtual time passed the deadline. A timeout
+//   of 0 only polls the handles, without giving the driver a turn.
+//
+DWORD VirtualClock::Wait(DWORD count, const HANDLE* handles, DWORD timeout)
+{
+    std::vector<HANDLE> events(handles, handles + count);
+    Waiter waiter;
+    DWORD result;
+
+    if (timeout == 0)
+    {
+        return count == 0 ? WAIT_TIMEOUT :
+               WaitForMultipleObjects(count, handles, FALSE, 0);
+    }
+    if (count >= MAXIMUM_WAIT_OBJECTS)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return WAIT_FAILED;
+    }
+    waiter.hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (waiter.hWake == NULL)
+    {
+        return WAIT_FAILED;
+    }
+    events.push_back(waiter.hWake);
+    EnterCriticalSection(&m_lock);
+    waiter.deadline = timeout == INFINITE ? NO_DEADLINE : m_now + timeout;
+    m_waiters.push_back(&waiter);
+    LeaveCriticalSection(&m_lock);
+
+    result = WaitForMultipleObjects(count + 1, &events[0], FALSE, INFINITE);
+
+    EnterCriticalSection(&m_lock);
+    for (size_t i = 0; i < m_waiters.size(); i++)
+    {
+        if (m_waiters[i] == &waiter)
+        {
+            m_waiters.erase(m_waiters.begin() + i);
+            break;
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+    CloseHandle(waiter.hWake);
+    return result == WAIT_OBJECT_0 + count ? WAIT_TIMEOUT : result;
+}
+
+//
+//   FUNCTION: VirtualClock::WakeExpired()
+//
+//   PURPOSE: Wake the waits whose deadline passed. They leave the list at
+//   once, so that Settle counts them again only when they wait anew.
+//   Called with the lock held.
+//
+void VirtualClock::WakeExpired()
+{
+    size_t i = 0;
+
+    while (i < m_waiters.size())
+    {
+        if (m_waiters[i]->deadline <= m_now)
+        {
+            SetEvent(m_waiters[i]->hWake);
+            m_waiters.erase(m_waiters.begin() + i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void VirtualClock::Advance(ULONGLONG ms)
+{
+    EnterCriticalSection(&m_lock);
+    m_now += ms;
+    WakeExpired();
+    LeaveCriticalSection(&m_lock);
+}
+
+bool VirtualClock::AdvanceToNext()
+{
+    ULONGLONG next = NO_DEADLINE;
+
+    EnterCriticalSection(&m_lock);
+    for (size_t i = 0; i < m_waiters.size(); i++)
+    {
+        if (m_waiters[i]->deadline < next)
+        {
+            next = m_waiters[i]->deadline;
+        }
+    }
+    if (next != NO_DEADLINE)
+    {
+        m_now = next > m_now ? next : m_now;
+        WakeExpired();
+    }
+    LeaveCriticalSection(&m_lock);
+    return next != NO_DEADLINE;
+}
+
+DWORD VirtualClock::Waiters()
+{
+    DWORD waiters;
+
+    EnterCriticalSection(&m_lock);
+    waiters = (DWORD)m_waiters.size();
+    LeaveCriticalSection(&m_lock);
+    return waiters;
+}
+
+bool VirtualClock::Settle(DWORD waiters, DWORD timeout)
+{
+    ULONGLONG start = GetTickCount64();
+
+    while (Waiters() < waiters)
+    {
+        if (GetTickCount64() - start >= timeout)
+        {
+            return false;
+        }
+        ::Sleep(1);
+    }
+    return true;
+}
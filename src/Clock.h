@@ -0,0 +1,85 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+#include <windows.h>
+#include <vector>
+
+/**
+ * Source of time and of timed waits for the supervision code. Every
+ * timeout of a restart, a stop or a heartbeat is counted on it, so that
+ * a simulated clock can stand in for the tick count.
+ */
+class Clock
+{
+    public:
+        virtual ~Clock() {}
+
+        // Milliseconds since an arbitrary origin, never going back
+        virtual ULONGLONG Now() = 0;
+        // WaitForMultipleObjects for any of the handles, with the timeout
+        // counted on this clock. count may be 0 to only let time pass.
+        virtual DWORD Wait(DWORD count, const HANDLE* handles, DWORD timeout) = 0;
+
+        DWORD Wait(HANDLE handle, DWORD timeout)
+        {
+            return Wait(1, &handle, timeout);
+        }
+        void Sleep(DWORD timeout)
+        {
+            Wait(0, NULL, timeout);
+        }
+
+        // The tick count, shared by everything that is not given a clock
+        static Clock* System();
+};
+
+class SystemClock : public Clock
+{
+    public:
+        ULONGLONG Now();
+        DWORD Wait(DWORD count, const HANDLE* handles, DWORD timeout);
+};
+
+/**
+ * Time that only moves when the driver says so. A wait returns when one
+ * of its handles is signaled or when the virtual time reaches its end, so
+ * hours of restart delays, backoffs and heartbeat timeouts pass in as
+ * long as the code takes to run.
+ *
+ * The driver lets the threads under test run until they all wait on the
+ * clock with Settle, then moves to the next deadline with AdvanceToNext.
+ * As long as every thread waits through the clock, each step wakes the
+ * same waits in the same order on every run.
+ */
+class VirtualClock : public Clock
+{
+    public:
+        VirtualClock(ULONGLONG start = 0);
+        ~VirtualClock();
+
+        ULONGLONG Now();
+        DWORD Wait(DWORD count, const HANDLE* handles, DWORD timeout);
+
+        // Move the time forward, waking the waits that end meanwhile
+        void Advance(ULONGLONG ms);
+        // Move to the end of the earliest wait, false if none has one
+        bool AdvanceToNext();
+        // Number of threads blocked in Wait
+        DWORD Waiters();
+        // Wait, in real time, until at least waiters threads are blocked
+        bool Settle(DWORD waiters, DWORD timeout);
+
+    private:
+        struct Waiter
+        {
+            ULONGLONG deadline;
+            HANDLE hWake;
+        };
+
+        void WakeExpired();
+
+        CRITICAL_SECTION m_lock;
+        ULONGLONG m_now;
+        std::vector<Waiter*> m_waiters;
+};
+
+#endif /* _CLOCK_H_ */
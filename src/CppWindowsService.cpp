@@ -1,300 +1,852 @@
-/****************************** Module Header ******************************\
-* Module Name:  CppWindowsService.cpp
-* Project:      CppWindowsService
-* Copyright (c) Microsoft Corporation.
-*
-* The file defines the entry point of the application. According to the
-* arguments in the command line, the function installs or uninstalls or
-* starts the service by calling into different routines.
-*
-* This source is subject to the Microsoft Public License.
-* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
-* All other rights reserved.
-*
-* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
-* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
-* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#include <stdio.h>
-#include <windows.h>
-#include <fstream>
-#include <sys/stat.h>
-#include <codecvt>
-#include <iostream>
-#include <vector>
-#include "ServiceInstaller.h"
-#include "ServiceBase.h"
-#include "SampleService.h"
-#include "rapidxml.hpp"
-#include "strings.h"
-#include "Descriptor.h"
-#include "utils.h"
-
-std::string WideCharToACP(const std::wstring & str)
-{
-   if (str.empty())
-      return std::string();
-
-   size_t charsNeeded = ::WideCharToMultiByte(CP_ACP, 0, 
-      str.data(), (int)str.size(), NULL, 0, NULL, NULL);
-   if (charsNeeded == 0)
-      throw std::runtime_error("Failed to calculate WideChar string to Windows-1252");
-
-   std::vector<char> buffer(charsNeeded);
-   int charsConverted = ::WideCharToMultiByte(CP_ACP, 0, 
-      str.data(), (int)str.size(), &buffer[0], buffer.size(), NULL, NULL);
-   if (charsConverted == 0)
-      throw std::runtime_error("Failed converting WideChar string to Windows-1252");
-   return std::string(&buffer[0], charsConverted);
-}
-
-std::wstring ACPToWideChar(const std::string & str)
-{
-   if (str.empty())
-      return std::wstring();
-
-   size_t charsNeeded = ::MultiByteToWideChar(CP_ACP, 0, 
-      str.data(), (int)str.size(), NULL, 0);
-   if (charsNeeded == 0)
-      throw std::runtime_error("Failed to calculate Windows-1252 string to WideChar");
-
-   std::vector<wchar_t> buffer(charsNeeded);
-   int charsConverted = ::MultiByteToWideChar(CP_ACP, 0, 
-      str.data(), (int)str.size(), &buffer[0], buffer.size());
-   if (charsConverted == 0)
-      throw std::runtime_error("Failed converting Windows-1252 string to WideChar");
-   return std::wstring(&buffer[0], charsConverted);
-}
-
-std::wstring UTF8ToWideChar(const std::string & str)
-{
-   if (str.empty())
-      return std::wstring();
-
-   size_t charsNeeded = ::MultiByteToWideChar(CP_UTF8, 0, 
-      str.data(), (int)str.size(), NULL, 0);
-   if (charsNeeded == 0)
-      throw std::runtime_error("Failed to calculate UTF-8 string to WideChar");
-
-   std::vector<wchar_t> buffer(charsNeeded);
-   int charsConverted = ::MultiByteToWideChar(CP_UTF8, 0, 
-      str.data(), (int)str.size(), &buffer[0], buffer.size());
-   if (charsConverted == 0)
-      throw std::runtime_error("Failed converting UTF-8 string to WideChar");
-   return std::wstring(&buffer[0], charsConverted);
-}
-
-String LoadUtf8FileToString(const String& filename)
-{
-    std::string buffer;            // stores file contents
-#ifdef _UNICODE
-    std::wstring filenameW = filename;
-#else
-    std::wstring filenameW = ACPToWideChar(filename);
-#endif
-    FILE *fp = _wfopen(filenameW.c_str(), L"r");
-
-    // Failed to open file
-    if (fp == NULL)
-    {
-        // ...handle some error...
-        throw std::runtime_error("File not found");
-    }
-    fseek(fp, 0, SEEK_END);
-    long filesize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    // Read entire file contents in to memory
-    if (filesize > 0)
-    {
-        buffer.resize(filesize);
-        size_t chars_read = fread(&(buffer.front()), sizeof(char), filesize, fp);
-        buffer.resize(chars_read);
-        buffer.shrink_to_fit();
-    }
-    fclose(fp);
-#ifdef _UNICODE
-    return UTF8ToWideChar(buffer);
-#else
-    return WideCharToACP(UTF8ToWideChar(buffer));
-#endif
-}
-
-
-// Settings of the service
-
-// Service start options.
-#define SERVICE_START_TYPE       SERVICE_AUTO_START
-
-// List of service dependencies - "dep1\0dep2\0\0"
-#define SERVICE_DEPENDENCIES     TEXT("")
-
-// The name of the account under which the service should run
-// #define SERVICE_ACCOUNT          TEXT("NULL\\NULL")
-// #define SERVICE_ACCOUNT          TEXT("NT AUTHORITY\\LocalService")
-#define SERVICE_ACCOUNT          NULL
-
-// The password to the service account name
-#define SERVICE_PASSWORD         NULL
-
-#include "../mingw-unicode-main/mingw-unicode.c"
-//
-//  FUNCTION: wmain(int, TCHAR *[])
-//
-//  PURPOSE: entrypoint for the application.
-//
-//  PARAMETERS:
-//    argc - number of command line arguments
-//    argv - array of command line arguments
-//
-//  RETURN VALUE:
-//    none
-//
-//  COMMENTS:
-//    wmain() either performs the command line task, or run the service.
-//
-int _tmain(int argc, TCHAR **argv)
-{
-    using namespace rapidxml;
-    xml_document<TCHAR> doc;    // character type defaults to char
-    Descriptor d;
-
-    TCHAR szPath[MAX_PATH];
-
-    if (GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath)) == 0)
-    {
-        _tprintf(TEXT("GetModuleFileName failed w/err 0x%08lx\n"), GetLastError());
-        return 1;
-    }
-    String exefilename = szPath;
-    d.directory = exefilename.substr(0,exefilename.find_last_of(TEXT('\\')));
-    d.logpath = d.directory + TEXT("\\logs");
-    String xmlfilename=exefilename.substr(0,
-                             exefilename.find_last_of(TEXT('.'))) + TEXT(".xml");
-    String str;
-    try
-    {
-        str = LoadUtf8FileToString(xmlfilename);
-    }
-    catch(std::runtime_error e)
-    {
-        Cout << TEXT("Error loading XML file: ") << e.what() << TEXT("\n");
-        return 2;
-    }
-    try
-    {        
-        doc.parse<0>((TCHAR*)str.c_str());   // 0 means default parse flags
-    }
-    catch(std::runtime_error e)
-    {
-        Cout << TEXT("Error parsing XML file: ") << e.what() << TEXT("\n");
-        return 3;
-    }
-    xml_node<TCHAR> *svc_node = doc.first_node(TEXT("service"));
-    for (xml_node<TCHAR> *node = svc_node->first_node(); node;
-         node = node->next_sibling())
-    {
-        if (_tcsicmp(TEXT("id"), node->name()) == 0)
-        {
-            d.id = node->value();
-        }
-        else if (_tcsicmp(TEXT("name"), node->name()) == 0)
-        {
-            d.name = node->value();
-        }
-        else if (_tcsicmp(TEXT("description"), node->name()) == 0)
-        {
-            d.description = node->value();
-        }
-        else if (_tcsicmp(TEXT("executable"), node->name()) == 0)
-        {
-            d.executable = node->value();
-        }
-        else if (_tcsicmp(TEXT("workingdirectory"), node->name()) == 0)
-        {
-            d.workingdirectory = node->value();
-        }
-        else if (_tcsicmp(TEXT("env"), node->name()) == 0)
-        {
-            xml_attribute<TCHAR> *attr_name = node->first_attribute(TEXT("name"));
-            xml_attribute<TCHAR> *attr_value = node->first_attribute(TEXT("value"));
-            if (attr_name == NULL || attr_value == NULL)
-            {
-                continue;
-            }
-            d.env.push_back(std::make_pair(attr_name->value(), attr_value->value()));
-        }
-        else if (_tcsicmp(TEXT("logpath"), node->name()) == 0)
-        {
-            d.logpath = node->value();
-        }
-        else if (_tcsicmp(TEXT("logmode"), node->name()) == 0)
-        {
-            d.logmode = node->value();
-        }
-        else if (_tcsicmp(TEXT("startargument"), node->name()) == 0)
-        {
-            d.startargument.push_back(node->value());
-        }
-        else if (_tcsicmp(TEXT("stopexecutable"), node->name()) == 0)
-        {
-            d.stopexecutable = node->value();
-        }
-        else if (_tcsicmp(TEXT("stoparguments"), node->name()) == 0)
-        {
-            d.stoparguments = node->value();
-        }
-        else if (_tcsicmp(TEXT("stopargument"), node->name()) == 0)
-        {
-            d.stopargument.push_back(node->value());
-        }
-    }
-    if (!CreateRecursiveDirectory(d.logpath.c_str()))
-    {
-        Cout << TEXT("Can't create log directory \"") << d.logpath << TEXT("\"\n");
-        return 4;
-    }
-    if (argc > 1)
-    {
-        if (_tcsicmp(TEXT("install"), argv[1]) == 0)
-        {
-            // Install the service when the command is
-            // "install".
-            InstallService(
-                d.id.c_str(),               // Name of service
-                d.name.c_str(),             // Name to display
-                d.description.c_str(),             // Description
-                SERVICE_START_TYPE,         // Service start type
-                SERVICE_DEPENDENCIES,       // Dependencies
-                SERVICE_ACCOUNT,            // Service running account
-                SERVICE_PASSWORD            // Password of the account
-            );
-        }
-        else if (_tcsicmp(TEXT("uninstall"), argv[1]) == 0)
-        {
-            // Uninstall the service when the command isn "uninstall".
-            UninstallService(d.id.c_str());
-        }
-        else if (_tcsicmp(TEXT("help"), argv[1]) == 0)
-        {
-            _tprintf(TEXT("Parameters:\n"));
-            _tprintf(TEXT(" install    to install the service.\n"));
-            _tprintf(TEXT(" uninstall  to remove the service.\n"));
-        }
-        else if (_tcsicmp(TEXT("test"), argv[1]) == 0)
-        {
-            CSampleService service(&d, d.name.c_str());
-            service.Test();
-        }
-    }
-    else
-    {
-        CSampleService service(&d, d.name.c_str());
-        if (!CServiceBase::Run(service))
-        {
-            _tprintf(TEXT("Service failed to run w/err 0x%08lx\n"), GetLastError());
-        }
-    }
-
-    return 0;
+/****************************** Module Header ******************************\
+* Module Name:  CppWindowsService.cpp
+* Project:      CppWindowsService
+* Copyright (c) Microsoft Corporation.
+*
+* The file defines the entry point of the application. According to the
+* arguments in the command line, the function installs or uninstalls or
+* starts the service by calling into different routines.
+*
+* This source is subject to the Microsoft Public License.
+* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
+* All other rights reserved.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include <stdio.h>
+#include <windows.h>
+#include <fstream>
+#include <sys/stat.h>
+#include <codecvt>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "ServiceInstaller.h"
+#include "ServiceBase.h"
+#include "SampleService.h"
+#include "rapidxml.hpp"
+#include "strings.h"
+#include "Descriptor.h"
+#include "utils.h"
+#include "Faults.h"
+#include "StatusPage.h"
+#include "Trace.h"
+#include "History.h"
+#include "LogArchive.h"
+
+std::string WideCharToACP(const std::wstring & str)
+{
+   if (str.empty())
+      return std::string();
+
+   size_t charsNeeded = ::WideCharToMultiByte(CP_ACP, 0, 
+      str.data(), (int)str.size(), NULL, 0, NULL, NULL);
+   if (charsNeeded == 0)
+      throw std::runtime_error("Failed to calculate WideChar string to Windows-1252");
+
+   std::vector<char> buffer(charsNeeded);
+   int charsConverted = ::WideCharToMultiByte(CP_ACP, 0, 
+      str.data(), (int)str.size(), &buffer[0], buffer.size(), NULL, NULL);
+   if (charsConverted == 0)
+      throw std::runtime_error("Failed converting WideChar string to Windows-1252");
+   return std::string(&buffer[0], charsConverted);
+}
+
+std::wstring ACPToWideChar(const std::string & str)
+{
+   if (str.empty())
+      return std::wstring();
+
+   size_t charsNeeded = ::MultiByteToWideChar(CP_ACP, 0, 
+      str.data(), (int)str.size(), NULL, 0);
+   if (charsNeeded == 0)
+      throw std::runtime_error("Failed to calculate Windows-1252 string to WideChar");
+
+   std::vector<wchar_t> buffer(charsNeeded);
+   int charsConverted = ::MultiByteToWideChar(CP_ACP, 0, 
+      str.data(), (int)str.size(), &buffer[0], buffer.size());
+   if (charsConverted == 0)
+      throw std::runtime_error("Failed converting Windows-1252 string to WideChar");
+   return std::wstring(&buffer[0], charsConverted);
+}
+
+std::wstring UTF8ToWideChar(const std::string & str)
+{
+   if (str.empty())
+      return std::wstring();
+
+   size_t charsNeeded = ::MultiByteToWideChar(CP_UTF8, 0, 
+      str.data(), (int)str.size(), NULL, 0);
+   if (charsNeeded == 0)
+      throw std::runtime_error("Failed to calculate UTF-8 string to WideChar");
+
+   std::vector<wchar_t> buffer(charsNeeded);
+   int charsConverted = ::MultiByteToWideChar(CP_UTF8, 0, 
+      str.data(), (int)str.size(), &buffer[0], buffer.size());
+   if (charsConverted == 0)
+      throw std::runtime_error("Failed converting UTF-8 string to WideChar");
+   return std::wstring(&buffer[0], charsConverted);
+}
+
+String LoadUtf8FileToString(const String& filename)
+{
+    std::string buffer;            // stores file contents
+#ifdef _UNICODE
+    std::wstring filenameW = filename;
+#else
+    std::wstring filenameW = ACPToWideChar(filename);
+#endif
+    FILE *fp = _wfopen(filenameW.c_str(), L"r");
+
+    // Failed to open file
+    if (fp == NULL)
+    {
+        // ...handle some error...
+        throw std::runtime_error("File not found");
+    }
+    fseek(fp, 0, SEEK_END);
+    long filesize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    // Read entire file contents in to memory
+    if (filesize > 0)
+    {
+        buffer.resize(filesize);
+        size_t chars_read = fread(&(buffer.front()), sizeof(char), filesize, fp);
+        buffer.resize(chars_read);
+        buffer.shrink_to_fit();
+    }
+    fclose(fp);
+#ifdef _UNICODE
+    return UTF8ToWideChar(buffer);
+#else
+    return WideCharToACP(UTF8ToWideChar(buffer));
+#endif
+}
+
+// Names of the SERVICE_* states
+static const TCHAR* s_states[] =
+{
+    TEXT("unknown"), TEXT("stopped"), TEXT("start pending"),
+    TEXT("stop pending"), TEXT("running"), TEXT("continue pending"),
+    TEXT("pause pending"), TEXT("paused")
+};
+
+//
+//   FUNCTION: PrintStatus
+//
+//   PURPOSE: Print the status page of a running wrapper, as a monitoring
+//   tool would read it.
+//
+int PrintStatus(const String& id)
+{
+    static const TCHAR* childStates[] =
+    {
+        TEXT("idle"), TEXT("suspended"), TEXT("running"), TEXT("stopping"),
+        TEXT("exited")
+    };
+    static const TCHAR* latencies[STATUS_LATENCIES] =
+    {
+        TEXT("spawn:"), TEXT("ready:"), TEXT("stop:"), TEXT("restart gap:"),
+        TEXT("backend connect:"), TEXT("log write:")
+    };
+    std::wstring name(id.begin(), id.end());
+    StatusReader reader;
+    StatusRecord record;
+
+    if (!reader.Open(name.c_str()) || !reader.Read(&record))
+    {
+        _tprintf(TEXT("Read status page failed w/err 0x%08lx\n"), GetLastError());
+        return 1;
+    }
+    _tprintf(TEXT("service:  %s\n"),
+             s_states[record.serviceState < 8 ? record.serviceState : 0]);
+    _tprintf(TEXT("wrapper:  pid %lu\n"), record.wrapperPid);
+    _tprintf(TEXT("process:  %s, pid %lu, last exit code 0x%08lx\n"),
+             childStates[record.childState < 5 ? record.childState : 0],
+             record.childPid, record.lastExitCode);
+    if (record.childStartTime != 0)
+    {
+        _tprintf(TEXT("uptime:   %I64u s\n"),
+                 (record.sampleTime - record.childStartTime) / 10000000);
+    }
+    _tprintf(TEXT("restarts: %lu planned, %lu failed\n"),
+             record.plannedRestarts, record.failedRestarts);
+    _tprintf(TEXT("tree:     %lu processes, %I64u ms cpu, %I64u bytes peak\n"),
+             record.processes, record.cpuTime, record.peakMemory);
+    _tprintf(TEXT("jobs:     %lu running\n"), record.runningJobs);
+    for (int i = 0; i < STATUS_LATENCIES; i++)
+    {
+        if (record.latencies[i].count > 0)
+        {
+            _tprintf(TEXT("%-16s %lu times, p50 %I64u us, p90 %I64u us, p99 %I64u us, max %I64u us\n"),
+                     latencies[i], record.latencies[i].count,
+                     record.latencies[i].p50, record.latencies[i].p90,
+                     record.latencies[i].p99, record.latencies[i].max);
+        }
+    }
+    return 0;
+}
+
+//
+//   FUNCTION: ParseTimeArgument
+//
+//   PURPOSE: Read a local time, yyyy-mm-dd[Thh:mm[:ss]], or a time back
+//   from now, -<n>s|m|h|d, as a FILETIME. Returns 0 when invalid.
+//
+ULONGLONG ParseTimeArgument(const TCHAR* text, ULONGLONG now)
+{
+    SYSTEMTIME st;
+    FILETIME local, ft;
+    unsigned int year, month, day, hour = 0, minute = 0, second = 0;
+
+    if (text[0] == TEXT('-'))
+    {
+        TCHAR* end;
+        ULONGLONG count = _tcstoul(text + 1, &end, 10);
+        ULONGLONG scale = 0;
+        switch (*end)
+        {
+        case TEXT('s'):
+            scale = 1;
+            break;
+        case TEXT('m'):
+            scale = 60;
+            break;
+        case TEXT('h'):
+            scale = 3600;
+            break;
+        case TEXT('d'):
+            scale = 86400;
+            break;
+        }
+        if (scale == 0 || end[1] != 0 || count * scale * 10000000 >= now)
+        {
+            return 0;
+        }
+        return now - count * scale * 10000000;
+    }
+    if (_stscanf(text, TEXT("%4u-%2u-%2uT%2u:%2u:%2u"), &year, &month, &day,
+                 &hour, &minute, &second) < 3)
+    {
+        return 0;
+    }
+    ZeroMemory(&st, sizeof(st));
+    st.wYear = (WORD)year;
+    st.wMonth = (WORD)month;
+    st.wDay = (WORD)day;
+    st.wHour = (WORD)hour;
+    st.wMinute = (WORD)minute;
+    st.wSecond = (WORD)second;
+    if (!SystemTimeToFileTime(&st, &local) || !LocalFileTimeToFileTime(&local, &ft))
+    {
+        return 0;
+    }
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+//
+//   FUNCTION: PrintLogs
+//
+//   PURPOSE: Write the archived output of a stream between from and to, the
+//   last hour by default, from every log file the stream goes to. Only the
+//   frames dated within the range are decompressed; their lines are not
+//   filtered further, and the live logs aren't searched.
+//
+int PrintLogs(Descriptor& d, const TCHAR* stream, const TCHAR* from,
+              const TCHAR* to)
+{
+    String filename = d.logpath + TEXT("\\") + d.id +
+        (_tcsicmp(stream, TEXT("stderr")) == 0 ? TEXT(".err.log") : TEXT(".out.log"));
+    std::vector<String> files;
+    std::vector<LogSinkConfig>::iterator it;
+    FILETIME ft;
+    ULONGLONG now, start, end;
+    bool found = false;
+
+    GetSystemTimeAsFileTime(&ft);
+    now = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    start = ParseTimeArgument(from != NULL ? from : TEXT("-1h"), now);
+    end = to != NULL ? ParseTimeArgument(to, now) : now;
+    if (start == 0 || end == 0)
+    {
+        _tprintf(TEXT("Invalid time \"%s\", use yyyy-mm-dd[Thh:mm[:ss]] or -<n>s|m|h|d\n"),
+                 start == 0 ? from : to);
+        return 1;
+    }
+    if (d.logs.empty())
+    {
+        files.push_back(filename);
+    }
+    for (it = d.logs.begin(); it != d.logs.end(); it++)
+    {
+        String file = it->path.size() > 0 ? it->path : filename;
+        if (it->appliesTo(stream) &&
+            _tcsicmp(it->type.c_str(), TEXT("tail")) != 0 &&
+            _tcsicmp(it->type.c_str(), TEXT("pipe")) != 0 &&
+            std::find(files.begin(), files.end(), file) == files.end())
+        {
+            files.push_back(file);
+        }
+    }
+    fflush(stdout);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (ReadLogArchive(files[i], start, end, GetStdHandle(STD_OUTPUT_HANDLE)))
+        {
+            found = true;
+        }
+        else if (GetLastError() != ERROR_FILE_NOT_FOUND)
+        {
+            _tprintf(TEXT("Read log archive of %s failed w/err 0x%08lx\n"),
+                     files[i].c_str(), GetLastError());
+            return 1;
+        }
+    }
+    if (!found)
+    {
+        _tprintf(TEXT("No archived %s output, set logmode to archive\n"), stream);
+        return 1;
+    }
+    return 0;
+}
+
+//
+//   FUNCTION: PrintHistory
+//
+//   PURPOSE: Print the history of the service between from and to, the
+//   last day by default. CPU and log output are shown as rates over the
+//   interval since the previous sample.
+//
+int PrintHistory(const String& path, const String& id, const TCHAR* from,
+                 const TCHAR* to)
+{
+    std::vector<HistoryRecord> records;
+    HistoryRecord last;
+    FILETIME ft;
+    SYSTEMTIME st;
+    ULONGLONG now, start, end;
+    TCHAR time[32];
+    bool sampled = false;
+
+    ZeroMemory(&last, sizeof(last));
+    GetSystemTimeAsFileTime(&ft);
+    now = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    start = ParseTimeArgument(from != NULL ? from : TEXT("-1d"), now);
+    end = to != NULL ? ParseTimeArgument(to, now) : now;
+    if (start == 0 || end == 0)
+    {
+        _tprintf(TEXT("Invalid time \"%s\", use yyyy-mm-dd[Thh:mm[:ss]] or -<n>s|m|h|d\n"),
+                 start == 0 ? from : to);
+        return 1;
+    }
+    if (!ReadHistory(path, id, start, end, &records))
+    {
+        _tprintf(TEXT("Read history failed w/err 0x%08lx\n"), GetLastError());
+        return 1;
+    }
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const HistoryRecord& record = records[i];
+        ft.dwLowDateTime = (DWORD)record.time;
+        ft.dwHighDateTime = (DWORD)(record.time >> 32);
+        FileTimeToLocalFileTime(&ft, &ft);
+        FileTimeToSystemTime(&ft, &st);
+        _sntprintf(time, ARRAYSIZE(time), TEXT("%04u-%02u-%02u %02u:%02u:%02u"),
+                   st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute,
+                   st.wSecond);
+        time[ARRAYSIZE(time) - 1] = 0;
+        switch (record.kind)
+        {
+        case HISTORY_SAMPLE:
+            if (sampled && record.time >= last.time + 10000)
+            {
+                ULONGLONG elapsed = (record.time - last.time) / 10000;
+                // Counters start over with a new process tree or wrapper
+                ULONGLONG cpu = record.cpuTime >= last.cpuTime ?
+                    record.cpuTime - last.cpuTime : record.cpuTime;
+                ULONGLONG log = record.logBytes >= last.logBytes ?
+                    record.logBytes - last.logBytes : record.logBytes;
+                _tprintf(TEXT("%s  cpu %5.1f%%  memory %8I64u KB  processes %3lu  log %I64u B/s\n"),
+                         time, cpu * 100.0 / elapsed, record.workingSet / 1024,
+                         record.processes, log * 1000 / elapsed);
+            }
+            else
+            {
+                _tprintf(TEXT("%s  cpu %I64u ms  memory %8I64u KB  processes %3lu\n"),
+                         time, record.cpuTime, record.workingSet / 1024,
+                         record.processes);
+            }
+            last = record;
+            sampled = true;
+            break;
+        case HISTORY_STATE:
+            _tprintf(TEXT("%s  service %s\n"), time,
+                     s_states[record.value < 8 ? record.value : 0]);
+            break;
+        case HISTORY_START:
+            _tprintf(TEXT("%s  process started, pid %lu\n"), time, record.value);
+            break;
+        case HISTORY_EXIT:
+            _tprintf(TEXT("%s  process exited w/code 0x%08lx%s\n"), time,
+                     record.value, record.failed ? TEXT(", failed") : TEXT(""));
+            break;
+        }
+    }
+    return 0;
+}
+
+// Settings of the service
+
+// Service start options.
+#define SERVICE_START_TYPE       SERVICE_AUTO_START
+
+// The name of the account under which the service should run
+// #define SERVICE_ACCOUNT          TEXT("NULL\\NULL")
+// #define SERVICE_ACCOUNT          TEXT("NT AUTHORITY\\LocalService")
+#define SERVICE_ACCOUNT          NULL
+
+// The password to the service account name
+#define SERVICE_PASSWORD         NULL
+
+#include "../mingw-unicode-main/mingw-unicode.c"
+//
+//  FUNCTION: wmain(int, TCHAR *[])
+//
+//  PURPOSE: entrypoint for the application.
+//
+//  PARAMETERS:
+//    argc - number of command line arguments
+//    argv - array of command line arguments
+//
+//  RETURN VALUE:
+//    none
+//
+//  COMMENTS:
+//    wmain() either performs the command line task, or run the service.
+//
+int _tmain(int argc, TCHAR **argv)
+{
+    using namespace rapidxml;
+    xml_document<TCHAR> doc;    // character type defaults to char
+    Descriptor d;
+
+    TCHAR szPath[MAX_PATH];
+
+    if (GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath)) == 0)
+    {
+        _tprintf(TEXT("GetModuleFileName failed w/err 0x%08lx\n"), GetLastError());
+        return 1;
+    }
+    String exefilename = szPath;
+    d.directory = exefilename.substr(0,exefilename.find_last_of(TEXT('\\')));
+    d.logpath = d.directory + TEXT("\\logs");
+    String xmlfilename=exefilename.substr(0,
+                             exefilename.find_last_of(TEXT('.'))) + TEXT(".xml");
+    String str;
+    try
+    {
+        str = LoadUtf8FileToString(xmlfilename);
+    }
+    catch(std::runtime_error e)
+    {
+        Cout << TEXT("Error loading XML file: ") << e.what() << TEXT("\n");
+        return 2;
+    }
+    try
+    {        
+        doc.parse<0>((TCHAR*)str.c_str());   // 0 means default parse flags
+    }
+    catch(std::runtime_error e)
+    {
+        Cout << TEXT("Error parsing XML file: ") << e.what() << TEXT("\n");
+        return 3;
+    }
+    xml_node<TCHAR> *svc_node = doc.first_node(TEXT("service"));
+    for (xml_node<TCHAR> *node = svc_node->first_node(); node;
+         node = node->next_sibling())
+    {
+        if (_tcsicmp(TEXT("id"), node->name()) == 0)
+        {
+            d.id = node->value();
+        }
+        else if (_tcsicmp(TEXT("name"), node->name()) == 0)
+        {
+            d.name = node->value();
+        }
+        else if (_tcsicmp(TEXT("description"), node->name()) == 0)
+        {
+            d.description = node->value();
+        }
+        else if (_tcsicmp(TEXT("executable"), node->name()) == 0)
+        {
+            d.executable = node->value();
+        }
+        else if (_tcsicmp(TEXT("workingdirectory"), node->name()) == 0)
+        {
+            d.workingdirectory = node->value();
+        }
+        else if (_tcsicmp(TEXT("notify"), node->name()) == 0)
+        {
+            d.notify = _tcsicmp(TEXT("true"), node->value()) == 0;
+        }
+        else if (_tcsicmp(TEXT("watchdogtimeout"), node->name()) == 0)
+        {
+            d.watchdogtimeout = _tcstoul(node->value(), NULL, 10);
+        }
+        else if (_tcsicmp(TEXT("starttimeout"), node->name()) == 0)
+        {
+            d.starttimeout = _tcstoul(node->value(), NULL, 10);
+        }
+        else if (_tcsicmp(TEXT("stoptimeout"), node->name()) == 0)
+        {
+            d.stoptimeout = _tcstoul(node->value(), NULL, 10);
+        }
+        else if (_tcsicmp(TEXT("ondemand"), node->name()) == 0)
+        {
+            xml_attribute<TCHAR> *attr;
+            if ((attr = node->first_attribute(TEXT("listen"))) != NULL)
+            {
+                d.listen = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("backend"))) != NULL)
+            {
+                d.backend = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("idletimeout"))) != NULL)
+            {
+                d.idletimeout = _tcstoul(attr->value(), NULL, 10);
+            }
+        }
+        else if (_tcsicmp(TEXT("job"), node->name()) == 0)
+        {
+            JobConfig job;
+            xml_attribute<TCHAR> *attr;
+            if ((attr = node->first_attribute(TEXT("name"))) != NULL)
+            {
+                job.name = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("executable"))) != NULL)
+            {
+                job.executable = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("arguments"))) != NULL)
+            {
+                job.arguments = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("interval"))) != NULL)
+            {
+                job.interval = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("cron"))) != NULL)
+            {
+                job.cron = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("overlap"))) != NULL)
+            {
+                job.overlap = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("catchup"))) != NULL)
+            {
+                job.catchup = attr->value();
+            }
+            d.jobs.push_back(job);
+        }
+        else if (_tcsicmp(TEXT("recycle"), node->name()) == 0)
+        {
+            xml_attribute<TCHAR> *attr;
+            if ((attr = node->first_attribute(TEXT("maxlifetime"))) != NULL)
+            {
+                d.maxlifetime = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("jitter"))) != NULL)
+            {
+                d.recyclejitter = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("maxconnections"))) != NULL)
+            {
+                d.maxconnections = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("group"))) != NULL)
+            {
+                d.recyclegroup = attr->value();
+            }
+        }
+        else if (_tcsicmp(TEXT("cpu"), node->name()) == 0)
+        {
+            xml_attribute<TCHAR> *attr;
+            if ((attr = node->first_attribute(TEXT("affinity"))) != NULL)
+            {
+                d.affinity = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("spread"))) != NULL)
+            {
+                d.cpuspread = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("group"))) != NULL)
+            {
+                d.cpugroup = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("priority"))) != NULL)
+            {
+                d.priority = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("iopriority"))) != NULL)
+            {
+                d.iopriority = attr->value();
+            }
+        }
+        else if (_tcsicmp(TEXT("limits"), node->name()) == 0)
+        {
+            xml_attribute<TCHAR> *attr;
+            if ((attr = node->first_attribute(TEXT("processmemory"))) != NULL)
+            {
+                d.processmemory = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("treememory"))) != NULL)
+            {
+                d.treememory = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("processes"))) != NULL)
+            {
+                d.processlimit = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("errordialogs"))) != NULL)
+            {
+                d.errordialogs = _tcsicmp(TEXT("false"), attr->value()) != 0;
+            }
+        }
+        else if (_tcsicmp(TEXT("faults"), node->name()) == 0)
+        {
+            d.faults = node->value();
+        }
+        else if (_tcsicmp(TEXT("trace"), node->name()) == 0)
+        {
+            d.trace = _tcsicmp(TEXT("true"), node->value()) == 0;
+        }
+        else if (_tcsicmp(TEXT("history"), node->name()) == 0)
+        {
+            d.history = _tcstoul(node->value(), NULL, 10);
+        }
+        else if (_tcsicmp(TEXT("orphan"), node->name()) == 0)
+        {
+            d.orphan = node->value();
+        }
+        else if (_tcsicmp(TEXT("env"), node->name()) == 0)
+        {
+            xml_attribute<TCHAR> *attr_name = node->first_attribute(TEXT("name"));
+            xml_attribute<TCHAR> *attr_value = node->first_attribute(TEXT("value"));
+            if (attr_name == NULL || attr_value == NULL)
+            {
+                continue;
+            }
+            d.env.push_back(std::make_pair(attr_name->value(), attr_value->value()));
+        }
+        else if (_tcsicmp(TEXT("logpath"), node->name()) == 0)
+        {
+            d.logpath = node->value();
+        }
+        else if (_tcsicmp(TEXT("logmode"), node->name()) == 0)
+        {
+            d.logmode = node->value();
+        }
+        else if (_tcsicmp(TEXT("log"), node->name()) == 0)
+        {
+            LogSinkConfig log;
+            xml_attribute<TCHAR> *attr;
+            if ((attr = node->first_attribute(TEXT("stream"))) != NULL)
+            {
+                log.stream = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("type"))) != NULL)
+            {
+                log.type = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("path"))) != NULL)
+            {
+                log.path = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("size"))) != NULL)
+            {
+                log.size = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("backpressure"))) != NULL)
+            {
+                log.backpressure = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("queue"))) != NULL)
+            {
+                log.queue = _tcstoul(attr->value(), NULL, 10);
+            }
+            d.logs.push_back(log);
+        }
+        else if (_tcsicmp(TEXT("trigger"), node->name()) == 0)
+        {
+            TriggerConfig trigger;
+            xml_attribute<TCHAR> *attr;
+            if ((attr = node->first_attribute(TEXT("pattern"))) != NULL)
+            {
+                trigger.pattern = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("regex"))) != NULL)
+            {
+                trigger.regex = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("action"))) != NULL)
+            {
+                trigger.action = attr->value();
+            }
+            if ((attr = node->first_attribute(TEXT("cooldown"))) != NULL)
+            {
+                trigger.cooldown = _tcstoul(attr->value(), NULL, 10);
+            }
+            if ((attr = node->first_attribute(TEXT("stream"))) != NULL)
+            {
+                trigger.stream = attr->value();
+            }
+            d.triggers.push_back(trigger);
+        }
+        else if (_tcsicmp(TEXT("startargument"), node->name()) == 0)
+        {
+            d.startargument.push_back(node->value());
+        }
+        else if (_tcsicmp(TEXT("stopexecutable"), node->name()) == 0)
+        {
+            d.stopexecutable = node->value();
+        }
+        else if (_tcsicmp(TEXT("stoparguments"), node->name()) == 0)
+        {
+            d.stoparguments = node->value();
+        }
+        else if (_tcsicmp(TEXT("stopargument"), node->name()) == 0)
+        {
+            d.stopargument.push_back(node->value());
+        }
+        else if (_tcsicmp(TEXT("dependson"), node->name()) == 0)
+        {
+            d.dependson.push_back(node->value());
+        }
+    }
+    if (!CreateRecursiveDirectory(d.logpath.c_str()))
+    {
+        Cout << TEXT("Can't create log directory \"") << d.logpath << TEXT("\"\n");
+        return 4;
+    }
+    // List of service dependencies - "dep1\0dep2\0\0"
+    String dependencies = d.dependencies();
+    // Checked for the commands run from a console only: when the SCM
+    // starts the service, nobody reads what is printed and the SCM has
+    // already resolved the dependencies
+    if (argc > 1 &&
+        !CheckServiceDependencies(d.id.c_str(), dependencies.c_str()))
+    {
+        return 5;
+    }
+    // Waits go through the fault clock only when faults are scheduled
+    FaultClock faultClock(Clock::System());
+    Clock* clock = Clock::System();
+    if (!Faults::Load(d.faults))
+    {
+        Cout << TEXT("Invalid fault schedule \"") << d.faults << TEXT("\" w/err ")
+             << GetLastError() << TEXT("\n");
+        return 6;
+    }
+    if (Faults::Enabled())
+    {
+        clock = &faultClock;
+    }
+    // Only the wrapper running the service traces, not the commands
+    if (d.trace && (argc == 1 || _tcsicmp(TEXT("test"), argv[1]) == 0) &&
+        !Trace::Open(d.logpath + TEXT("\\") + d.id + TEXT(".trace.json")))
+    {
+        _tprintf(TEXT("Open trace failed w/err 0x%08lx\n"), GetLastError());
+        return 7;
+    }
+    if (argc > 1)
+    {
+        if (_tcsicmp(TEXT("install"), argv[1]) == 0)
+        {
+            // Install the service when the command is
+            // "install".
+            InstallService(
+                d.id.c_str(),               // Name of service
+                d.name.c_str(),             // Name to display
+                d.description.c_str(),             // Description
+                SERVICE_START_TYPE,         // Service start type
+                dependencies.c_str(),       // Dependencies
+                SERVICE_ACCOUNT,            // Service running account
+                SERVICE_PASSWORD            // Password of the account
+            );
+        }
+        else if (_tcsicmp(TEXT("uninstall"), argv[1]) == 0)
+        {
+            // Uninstall the service when the command isn "uninstall".
+            UninstallService(d.id.c_str());
+        }
+        else if (_tcsicmp(TEXT("upgrade"), argv[1]) == 0)
+        {
+            // Hand the running service process over to the installed
+            // binary when the command is "upgrade".
+            UpgradeService(d.id.c_str());
+        }
+        else if (_tcsicmp(TEXT("status"), argv[1]) == 0)
+        {
+            return PrintStatus(d.id);
+        }
+        else if (_tcsicmp(TEXT("history"), argv[1]) == 0)
+        {
+            return PrintHistory(d.logpath, d.id, argc > 2 ? argv[2] : NULL,
+                                argc > 3 ? argv[3] : NULL);
+        }
+        else if (_tcsicmp(TEXT("logs"), argv[1]) == 0)
+        {
+            const TCHAR* stream = TEXT("stdout");
+            int arg = 2;
+            if (argc > 2 && (_tcsicmp(TEXT("stdout"), argv[2]) == 0 ||
+                             _tcsicmp(TEXT("stderr"), argv[2]) == 0))
+            {
+                stream = argv[arg++];
+            }
+            return PrintLogs(d, stream, argc > arg ? argv[arg] : NULL,
+                             argc > arg + 1 ? argv[arg + 1] : NULL);
+        }
+        else if (_tcsicmp(TEXT("trace"), argv[1]) == 0)
+        {
+            // Ask the running service to write its trace now
+            TraceService(d.id.c_str());
+        }
+        else if (_tcsicmp(TEXT("help"), argv[1]) == 0)
+        {
+            _tprintf(TEXT("Parameters:\n"));
+            _tprintf(TEXT(" install    to install the service.\n"));
+            _tprintf(TEXT(" uninstall  to remove the service.\n"));
+            _tprintf(TEXT(" upgrade    to restart the wrapper, keeping the service process.\n"));
+            _tprintf(TEXT(" status     to print the status page of the running service.\n"));
+            _tprintf(TEXT(" trace      to write the trace of the running service.\n"));
+            _tprintf(TEXT(" history    [from [to]] to print the history of the service,\n"));
+            _tprintf(TEXT("            e.g. history -2h or history 2024-05-01T08:00 -1h.\n"));
+            _tprintf(TEXT(" logs       [stdout|stderr] [from [to]] to print the archived output\n"));
+            _tprintf(TEXT("            of the service, e.g. logs stderr -30m.\n"));
+        }
+        else if (_tcsicmp(TEXT("test"), argv[1]) == 0)
+        {
+            CSampleService service(&d, d.name.c_str(), TRUE, TRUE, FALSE, clock);
+            service.Test();
+            Trace::Export();
+        }
+    }
+    else
+    {
+        CSampleService service(&d, d.name.c_str(), TRUE, TRUE, FALSE, clock);
+        if (!CServiceBase::Run(service))
+        {
+            _tprintf(TEXT("Service failed to run w/err 0x%08lx\n"), GetLastError());
+        }
+        service.CompleteHandover();
+        Trace::Export();
+    }
+
+    return 0;
 }
\ No newline at end of file
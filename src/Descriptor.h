@@ -1,85 +1,247 @@
-#ifndef _DESCRIPTOR_H_
-#define _DESCRIPTOR_H_
-#include <string>
-#include <vector>
-#include "strings.h"
-
-class Descriptor
-{
-    public:
-        String id;
-        String name;
-        String description;
-        String executable;
-        std::vector<std::pair<String, String> > env;
-        String logpath;
-        String logmode;
-        std::vector<String> startargument;
-        String stopexecutable;
-        std::vector<String> stopargument;
-        String stoparguments;
-        
-        String directory;
-        String workingdirectory;
-        
-        String quoteParam(String param)
-        {
-            if (param.size() > 0 && param[0] == TEXT('"'))
-            {
-                return param;
-            }
-            if (param.find_first_of(TEXT(' ')) != String::npos)
-            {
-                return TEXT("\"") + param + TEXT("\"");
-            }
-            return param;
-        }
-            
-        String envCmd()
-        {
-            String arguments;
-            std::vector<std::pair<String, String> >::iterator it;
-
-            for(it = env.begin(); it != env.end(); it++)
-            {
-                arguments += it->first + TEXT("=") + it->second;
-                arguments.push_back(TEXT('\0'));
-            }
-            return arguments;
-        }
-            
-        String startarguments()
-        {
-            String arguments;
-            std::vector<String>::iterator it;
-
-            for(it = startargument.begin(); it != startargument.end(); it++)
-            {
-                arguments += quoteParam(*it) + TEXT(" ");
-            }
-            return arguments;
-        }
-            
-        String stopargumentsCmd()
-        {
-            String arguments;
-            std::vector<String>::iterator it;
-
-            for(it = stopargument.begin(); it != stopargument.end(); it++)
-            {
-                arguments += quoteParam(*it) + TEXT(" ");
-            }
-            return arguments + TEXT(" ") + stoparguments;
-        }
-        
-        String currentDirectory()
-        {
-            if (workingdirectory.size() == 0)
-            {
-                return directory;
-            }
-            return workingdirectory;
-        }
-};
-
+#ifndef _DESCRIPTOR_H_
+#define _DESCRIPTOR_H_
+#include <string>
+#include <vector>
+#include "strings.h"
+
+/**
+ * One destination of a captured stream, declared with
+ * <log stream="stdout|stderr" type="file|tail|pipe" path="" size=""
+ *      backpressure="block|drop" queue="" />
+ * An empty stream applies the sink to both streams.
+ */
+class LogSinkConfig
+{
+    public:
+        String stream;
+        String type;
+        String path;
+        DWORD size;
+        String backpressure;
+        DWORD queue;
+
+        LogSinkConfig() : size(0), queue(0) {}
+
+        bool appliesTo(const TCHAR* name)
+        {
+            return stream.size() == 0 || _tcsicmp(stream.c_str(), name) == 0;
+        }
+};
+
+/**
+ * Action taken when the child prints a literal pattern or a line matching
+ * a regular expression, declared with
+ * <trigger pattern="" regex="" action="restart|metric|event" cooldown=""
+ *          stream="stdout|stderr" />
+ * cooldown: minimum time in milliseconds between two restarts or events
+ */
+class TriggerConfig
+{
+    public:
+        String pattern;
+        String regex;
+        String action;
+        DWORD cooldown;
+        String stream;
+
+        TriggerConfig() : cooldown(60000) {}
+
+        bool appliesTo(const TCHAR* name)
+        {
+            return stream.size() == 0 || _tcsicmp(stream.c_str(), name) == 0;
+        }
+};
+
+/**
+ * Periodic job run by the wrapper next to the service, declared with
+ * <job name="" executable="" arguments="" interval="" cron=""
+ *      overlap="skip|queue|kill" catchup="none|once|all" />
+ * interval: seconds between two runs, or 0 to use cron, a five field
+ * expression in local time. The output goes to <id>.job.<name>.log.
+ */
+class JobConfig
+{
+    public:
+        String name;
+        String executable;
+        String arguments;
+        DWORD interval;
+        String cron;
+        String overlap;
+        String catchup;
+
+        JobConfig() : interval(0) {}
+};
+
+class Descriptor
+{
+    public:
+        Descriptor()
+            : notify(false), watchdogtimeout(0), starttimeout(12000),
+              stoptimeout(15000), idletimeout(600000),
+              maxlifetime(0), recyclejitter(0), maxconnections(0),
+              processmemory(0), treememory(0), processlimit(0),
+              errordialogs(true), trace(false), history(7)
+        {
+        }
+
+        String id;
+        String name;
+        String description;
+        String executable;
+        std::vector<std::pair<String, String> > env;
+        String logpath;
+        String logmode;
+        std::vector<LogSinkConfig> logs;
+        std::vector<TriggerConfig> triggers;
+        std::vector<JobConfig> jobs;
+        std::vector<String> startargument;
+        String stopexecutable;
+        std::vector<String> stopargument;
+        String stoparguments;
+        std::vector<String> dependson;
+        
+        String directory;
+        String workingdirectory;
+
+        // Export NOTIFY_SOCKET and NOTIFY_TOKEN and wait for READY=1 before
+        // reporting start; datagrams carry TOKEN=<NOTIFY_TOKEN>
+        bool notify;
+        // Restart the child when WATCHDOG=1 is not received in time (ms)
+        DWORD watchdogtimeout;
+        // Time allowed for the child to start (ms)
+        DWORD starttimeout;
+        // Time allowed to stop the child before it is killed (ms)
+        DWORD stoptimeout;
+        // Child left running by a crashed wrapper: kill (default) or adopt
+        String orphan;
+        // On demand start: the wrapper listens on listen and relays to
+        // backend, where the child listens (IPv4 host:port)
+        String listen;
+        String backend;
+        // Stop the child after this long without connections (ms)
+        DWORD idletimeout;
+        // Recycle the child after maxlifetime plus up to recyclejitter (ms)
+        DWORD maxlifetime;
+        DWORD recyclejitter;
+        // Recycle the child after it was given maxconnections connections
+        DWORD maxconnections;
+        // Services of the same group never recycle at the same time,
+        // services of the same executable by default
+        String recyclegroup;
+        // <cpu affinity="" spread="none|core|node" group="" priority=""
+        //      iopriority="" />, see CpuPlacement. Services spread within
+        // their group, services of the same executable by default.
+        String affinity;
+        String cpuspread;
+        String cpugroup;
+        String priority;
+        String iopriority;
+        // <limits processmemory="" treememory="" processes=""
+        //         errordialogs="true|false" />, memory in MB, applied to
+        // the process tree of the child
+        DWORD processmemory;
+        DWORD treememory;
+        DWORD processlimit;
+        bool errordialogs;
+        // Scripted failures of the platform calls, see Faults. Only read by
+        // a wrapper built with FAULT_INJECTION.
+        String faults;
+        // Record the spans of the lifecycle phases, written to
+        // <logpath>\<id>.trace.json at exit and on the trace command
+        bool trace;
+        // Days of history kept in <logpath>\<id>.<yyyymmdd>.history, see
+        // HistoryFile; 0 records none
+        DWORD history;
+        
+        String quoteParam(String param)
+        {
+            if (param.size() > 0 && param[0] == TEXT('"'))
+            {
+                return param;
+            }
+            if (param.find_first_of(TEXT(' ')) != String::npos)
+            {
+                return TEXT("\"") + param + TEXT("\"");
+            }
+            return param;
+        }
+            
+        String envCmd()
+        {
+            String arguments;
+            std::vector<std::pair<String, String> >::iterator it;
+
+            for(it = env.begin(); it != env.end(); it++)
+            {
+                arguments += it->first + TEXT("=") + it->second;
+                arguments.push_back(TEXT('\0'));
+            }
+            return arguments;
+        }
+            
+        String startarguments()
+        {
+            String arguments;
+            std::vector<String>::iterator it;
+
+            for(it = startargument.begin(); it != startargument.end(); it++)
+            {
+                arguments += quoteParam(*it) + TEXT(" ");
+            }
+            return arguments;
+        }
+            
+        String stopargumentsCmd()
+        {
+            String arguments;
+            std::vector<String>::iterator it;
+
+            for(it = stopargument.begin(); it != stopargument.end(); it++)
+            {
+                arguments += quoteParam(*it) + TEXT(" ");
+            }
+            return arguments + TEXT(" ") + stoparguments;
+        }
+        
+        // The output of the child is only captured when asked for, with a
+        // <logmode> other than none, a <log> or a <trigger>
+        bool captureOutput()
+        {
+            return logs.size() > 0 || triggers.size() > 0 || logFile();
+        }
+
+        // Output goes to <id>.out.log and <id>.err.log when no <log> is
+        // declared
+        bool logFile()
+        {
+            return logmode.size() > 0 &&
+                _tcsicmp(logmode.c_str(), TEXT("none")) != 0;
+        }
+
+        // Double null-terminated list of the services to start first
+        String dependencies()
+        {
+            String result;
+            std::vector<String>::iterator it;
+
+            for(it = dependson.begin(); it != dependson.end(); it++)
+            {
+                result += *it;
+                result.push_back(TEXT('\0'));
+            }
+            result.push_back(TEXT('\0'));
+            return result;
+        }
+
+        String currentDirectory()
+        {
+            if (workingdirectory.size() == 0)
+            {
+                return directory;
+            }
+            return workingdirectory;
+        }
+};
+
 #endif /* _DESCRIPTOR_H_ */
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include <vector>
+#include "Faults.h"
+
+#define NO_LAST_CALL 0xFFFFFFFF
+
+struct FaultRule
+{
+    // Calls of the point the rule applies to, from 1
+    DWORD first;
+    DWORD last;
+    Fault fault;
+};
+
+static const TCHAR* s_points[FAULT_POINTS] =
+{
+    TEXT("spawn"), TEXT("wait"), TEXT("read"), TEXT("write"), TEXT("signal"),
+    TEXT("file")
+};
+
+// Error of a failure scheduled without one
+static const DWORD s_errors[FAULT_POINTS] =
+{
+    ERROR_NOT_ENOUGH_MEMORY, ERROR_INVALID_HANDLE, ERROR_BROKEN_PIPE,
+    ERROR_NO_DATA, ERROR_ACCESS_DENIED, ERROR_DISK_FULL
+};
+
+// Written by Load before the service starts, read only afterwards
+static std::vector<FaultRule> s_rules[FAULT_POINTS];
+static bool s_enabled = false;
+static volatile LONG s_calls[FAULT_POINTS];
+static volatile LONG s_injected = 0;
+
+//
+//   FUNCTION: ParseRule
+//
+//   PURPOSE: Parse one point@calls=action[:value] of a schedule.
+//
+static bool ParseRule(const String& text, int* point, FaultRule* rule)
+{
+    size_t at = text.find(TEXT('@'));
+    size_t equal = text.find(TEXT('='));
+    const TCHAR* p;
+    TCHAR* end;
+
+    if (at == String::npos || equal == String::npos || equal < at)
+    {
+        return false;
+    }
+    String name = text.substr(0, at);
+    *point = -1;
+    for (int i = 0; i < FAULT_POINTS; i++)
+    {
+        if (_tcsicmp(name.c_str(), s_points[i]) == 0)
+        {
+            *point = i;
+        }
+    }
+    if (*point < 0)
+    {
+        return false;
+    }
+
+    String calls = text.substr(at + 1, equal - at - 1);
+    p = calls.c_str();
+    rule->first = _tcstoul(p, &end, 10);
+    rule->last = rule->first;
+    if (end == p || rule->first == 0)
+    {
+        return false;
+    }
+    if (*end == TEXT('-'))
+    {
+        p = end + 1;
+        rule->last = *p == 0 ? NO_LAST_CALL : _tcstoul(p, &end, 10);
+        if ((*p != 0 && end == p) || rule->last < rule->first)
+        {
+            return false;
+        }
+    }
+    if (*p != 0 && *end != 0)
+    {
+        return false;
+    }
+
+    String action = text.substr(equal + 1);
+    size_t colon = action.find(TEXT(':'));
+    rule->fault.value = 0;
+    if (colon != String::npos)
+    {
+        p = action.c_str() + colon + 1;
+        rule->fault.value = _tcstoul(p, &end, 0);
+        if (end == p || *end != 0)
+        {
+            return false;
+        }
+        action.resize(colon);
+    }
+    if (_tcsicmp(action.c_str(), TEXT("fail")) == 0)
+    {
+        rule->fault.action = FAULT_FAIL;
+    }
+    else if (_tcsicmp(action.c_str(), TEXT("stall")) == 0 && colon != String::npos)
+    {
+        rule->fault.action = FAULT_STALL;
+    }
+    else if (_tcsicmp(action.c_str(), TEXT("timeout")) == 0 && *point == FAULT_WAIT)
+    {
+        rule->fault.action = FAULT_TIMEOUT;
+    }
+    else
+    {
+        return false;
+    }
+    if (rule->fault.action == FAULT_FAIL && rule->fault.value == 0)
+    {
+        rule->fault.value = s_errors[*point];
+    }
+    return true;
+}
+
+bool Faults::Load(const String& schedule)
+{
+    std::vector<FaultRule> rules[FAULT_POINTS];
+    size_t start = 0;
+
+    while (start < schedule.size())
+    {
+        size_t end = schedule.find(TEXT(';'), start);
+        if (end == String::npos)
+        {
+            end = schedule.size();
+        }
+        String text = schedule.substr(start, end - start);
+        size_t first = text.find_first_not_of(TEXT(" \t\r\n"));
+        size_t last = text.find_last_not_of(TEXT(" \t\r\n"));
+        start = end + 1;
+        if (first == String::npos)
+        {
+            continue;
+        }
+        text = text.substr(first, last - first + 1);
+        int point;
+        FaultRule rule;
+        if (!ParseRule(text, &point, &rule))
+        {
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return false;
+        }
+        rules[point].push_back(rule);
+    }
+#ifndef FAULT_INJECTION
+    for (int i = 0; i < FAULT_POINTS; i++)
+    {
+        if (!rules[i].empty())
+        {
+            SetLastError(ERROR_NOT_SUPPORTED);
+            return false;
+        }
+    }
+#endif
+    s_enabled = false;
+    for (int i = 0; i < FAULT_POINTS; i++)
+    {
+        s_rules[i].swap(rules[i]);
+        s_calls[i] = 0;
+        s_enabled = s_enabled || !s_rules[i].empty();
+    }
+    s_injected = 0;
+    return true;
+}
+
+bool Faults::Enabled()
+{
+    return s_enabled;
+}
+
+bool Faults::Next(FaultPoint point, Fault* fault)
+{
+    std::vector<FaultRule>& rules = s_rules[point];
+    DWORD call;
+
+    fault->action = FAULT_NONE;
+    fault->value = 0;
+    if (rules.empty())
+    {
+        return false;
+    }
+    call = (DWORD)InterlockedIncrement(&s_calls[point]);
+    for (size_t i = 0; i < rules.size(); i++)
+    {
+        if (call >= rules[i].first && call <= rules[i].last)
+        {
+            *fault = rules[i].fault;
+            InterlockedIncrement(&s_injected);
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef FAULT_INJECTION
+bool Faults::Inject(FaultPoint point)
+{
+    Fault fault;
+
+    if (!Next(point, &fault))
+    {
+        return false;
+    }
+    if (fault.action == FAULT_STALL)
+    {
+        Sleep(fault.value);
+        return false;
+    }
+    SetLastError(fault.value);
+    return true;
+}
+#endif
+
+LONG Faults::Injected()
+{
+    return s_injected;
+}
+
+FaultClock::FaultClock(Clock* clock)
+    : m_clock(clock)
+{
+}
+
+ULONGLONG FaultClock::Now()
+{
+    return m_clock->Now();
+}
+
+DWORD FaultClock::Wait(DWORD count, const HANDLE* handles, DWORD timeout)
+{
+    Fault fault;
+
+    if (Faults::Next(FAULT_WAIT, &fault))
+    {
+        switch (fault.action)
+        {
+            case FAULT_FAIL:
+                SetLastError(fault.value);
+                return WAIT_FAILED;
+            case FAULT_STALL:
+                m_clock->Sleep(fault.value);
+                break;
+            case FAULT_TIMEOUT:
+                // A wait without a timeout gives up at once
+                if (timeout != INFINITE)
+                {
+                    m_clock->Sleep(timeout);
+                }
+                return WAIT_TIMEOUT;
+            default:
+                break;
+        }
+    }
+    return m_clock->Wait(count, handles, timeout);
+}
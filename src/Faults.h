@@ -0,0 +1,92 @@
+#ifndef _FAULTS_H_
+#define _FAULTS_H_
+#include <windows.h>
+#include <string>
+#include "strings.h"
+#include "Clock.h"
+
+/**
+ * Platform calls a fault can be injected into.
+ */
+enum FaultPoint
+{
+    // CreateProcess of the child or a job
+    FAULT_SPAWN,
+    // Timed waits of the supervision, through FaultClock
+    FAULT_WAIT,
+    // ReadFile on a capture pipe
+    FAULT_READ,
+    // WriteFile to a log pipe
+    FAULT_WRITE,
+    // Delivery of a stop: the stop command and the kill of the child
+    FAULT_SIGNAL,
+    // WriteFile to a log, handover or job state file
+    FAULT_FILE,
+    FAULT_POINTS
+};
+
+enum FaultAction
+{
+    FAULT_NONE,
+    // The call fails with the given error, or one typical of the point
+    FAULT_FAIL,
+    // The call runs after a delay of the given milliseconds
+    FAULT_STALL,
+    // A wait lasts its whole timeout and returns WAIT_TIMEOUT
+    FAULT_TIMEOUT
+};
+
+struct Fault
+{
+    FaultAction action;
+    DWORD value;
+};
+
+/**
+ * Scripted faults, to reproduce on purpose the crash loops, stop hangs,
+ * pipe stalls and spawn failures met in production. The schedule is a
+ * list of point@calls=action[:value] separated by ';', where calls count
+ * the calls of the point from 1 as N, N-M or N-, e.g.
+ *
+ *   spawn@2-4=fail:8;wait@3=timeout;read@10-=stall:5000
+ *
+ * Only a wrapper built with FAULT_INJECTION injects anything, elsewhere
+ * Inject compiles to nothing and Load refuses a schedule.
+ */
+class Faults
+{
+    public:
+        static bool Load(const String& schedule);
+        static bool Enabled();
+        // Count a call of the point and tell the fault scheduled for it
+        static bool Next(FaultPoint point, Fault* fault);
+#ifdef FAULT_INJECTION
+        // For calls that return a BOOL: stall here, or set the last error
+        // and return true when the call must fail
+        static bool Inject(FaultPoint point);
+#else
+        static bool Inject(FaultPoint point)
+        {
+            return false;
+        }
+#endif
+        // Faults injected so far
+        static LONG Injected();
+};
+
+/**
+ * Clock injecting the faults of FAULT_WAIT into the waits of another.
+ */
+class FaultClock : public Clock
+{
+    public:
+        FaultClock(Clock* clock);
+
+        ULONGLONG Now();
+        DWORD Wait(DWORD count, const HANDLE* handles, DWORD timeout);
+
+    private:
+        Clock* m_clock;
+};
+
+#endif /* _FAULTS_H_ */
@@ -0,0 +1,179 @@
+#include "Handover.h"
+#include "Faults.h"
+
+bool SaveHandoverState(const String& filename, const HandoverState& state)
+{
+    String temp = filename + TEXT(".tmp");
+    HANDLE hFile;
+    DWORD written;
+    BOOL result;
+    HandoverState copy = state;
+
+    copy.magic = HANDOVER_MAGIC;
+    copy.version = HANDOVER_VERSION;
+    hFile = CreateFile(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    result = !Faults::Inject(FAULT_FILE) &&
+             WriteFile(hFile, &copy, sizeof(copy), &written, NULL) &&
+             written == sizeof(copy) && FlushFileBuffers(hFile);
+    CloseHandle(hFile);
+    // Never leave a partial state where the next instance looks for it
+    if (!result || !MoveFileEx(temp.c_str(), filename.c_str(),
+                               MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DWORD dwError = GetLastError();
+        DeleteFile(temp.c_str());
+        SetLastError(dwError);
+        return false;
+    }
+    return true;
+}
+
+// Layouts of the previous versions, read so that an upgrade across a
+// version bump still hands the child over instead of starting another one
+struct HandoverStateV1
+{
+    DWORD magic;
+    DWORD version;
+    DWORD ownerPid;
+    DWORD childPid;
+    ULONGLONG hProcess;
+    ULONGLONG hOutPipe;
+    ULONGLONG hErrPipe;
+    LONG repeatCount;
+    USHORT notifyPort;
+};
+
+struct HandoverStateV2
+{
+    DWORD magic;
+    DWORD version;
+    DWORD ownerPid;
+    DWORD childPid;
+    ULONGLONG hProcess;
+    ULONGLONG hOutPipe;
+    ULONGLONG hErrPipe;
+    ULONGLONG hJob;
+    LONG repeatCount;
+    USHORT notifyPort;
+};
+
+struct HandoverStateV3
+{
+    DWORD magic;
+    DWORD version;
+    DWORD ownerPid;
+    DWORD childPid;
+    ULONGLONG hProcess;
+    ULONGLONG hOutPipe;
+    ULONGLONG hErrPipe;
+    ULONGLONG hJob;
+    ULONGLONG hCpuSlot;
+    DWORD cpuSlot;
+    LONG repeatCount;
+    USHORT notifyPort;
+};
+
+struct HandoverStateV4
+{
+    HandoverStateV3 base;
+    HistogramData latencies[LATENCY_KINDS];
+};
+
+union HandoverBuffer
+{
+    HandoverState current;
+    HandoverStateV1 v1;
+    HandoverStateV2 v2;
+    HandoverStateV3 v3;
+    HandoverStateV4 v4;
+};
+
+// Fields every version has
+template <class T>
+static void CopyHandoverState(const T& old, HandoverState* state)
+{
+    state->magic = old.magic;
+    state->version = HANDOVER_VERSION;
+    state->ownerPid = old.ownerPid;
+    state->childPid = old.childPid;
+    state->hProcess = old.hProcess;
+    state->hOutPipe = old.hOutPipe;
+    state->hErrPipe = old.hErrPipe;
+    state->repeatCount = old.repeatCount;
+    state->notifyPort = old.notifyPort;
+}
+
+bool LoadHandoverState(const String& filename, HandoverState* state)
+{
+    HANDLE hFile;
+    DWORD bytesRead;
+    BOOL result;
+    HandoverBuffer buffer;
+
+    hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    result = ReadFile(hFile, &buffer, sizeof(buffer), &bytesRead, NULL);
+    CloseHandle(hFile);
+    if (!result || bytesRead < sizeof(buffer.v1) ||
+        buffer.v1.magic != HANDOVER_MAGIC)
+    {
+        return false;
+    }
+    // Fields an older version did not have stay 0: no job, no processor
+    // slot, no latencies, and a new notification token
+    ZeroMemory(state, sizeof(*state));
+    switch (buffer.v1.version)
+    {
+        case HANDOVER_VERSION:
+            *state = buffer.current;
+            return bytesRead == sizeof(buffer.current);
+        case 4:
+            CopyHandoverState(buffer.v4.base, state);
+            state->hJob = buffer.v4.base.hJob;
+            state->hCpuSlot = buffer.v4.base.hCpuSlot;
+            state->cpuSlot = buffer.v4.base.cpuSlot;
+            CopyMemory(state->latencies, buffer.v4.latencies,
+                       sizeof(state->latencies));
+            return bytesRead == sizeof(buffer.v4);
+        case 3:
+            CopyHandoverState(buffer.v3, state);
+            state->hJob = buffer.v3.hJob;
+            state->hCpuSlot = buffer.v3.hCpuSlot;
+            state->cpuSlot = buffer.v3.cpuSlot;
+            return bytesRead == sizeof(buffer.v3);
+        case 2:
+            CopyHandoverState(buffer.v2, state);
+            state->hJob = buffer.v2.hJob;
+            return bytesRead == sizeof(buffer.v2);
+        case 1:
+            CopyHandoverState(buffer.v1, state);
+            return bytesRead == sizeof(buffer.v1);
+    }
+    return false;
+}
+
+HANDLE TakeHandoverHandle(HANDLE hOwner, ULONGLONG value)
+{
+    HANDLE hTarget = NULL;
+
+    if (value == 0)
+    {
+        return NULL;
+    }
+    if (!DuplicateHandle(hOwner, (HANDLE)(ULONG_PTR)value, GetCurrentProcess(),
+                         &hTarget, 0, FALSE,
+                         DUPLICATE_SAME_ACCESS | DUPLICATE_CLOSE_SOURCE))
+    {
+        return NULL;
+    }
+    return hTarget;
+}
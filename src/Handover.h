@@ -0,0 +1,51 @@
+#ifndef _HANDOVER_H_
+#define _HANDOVER_H_
+#include <windows.h>
+#include <string>
+#include "strings.h"
+#include "Histogram.h"
+#include "NotifySocket.h"
+
+// Control code that asks the running wrapper to hand its child over to a
+// new instance of the service
+#define SERVICE_CONTROL_HANDOVER 128
+
+#define HANDOVER_MAGIC 0x52564f48
+// Each bump keeps the previous layout readable in LoadHandoverState, the
+// running instance is the old binary during an upgrade
+#define HANDOVER_VERSION 5
+
+/**
+ * State passed from a running wrapper to the instance that replaces it.
+ *
+ * Handles are values in the owner process. The new instance moves them
+ * with DUPLICATE_CLOSE_SOURCE, so each handle has a single owner at any
+ * time and the capture pipes stay open across the handover.
+ */
+struct HandoverState
+{
+    DWORD magic;
+    DWORD version;
+    DWORD ownerPid;
+    DWORD childPid;
+    ULONGLONG hProcess;
+    ULONGLONG hOutPipe;
+    ULONGLONG hErrPipe;
+    // Job object of the process tree of the child
+    ULONGLONG hJob;
+    // Processor slot of the service, see CpuPlacement
+    ULONGLONG hCpuSlot;
+    DWORD cpuSlot;
+    LONG repeatCount;
+    USHORT notifyPort;
+    char notifyToken[NOTIFY_TOKEN_LENGTH + 1];
+    // Latencies recorded so far, merged into those of the next instance
+    HistogramData latencies[LATENCY_KINDS];
+};
+
+bool SaveHandoverState(const String& filename, const HandoverState& state);
+bool LoadHandoverState(const String& filename, HandoverState* state);
+// Move a handle out of the owner process, NULL when value is 0 or on error
+HANDLE TakeHandoverHandle(HANDLE hOwner, ULONGLONG value);
+
+#endif /* _HANDOVER_H_ */
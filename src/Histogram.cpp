@@ -0,0 +1,130 @@
+#include "Histogram.h"
+
+DurationHistogram::DurationHistogram()
+{
+    ZeroMemory(&m_data, sizeof(m_data));
+}
+
+//
+//   FUNCTION: DurationHistogram::Bucket
+//
+//   PURPOSE: Values below 8 have a bucket each, above that the two bits
+//   under the highest set bit pick one of the four buckets of its power of
+//   two.
+//
+int DurationHistogram::Bucket(ULONGLONG value)
+{
+    int msb = 0;
+
+    if (value < 8)
+    {
+        return (int)value;
+    }
+    while ((value >> msb) > 1)
+    {
+        msb++;
+    }
+    return (msb - 1) * 4 + (int)((value >> (msb - 2)) & 3);
+}
+
+ULONGLONG DurationHistogram::LowerBound(int bucket)
+{
+    if (bucket < 8)
+    {
+        return bucket;
+    }
+    return (ULONGLONG)(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+void DurationHistogram::Add(ULONGLONG value)
+{
+    LONGLONG max;
+
+    InterlockedIncrement((volatile LONG*)&m_data.buckets[Bucket(value)]);
+    InterlockedIncrement((volatile LONG*)&m_data.count);
+    while (value > (ULONGLONG)(max = (LONGLONG)m_data.max) &&
+           InterlockedCompareExchange64((volatile LONGLONG*)&m_data.max,
+                                        (LONGLONG)value, max) != max)
+    {
+    }
+}
+
+void DurationHistogram::Merge(const HistogramData& data)
+{
+    LONGLONG max;
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        if (data.buckets[i] != 0)
+        {
+            InterlockedExchangeAdd((volatile LONG*)&m_data.buckets[i],
+                                   (LONG)data.buckets[i]);
+        }
+    }
+    InterlockedExchangeAdd((volatile LONG*)&m_data.count, (LONG)data.count);
+    while (data.max > (ULONGLONG)(max = (LONGLONG)m_data.max) &&
+           InterlockedCompareExchange64((volatile LONGLONG*)&m_data.max,
+                                        (LONGLONG)data.max, max) != max)
+    {
+    }
+}
+
+// Values recorded meanwhile may be partly in the copy
+void DurationHistogram::Save(HistogramData* data)
+{
+    *data = m_data;
+}
+
+ULONG DurationHistogram::Count()
+{
+    return m_data.count;
+}
+
+ULONGLONG DurationHistogram::Max()
+{
+    return m_data.max;
+}
+
+ULONGLONG DurationHistogram::Percentile(double percentile)
+{
+    ULONG count = m_data.count;
+    ULONGLONG max = m_data.max;
+    ULONG rank = (ULONG)(count * percentile / 100.0 + 0.5);
+    ULONG seen = 0;
+    int last = HISTOGRAM_BUCKETS - 1;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    for (int i = 0; i <= last; i++)
+    {
+        seen += m_data.buckets[i];
+        if (seen >= rank)
+        {
+            ULONGLONG upper = i < last ? LowerBound(i + 1) - 1 : max;
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+ULONGLONG GetMicroseconds()
+{
+    static LONGLONG frequency = 0;
+    LARGE_INTEGER value;
+
+    if (frequency == 0)
+    {
+        QueryPerformanceFrequency(&value);
+        frequency = value.QuadPart;
+    }
+    QueryPerformanceCounter(&value);
+    // Split so that the product doesn't overflow
+    return (ULONGLONG)(value.QuadPart / frequency * 1000000 +
+                       value.QuadPart % frequency * 1000000 / frequency);
+}
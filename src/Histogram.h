@@ -0,0 +1,68 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+#include <windows.h>
+
+#define HISTOGRAM_BUCKETS 252
+
+/**
+ * Lifecycle transitions of a service timed by the wrapper, in
+ * microseconds.
+ */
+enum LatencyKind
+{
+    // CreateProcess of the service process
+    LATENCY_SPAWN,
+    // From the spawn to READY=1, or to the start timeout without notify
+    LATENCY_READY,
+    // From the stop request to the end of the worker
+    LATENCY_STOP,
+    // From the exit of a service process to the start of the next
+    LATENCY_RESTART_GAP,
+    // Connection of the proxy to the backend of the service process
+    LATENCY_PROBE,
+    // Delivery of a chunk of output to the log sinks of its stream
+    LATENCY_LOG_WRITE,
+    LATENCY_KINDS
+};
+
+/**
+ * Counts of a histogram as saved, e.g. in the handover state, and merged
+ * into another one.
+ */
+struct HistogramData
+{
+    ULONG buckets[HISTOGRAM_BUCKETS];
+    ULONG count;
+    ULONG reserved;
+    ULONGLONG max;
+};
+
+/**
+ * Log-linear histogram of durations: four buckets per power of two, so
+ * percentiles are within 25%. Values are recorded with interlocked
+ * operations, from any thread and without locks.
+ */
+class DurationHistogram
+{
+    public:
+        DurationHistogram();
+
+        void Add(ULONGLONG value);
+        void Merge(const HistogramData& data);
+        void Save(HistogramData* data);
+        ULONG Count();
+        ULONGLONG Max();
+        // Upper bound of the bucket holding the percentile, 0 when empty
+        ULONGLONG Percentile(double percentile);
+
+    private:
+        static int Bucket(ULONGLONG value);
+        static ULONGLONG LowerBound(int bucket);
+
+        HistogramData m_data;
+};
+
+// QueryPerformanceCounter in microseconds
+ULONGLONG GetMicroseconds();
+
+#endif /* _HISTOGRAM_H_ */
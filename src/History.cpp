@@ -0,0 +1,535 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include "History.h"
+
+// Record encoded without deltas, an index entry may point at it
+#define HISTORY_KEY 0x80
+// Kind byte and five varints of up to ten bytes
+#define HISTORY_RECORD_MAX 64
+
+struct HistoryIndexEntry
+{
+    ULONGLONG time;
+    DWORD offset;
+    DWORD reserved;
+};
+
+/**
+ * Header of a segment file, followed by the records.
+ */
+struct HistorySegment
+{
+    DWORD magic;
+    DWORD version;
+    // Start of the UTC day the segment covers
+    ULONGLONG start;
+    // Bytes of records; index entries are only valid below it
+    volatile LONG used;
+    volatile LONG indexed;
+    // Time of the last record in ms since start
+    ULONG lastTime;
+    DWORD reserved;
+    HistoryIndexEntry index[HISTORY_INDEX_ENTRIES];
+    BYTE data[1];
+};
+
+#define HISTORY_DATA_SIZE ((LONG)(HISTORY_SEGMENT_SIZE - offsetof(HistorySegment, data)))
+
+static String GetSegmentName(const String& path, const String& id,
+                             ULONGLONG day)
+{
+    FILETIME ft;
+    SYSTEMTIME st;
+    TCHAR buff[32];
+
+    ft.dwLowDateTime = (DWORD)day;
+    ft.dwHighDateTime = (DWORD)(day >> 32);
+    FileTimeToSystemTime(&ft, &st);
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT(".%04u%02u%02u.history"),
+               st.wYear, st.wMonth, st.wDay);
+    buff[ARRAYSIZE(buff) - 1] = 0;
+    return path + TEXT("\\") + id + buff;
+}
+
+// Day of a segment file of the service, 0 for any other file
+static ULONGLONG ParseSegmentName(const TCHAR* name, const String& id)
+{
+    SYSTEMTIME st;
+    FILETIME ft;
+    unsigned int year, month, day;
+    int length = 0;
+
+    if (_tcsnicmp(name, id.c_str(), id.size()) != 0 ||
+        _stscanf(name + id.size(), TEXT(".%4u%2u%2u%n"), &year, &month,
+                 &day, &length) != 3 || length != 9 ||
+        _tcsicmp(name + id.size() + length, TEXT(".history")) != 0)
+    {
+        return 0;
+    }
+    ZeroMemory(&st, sizeof(st));
+    st.wYear = (WORD)year;
+    st.wMonth = (WORD)month;
+    st.wDay = (WORD)day;
+    if (!SystemTimeToFileTime(&st, &ft))
+    {
+        return 0;
+    }
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static BYTE* PutVarint(BYTE* p, ULONGLONG value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (BYTE)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (BYTE)value;
+    return p;
+}
+
+// Zigzag encoded, so that small decreases stay short too
+static BYTE* PutDelta(BYTE* p, ULONGLONG value, ULONGLONG base)
+{
+    LONGLONG delta = (LONGLONG)(value - base);
+
+    return PutVarint(p, ((ULONGLONG)delta << 1) ^ (ULONGLONG)(delta >> 63));
+}
+
+static bool GetVarint(const BYTE** p, const BYTE* end, ULONGLONG* value)
+{
+    *value = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7)
+    {
+        BYTE b = *(*p)++;
+        *value |= (ULONGLONG)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool GetDelta(const BYTE** p, const BYTE* end, ULONGLONG base,
+                     ULONGLONG* value)
+{
+    ULONGLONG zigzag;
+
+    if (!GetVarint(p, end, &zigzag))
+    {
+        return false;
+    }
+    *value = base + ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+    return true;
+}
+
+HistoryFile::HistoryFile()
+    : m_days(0), m_open(false), m_hFile(INVALID_HANDLE_VALUE),
+      m_hMapping(NULL), m_segment(NULL), m_day(0), m_sinceKey(0),
+      m_key(true)
+{
+    InitializeCriticalSection(&m_lock);
+    ZeroMemory(&m_last, sizeof(m_last));
+}
+
+HistoryFile::~HistoryFile()
+{
+    Close();
+    DeleteCriticalSection(&m_lock);
+}
+
+//
+//   FUNCTION: HistoryFile::Open
+//
+//   PURPOSE: Open the segment of today, where a previous instance of the
+//   wrapper may have left records, and delete the expired ones.
+//
+bool HistoryFile::Open(const String& path, const String& id, DWORD days)
+{
+    FILETIME now;
+    ULONGLONG time;
+    bool result;
+
+    GetSystemTimeAsFileTime(&now);
+    time = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+    EnterCriticalSection(&m_lock);
+    m_path = path;
+    m_id = id;
+    m_days = days > 0 ? days : 1;
+    result = OpenSegment(time - time % HISTORY_DAY);
+    if (result)
+    {
+        DeleteExpired(m_day);
+    }
+    m_open = result;
+    LeaveCriticalSection(&m_lock);
+    return result;
+}
+
+void HistoryFile::Close()
+{
+    EnterCriticalSection(&m_lock);
+    CloseSegment();
+    m_open = false;
+    LeaveCriticalSection(&m_lock);
+}
+
+bool HistoryFile::IsOpen()
+{
+    return m_open;
+}
+
+bool HistoryFile::OpenSegment(ULONGLONG day)
+{
+    String filename = GetSegmentName(m_path, m_id, day);
+    HistorySegment* segment;
+
+    m_hFile = CreateFile(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+                         FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READWRITE, 0,
+                                       HISTORY_SEGMENT_SIZE, NULL);
+    }
+    if (m_hMapping != NULL)
+    {
+        m_segment = (HistorySegment*)MapViewOfFile(m_hMapping, FILE_MAP_WRITE,
+                                                   0, 0, HISTORY_SEGMENT_SIZE);
+    }
+    if (m_segment == NULL)
+    {
+        DWORD dwError = GetLastError();
+        CloseSegment();
+        SetLastError(dwError);
+        return false;
+    }
+    segment = m_segment;
+    // A new file is extended with zeros; a segment of another version or
+    // with a damaged header starts over
+    if (segment->magic != HISTORY_MAGIC || segment->version != HISTORY_VERSION ||
+        segment->start != day || segment->used < 0 ||
+        segment->used > HISTORY_DATA_SIZE ||
+        segment->lastTime >= HISTORY_DAY / 10000)
+    {
+        InterlockedExchange((volatile LONG*)&segment->magic, 0);
+        segment->version = HISTORY_VERSION;
+        segment->start = day;
+        segment->used = 0;
+        segment->indexed = 0;
+        segment->lastTime = 0;
+        InterlockedExchange((volatile LONG*)&segment->magic, HISTORY_MAGIC);
+    }
+    m_day = day;
+    // The deltas of the last instance are unknown, start with a key record
+    ZeroMemory(&m_last, sizeof(m_last));
+    m_last.time = day + (ULONGLONG)segment->lastTime * 10000;
+    m_sinceKey = 0;
+    m_key = true;
+    return true;
+}
+
+void HistoryFile::CloseSegment()
+{
+    if (m_segment != NULL)
+    {
+        FlushViewOfFile(m_segment, 0);
+        UnmapViewOfFile(m_segment);
+        m_segment = NULL;
+    }
+    if (m_hMapping != NULL)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+void HistoryFile::DeleteExpired(ULONGLONG day)
+{
+    WIN32_FIND_DATA data;
+    String pattern = m_path + TEXT("\\") + m_id + TEXT(".*.history");
+    HANDLE hFind = FindFirstFile(pattern.c_str(), &data);
+
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    do
+    {
+        ULONGLONG segmentDay = ParseSegmentName(data.cFileName, m_id);
+        if (segmentDay != 0 && segmentDay + m_days * HISTORY_DAY <= day)
+        {
+            DeleteFile((m_path + TEXT("\\") + data.cFileName).c_str());
+        }
+    } while (FindNextFile(hFind, &data));
+    FindClose(hFind);
+}
+
+//
+//   FUNCTION: HistoryFile::Append
+//
+//   PURPOSE: Encode the record at the end of the segment of its day. The
+//   bytes and the index entry are written before the used size, which
+//   publishes them. Records are not flushed: the mapped pages outlive a
+//   crash of the wrapper.
+//
+bool HistoryFile::Append(const HistoryRecord& record)
+{
+    BYTE buff[HISTORY_RECORD_MAX];
+    BYTE* p = buff;
+    HistoryRecord next = record;
+    HistoryRecord base;
+    ULONGLONG day = record.time - record.time % HISTORY_DAY;
+    LONG used, size, indexed;
+    bool key;
+
+    EnterCriticalSection(&m_lock);
+    // A clock set back stays in the current segment
+    if (m_open && (m_segment == NULL || day > m_day))
+    {
+        CloseSegment();
+        if (OpenSegment(day))
+        {
+            DeleteExpired(day);
+        }
+    }
+    if (m_segment == NULL)
+    {
+        LeaveCriticalSection(&m_lock);
+        return false;
+    }
+    // Times never decrease within a segment, which keeps the index sorted
+    if (record.time > m_last.time)
+    {
+        next.time = record.time - (record.time - m_day) % 10000;
+    }
+    else
+    {
+        next.time = m_last.time;
+    }
+    next.workingSet = record.workingSet / 1024;
+    key = m_key || m_sinceKey >= HISTORY_INDEX_INTERVAL;
+    base = m_last;
+    if (key)
+    {
+        ZeroMemory(&base, sizeof(base));
+        base.time = m_day;
+    }
+    *p++ = (BYTE)(next.kind | (key ? HISTORY_KEY : 0));
+    p = PutVarint(p, (next.time - base.time) / 10000);
+    if (next.kind == HISTORY_SAMPLE)
+    {
+        p = PutDelta(p, next.cpuTime, base.cpuTime);
+        p = PutDelta(p, next.workingSet, base.workingSet);
+        p = PutDelta(p, next.logBytes, base.logBytes);
+        p = PutDelta(p, next.processes, base.processes);
+    }
+    else
+    {
+        p = PutVarint(p, next.value);
+        p = PutVarint(p, next.failed);
+    }
+    size = (LONG)(p - buff);
+    used = m_segment->used;
+    if (used + size > HISTORY_DATA_SIZE)
+    {
+        LeaveCriticalSection(&m_lock);
+        SetLastError(ERROR_DISK_FULL);
+        return false;
+    }
+    CopyMemory(m_segment->data + used, buff, size);
+    m_segment->lastTime = (ULONG)((next.time - m_day) / 10000);
+    indexed = m_segment->indexed;
+    if (key && indexed < HISTORY_INDEX_ENTRIES)
+    {
+        m_segment->index[indexed].time = next.time;
+        m_segment->index[indexed].offset = used;
+        InterlockedExchange(&m_segment->indexed, indexed + 1);
+    }
+    InterlockedExchange(&m_segment->used, used + size);
+    if (next.kind == HISTORY_SAMPLE)
+    {
+        base = next;
+    }
+    base.time = next.time;
+    m_last = base;
+    m_sinceKey = key ? 1 : m_sinceKey + 1;
+    m_key = false;
+    LeaveCriticalSection(&m_lock);
+    return true;
+}
+
+//
+//   FUNCTION: DecodeSegment
+//
+//   PURPOSE: Find the last key record before from in the index and decode
+//   from there until to. Records of the same second as a key may precede
+//   it, so a key at from isn't a start. Index entries of a record still
+//   being written are left out.
+//
+static void DecodeSegment(const HistorySegment* segment, ULONGLONG from,
+                          ULONGLONG to, std::vector<HistoryRecord>* records)
+{
+    LONG used = segment->used;
+    LONG indexed = segment->indexed;
+    LONG low = 0, high;
+    HistoryRecord last, record;
+    ULONGLONG value, failed;
+    const BYTE* p = segment->data;
+    const BYTE* end;
+
+    MemoryBarrier();
+    if (used < 0 || used > HISTORY_DATA_SIZE)
+    {
+        return;
+    }
+    indexed = indexed < 0 ? 0 : indexed;
+    indexed = indexed > HISTORY_INDEX_ENTRIES ? HISTORY_INDEX_ENTRIES : indexed;
+    while (indexed > 0 && segment->index[indexed - 1].offset >= (DWORD)used)
+    {
+        indexed--;
+    }
+    high = indexed;
+    while (low < high)
+    {
+        LONG middle = (low + high) / 2;
+        if (segment->index[middle].time < from)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low > 0)
+    {
+        p += segment->index[low - 1].offset;
+    }
+    end = segment->data + used;
+    ZeroMemory(&last, sizeof(last));
+    last.time = segment->start;
+    while (p < end)
+    {
+        BYTE kind = *p++;
+        if ((kind & HISTORY_KEY) != 0)
+        {
+            ZeroMemory(&last, sizeof(last));
+            last.time = segment->start;
+        }
+        ZeroMemory(&record, sizeof(record));
+        record.kind = kind & ~HISTORY_KEY;
+        if (!GetVarint(&p, end, &value))
+        {
+            break;
+        }
+        record.time = last.time + value * 10000;
+        if (record.kind == HISTORY_SAMPLE)
+        {
+            if (!GetDelta(&p, end, last.cpuTime, &record.cpuTime) ||
+                !GetDelta(&p, end, last.workingSet, &record.workingSet) ||
+                !GetDelta(&p, end, last.logBytes, &record.logBytes) ||
+                !GetDelta(&p, end, last.processes, &value))
+            {
+                break;
+            }
+            record.processes = (DWORD)value;
+            last = record;
+        }
+        else
+        {
+            if (!GetVarint(&p, end, &value) || !GetVarint(&p, end, &failed))
+            {
+                break;
+            }
+            record.value = (DWORD)value;
+            record.failed = (DWORD)failed;
+        }
+        last.time = record.time;
+        if (record.time > to)
+        {
+            break;
+        }
+        if (record.time >= from)
+        {
+            record.workingSet *= 1024;
+            records->push_back(record);
+        }
+    }
+}
+
+static void ReadSegment(const String& filename, ULONGLONG day, ULONGLONG from,
+                        ULONGLONG to, std::vector<HistoryRecord>* records)
+{
+    HANDLE hFile, hMapping = NULL;
+    const HistorySegment* segment = NULL;
+
+    // The wrapper may be writing the segment or deleting it
+    hFile = CreateFile(filename.c_str(), GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    if (GetFileSize(hFile, NULL) == HISTORY_SEGMENT_SIZE)
+    {
+        hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if (hMapping != NULL)
+    {
+        segment = (const HistorySegment*)MapViewOfFile(hMapping, FILE_MAP_READ,
+                                                       0, 0, 0);
+    }
+    if (segment != NULL && segment->magic == HISTORY_MAGIC &&
+        segment->version == HISTORY_VERSION && segment->start == day)
+    {
+        DecodeSegment(segment, from, to, records);
+    }
+    if (segment != NULL)
+    {
+        UnmapViewOfFile(segment);
+    }
+    if (hMapping != NULL)
+    {
+        CloseHandle(hMapping);
+    }
+    CloseHandle(hFile);
+}
+
+bool ReadHistory(const String& path, const String& id, ULONGLONG from,
+                 ULONGLONG to, std::vector<HistoryRecord>* records)
+{
+    WIN32_FIND_DATA data;
+    std::vector<ULONGLONG> days;
+    String pattern = path + TEXT("\\") + id + TEXT(".*.history");
+    HANDLE hFind = FindFirstFile(pattern.c_str(), &data);
+
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    do
+    {
+        ULONGLONG day = ParseSegmentName(data.cFileName, id);
+        if (day != 0 && day + HISTORY_DAY > from && day <= to)
+        {
+            days.push_back(day);
+        }
+    } while (FindNextFile(hFind, &data));
+    FindClose(hFind);
+    std::sort(days.begin(), days.end());
+    for (size_t i = 0; i < days.size(); i++)
+    {
+        ReadSegment(GetSegmentName(path, id, days[i]), days[i], from, to,
+                    records);
+    }
+    return true;
+}
@@ -0,0 +1,103 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "strings.h"
+
+#define HISTORY_MAGIC 0x48535653
+#define HISTORY_VERSION 1
+// A day of samples every HISTORY_INTERVAL takes about a tenth of it
+#define HISTORY_SEGMENT_SIZE (1024 * 1024)
+#define HISTORY_INDEX_ENTRIES 1024
+// Every that many records one is encoded without deltas and indexed
+#define HISTORY_INDEX_INTERVAL 32
+// Time covered by a segment, in FILETIME units
+#define HISTORY_DAY 864000000000ULL
+// Period of the resource samples (ms)
+#define HISTORY_INTERVAL 10000
+
+enum HistoryKind
+{
+    // Resources of the service process, every HISTORY_INTERVAL
+    HISTORY_SAMPLE,
+    // value: state reported to the SCM
+    HISTORY_STATE,
+    // value: pid of the service process started
+    HISTORY_START,
+    // value: exit code, failed: the exit counts as a failed restart
+    HISTORY_EXIT
+};
+
+/**
+ * One entry of the history. Times are FILETIMEs, kept to the millisecond.
+ */
+struct HistoryRecord
+{
+    DWORD kind;
+    ULONGLONG time;
+    // HISTORY_SAMPLE: CPU time of the process tree in ms, working set of
+    // the service process in bytes (kept to the KB), output captured since
+    // the wrapper started in bytes, processes of the tree
+    ULONGLONG cpuTime;
+    ULONGLONG workingSet;
+    ULONGLONG logBytes;
+    DWORD processes;
+    // Other kinds, see HistoryKind
+    DWORD value;
+    DWORD failed;
+};
+
+struct HistorySegment;
+
+/**
+ * Append-only time series of a service, one memory mapped segment file
+ * per UTC day, <path>\<id>.<yyyymmdd>.history, kept for a number of days.
+ *
+ * Records are a kind byte followed by varints: the time and the sample
+ * values are deltas of the previous record. Every HISTORY_INDEX_INTERVAL
+ * records a key record holds absolute values and gets an entry in the
+ * sparse time index of the segment header, where a range query starts to
+ * decode. The used size is published after each record, so a crash of the
+ * wrapper loses at most the record being written.
+ */
+class HistoryFile
+{
+    public:
+        HistoryFile();
+        ~HistoryFile();
+
+        bool Open(const String& path, const String& id, DWORD days);
+        void Close();
+        bool IsOpen();
+        // Rolls over to the segment of the day of the record; false when
+        // that segment is full or can't be opened
+        bool Append(const HistoryRecord& record);
+
+    private:
+        bool OpenSegment(ULONGLONG day);
+        void CloseSegment();
+        // Delete the segments older than m_days days before day
+        void DeleteExpired(ULONGLONG day);
+
+        CRITICAL_SECTION m_lock;
+        String m_path;
+        String m_id;
+        DWORD m_days;
+        bool m_open;
+        HANDLE m_hFile;
+        HANDLE m_hMapping;
+        HistorySegment* m_segment;
+        // Start of the day of the segment
+        ULONGLONG m_day;
+        // Base of the deltas of the next record
+        HistoryRecord m_last;
+        DWORD m_sinceKey;
+        bool m_key;
+};
+
+// Records of the service between from and to, in time order
+bool ReadHistory(const String& path, const String& id, ULONGLONG from,
+                 ULONGLONG to, std::vector<HistoryRecord>* records);
+
+#endif /* _HISTORY_H_ */
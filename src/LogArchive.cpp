@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <compressapi.h>
+#include "LogArchive.h"
+#include "ThreadPool.h"
+#include "Faults.h"
+
+#define LOG_ARCHIVE_ALGORITHM (COMPRESS_ALGORITHM_XPRESS_HUFF | COMPRESS_RAW)
+// Frame kept as it is, compressing it didn't make it smaller
+#define LOG_FRAME_STORED 1
+
+/**
+ * Start of an index, followed by the frames.
+ */
+struct LogArchiveHeader
+{
+    DWORD magic;
+    DWORD version;
+    DWORD algorithm;
+    DWORD reserved;
+};
+
+static bool WriteAll(HANDLE hFile, const void* data, DWORD size)
+{
+    DWORD written = 0;
+
+    return !Faults::Inject(FAULT_FILE) &&
+           WriteFile(hFile, data, size, &written, NULL) && written == size;
+}
+
+static bool ReadAll(HANDLE hFile, void* data, DWORD size)
+{
+    DWORD read = 0;
+
+    return ReadFile(hFile, data, size, &read, NULL) && read == size;
+}
+
+// Directory of filename with its trailing backslash, empty if none
+static String GetDirectory(const String& filename)
+{
+    size_t pos = filename.find_last_of(TEXT('\\'));
+
+    return pos == String::npos ? String() : filename.substr(0, pos + 1);
+}
+
+// Archives of filename, <log>.<time>, oldest first
+static std::vector<String> FindArchives(const String& filename)
+{
+    WIN32_FIND_DATA data;
+    std::vector<String> archives;
+    String directory = GetDirectory(filename);
+    String pattern = filename + TEXT(".*.idx");
+    HANDLE hFind = FindFirstFile(pattern.c_str(), &data);
+
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        return archives;
+    }
+    do
+    {
+        String name = data.cFileName;
+        archives.push_back(directory + name.substr(0, name.size() - 4));
+    } while (FindNextFile(hFind, &data));
+    FindClose(hFind);
+    // The time in the names sorts them
+    std::sort(archives.begin(), archives.end());
+    return archives;
+}
+
+/**
+ * Archive of one rolled log, queued on the thread pool. Deletes itself.
+ */
+class LogArchiveJob
+{
+    public:
+        LogArchiveJob(const String& rolled, const String& filename,
+                      const std::vector<LogMark>& marks, ULONGLONG rollTime,
+                      DWORD keep)
+            : m_rolled(rolled), m_filename(filename), m_marks(marks),
+              m_rollTime(rollTime), m_keep(keep)
+        {
+        }
+
+        void Run(void);
+
+    private:
+        bool Archive();
+        bool WriteFrames(HANDLE hIn, HANDLE hArchive,
+                         COMPRESSOR_HANDLE hCompressor,
+                         std::vector<LogFrame>* frames);
+        bool WriteIndex(const std::vector<LogFrame>& frames);
+        // The byte at offset was written at or after the time returned
+        ULONGLONG GetFirstTime(ULONGLONG offset);
+        // The bytes before offset were written by the time returned
+        ULONGLONG GetLastTime(ULONGLONG offset);
+
+        String m_rolled;
+        String m_filename;
+        std::vector<LogMark> m_marks;
+        ULONGLONG m_rollTime;
+        DWORD m_keep;
+};
+
+void QueueLogArchive(const String& rolled, const String& filename,
+                     const std::vector<LogMark>& marks, ULONGLONG rollTime,
+                     DWORD keep)
+{
+    LogArchiveJob* job = new LogArchiveJob(rolled, filename, marks, rollTime,
+                                           keep);
+
+    CThreadPool::QueueUserWorkItem(&LogArchiveJob::Run, job);
+}
+
+void LogArchiveJob::Run(void)
+{
+    std::vector<String> archives;
+
+    if (Archive())
+    {
+        DeleteFile(m_rolled.c_str());
+    }
+    archives = FindArchives(m_filename);
+    for (size_t i = 0; i + m_keep < archives.size(); i++)
+    {
+        DeleteFile((archives[i] + TEXT(".arc")).c_str());
+        DeleteFile((archives[i] + TEXT(".idx")).c_str());
+    }
+    delete this;
+}
+
+bool LogArchiveJob::Archive()
+{
+    String archive = m_rolled + TEXT(".arc");
+    COMPRESSOR_HANDLE hCompressor = NULL;
+    HANDLE hIn, hArchive;
+    std::vector<LogFrame> frames;
+    bool result;
+
+    hIn = CreateFile(m_rolled.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    hArchive = CreateFile(archive.c_str(), GENERIC_WRITE, 0, NULL,
+                          CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    result = hIn != INVALID_HANDLE_VALUE && hArchive != INVALID_HANDLE_VALUE &&
+             CreateCompressor(LOG_ARCHIVE_ALGORITHM, NULL, &hCompressor) &&
+             WriteFrames(hIn, hArchive, hCompressor, &frames);
+    if (hCompressor != NULL)
+    {
+        CloseCompressor(hCompressor);
+    }
+    if (hIn != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hIn);
+    }
+    if (hArchive != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hArchive);
+    }
+    // Readers only look at archives with an index, it is written last
+    if (!result || !WriteIndex(frames))
+    {
+        DeleteFile(archive.c_str());
+        DeleteFile((m_rolled + TEXT(".idx")).c_str());
+        return false;
+    }
+    return true;
+}
+
+//
+//   FUNCTION: LogArchiveJob::WriteFrames
+//
+//   PURPOSE: Compress the rolled log in frames of up to LOG_FRAME_SIZE,
+//   cut after the last line end within, so that a line only spans frames
+//   when it is longer than one.
+//
+bool LogArchiveJob::WriteFrames(HANDLE hIn, HANDLE hArchive,
+                                COMPRESSOR_HANDLE hCompressor,
+                                std::vector<LogFrame>* frames)
+{
+    std::vector<char> raw(LOG_FRAME_SIZE);
+    std::vector<char> packed(LOG_FRAME_SIZE);
+    ULONGLONG start = 0, offset = 0;
+    size_t pending = 0;
+    bool eof = false;
+
+    while (true)
+    {
+        if (!eof)
+        {
+            DWORD read = 0;
+            if (!ReadFile(hIn, &raw[pending], (DWORD)(raw.size() - pending),
+                          &read, NULL))
+            {
+                return false;
+            }
+            pending += read;
+            eof = pending < raw.size();
+        }
+        if (pending == 0)
+        {
+            return true;
+        }
+        size_t cut = pending;
+        for (size_t i = pending; !eof && i > 0; i--)
+        {
+            if (raw[i - 1] == '\n')
+            {
+                cut = i;
+                break;
+            }
+        }
+        LogFrame frame;
+        SIZE_T size = 0;
+        ZeroMemory(&frame, sizeof(frame));
+        frame.firstTime = GetFirstTime(start);
+        frame.lastTime = GetLastTime(start + cut);
+        frame.offset = offset;
+        frame.rawSize = (DWORD)cut;
+        // A frame that doesn't fit in its own size is stored
+        if (Compress(hCompressor, &raw[0], cut, &packed[0], cut, &size))
+        {
+            frame.size = (DWORD)size;
+        }
+        else if (GetLastError() == ERROR_INSUFFICIENT_BUFFER)
+        {
+            frame.size = (DWORD)cut;
+            frame.flags = LOG_FRAME_STORED;
+        }
+        else
+        {
+            return false;
+        }
+        if (!WriteAll(hArchive, frame.flags == LOG_FRAME_STORED ? &raw[0] : &packed[0],
+                      frame.size))
+        {
+            return false;
+        }
+        frames->push_back(frame);
+        offset += frame.size;
+        start += cut;
+        pending -= cut;
+        memmove(&raw[0], &raw[cut], pending);
+    }
+}
+
+bool LogArchiveJob::WriteIndex(const std::vector<LogFrame>& frames)
+{
+    String index = m_rolled + TEXT(".idx");
+    LogArchiveHeader header;
+    HANDLE hFile;
+    bool result;
+
+    hFile = CreateFile(index.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    ZeroMemory(&header, sizeof(header));
+    header.magic = LOG_ARCHIVE_MAGIC;
+    header.version = LOG_ARCHIVE_VERSION;
+    header.algorithm = LOG_ARCHIVE_ALGORITHM;
+    result = WriteAll(hFile, &header, sizeof(header)) &&
+             (frames.empty() ||
+              WriteAll(hFile, &frames[0], (DWORD)(frames.size() * sizeof(LogFrame))));
+    CloseHandle(hFile);
+    return result;
+}
+
+ULONGLONG LogArchiveJob::GetFirstTime(ULONGLONG offset)
+{
+    ULONGLONG time = m_marks.empty() ? m_rollTime : m_marks[0].time;
+
+    for (size_t i = 0; i < m_marks.size() && m_marks[i].offset <= offset; i++)
+    {
+        time = m_marks[i].time;
+    }
+    return time;
+}
+
+ULONGLONG LogArchiveJob::GetLastTime(ULONGLONG offset)
+{
+    for (size_t i = 0; i < m_marks.size(); i++)
+    {
+        if (m_marks[i].offset >= offset)
+        {
+            return m_marks[i].time;
+        }
+    }
+    return m_rollTime;
+}
+
+/**
+ * Decompression of one frame, queued on the thread pool.
+ */
+class LogFrameJob
+{
+    public:
+        String archive;
+        LogFrame frame;
+        DWORD algorithm;
+        std::vector<char> data;
+        bool result;
+        // Signaled when the last job of a batch is done
+        volatile LONG* pending;
+        HANDLE hDone;
+
+        void Run(void);
+};
+
+void LogFrameJob::Run(void)
+{
+    DECOMPRESSOR_HANDLE hDecompressor = NULL;
+    std::vector<char> packed(frame.size > 0 ? frame.size : 1);
+    LARGE_INTEGER position;
+    SIZE_T size = 0;
+    HANDLE hFile;
+
+    hFile = CreateFile(archive.c_str(), GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    position.QuadPart = frame.offset;
+    result = hFile != INVALID_HANDLE_VALUE &&
+             SetFilePointerEx(hFile, position, NULL, FILE_BEGIN) &&
+             ReadAll(hFile, &packed[0], frame.size);
+    if (result && (frame.flags & LOG_FRAME_STORED) != 0)
+    {
+        packed.resize(frame.size);
+        data.swap(packed);
+    }
+    else if (result)
+    {
+        data.resize(frame.rawSize > 0 ? frame.rawSize : 1);
+        result = CreateDecompressor(algorithm, NULL, &hDecompressor) &&
+                 Decompress(hDecompressor, &packed[0], frame.size, &data[0],
+                            frame.rawSize, &size) &&
+                 size == frame.rawSize;
+        data.resize(frame.rawSize);
+    }
+    if (hDecompressor != NULL)
+    {
+        CloseDecompressor(hDecompressor);
+    }
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hFile);
+    }
+    if (InterlockedDecrement(pending) == 0)
+    {
+        SetEvent(hDone);
+    }
+}
+
+//
+//   FUNCTION: FindFrames
+//
+//   PURPOSE: Add the frames of an archive written between from and to.
+//   Frames are in time order, a binary search skips those ended before
+//   from.
+//
+static void FindFrames(const String& archive, ULONGLONG from, ULONGLONG to,
+                       std::vector<LogFrameJob>* jobs)
+{
+    LogArchiveHeader header;
+    std::vector<LogFrame> frames;
+    LARGE_INTEGER size;
+    size_t low = 0, high;
+    HANDLE hFile;
+
+    hFile = CreateFile((archive + TEXT(".idx")).c_str(), GENERIC_READ,
+                       FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    if (GetFileSizeEx(hFile, &size) && size.QuadPart >= (LONGLONG)sizeof(header) &&
+        ReadAll(hFile, &header, sizeof(header)) &&
+        header.magic == LOG_ARCHIVE_MAGIC && header.version == LOG_ARCHIVE_VERSION)
+    {
+        frames.resize((size_t)((size.QuadPart - sizeof(header)) / sizeof(LogFrame)));
+        if (!frames.empty() &&
+            !ReadAll(hFile, &frames[0], (DWORD)(frames.size() * sizeof(LogFrame))))
+        {
+            frames.clear();
+        }
+    }
+    CloseHandle(hFile);
+    high = frames.size();
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (frames[middle].lastTime < from)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    for (size_t i = low; i < frames.size() && frames[i].firstTime <= to; i++)
+    {
+        LogFrameJob job;
+        job.archive = archive + TEXT(".arc");
+        job.frame = frames[i];
+        job.algorithm = header.algorithm;
+        job.result = false;
+        job.pending = NULL;
+        job.hDone = NULL;
+        jobs->push_back(job);
+    }
+}
+
+//
+//   FUNCTION: ReadLogArchive
+//
+//   PURPOSE: Decompress the frames found in batches of two per processor,
+//   and write each batch in order once all of its frames are done, so
+//   that memory stays bounded whatever the range.
+//
+bool ReadLogArchive(const String& filename, ULONGLONG from, ULONGLONG to,
+                    HANDLE hOutput)
+{
+    std::vector<String> archives = FindArchives(filename);
+    std::vector<LogFrameJob> jobs;
+    SYSTEM_INFO info;
+    volatile LONG pending;
+    HANDLE hDone;
+    size_t batch;
+    DWORD written;
+
+    if (archives.empty())
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return false;
+    }
+    for (size_t i = 0; i < archives.size(); i++)
+    {
+        FindFrames(archives[i], from, to, &jobs);
+    }
+    GetSystemInfo(&info);
+    batch = info.dwNumberOfProcessors > 0 ? 2 * info.dwNumberOfProcessors : 2;
+    hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (hDone == NULL)
+    {
+        return false;
+    }
+    for (size_t first = 0; first < jobs.size(); first += batch)
+    {
+        size_t last = std::min(first + batch, jobs.size());
+        pending = (LONG)(last - first);
+        for (size_t i = first; i < last; i++)
+        {
+            jobs[i].pending = &pending;
+            jobs[i].hDone = hDone;
+            try
+            {
+                CThreadPool::QueueUserWorkItem(&LogFrameJob::Run, &jobs[i]);
+            }
+            catch (DWORD)
+            {
+                jobs[i].Run();
+            }
+        }
+        WaitForSingleObject(hDone, INFINITE);
+        for (size_t i = first; i < last; i++)
+        {
+            if (!jobs[i].result)
+            {
+                CloseHandle(hDone);
+                SetLastError(ERROR_INVALID_DATA);
+                return false;
+            }
+            if (!jobs[i].data.empty() &&
+                !WriteFile(hOutput, &jobs[i].data[0], (DWORD)jobs[i].data.size(),
+                           &written, NULL))
+            {
+                DWORD dwError = GetLastError();
+                CloseHandle(hDone);
+                SetLastError(dwError);
+                return false;
+            }
+            std::vector<char>().swap(jobs[i].data);
+        }
+    }
+    CloseHandle(hDone);
+    return true;
+}
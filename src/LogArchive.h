@@ -0,0 +1,61 @@
+#ifndef _LOGARCHIVE_H_
+#define _LOGARCHIVE_H_
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "strings.h"
+
+#define LOG_ARCHIVE_MAGIC 0x41535653
+#define LOG_ARCHIVE_VERSION 1
+// Output compressed at once, frames are cut at the last line end within
+#define LOG_FRAME_SIZE (256 * 1024)
+// Marks of a log are at least this far apart, in FILETIME units
+#define LOG_MARK_INTERVAL 10000000ULL
+
+/**
+ * Time at which the byte at offset of a log was written.
+ */
+struct LogMark
+{
+    ULONGLONG offset;
+    ULONGLONG time;
+};
+
+/**
+ * Entry of the index of an archive, one per frame. The output of a frame
+ * was written between firstTime and lastTime.
+ */
+struct LogFrame
+{
+    ULONGLONG firstTime;
+    ULONGLONG lastTime;
+    // Of the compressed frame in the archive
+    ULONGLONG offset;
+    DWORD size;
+    DWORD rawSize;
+    DWORD flags;
+    DWORD reserved;
+};
+
+/**
+ * Compress a rolled log, <log>.<time>, into <log>.<time>.arc on a worker
+ * thread. The archive holds independently compressed frames (XPRESS with
+ * Huffman, from the Windows compression API); the sidecar index
+ * <log>.<time>.idx dates each frame with the marks taken while the log
+ * was written. Once both are written the rolled log is deleted, and only
+ * the newest keep archives of the log are kept. A rolled log that can't
+ * be archived stays as it is.
+ */
+void QueueLogArchive(const String& rolled, const String& filename,
+                     const std::vector<LogMark>& marks, ULONGLONG rollTime,
+                     DWORD keep);
+
+/**
+ * Write to hOutput the frames of the archives of filename whose output
+ * was written between from and to, in time order. Frames are found by a
+ * binary search of the indexes and decompressed in parallel.
+ */
+bool ReadLogArchive(const String& filename, ULONGLONG from, ULONGLONG to,
+                    HANDLE hOutput);
+
+#endif /* _LOGARCHIVE_H_ */
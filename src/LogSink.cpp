@@ -0,0 +1,893 @@
+#include "LogSink.h"
+#include "ThreadPool.h"
+#include "Faults.h"
+
+// Size at which a rolling log is moved aside and the number of old files kept
+#define LOG_ROLL_SIZE   (10 * 1024 * 1024)
+#define LOG_ROLL_KEEP   8
+
+// Delay before a lost collector connection is retried
+#define LOG_PIPE_RETRY  5000
+// Time the thread pool gets to start the worker of a queued sink
+#define LOG_QUEUE_START 5000
+
+LogSink::LogSink()
+    : m_bytesWritten(0), m_writeCalls(0), m_bytesDropped(0)
+{
+}
+
+LogSink::~LogSink()
+{
+}
+
+bool LogSink::Open()
+{
+    return true;
+}
+
+void LogSink::Flush()
+{
+}
+
+void LogSink::Close()
+{
+}
+
+ULONGLONG LogSink::BytesWritten()
+{
+    return m_bytesWritten;
+}
+
+ULONGLONG LogSink::WriteCalls()
+{
+    return m_writeCalls;
+}
+
+ULONGLONG LogSink::BytesDropped()
+{
+    return m_bytesDropped;
+}
+
+bool LogSink::Persistent()
+{
+    return true;
+}
+
+FileLogSink::FileLogSink(const String& filename, const String& mode,
+                         DWORD batchSize)
+    : m_hFile(INVALID_HANDLE_VALUE), m_filename(filename), m_mode(mode),
+      m_batchSize(batchSize), m_fileSize(0),
+      m_archive(_tcsicmp(mode.c_str(), TEXT("archive")) == 0)
+{
+    InitializeCriticalSection(&m_lock);
+    m_batch.reserve(m_batchSize);
+}
+
+FileLogSink::~FileLogSink()
+{
+    Close();
+    DeleteCriticalSection(&m_lock);
+}
+
+bool FileLogSink::Open()
+{
+    if (_tcsicmp(m_mode.c_str(), TEXT("none")) == 0)
+    {
+        return true;
+    }
+    DWORD disposition = OPEN_ALWAYS;
+    if (_tcsicmp(m_mode.c_str(), TEXT("reset")) == 0)
+    {
+        disposition = CREATE_ALWAYS;
+    }
+    m_hFile = CreateFile(m_filename.c_str(), FILE_APPEND_DATA,
+                         FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                         disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(m_hFile, &size))
+    {
+        m_fileSize = size.QuadPart;
+    }
+    // Output of an earlier run is dated by the last write of the file
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (m_archive && m_fileSize > 0 && m_marks.empty() &&
+        GetFileAttributesEx(m_filename.c_str(), GetFileExInfoStandard, &data))
+    {
+        LogMark mark;
+        mark.offset = 0;
+        mark.time = ((ULONGLONG)data.ftLastWriteTime.dwHighDateTime << 32) |
+                    data.ftLastWriteTime.dwLowDateTime;
+        m_marks.push_back(mark);
+    }
+    return true;
+}
+
+void FileLogSink::Write(const LogBuffer& buffer)
+{
+    EnterCriticalSection(&m_lock);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        if (m_batch.size() + buffer->size() > m_batchSize)
+        {
+            FlushLocked();
+        }
+        m_batch.insert(m_batch.end(), buffer->begin(), buffer->end());
+        if (m_batch.size() >= m_batchSize)
+        {
+            FlushLocked();
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void FileLogSink::Flush()
+{
+    EnterCriticalSection(&m_lock);
+    FlushLocked();
+    LeaveCriticalSection(&m_lock);
+}
+
+void FileLogSink::Close()
+{
+    EnterCriticalSection(&m_lock);
+    FlushLocked();
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void FileLogSink::FlushLocked()
+{
+    if (m_batch.empty() || m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    if (m_archive)
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        LogMark mark;
+        mark.offset = m_fileSize;
+        mark.time = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+        if (m_marks.empty() || mark.time >= m_marks.back().time + LOG_MARK_INTERVAL)
+        {
+            m_marks.push_back(mark);
+        }
+    }
+    DWORD written = 0;
+    if (!Faults::Inject(FAULT_FILE))
+    {
+        WriteFile(m_hFile, &m_batch[0], (DWORD)m_batch.size(), &written, NULL);
+    }
+    m_writeCalls++;
+    m_bytesWritten += written;
+    m_fileSize += written;
+    m_batch.clear();
+    if (m_fileSize >= LOG_ROLL_SIZE && m_archive)
+    {
+        ArchiveLocked();
+    }
+    else if (m_fileSize >= LOG_ROLL_SIZE &&
+             _tcsicmp(m_mode.c_str(), TEXT("roll")) == 0)
+    {
+        RollLocked();
+    }
+}
+
+void FileLogSink::RollLocked()
+{
+    TCHAR from[MAX_PATH + 16];
+    TCHAR to[MAX_PATH + 16];
+
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+    for (int i = LOG_ROLL_KEEP - 1; i > 0; i--)
+    {
+        _sntprintf(from, ARRAYSIZE(from), TEXT("%s.%d"), m_filename.c_str(), i);
+        _sntprintf(to, ARRAYSIZE(to), TEXT("%s.%d"), m_filename.c_str(), i + 1);
+        MoveFileEx(from, to, MOVEFILE_REPLACE_EXISTING);
+    }
+    _sntprintf(to, ARRAYSIZE(to), TEXT("%s.1"), m_filename.c_str());
+    MoveFileEx(m_filename.c_str(), to, MOVEFILE_REPLACE_EXISTING);
+    m_hFile = CreateFile(m_filename.c_str(), FILE_APPEND_DATA,
+                         FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    m_fileSize = 0;
+}
+
+//
+//   FUNCTION: FileLogSink::ArchiveLocked
+//
+//   PURPOSE: Move the log aside under the UTC time of the roll, which sorts
+//   the archives, and leave the compression to a worker thread so that the
+//   pump isn't held by it. If the log can't be moved it keeps growing, with
+//   its marks, until the next try.
+//
+void FileLogSink::ArchiveLocked()
+{
+    TCHAR to[MAX_PATH + 32];
+    DWORD disposition = OPEN_ALWAYS;
+    SYSTEMTIME st;
+    FILETIME now;
+
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+    GetSystemTimeAsFileTime(&now);
+    FileTimeToSystemTime(&now, &st);
+    _sntprintf(to, ARRAYSIZE(to), TEXT("%s.%04u%02u%02uT%02u%02u%02u%03u"),
+               m_filename.c_str(), st.wYear, st.wMonth, st.wDay, st.wHour,
+               st.wMinute, st.wSecond, st.wMilliseconds);
+    to[ARRAYSIZE(to) - 1] = 0;
+    if (MoveFileEx(m_filename.c_str(), to, 0))
+    {
+        QueueLogArchive(to, m_filename, m_marks,
+                        ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime,
+                        LOG_ROLL_KEEP);
+        m_marks.clear();
+        disposition = CREATE_ALWAYS;
+        m_fileSize = 0;
+    }
+    m_hFile = CreateFile(m_filename.c_str(), FILE_APPEND_DATA,
+                         FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                         disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+TailLogSink::TailLogSink(DWORD size)
+    : m_ring(size > 0 ? size : 1), m_pos(0), m_full(false)
+{
+    InitializeCriticalSection(&m_lock);
+}
+
+TailLogSink::~TailLogSink()
+{
+    DeleteCriticalSection(&m_lock);
+}
+
+void TailLogSink::Write(const LogBuffer& buffer)
+{
+    const char* data = &(*buffer)[0];
+    size_t size = buffer->size();
+
+    EnterCriticalSection(&m_lock);
+    if (size >= m_ring.size())
+    {
+        data += size - m_ring.size();
+        size = m_ring.size();
+    }
+    while (size > 0)
+    {
+        size_t count = m_ring.size() - m_pos;
+        if (count > size)
+        {
+            count = size;
+        }
+        memcpy(&m_ring[m_pos], data, count);
+        data += count;
+        size -= count;
+        m_pos += count;
+        if (m_pos == m_ring.size())
+        {
+            m_pos = 0;
+            m_full = true;
+        }
+    }
+    m_writeCalls++;
+    m_bytesWritten += buffer->size();
+    LeaveCriticalSection(&m_lock);
+}
+
+bool TailLogSink::Persistent()
+{
+    return false;
+}
+
+std::string TailLogSink::Snapshot()
+{
+    std::string result;
+
+    EnterCriticalSection(&m_lock);
+    if (m_full)
+    {
+        result.assign(m_ring.begin() + m_pos, m_ring.end());
+    }
+    result.append(m_ring.begin(), m_ring.begin() + m_pos);
+    LeaveCriticalSection(&m_lock);
+    return result;
+}
+
+PipeLogSink::PipeLogSink(const String& pipename)
+    : m_hPipe(INVALID_HANDLE_VALUE), m_pipename(pipename), m_nextConnect(0)
+{
+}
+
+PipeLogSink::~PipeLogSink()
+{
+    Close();
+}
+
+bool PipeLogSink::Connect()
+{
+    if (m_hPipe != INVALID_HANDLE_VALUE)
+    {
+        return true;
+    }
+    ULONGLONG now = GetTickCount64();
+    if (now < m_nextConnect)
+    {
+        return false;
+    }
+    m_hPipe = CreateFile(m_pipename.c_str(), GENERIC_WRITE, 0, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hPipe == INVALID_HANDLE_VALUE)
+    {
+        m_nextConnect = now + LOG_PIPE_RETRY;
+        return false;
+    }
+    return true;
+}
+
+void PipeLogSink::Write(const LogBuffer& buffer)
+{
+    DWORD written = 0;
+
+    if (!Connect())
+    {
+        m_bytesDropped += buffer->size();
+        return;
+    }
+    if (Faults::Inject(FAULT_WRITE) ||
+        !WriteFile(m_hPipe, &(*buffer)[0], (DWORD)buffer->size(), &written,
+                   NULL))
+    {
+        m_bytesDropped += buffer->size();
+        Close();
+        m_nextConnect = GetTickCount64() + LOG_PIPE_RETRY;
+        return;
+    }
+    m_writeCalls++;
+    m_bytesWritten += written;
+}
+
+void PipeLogSink::Close()
+{
+    if (m_hPipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hPipe);
+        m_hPipe = INVALID_HANDLE_VALUE;
+    }
+}
+
+/**
+ * Thread pool item starting the worker of a queued sink. Open and the item
+ * share it, so that Open can give up on a pool too busy to run the item:
+ * whichever side sets the state first decides whether the worker runs, and
+ * the last one to release it deletes it.
+ */
+class QueuedLogStart
+{
+    public:
+        QueuedLogStart(QueuedLogSink* sink)
+            : m_sink(sink), m_state(0), m_refs(2)
+        {
+        }
+
+        void Run(void);
+        // false when the worker already started
+        bool Abandon();
+        void Release();
+
+    private:
+        QueuedLogSink* m_sink;
+        volatile LONG m_state;
+        volatile LONG m_refs;
+};
+
+void QueuedLogStart::Run(void)
+{
+    if (InterlockedCompareExchange(&m_state, 1, 0) == 0)
+    {
+        m_sink->Run();
+    }
+    Release();
+}
+
+bool QueuedLogStart::Abandon()
+{
+    return InterlockedCompareExchange(&m_state, 2, 0) == 0;
+}
+
+void QueuedLogStart::Release()
+{
+    if (InterlockedDecrement(&m_refs) == 0)
+    {
+        delete this;
+    }
+}
+
+QueuedLogSink::QueuedLogSink(LogSink* sink, const String& backpressure,
+                             DWORD queueSize)
+    : m_sink(sink), m_hDone(NULL), m_hStarted(NULL), m_hThread(NULL),
+      m_queued(0), m_queueSize(queueSize), m_flush(false), m_closing(false)
+{
+    m_block = _tcsicmp(backpressure.c_str(), TEXT("block")) == 0;
+    InitializeCriticalSection(&m_lock);
+    InitializeConditionVariable(&m_changed);
+}
+
+QueuedLogSink::~QueuedLogSink()
+{
+    Close();
+    delete m_sink;
+    DeleteCriticalSection(&m_lock);
+}
+
+bool QueuedLogSink::Open()
+{
+    if (!m_sink->Open())
+    {
+        return false;
+    }
+    m_hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hDone == NULL)
+    {
+        return false;
+    }
+    m_hStarted = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hStarted == NULL)
+    {
+        CloseHandle(m_hDone);
+        m_hDone = NULL;
+        return false;
+    }
+    QueuedLogStart* start = new QueuedLogStart(this);
+    CThreadPool::QueueUserWorkItem(&QueuedLogStart::Run, start);
+    // The worker publishes its thread handle before taking buffers. A pool
+    // saturated by detached pumps must not hang the start of the service.
+    if (WaitForSingleObject(m_hStarted, LOG_QUEUE_START) == WAIT_TIMEOUT &&
+        start->Abandon())
+    {
+        start->Release();
+        CloseHandle(m_hStarted);
+        CloseHandle(m_hDone);
+        m_hStarted = NULL;
+        m_hDone = NULL;
+        m_sink->Close();
+        SetLastError(ERROR_TIMEOUT);
+        return false;
+    }
+    WaitForSingleObject(m_hStarted, INFINITE);
+    start->Release();
+    CloseHandle(m_hStarted);
+    m_hStarted = NULL;
+    return true;
+}
+
+void QueuedLogSink::Write(const LogBuffer& buffer)
+{
+    EnterCriticalSection(&m_lock);
+    if (m_block)
+    {
+        while (!m_closing && !m_queue.empty() &&
+               m_queued + buffer->size() > m_queueSize)
+        {
+            SleepConditionVariableCS(&m_changed, &m_lock, INFINITE);
+        }
+    }
+    if (m_closing ||
+        (!m_queue.empty() && m_queued + buffer->size() > m_queueSize))
+    {
+        m_bytesDropped += buffer->size();
+    }
+    else
+    {
+        m_queue.push_back(buffer);
+        m_queued += buffer->size();
+        WakeAllConditionVariable(&m_changed);
+    }
+    LeaveCriticalSection(&m_lock);
+}
+
+void QueuedLogSink::Flush()
+{
+    EnterCriticalSection(&m_lock);
+    m_flush = true;
+    WakeAllConditionVariable(&m_changed);
+    LeaveCriticalSection(&m_lock);
+}
+
+void QueuedLogSink::Close()
+{
+    DWORD timeout = 5000;
+
+    if (m_hDone == NULL)
+    {
+        return;
+    }
+    EnterCriticalSection(&m_lock);
+    m_closing = true;
+    WakeAllConditionVariable(&m_changed);
+    LeaveCriticalSection(&m_lock);
+    // A sink stuck in a write (collector not reading) must not hold the
+    // stop, cancel the blocking call and let the worker drain the queue.
+    if (WaitForSingleObject(m_hDone, timeout) == WAIT_TIMEOUT)
+    {
+        CancelSynchronousIo(m_hThread);
+        WaitForSingleObject(m_hDone, INFINITE);
+    }
+    m_sink->Close();
+    CloseHandle(m_hThread);
+    CloseHandle(m_hDone);
+    m_hThread = NULL;
+    m_hDone = NULL;
+}
+
+ULONGLONG QueuedLogSink::BytesWritten()
+{
+    return m_sink->BytesWritten();
+}
+
+ULONGLONG QueuedLogSink::WriteCalls()
+{
+    return m_sink->WriteCalls();
+}
+
+ULONGLONG QueuedLogSink::BytesDropped()
+{
+    return m_bytesDropped + m_sink->BytesDropped();
+}
+
+bool QueuedLogSink::Persistent()
+{
+    return m_sink->Persistent();
+}
+
+void QueuedLogSink::Run(void)
+{
+    DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
+                    GetCurrentProcess(), &m_hThread, 0, FALSE,
+                    DUPLICATE_SAME_ACCESS);
+    SetEvent(m_hStarted);
+    EnterCriticalSection(&m_lock);
+    while (true)
+    {
+        if (!m_queue.empty())
+        {
+            LogBuffer buffer = m_queue.front();
+            m_queue.pop_front();
+            m_queued -= buffer->size();
+            WakeAllConditionVariable(&m_changed);
+            LeaveCriticalSection(&m_lock);
+            m_sink->Write(buffer);
+            EnterCriticalSection(&m_lock);
+        }
+        else if (m_flush)
+        {
+            m_flush = false;
+            LeaveCriticalSection(&m_lock);
+            m_sink->Flush();
+            EnterCriticalSection(&m_lock);
+        }
+        else if (m_closing)
+        {
+            break;
+        }
+        else
+        {
+            SleepConditionVariableCS(&m_changed, &m_lock, INFINITE);
+        }
+    }
+    LeaveCriticalSection(&m_lock);
+    m_sink->Flush();
+    SetEvent(m_hDone);
+}
+
+LogFanout::LogFanout()
+    : m_tail(NULL), m_bytesReceived(0), m_refs(1)
+{
+}
+
+LogFanout::~LogFanout()
+{
+    std::vector<LogSink*>::iterator it;
+
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        delete *it;
+    }
+}
+
+void LogFanout::Add(LogSink* sink)
+{
+    m_sinks.push_back(sink);
+    if (m_tail == NULL)
+    {
+        m_tail = dynamic_cast<TailLogSink*>(sink);
+    }
+}
+
+bool LogFanout::Empty()
+{
+    return m_sinks.empty();
+}
+
+TailLogSink* LogFanout::Tail()
+{
+    return m_tail;
+}
+
+bool LogFanout::Open()
+{
+    std::vector<LogSink*>::iterator it;
+
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        if (!(*it)->Open())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LogFanout::Write(const LogBuffer& buffer)
+{
+    std::vector<LogSink*>::iterator it;
+
+    InterlockedExchangeAdd64(&m_bytesReceived, (LONGLONG)buffer->size());
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        (*it)->Write(buffer);
+    }
+}
+
+void LogFanout::Flush()
+{
+    std::vector<LogSink*>::iterator it;
+
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        (*it)->Flush();
+    }
+}
+
+void LogFanout::Close()
+{
+    std::vector<LogSink*>::iterator it;
+
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        (*it)->Close();
+    }
+}
+
+ULONGLONG LogFanout::BytesWritten()
+{
+    ULONGLONG total = 0;
+    std::vector<LogSink*>::iterator it;
+
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        if ((*it)->Persistent())
+        {
+            total += (*it)->BytesWritten();
+        }
+    }
+    return total;
+}
+
+ULONGLONG LogFanout::BytesReceived()
+{
+    // A plain 64-bit read may tear on x86
+    return (ULONGLONG)InterlockedCompareExchange64(&m_bytesReceived, 0, 0);
+}
+
+void LogFanout::AddRef()
+{
+    InterlockedIncrement(&m_refs);
+}
+
+void LogFanout::Release()
+{
+    if (InterlockedDecrement(&m_refs) == 0)
+    {
+        delete this;
+    }
+}
+
+ULONGLONG LogFanout::WriteCalls()
+{
+    ULONGLONG total = 0;
+    std::vector<LogSink*>::iterator it;
+
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        if ((*it)->Persistent())
+        {
+            total += (*it)->WriteCalls();
+        }
+    }
+    return total;
+}
+
+ULONGLONG LogFanout::BytesDropped()
+{
+    ULONGLONG total = 0;
+    std::vector<LogSink*>::iterator it;
+
+    for (it = m_sinks.begin(); it != m_sinks.end(); it++)
+    {
+        total += (*it)->BytesDropped();
+    }
+    return total;
+}
+
+LogPump::LogPump(HANDLE hPipe, LogSink* sink, DurationHistogram* latency)
+    : m_hPipe(hPipe), m_hThread(NULL), m_sink(sink), m_latency(latency),
+      m_release(false), m_reading(false), m_done(false), m_owned(NULL)
+{
+    m_hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hDone == NULL)
+    {
+        throw GetLastError();
+    }
+    InitializeCriticalSection(&m_lock);
+}
+
+LogPump::~LogPump()
+{
+    if (m_hThread != NULL)
+    {
+        CloseHandle(m_hThread);
+    }
+    DeleteCriticalSection(&m_lock);
+    CloseHandle(m_hDone);
+}
+
+void LogPump::Run(void)
+{
+    char buff[16 * 1024];
+    DWORD bytesRead, available;
+    ULONGLONG start = 0;
+    BOOL result;
+
+    EnterCriticalSection(&m_lock);
+    DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
+                    GetCurrentProcess(), &m_hThread, 0, FALSE,
+                    DUPLICATE_SAME_ACCESS);
+    LeaveCriticalSection(&m_lock);
+    while (!m_release)
+    {
+        EnterCriticalSection(&m_lock);
+        m_reading = true;
+        LeaveCriticalSection(&m_lock);
+        result = !Faults::Inject(FAULT_READ) &&
+                 ReadFile(m_hPipe, buff, sizeof(buff), &bytesRead, NULL);
+        EnterCriticalSection(&m_lock);
+        m_reading = false;
+        LeaveCriticalSection(&m_lock);
+        if (!result)
+        {
+            break;
+        }
+        if (bytesRead == 0)
+        {
+            continue;
+        }
+        if (m_latency != NULL)
+        {
+            start = GetMicroseconds();
+        }
+        // One buffer per read, shared by every sink of the stream
+        m_sink->Write(LogBuffer(new std::vector<char>(buff, buff + bytesRead)));
+        // Keep batching while the child is still producing output and write
+        // the batch out as soon as the pipe runs dry.
+        if (!PeekNamedPipe(m_hPipe, NULL, 0, NULL, &available, NULL) ||
+            available == 0)
+        {
+            m_sink->Flush();
+        }
+        if (m_latency != NULL)
+        {
+            m_latency->Add(GetMicroseconds() - start);
+        }
+    }
+    m_sink->Flush();
+    if (!m_release)
+    {
+        CloseHandle(m_hPipe);
+        m_hPipe = NULL;
+    }
+    EnterCriticalSection(&m_lock);
+    m_done = true;
+    LogFanout* owned = m_owned;
+    LeaveCriticalSection(&m_lock);
+    SetEvent(m_hDone);
+    // Nobody waits for a detached pump
+    if (owned != NULL)
+    {
+        owned->Release();
+        delete this;
+    }
+}
+
+BOOL LogPump::WaitDone(DWORD timeout)
+{
+    return WaitForSingleObject(m_hDone, timeout) == WAIT_OBJECT_0;
+}
+
+//
+//   FUNCTION: LogPump::Release
+//
+//   PURPOSE: Interrupt a ReadFile blocked on a quiet pipe. The cancel is
+//   only issued while the pump is reading, so it never hits a sink write
+//   done on the pump thread.
+//
+HANDLE LogPump::Release()
+{
+    HANDLE hPipe;
+
+    m_release = true;
+    while (!WaitDone(10))
+    {
+        EnterCriticalSection(&m_lock);
+        if (m_reading && m_hThread != NULL)
+        {
+            CancelSynchronousIo(m_hThread);
+        }
+        LeaveCriticalSection(&m_lock);
+    }
+    hPipe = m_hPipe;
+    m_hPipe = NULL;
+    return hPipe;
+}
+
+//
+//   FUNCTION: LogPump::Detach
+//
+//   PURPOSE: Hand a pump whose pipe is kept open by a grandchild its own
+//   reference on the sink, so that the sink outlives the service's
+//   reference. The pump keeps draining the pipe into the sink, closed by
+//   then, and frees both when the pipe breaks.
+//
+bool LogPump::Detach(LogFanout* sink)
+{
+    bool detached;
+
+    EnterCriticalSection(&m_lock);
+    detached = !m_done;
+    if (detached)
+    {
+        sink->AddRef();
+        m_owned = sink;
+    }
+    LeaveCriticalSection(&m_lock);
+    return detached;
+}
+
+bool CreateCapturePipe(HANDLE* hRead, HANDLE* hWrite)
+{
+    SECURITY_ATTRIBUTES sa;
+
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+    if (!CreatePipe(hRead, hWrite, &sa, 0))
+    {
+        return false;
+    }
+    // Only the child end may be inherited
+    if (!SetHandleInformation(*hRead, HANDLE_FLAG_INHERIT, 0))
+    {
+        CloseHandle(*hRead);
+        CloseHandle(*hWrite);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,252 @@
+#ifndef _LOGSINK_H_
+#define _LOGSINK_H_
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include "strings.h"
+#include "Histogram.h"
+#include "LogArchive.h"
+
+/**
+ * Chunk of child output shared by every sink of a stream. Sinks that need
+ * to keep the data around hold a reference instead of copying it.
+ */
+typedef std::shared_ptr<const std::vector<char> > LogBuffer;
+
+/**
+ * Destination of captured child output.
+ */
+class LogSink
+{
+    public:
+        LogSink();
+        virtual ~LogSink();
+
+        virtual bool Open();
+        virtual void Write(const LogBuffer& buffer) = 0;
+        virtual void Flush();
+        virtual void Close();
+
+        virtual ULONGLONG BytesWritten();
+        virtual ULONGLONG WriteCalls();
+        virtual ULONGLONG BytesDropped();
+        // Delivers the output somewhere, false for a sink that only looks
+        // at it in memory
+        virtual bool Persistent();
+
+    protected:
+        ULONGLONG m_bytesWritten;
+        ULONGLONG m_writeCalls;
+        ULONGLONG m_bytesDropped;
+};
+
+/**
+ * Writes captured child output to a log file.
+ *
+ * Chunks read from the capture pipe are appended to an in-memory batch
+ * that is written with a single WriteFile call when it fills up or when
+ * the pipe has nothing else pending, so a chatty child costs one write per
+ * batch instead of one write per chunk.
+ *
+ * mode: append (default), reset, roll, archive or none. archive rolls like
+ * roll, but rolled logs are compressed and indexed by time, see
+ * QueueLogArchive.
+ */
+class FileLogSink : public LogSink
+{
+    public:
+        FileLogSink(const String& filename, const String& mode,
+                    DWORD batchSize = 64 * 1024);
+        virtual ~FileLogSink();
+
+        virtual bool Open();
+        virtual void Write(const LogBuffer& buffer);
+        virtual void Flush();
+        virtual void Close();
+
+    private:
+        void FlushLocked();
+        void RollLocked();
+        void ArchiveLocked();
+
+        CRITICAL_SECTION m_lock;
+        HANDLE m_hFile;
+        String m_filename;
+        String m_mode;
+        std::vector<char> m_batch;
+        DWORD m_batchSize;
+        ULONGLONG m_fileSize;
+        bool m_archive;
+        // Times of the output of the log, for the index of its archive
+        std::vector<LogMark> m_marks;
+};
+
+/**
+ * Keeps the last bytes written by the child in memory.
+ */
+class TailLogSink : public LogSink
+{
+    public:
+        TailLogSink(DWORD size);
+        virtual ~TailLogSink();
+
+        virtual void Write(const LogBuffer& buffer);
+        virtual bool Persistent();
+
+        // Oldest to newest copy of the retained output
+        std::string Snapshot();
+
+    private:
+        CRITICAL_SECTION m_lock;
+        std::vector<char> m_ring;
+        size_t m_pos;
+        bool m_full;
+};
+
+/**
+ * Forwards child output to a local log collector listening on a named pipe.
+ * A broken connection is retried on the next write.
+ */
+class PipeLogSink : public LogSink
+{
+    public:
+        PipeLogSink(const String& pipename);
+        virtual ~PipeLogSink();
+
+        virtual void Write(const LogBuffer& buffer);
+        virtual void Close();
+
+    private:
+        bool Connect();
+
+        HANDLE m_hPipe;
+        String m_pipename;
+        ULONGLONG m_nextConnect;
+};
+
+/**
+ * Decouples a sink from the capture pipe. Buffers are queued by reference
+ * and written by a worker thread, so a slow sink only stalls its own queue.
+ *
+ * backpressure: block waits for queue space, drop discards the new buffer
+ * when the queue is full. Open fails with ERROR_TIMEOUT when the thread
+ * pool doesn't start the worker in time.
+ */
+class QueuedLogSink : public LogSink
+{
+    public:
+        QueuedLogSink(LogSink* sink, const String& backpressure,
+                      DWORD queueSize);
+        virtual ~QueuedLogSink();
+
+        virtual bool Open();
+        virtual void Write(const LogBuffer& buffer);
+        virtual void Flush();
+        virtual void Close();
+
+        virtual ULONGLONG BytesWritten();
+        virtual ULONGLONG WriteCalls();
+        virtual ULONGLONG BytesDropped();
+        virtual bool Persistent();
+
+        void Run(void);
+
+    private:
+        LogSink* m_sink;
+        CRITICAL_SECTION m_lock;
+        CONDITION_VARIABLE m_changed;
+        HANDLE m_hDone;
+        HANDLE m_hStarted;
+        HANDLE m_hThread;
+        std::deque<LogBuffer> m_queue;
+        size_t m_queued;
+        size_t m_queueSize;
+        bool m_block;
+        bool m_flush;
+        bool m_closing;
+};
+
+/**
+ * Delivers every buffer of one stream to all of its sinks.
+ */
+class LogFanout : public LogSink
+{
+    public:
+        LogFanout();
+        virtual ~LogFanout();
+
+        void Add(LogSink* sink);
+        bool Empty();
+        // First tail sink of the stream or NULL
+        TailLogSink* Tail();
+
+        virtual bool Open();
+        virtual void Write(const LogBuffer& buffer);
+        virtual void Flush();
+        virtual void Close();
+
+        // Bytes and writes of the persistent sinks only, the tail and the
+        // triggers see every byte again
+        virtual ULONGLONG BytesWritten();
+        virtual ULONGLONG WriteCalls();
+        virtual ULONGLONG BytesDropped();
+        // Output of the stream, counted once whatever the number of sinks
+        ULONGLONG BytesReceived();
+
+        // The creator holds the first reference, a detached pump another
+        // one; the last Release deletes the fanout
+        void AddRef();
+        void Release();
+
+    private:
+        std::vector<LogSink*> m_sinks;
+        TailLogSink* m_tail;
+        // Added by the pumps, read by the history thread
+        volatile LONGLONG m_bytesReceived;
+        volatile LONG m_refs;
+};
+
+/**
+ * Reads one capture pipe until the child closes it and feeds a LogSink.
+ *
+ * Run is queued on the thread pool; the done event is signaled when the
+ * pipe is broken and every pending byte reached the sink.
+ */
+class LogPump
+{
+    public:
+        // latency: gets the time taken by the sink for each chunk, in
+        // microseconds; may be NULL
+        LogPump(HANDLE hPipe, LogSink* sink, DurationHistogram* latency = NULL);
+        ~LogPump();
+
+        void Run(void);
+        BOOL WaitDone(DWORD timeout);
+        // Stop reading and return the pipe still open. Bytes already read
+        // reach the sink, the rest stays in the pipe for the next reader.
+        HANDLE Release();
+        // Leave the pump running on its own, it releases sink and deletes
+        // itself once the pipe breaks. false when it is already done.
+        bool Detach(LogFanout* sink);
+
+    private:
+        HANDLE m_hPipe;
+        HANDLE m_hDone;
+        HANDLE m_hThread;
+        LogSink* m_sink;
+        DurationHistogram* m_latency;
+        CRITICAL_SECTION m_lock;
+        volatile bool m_release;
+        bool m_reading;
+        bool m_done;
+        LogFanout* m_owned;
+};
+
+/**
+ * Create a pipe whose write end can be inherited by a child process.
+ */
+bool CreateCapturePipe(HANDLE* hRead, HANDLE* hWrite);
+
+#endif /* _LOGSINK_H_ */
@@ -0,0 +1,206 @@
+#include <winsock2.h>
+#include <ntsecapi.h>
+#include <vector>
+#include "NotifySocket.h"
+#include "ThreadPool.h"
+
+NotifySocket::NotifySocket(NotifyHandler* handler)
+    : m_handler(handler), m_socket(INVALID_SOCKET), m_hEvent(NULL),
+      m_hClose(NULL), m_hDone(NULL), m_port(0), m_rejected(0)
+{
+    m_token[0] = 0;
+}
+
+NotifySocket::~NotifySocket()
+{
+    Close();
+}
+
+bool NotifySocket::Open(USHORT port, const char* token)
+{
+    WSADATA wsaData;
+    struct sockaddr_in addr;
+    int addrlen = sizeof(addr);
+    BYTE random[NOTIFY_TOKEN_LENGTH / 2];
+
+    // A token read from a state file ends where it should or is ignored
+    if (token != NULL &&
+        memchr(token, 0, NOTIFY_TOKEN_LENGTH + 1) == token + NOTIFY_TOKEN_LENGTH)
+    {
+        strcpy(m_token, token);
+    }
+    else if (RtlGenRandom(random, sizeof(random)))
+    {
+        for (int i = 0; i < (int)sizeof(random); i++)
+        {
+            sprintf(m_token + 2 * i, "%02x", random[i]);
+        }
+    }
+    else
+    {
+        return false;
+    }
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        return false;
+    }
+    m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (m_socket == INVALID_SOCKET)
+    {
+        WSACleanup();
+        return false;
+    }
+    ZeroMemory(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    m_hEvent = WSACreateEvent();
+    m_hClose = CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (bind(m_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        getsockname(m_socket, (struct sockaddr*)&addr, &addrlen) == SOCKET_ERROR ||
+        m_hEvent == NULL || m_hClose == NULL || m_hDone == NULL ||
+        WSAEventSelect(m_socket, m_hEvent, FD_READ) == SOCKET_ERROR)
+    {
+        DWORD dwError = WSAGetLastError();
+        Close();
+        SetLastError(dwError);
+        return false;
+    }
+    m_port = ntohs(addr.sin_port);
+    CThreadPool::QueueUserWorkItem(&NotifySocket::Run, this);
+    return true;
+}
+
+void NotifySocket::Close()
+{
+    if (m_socket == INVALID_SOCKET)
+    {
+        return;
+    }
+    if (m_port != 0)
+    {
+        SetEvent(m_hClose);
+        WaitForSingleObject(m_hDone, INFINITE);
+    }
+    closesocket(m_socket);
+    m_socket = INVALID_SOCKET;
+    if (m_hEvent)
+    {
+        WSACloseEvent(m_hEvent);
+        m_hEvent = NULL;
+    }
+    if (m_hClose)
+    {
+        CloseHandle(m_hClose);
+        m_hClose = NULL;
+    }
+    if (m_hDone)
+    {
+        CloseHandle(m_hDone);
+        m_hDone = NULL;
+    }
+    m_port = 0;
+    WSACleanup();
+}
+
+String NotifySocket::Address()
+{
+    TCHAR buff[32];
+
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("127.0.0.1:%u"), (UINT)m_port);
+    return buff;
+}
+
+USHORT NotifySocket::Port()
+{
+    return m_port;
+}
+
+const char* NotifySocket::Token()
+{
+    return m_token;
+}
+
+LONG NotifySocket::Rejected()
+{
+    return m_rejected;
+}
+
+void NotifySocket::Run(void)
+{
+    char buff[4096];
+    const HANDLE events[2] =
+    {
+        m_hClose, m_hEvent
+    };
+    WSANETWORKEVENTS networkEvents;
+
+    while (WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        WSAEnumNetworkEvents(m_socket, m_hEvent, &networkEvents);
+        // The socket is non-blocking after WSAEventSelect, read until the
+        // queue is empty so a burst of heartbeats costs a single wake up.
+        while (true)
+        {
+            int size = recvfrom(m_socket, buff, sizeof(buff), 0, NULL, NULL);
+            if (size == SOCKET_ERROR)
+            {
+                int error = WSAGetLastError();
+                if (error == WSAEMSGSIZE || error == WSAECONNRESET)
+                {
+                    continue;
+                }
+                break;
+            }
+            Dispatch(buff, size);
+        }
+    }
+    SetEvent(m_hDone);
+}
+
+//
+//   FUNCTION: NotifySocket::Dispatch
+//
+//   PURPOSE: Pass the assignments of a datagram to the handler once its
+//   TOKEN line, wherever it is, matched.
+//
+void NotifySocket::Dispatch(const char* data, int size)
+{
+    const char* end = data + size;
+    std::vector<std::pair<std::string, std::string> > assignments;
+    bool authorized = false;
+
+    while (data < end)
+    {
+        const char* eol = data;
+        while (eol < end && *eol != '\n')
+        {
+            eol++;
+        }
+        const char* sep = data;
+        while (sep < eol && *sep != '=')
+        {
+            sep++;
+        }
+        if (sep < eol && std::string(data, sep) == "TOKEN")
+        {
+            authorized = std::string(sep + 1, eol) == m_token;
+        }
+        else if (sep < eol)
+        {
+            assignments.push_back(std::make_pair(std::string(data, sep),
+                                                 std::string(sep + 1, eol)));
+        }
+        data = eol + 1;
+    }
+    if (!authorized)
+    {
+        InterlockedIncrement(&m_rejected);
+        return;
+    }
+    for (size_t i = 0; i < assignments.size(); i++)
+    {
+        m_handler->OnNotify(assignments[i].first, assignments[i].second);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef _NOTIFYSOCKET_H_
+#define _NOTIFYSOCKET_H_
+#include <windows.h>
+#include <string>
+#include "strings.h"
+
+// Hex digits of the token a datagram must carry
+#define NOTIFY_TOKEN_LENGTH 32
+
+/**
+ * Receives the state notifications sent by the child.
+ */
+class NotifyHandler
+{
+    public:
+        virtual ~NotifyHandler() {}
+
+        // key and value of one KEY=VALUE line, e.g. READY and 1
+        virtual void OnNotify(const std::string& key,
+                              const std::string& value) = 0;
+};
+
+/**
+ * sd_notify style notification socket.
+ *
+ * A datagram socket bound to the loopback interface; its address is
+ * exported to the child as NOTIFY_SOCKET=127.0.0.1:<port>. Each datagram
+ * holds newline separated KEY=VALUE assignments such as READY=1,
+ * WATCHDOG=1, STATUS=<text> or STOPPING=1.
+ *
+ * Any local process can send to the port, so a datagram must also carry
+ * TOKEN=<token>, the random value exported as NOTIFY_TOKEN; the others are
+ * dropped.
+ *
+ * One thread serves the socket and drains every pending datagram on each
+ * wake up, so heartbeats cost no thread per child.
+ */
+class NotifySocket
+{
+    public:
+        NotifySocket(NotifyHandler* handler);
+        ~NotifySocket();
+
+        // port: 0 for any port, or the port of a previous instance;
+        // token: that of the previous instance, or NULL for a new one
+        bool Open(USHORT port = 0, const char* token = NULL);
+        void Close();
+        // Value for the NOTIFY_SOCKET variable of the child
+        String Address();
+        USHORT Port();
+        // Value for the NOTIFY_TOKEN variable of the child
+        const char* Token();
+        // Datagrams dropped for a missing or wrong token
+        LONG Rejected();
+
+        void Run(void);
+
+    private:
+        void Dispatch(const char* data, int size);
+
+        NotifyHandler* m_handler;
+        // SOCKET, kept as UINT_PTR so that users don't need winsock2.h
+        UINT_PTR m_socket;
+        HANDLE m_hEvent;
+        HANDLE m_hClose;
+        HANDLE m_hDone;
+        USHORT m_port;
+        char m_token[NOTIFY_TOKEN_LENGTH + 1];
+        volatile LONG m_rejected;
+};
+
+#endif /* _NOTIFYSOCKET_H_ */
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <deque>
+#include "OutputTrigger.h"
+
+// Longest part of a line kept to report a match
+#define TRIGGER_LINE_MAX 1024
+
+OutputMatcher::OutputMatcher()
+    : m_states(1)
+{
+    std::fill(m_states[0].next, m_states[0].next + 256, -1);
+    m_states[0].fail = 0;
+}
+
+bool OutputMatcher::AddLiteral(size_t index, const std::string& pattern)
+{
+    int state = 0;
+    std::string::const_iterator it;
+
+    if (pattern.empty())
+    {
+        return false;
+    }
+    for (it = pattern.begin(); it != pattern.end(); it++)
+    {
+        unsigned char c = (unsigned char)*it;
+        if (m_states[state].next[c] < 0)
+        {
+            m_states[state].next[c] = (int)m_states.size();
+            m_states.push_back(State());
+            std::fill(m_states.back().next, m_states.back().next + 256, -1);
+            m_states.back().fail = 0;
+        }
+        state = m_states[state].next[c];
+    }
+    m_states[state].output.push_back(index);
+    return true;
+}
+
+bool OutputMatcher::AddRegex(size_t index, const std::string& pattern)
+{
+    try
+    {
+        m_regex.push_back(std::make_pair(index, std::regex(pattern)));
+    }
+    catch (const std::regex_error&)
+    {
+        return false;
+    }
+    return true;
+}
+
+//
+//   FUNCTION: OutputMatcher::Build
+//
+//   PURPOSE: Compute the failure links breadth first and turn the trie into
+//   a complete transition table, so Next never has to follow failure links
+//   while scanning.
+//
+void OutputMatcher::Build()
+{
+    std::deque<int> queue;
+
+    for (int c = 0; c < 256; c++)
+    {
+        int next = m_states[0].next[c];
+        if (next < 0)
+        {
+            m_states[0].next[c] = 0;
+        }
+        else
+        {
+            m_states[next].fail = 0;
+            queue.push_back(next);
+        }
+    }
+    while (!queue.empty())
+    {
+        int state = queue.front();
+        queue.pop_front();
+        int fail = m_states[state].fail;
+        m_states[state].output.insert(m_states[state].output.end(),
+                                      m_states[fail].output.begin(),
+                                      m_states[fail].output.end());
+        for (int c = 0; c < 256; c++)
+        {
+            int next = m_states[state].next[c];
+            if (next < 0)
+            {
+                m_states[state].next[c] = m_states[fail].next[c];
+            }
+            else
+            {
+                m_states[next].fail = m_states[fail].next[c];
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+bool OutputMatcher::HasRegex()
+{
+    return !m_regex.empty();
+}
+
+int OutputMatcher::Next(int state, unsigned char c)
+{
+    return m_states[state].next[c];
+}
+
+const std::vector<size_t>& OutputMatcher::Matches(int state)
+{
+    return m_states[state].output;
+}
+
+void OutputMatcher::MatchLine(const std::string& line,
+                              std::vector<size_t>& matches)
+{
+    std::vector<std::pair<size_t, std::regex> >::iterator it;
+
+    for (it = m_regex.begin(); it != m_regex.end(); it++)
+    {
+        if (std::regex_search(line, it->second))
+        {
+            matches.push_back(it->first);
+        }
+    }
+}
+
+TriggerLogSink::TriggerLogSink(OutputMatcher* matcher,
+                               TriggerHandler* handler)
+    : m_matcher(matcher), m_handler(handler), m_state(0)
+{
+    InitializeCriticalSection(&m_lock);
+}
+
+TriggerLogSink::~TriggerLogSink()
+{
+    delete m_matcher;
+    DeleteCriticalSection(&m_lock);
+}
+
+void TriggerLogSink::Write(const LogBuffer& buffer)
+{
+    std::vector<char>::const_iterator it;
+
+    EnterCriticalSection(&m_lock);
+    for (it = buffer->begin(); it != buffer->end(); it++)
+    {
+        unsigned char c = (unsigned char)*it;
+        if (c == '\n')
+        {
+            EndLine();
+            continue;
+        }
+        if (m_line.size() < TRIGGER_LINE_MAX && c != '\r')
+        {
+            m_line.push_back((char)c);
+        }
+        m_state = m_matcher->Next(m_state, c);
+        const std::vector<size_t>& output = m_matcher->Matches(m_state);
+        m_matches.insert(m_matches.end(), output.begin(), output.end());
+    }
+    // A child may print its last words without a line break and hang
+    Fire();
+    m_writeCalls++;
+    m_bytesWritten += buffer->size();
+    LeaveCriticalSection(&m_lock);
+}
+
+bool TriggerLogSink::Persistent()
+{
+    return false;
+}
+
+void TriggerLogSink::EndLine()
+{
+    if (m_matcher->HasRegex())
+    {
+        m_matcher->MatchLine(m_line, m_matches);
+    }
+    Fire();
+    m_line.clear();
+    m_state = 0;
+}
+
+void TriggerLogSink::Fire()
+{
+    std::vector<size_t>::iterator it, last;
+
+    if (m_matches.empty())
+    {
+        return;
+    }
+    std::sort(m_matches.begin(), m_matches.end());
+    last = std::unique(m_matches.begin(), m_matches.end());
+    for (it = m_matches.begin(); it != last; it++)
+    {
+        m_handler->OnTrigger(*it, m_line);
+    }
+    m_matches.clear();
+}
@@ -0,0 +1,85 @@
+#ifndef _OUTPUTTRIGGER_H_
+#define _OUTPUTTRIGGER_H_
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <regex>
+#include "strings.h"
+#include "LogSink.h"
+
+/**
+ * Receives the triggers matched on the child output.
+ */
+class TriggerHandler
+{
+    public:
+        virtual ~TriggerHandler() {}
+
+        // index: position of the trigger in the descriptor
+        // line: output line that contains the match, possibly truncated
+        virtual void OnTrigger(size_t index, const std::string& line) = 0;
+};
+
+/**
+ * Compiled trigger patterns.
+ *
+ * Literal patterns are merged into one Aho-Corasick automaton, so scanning
+ * the output costs a table lookup per byte whatever the number of
+ * literals. Regular expressions are evaluated once per complete line.
+ */
+class OutputMatcher
+{
+    public:
+        OutputMatcher();
+
+        // Returns false if the regular expression can't be compiled
+        bool AddLiteral(size_t index, const std::string& pattern);
+        bool AddRegex(size_t index, const std::string& pattern);
+        void Build();
+
+        bool HasRegex();
+        int Next(int state, unsigned char c);
+        const std::vector<size_t>& Matches(int state);
+        void MatchLine(const std::string& line, std::vector<size_t>& matches);
+
+    private:
+        struct State
+        {
+            int next[256];
+            int fail;
+            std::vector<size_t> output;
+        };
+
+        std::vector<State> m_states;
+        std::vector<std::pair<size_t, std::regex> > m_regex;
+};
+
+/**
+ * Sink that scans one captured stream and reports matches to the handler.
+ * Each trigger fires at most once per line and chunk. The sink owns the
+ * matcher built for its stream. Writes are serialized, a pump left
+ * running on a pipe inherited by a grandchild writes next to the pump of
+ * the next child.
+ */
+class TriggerLogSink : public LogSink
+{
+    public:
+        TriggerLogSink(OutputMatcher* matcher, TriggerHandler* handler);
+        virtual ~TriggerLogSink();
+
+        virtual void Write(const LogBuffer& buffer);
+        virtual bool Persistent();
+
+    private:
+        void EndLine();
+        void Fire();
+
+        OutputMatcher* m_matcher;
+        TriggerHandler* m_handler;
+        int m_state;
+        std::string m_line;
+        std::vector<size_t> m_matches;
+        CRITICAL_SECTION m_lock;
+};
+
+#endif /* _OUTPUTTRIGGER_H_ */
@@ -0,0 +1,322 @@
+#include "Placement.h"
+
+// Information class of NtSetInformationProcess for the I/O priority, which
+// has no documented API for another process
+#define PROCESS_IO_PRIORITY 33
+
+// Slots tried before giving up, far more than any machine has cores
+#define MAX_SLOTS 4096
+
+typedef LONG (WINAPI *NtSetInformationProcessProc)(HANDLE, ULONG, PVOID, ULONG);
+
+static bool ParseProcessors(const String& list, ULONGLONG* mask)
+{
+    const ULONG count = sizeof(DWORD_PTR) * 8;
+    const TCHAR* p = list.c_str();
+    TCHAR* end;
+
+    *mask = 0;
+    while (*p != 0)
+    {
+        ULONG first = _tcstoul(p, &end, 10);
+        ULONG last = first;
+        if (end == p)
+        {
+            return false;
+        }
+        p = end;
+        if (*p == TEXT('-'))
+        {
+            p++;
+            last = _tcstoul(p, &end, 10);
+            if (end == p)
+            {
+                return false;
+            }
+            p = end;
+        }
+        if (first > last || last >= count)
+        {
+            return false;
+        }
+        for (ULONG cpu = first; cpu <= last; cpu++)
+        {
+            *mask |= 1ULL << cpu;
+        }
+        while (*p == TEXT(' '))
+        {
+            p++;
+        }
+        if (*p == TEXT(','))
+        {
+            p++;
+        }
+        else if (*p != 0)
+        {
+            return false;
+        }
+    }
+    return *mask != 0;
+}
+
+static bool SetIoPriority(HANDLE hProcess, ULONG priority)
+{
+    static NtSetInformationProcessProc setInformation =
+        (NtSetInformationProcessProc)GetProcAddress(GetModuleHandle(TEXT("ntdll.dll")),
+                                                    "NtSetInformationProcess");
+    LONG status;
+
+    if (setInformation == NULL)
+    {
+        return false;
+    }
+    status = setInformation(hProcess, PROCESS_IO_PRIORITY, &priority,
+                            sizeof(priority));
+    if (status < 0)
+    {
+        // The NTSTATUS tells more than any Win32 code it maps to
+        SetLastError((DWORD)status);
+        return false;
+    }
+    return true;
+}
+
+CpuPlacement::CpuPlacement()
+    : m_affinity(0), m_priorityClass(0), m_ioPriority(-1), m_hSlot(NULL),
+      m_slot(0)
+{
+}
+
+CpuPlacement::~CpuPlacement()
+{
+    if (m_hSlot != NULL)
+    {
+        CloseHandle(m_hSlot);
+    }
+}
+
+bool CpuPlacement::Configure(const String& affinity, const String& spread,
+                             const String& priority, const String& iopriority)
+{
+    static const struct
+    {
+        const TCHAR* name;
+        DWORD priorityClass;
+    } classes[] =
+    {
+        { TEXT("idle"), IDLE_PRIORITY_CLASS },
+        { TEXT("belowNormal"), BELOW_NORMAL_PRIORITY_CLASS },
+        { TEXT("normal"), NORMAL_PRIORITY_CLASS },
+        { TEXT("aboveNormal"), ABOVE_NORMAL_PRIORITY_CLASS },
+        { TEXT("high"), HIGH_PRIORITY_CLASS }
+    };
+    static const TCHAR* ioPriorities[] =
+    {
+        TEXT("verylow"), TEXT("low"), TEXT("normal")
+    };
+
+    m_affinity = 0;
+    m_spread.clear();
+    m_priorityClass = 0;
+    m_ioPriority = -1;
+    if (affinity.size() > 0 && !ParseProcessors(affinity, &m_affinity))
+    {
+        m_affinity = 0;
+        return false;
+    }
+    for (size_t i = 0; i < ARRAYSIZE(classes) && priority.size() > 0; i++)
+    {
+        if (_tcsicmp(priority.c_str(), classes[i].name) == 0)
+        {
+            m_priorityClass = classes[i].priorityClass;
+        }
+    }
+    for (int i = 0; i < (int)ARRAYSIZE(ioPriorities) && iopriority.size() > 0; i++)
+    {
+        if (_tcsicmp(iopriority.c_str(), ioPriorities[i]) == 0)
+        {
+            m_ioPriority = i;
+        }
+    }
+    if ((priority.size() > 0 && m_priorityClass == 0) ||
+        (iopriority.size() > 0 && m_ioPriority < 0) ||
+        (spread.size() > 0 && _tcsicmp(spread.c_str(), TEXT("none")) != 0 &&
+         _tcsicmp(spread.c_str(), TEXT("core")) != 0 &&
+         _tcsicmp(spread.c_str(), TEXT("node")) != 0))
+    {
+        m_affinity = 0;
+        m_priorityClass = 0;
+        m_ioPriority = -1;
+        return false;
+    }
+    if (_tcsicmp(spread.c_str(), TEXT("none")) != 0)
+    {
+        m_spread = spread;
+    }
+    return true;
+}
+
+bool CpuPlacement::Acquire(const String& group)
+{
+    String prefix = TEXT("Global\\SvcWrapper.cpu.") + group + TEXT(".");
+    TCHAR buff[16];
+
+    if (m_spread.size() == 0 || m_hSlot != NULL)
+    {
+        return true;
+    }
+    for (DWORD slot = 0; slot < MAX_SLOTS; slot++)
+    {
+        _sntprintf(buff, ARRAYSIZE(buff), TEXT("%lu"), slot);
+        // The slot is held as long as a handle to the event is open
+        HANDLE hSlot = CreateEvent(NULL, TRUE, FALSE, (prefix + buff).c_str());
+        if (hSlot == NULL)
+        {
+            return false;
+        }
+        if (GetLastError() != ERROR_ALREADY_EXISTS)
+        {
+            Attach(hSlot, slot);
+            return true;
+        }
+        CloseHandle(hSlot);
+    }
+    SetLastError(ERROR_NO_MORE_ITEMS);
+    return false;
+}
+
+void CpuPlacement::Attach(HANDLE hSlot, DWORD slot)
+{
+    if (m_hSlot != NULL)
+    {
+        CloseHandle(m_hSlot);
+    }
+    m_hSlot = hSlot;
+    m_slot = slot;
+}
+
+HANDLE CpuPlacement::Detach()
+{
+    HANDLE hSlot = m_hSlot;
+
+    m_hSlot = NULL;
+    return hSlot;
+}
+
+DWORD CpuPlacement::Slot()
+{
+    return m_slot;
+}
+
+bool CpuPlacement::Enabled()
+{
+    return m_affinity != 0 || m_spread.size() > 0 || m_priorityClass != 0 ||
+           m_ioPriority >= 0;
+}
+
+//
+//   FUNCTION: CpuPlacement::GetUnits
+//
+//   PURPOSE: List the processors of each core or node that are in the
+//   affinity, in processor order. Hyper-threads of a core stay together.
+//
+void CpuPlacement::GetUnits(std::vector<ULONGLONG>& units)
+{
+    DWORD_PTR processMask, systemMask;
+    ULONGLONG allowed = m_affinity;
+
+    units.clear();
+    if (allowed == 0)
+    {
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        {
+            return;
+        }
+        allowed = systemMask;
+    }
+    if (_tcsicmp(m_spread.c_str(), TEXT("core")) == 0)
+    {
+        std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info;
+        DWORD size = 0;
+        GetLogicalProcessorInformation(NULL, &size);
+        if (size == 0)
+        {
+            return;
+        }
+        info.resize(size / sizeof(info[0]));
+        if (!GetLogicalProcessorInformation(&info[0], &size))
+        {
+            return;
+        }
+        for (size_t i = 0; i < info.size(); i++)
+        {
+            if (info[i].Relationship == RelationProcessorCore &&
+                (info[i].ProcessorMask & allowed) != 0)
+            {
+                units.push_back(info[i].ProcessorMask & allowed);
+            }
+        }
+    }
+    else if (_tcsicmp(m_spread.c_str(), TEXT("node")) == 0)
+    {
+        ULONG highest;
+        ULONGLONG mask;
+        if (!GetNumaHighestNodeNumber(&highest))
+        {
+            return;
+        }
+        for (ULONG node = 0; node <= highest; node++)
+        {
+            // Nodes of other processor groups have no processors here
+            if (GetNumaNodeProcessorMask((UCHAR)node, &mask) &&
+                (mask & allowed) != 0)
+            {
+                units.push_back(mask & allowed);
+            }
+        }
+    }
+}
+
+DWORD CpuPlacement::Units()
+{
+    std::vector<ULONGLONG> units;
+
+    GetUnits(units);
+    return (DWORD)units.size();
+}
+
+ULONGLONG CpuPlacement::Processors()
+{
+    std::vector<ULONGLONG> units;
+
+    GetUnits(units);
+    if (units.empty())
+    {
+        return m_affinity;
+    }
+    return units[m_slot % units.size()];
+}
+
+bool CpuPlacement::Apply(HANDLE hProcess)
+{
+    ULONGLONG processors = Processors();
+    DWORD dwError = ERROR_SUCCESS;
+
+    if (processors != 0 &&
+        !SetProcessAffinityMask(hProcess, (DWORD_PTR)processors))
+    {
+        dwError = GetLastError();
+    }
+    if (m_priorityClass != 0 && !SetPriorityClass(hProcess, m_priorityClass) &&
+        dwError == ERROR_SUCCESS)
+    {
+        dwError = GetLastError();
+    }
+    if (m_ioPriority >= 0 && !SetIoPriority(hProcess, (ULONG)m_ioPriority) &&
+        dwError == ERROR_SUCCESS)
+    {
+        dwError = GetLastError();
+    }
+    SetLastError(dwError);
+    return dwError == ERROR_SUCCESS;
+}
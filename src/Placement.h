@@ -0,0 +1,59 @@
+#ifndef _PLACEMENT_H_
+#define _PLACEMENT_H_
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "strings.h"
+
+/**
+ * Processors and priorities given to a child while it is still suspended.
+ *
+ * affinity: processors the child may use, a list of numbers and ranges
+ * (0-3,8), all processors when empty.
+ * spread: core or node gives each service of a group its own physical
+ * core or NUMA node out of the affinity, by slot. Slots are claimed with
+ * named objects, so wrappers started side by side take different ones
+ * and wrap around once every core or node is taken.
+ *
+ * Only the processors of the processor group of the wrapper are used.
+ */
+class CpuPlacement
+{
+    public:
+        CpuPlacement();
+        ~CpuPlacement();
+
+        // priority: idle, belowNormal, normal, aboveNormal or high
+        // iopriority: verylow, low or normal
+        // False when a setting is invalid, nothing is applied then
+        bool Configure(const String& affinity, const String& spread,
+                       const String& priority, const String& iopriority);
+        // Claim the first slot of the group no other wrapper holds
+        bool Acquire(const String& group);
+        // Take or give up the slot, for handovers. hSlot may be NULL for a
+        // slot not shared with other wrappers.
+        void Attach(HANDLE hSlot, DWORD slot);
+        HANDLE Detach();
+        DWORD Slot();
+
+        bool Enabled();
+        // Cores or nodes the slots are spread over, 0 without spread
+        DWORD Units();
+        // Processors of the child, 0 to leave them alone
+        ULONGLONG Processors();
+        // hProcess: created suspended, its descendants inherit the settings
+        bool Apply(HANDLE hProcess);
+
+    private:
+        void GetUnits(std::vector<ULONGLONG>& units);
+
+        ULONGLONG m_affinity;
+        String m_spread;
+        DWORD m_priorityClass;
+        // -1 to leave it alone
+        int m_ioPriority;
+        HANDLE m_hSlot;
+        DWORD m_slot;
+};
+
+#endif /* _PLACEMENT_H_ */
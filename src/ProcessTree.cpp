@@ -0,0 +1,164 @@
+#include "ProcessTree.h"
+
+ProcessTree::ProcessTree()
+    : m_hJob(NULL)
+{
+}
+
+ProcessTree::~ProcessTree()
+{
+    Close();
+}
+
+bool ProcessTree::Create(const String& name, bool killOnClose)
+{
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+
+    Close();
+    m_hJob = CreateJobObject(NULL, name.size() > 0 ? name.c_str() : NULL);
+    if (m_hJob == NULL)
+    {
+        return false;
+    }
+    if (!killOnClose)
+    {
+        return true;
+    }
+    ZeroMemory(&limits, sizeof(limits));
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    if (!SetInformationJobObject(m_hJob, JobObjectExtendedLimitInformation,
+                                 &limits, sizeof(limits)))
+    {
+        DWORD dwError = GetLastError();
+        Close();
+        SetLastError(dwError);
+        return false;
+    }
+    return true;
+}
+
+bool ProcessTree::Open(const String& name)
+{
+    Close();
+    m_hJob = OpenJobObject(JOB_OBJECT_ALL_ACCESS, FALSE, name.c_str());
+    return m_hJob != NULL;
+}
+
+void ProcessTree::Attach(HANDLE hJob)
+{
+    Close();
+    m_hJob = hJob;
+}
+
+HANDLE ProcessTree::Detach()
+{
+    HANDLE hJob = m_hJob;
+
+    m_hJob = NULL;
+    return hJob;
+}
+
+HANDLE ProcessTree::Handle()
+{
+    return m_hJob;
+}
+
+void ProcessTree::Close()
+{
+    if (m_hJob != NULL)
+    {
+        CloseHandle(m_hJob);
+        m_hJob = NULL;
+    }
+}
+
+bool ProcessTree::Assign(HANDLE hProcess)
+{
+    return m_hJob != NULL && AssignProcessToJobObject(m_hJob, hProcess);
+}
+
+bool ProcessTree::SetLimits(const TreeLimits& limits)
+{
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION info;
+
+    if (m_hJob == NULL)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    // Keep the limits already set, KILL_ON_JOB_CLOSE among them
+    if (!QueryInformationJobObject(m_hJob, JobObjectExtendedLimitInformation,
+                                   &info, sizeof(info), NULL))
+    {
+        return false;
+    }
+    if (limits.processMemory > 0)
+    {
+        info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+        info.ProcessMemoryLimit = limits.processMemory;
+    }
+    if (limits.treeMemory > 0)
+    {
+        info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_JOB_MEMORY;
+        info.JobMemoryLimit = limits.treeMemory;
+    }
+    if (limits.processes > 0)
+    {
+        info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_ACTIVE_PROCESS;
+        info.BasicLimitInformation.ActiveProcessLimit = limits.processes;
+    }
+    if (limits.noErrorDialogs)
+    {
+        info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_DIE_ON_UNHANDLED_EXCEPTION;
+    }
+    return SetInformationJobObject(m_hJob, JobObjectExtendedLimitInformation,
+                                   &info, sizeof(info)) != FALSE;
+}
+
+DWORD ProcessTree::ActiveProcesses()
+{
+    JOBOBJECT_BASIC_ACCOUNTING_INFORMATION accounting;
+
+    if (m_hJob == NULL ||
+        !QueryInformationJobObject(m_hJob, JobObjectBasicAccountingInformation,
+                                   &accounting, sizeof(accounting), NULL))
+    {
+        return 0;
+    }
+    return accounting.ActiveProcesses;
+}
+
+DWORD ProcessTree::Terminate(UINT exitCode)
+{
+    DWORD active = ActiveProcesses();
+
+    if (active > 0)
+    {
+        TerminateJobObject(m_hJob, exitCode);
+    }
+    return active;
+}
+
+bool ProcessTree::Usage(TreeUsage* usage)
+{
+    JOBOBJECT_BASIC_ACCOUNTING_INFORMATION accounting;
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+
+    ZeroMemory(usage, sizeof(*usage));
+    if (m_hJob == NULL ||
+        !QueryInformationJobObject(m_hJob, JobObjectBasicAccountingInformation,
+                                   &accounting, sizeof(accounting), NULL))
+    {
+        return false;
+    }
+    usage->cpuTime = (accounting.TotalUserTime.QuadPart +
+                      accounting.TotalKernelTime.QuadPart) / 10000;
+    usage->totalProcesses = accounting.TotalProcesses;
+    usage->activeProcesses = accounting.ActiveProcesses;
+    if (QueryInformationJobObject(m_hJob, JobObjectExtendedLimitInformation,
+                                  &limits, sizeof(limits), NULL))
+    {
+        usage->peakMemory = limits.PeakJobMemoryUsed;
+    }
+    return true;
+}
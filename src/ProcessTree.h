@@ -0,0 +1,69 @@
+#ifndef _PROCESSTREE_H_
+#define _PROCESSTREE_H_
+#include <windows.h>
+#include <string>
+#include "strings.h"
+
+/**
+ * Resources used by every process of a tree, exited ones included.
+ */
+struct TreeUsage
+{
+    // User and kernel time in milliseconds
+    ULONGLONG cpuTime;
+    ULONGLONG peakMemory;
+    DWORD totalProcesses;
+    DWORD activeProcesses;
+};
+
+/**
+ * Limits of every process of a tree, 0 for none.
+ */
+struct TreeLimits
+{
+    // Committed memory of each process and of the whole tree, in bytes
+    SIZE_T processMemory;
+    SIZE_T treeMemory;
+    // Processes running at once, creating one more fails
+    DWORD processes;
+    // A crashing process exits at once instead of showing an error dialog
+    // nobody sees in the service session
+    bool noErrorDialogs;
+};
+
+/**
+ * Job object holding a child and every process it creates, so that a stop
+ * or a restart reaches the grandchildren a script forks too.
+ *
+ * With killOnClose the tree dies with its last handle, also when the
+ * wrapper crashes. Without it, a named tree can be opened again by the
+ * next wrapper to adopt the processes.
+ */
+class ProcessTree
+{
+    public:
+        ProcessTree();
+        ~ProcessTree();
+
+        // name: may be empty for a tree that is never opened again
+        bool Create(const String& name, bool killOnClose);
+        bool Open(const String& name);
+        // Take or give up the ownership of the job handle, for handovers
+        void Attach(HANDLE hJob);
+        HANDLE Detach();
+        HANDLE Handle();
+        void Close();
+
+        bool Assign(HANDLE hProcess);
+        // Before the first process of the tree runs
+        bool SetLimits(const TreeLimits& limits);
+        DWORD ActiveProcesses();
+        // Kill every process of the tree, returns how many were running
+        DWORD Terminate(UINT exitCode);
+        bool Usage(TreeUsage* usage);
+
+    private:
+        HANDLE m_hJob;
+};
+
+#endif /* _PROCESSTREE_H_ */
@@ -0,0 +1,353 @@
+#include <winsock2.h>
+#include "Proxy.h"
+#include "ThreadPool.h"
+#include "Histogram.h"
+
+static bool ParseAddress(const String& address, struct sockaddr_in* addr)
+{
+    size_t colon = address.find_last_of(TEXT(':'));
+    std::string host;
+
+    if (colon == String::npos)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < colon; i++)
+    {
+        host.push_back((char)address[i]);
+    }
+    ZeroMemory(addr, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = inet_addr(host.c_str());
+    addr->sin_port = htons((USHORT)_tcstoul(address.c_str() + colon + 1,
+                                            NULL, 10));
+    return addr->sin_addr.s_addr != INADDR_NONE && addr->sin_port != 0;
+}
+
+/**
+ * One accepted connection, deletes itself when both sides are closed.
+ */
+class ProxyConnection
+{
+    public:
+        ProxyConnection(Proxy* proxy, SOCKET client)
+            : m_proxy(proxy), m_client(client), m_backend(INVALID_SOCKET)
+        {
+        }
+
+        void Run(void);
+        // Break blocking calls of the connection thread
+        void Abort();
+
+    private:
+        bool Connect();
+        void Relay();
+
+        Proxy* m_proxy;
+        SOCKET m_client;
+        SOCKET m_backend;
+};
+
+void ProxyConnection::Run(void)
+{
+    if (m_proxy->m_handler->OnConnect() && Connect())
+    {
+        Relay();
+    }
+    m_proxy->Unregister(this);
+    closesocket(m_client);
+    if (m_backend != INVALID_SOCKET)
+    {
+        closesocket(m_backend);
+    }
+    delete this;
+}
+
+void ProxyConnection::Abort()
+{
+    shutdown(m_client, SD_BOTH);
+    if (m_backend != INVALID_SOCKET)
+    {
+        shutdown(m_backend, SD_BOTH);
+    }
+}
+
+//
+//   FUNCTION: ProxyConnection::Connect
+//
+//   PURPOSE: Dial the backend. A child that was just started may not
+//   listen yet, a refused connection is retried until the timeout.
+//
+bool ProxyConnection::Connect()
+{
+    struct sockaddr_in addr;
+    ULONGLONG deadline = m_proxy->m_clock->Now() + m_proxy->m_connectTimeout;
+
+    if (!ParseAddress(m_proxy->m_backend, &addr))
+    {
+        return false;
+    }
+    while (!m_proxy->m_closing)
+    {
+        SOCKET backend = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (backend == INVALID_SOCKET)
+        {
+            return false;
+        }
+        EnterCriticalSection(&m_proxy->m_lock);
+        m_backend = backend;
+        LeaveCriticalSection(&m_proxy->m_lock);
+        ULONGLONG start = GetMicroseconds();
+        if (connect(backend, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+        {
+            m_proxy->m_handler->OnBackendConnect(GetMicroseconds() - start);
+            return true;
+        }
+        EnterCriticalSection(&m_proxy->m_lock);
+        m_backend = INVALID_SOCKET;
+        LeaveCriticalSection(&m_proxy->m_lock);
+        closesocket(backend);
+        if (m_proxy->m_clock->Now() >= deadline)
+        {
+            break;
+        }
+        m_proxy->m_clock->Sleep(100);
+    }
+    return false;
+}
+
+void ProxyConnection::Relay()
+{
+    char buff[16 * 1024];
+    SOCKET from[2] = { m_client, m_backend };
+    SOCKET to[2] = { m_backend, m_client };
+    bool open[2] = { true, true };
+
+    while ((open[0] || open[1]) && !m_proxy->m_closing)
+    {
+        fd_set readable;
+        struct timeval timeout = { 1, 0 };
+
+        FD_ZERO(&readable);
+        for (int i = 0; i < 2; i++)
+        {
+            if (open[i])
+            {
+                FD_SET(from[i], &readable);
+            }
+        }
+        int count = select(0, &readable, NULL, NULL, &timeout);
+        if (count == SOCKET_ERROR)
+        {
+            break;
+        }
+        for (int i = 0; i < 2 && count > 0; i++)
+        {
+            if (!open[i] || !FD_ISSET(from[i], &readable))
+            {
+                continue;
+            }
+            int size = recv(from[i], buff, sizeof(buff), 0);
+            if (size <= 0)
+            {
+                // Pass the half close on, the other side may still answer
+                shutdown(to[i], SD_SEND);
+                open[i] = false;
+                continue;
+            }
+            for (int sent = 0; sent < size; )
+            {
+                int result = send(to[i], buff + sent, size - sent, 0);
+                if (result == SOCKET_ERROR)
+                {
+                    return;
+                }
+                sent += result;
+            }
+            m_proxy->Touch();
+        }
+    }
+}
+
+Proxy::Proxy(ProxyHandler* handler, DWORD connectTimeout, Clock* clock)
+    : m_handler(handler), m_connectTimeout(connectTimeout), m_clock(clock),
+      m_socket(INVALID_SOCKET), m_hEvent(NULL), m_hClose(NULL), m_hDone(NULL),
+      m_connections(0), m_accepted(0), m_lastActivity(0), m_closing(false), m_running(false)
+{
+    InitializeCriticalSection(&m_lock);
+}
+
+Proxy::~Proxy()
+{
+    Close();
+    DeleteCriticalSection(&m_lock);
+}
+
+bool Proxy::Open(const String& address, const String& backend)
+{
+    WSADATA wsaData;
+    struct sockaddr_in addr;
+    struct sockaddr_in backendAddr;
+
+    if (!ParseAddress(address, &addr) || !ParseAddress(backend, &backendAddr))
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        return false;
+    }
+    m_backend = backend;
+    m_closing = false;
+    m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_socket == INVALID_SOCKET)
+    {
+        WSACleanup();
+        return false;
+    }
+    m_hEvent = WSACreateEvent();
+    m_hClose = CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (bind(m_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(m_socket, SOMAXCONN) == SOCKET_ERROR ||
+        m_hEvent == NULL || m_hClose == NULL || m_hDone == NULL ||
+        WSAEventSelect(m_socket, m_hEvent, FD_ACCEPT) == SOCKET_ERROR)
+    {
+        DWORD dwError = WSAGetLastError();
+        Close();
+        SetLastError(dwError);
+        return false;
+    }
+    Touch();
+    m_running = true;
+    CThreadPool::QueueUserWorkItem(&Proxy::Run, this);
+    return true;
+}
+
+void Proxy::Close()
+{
+    std::set<ProxyConnection*>::iterator it;
+
+    if (m_socket == INVALID_SOCKET)
+    {
+        return;
+    }
+    m_closing = true;
+    if (m_running)
+    {
+        SetEvent(m_hClose);
+        WaitForSingleObject(m_hDone, INFINITE);
+        m_running = false;
+    }
+    closesocket(m_socket);
+    m_socket = INVALID_SOCKET;
+    EnterCriticalSection(&m_lock);
+    for (it = m_live.begin(); it != m_live.end(); it++)
+    {
+        (*it)->Abort();
+    }
+    LeaveCriticalSection(&m_lock);
+    // The connection threads notice the close within a second
+    while (m_connections > 0)
+    {
+        Sleep(50);
+    }
+    if (m_hEvent)
+    {
+        WSACloseEvent(m_hEvent);
+        m_hEvent = NULL;
+    }
+    if (m_hClose)
+    {
+        CloseHandle(m_hClose);
+        m_hClose = NULL;
+    }
+    if (m_hDone)
+    {
+        CloseHandle(m_hDone);
+        m_hDone = NULL;
+    }
+    WSACleanup();
+}
+
+LONG Proxy::Connections()
+{
+    return m_connections;
+}
+
+ULONG Proxy::Accepted()
+{
+    return (ULONG)m_accepted;
+}
+
+ULONGLONG Proxy::LastActivity()
+{
+    return m_lastActivity;
+}
+
+void Proxy::Touch()
+{
+    InterlockedExchange64(&m_lastActivity, m_clock->Now());
+}
+
+bool Proxy::Register(ProxyConnection* connection)
+{
+    bool result;
+
+    EnterCriticalSection(&m_lock);
+    result = !m_closing;
+    if (result)
+    {
+        m_live.insert(connection);
+        InterlockedIncrement(&m_connections);
+    }
+    LeaveCriticalSection(&m_lock);
+    return result;
+}
+
+void Proxy::Unregister(ProxyConnection* connection)
+{
+    EnterCriticalSection(&m_lock);
+    m_live.erase(connection);
+    LeaveCriticalSection(&m_lock);
+    Touch();
+    InterlockedDecrement(&m_connections);
+}
+
+void Proxy::Run(void)
+{
+    const HANDLE events[2] =
+    {
+        m_hClose, m_hEvent
+    };
+    WSANETWORKEVENTS networkEvents;
+    u_long blocking = 0;
+
+    while (WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        WSAEnumNetworkEvents(m_socket, m_hEvent, &networkEvents);
+        while (true)
+        {
+            SOCKET client = accept(m_socket, NULL, NULL);
+            if (client == INVALID_SOCKET)
+            {
+                break;
+            }
+            // Accepted sockets inherit the event selection of the listener
+            WSAEventSelect(client, NULL, 0);
+            ioctlsocket(client, FIONBIO, &blocking);
+            ProxyConnection* connection = new ProxyConnection(this, client);
+            if (!Register(connection))
+            {
+                closesocket(client);
+                delete connection;
+                continue;
+            }
+            Touch();
+            InterlockedIncrement(&m_accepted);
+            CThreadPool::QueueUserWorkItem(&ProxyConnection::Run, connection);
+        }
+    }
+    SetEvent(m_hDone);
+}
@@ -0,0 +1,81 @@
+#ifndef _PROXY_H_
+#define _PROXY_H_
+#include <windows.h>
+#include <string>
+#include <set>
+#include "strings.h"
+#include "Clock.h"
+
+/**
+ * Receives the connections accepted by the proxy.
+ */
+class ProxyHandler
+{
+    public:
+        virtual ~ProxyHandler() {}
+
+        // Called on the connection thread before the backend is dialed.
+        // Blocks until the backend can take the connection, returns false
+        // to drop it.
+        virtual bool OnConnect() = 0;
+        // Time the backend took to accept a connection, in microseconds
+        virtual void OnBackendConnect(ULONGLONG time) {}
+};
+
+class ProxyConnection;
+
+/**
+ * TCP relay between a listening address held by the wrapper and the
+ * address the child listens on, so the child only has to run while
+ * connections come in.
+ *
+ * Each connection is relayed by one thread of the pool. Connections and
+ * the time of the last transferred byte tell when the child is idle.
+ */
+class Proxy
+{
+    public:
+        // connectTimeout: how long a starting backend may refuse connections
+        Proxy(ProxyHandler* handler, DWORD connectTimeout,
+              Clock* clock = Clock::System());
+        ~Proxy();
+
+        // Addresses are IPv4 host:port
+        bool Open(const String& address, const String& backend);
+        void Close();
+
+        // Connections being relayed
+        LONG Connections();
+        // Connections accepted since Open
+        ULONG Accepted();
+        // Time on the clock of the last accept or transfer
+        ULONGLONG LastActivity();
+
+        void Run(void);
+
+    private:
+        friend class ProxyConnection;
+
+        void Touch();
+        bool Register(ProxyConnection* connection);
+        void Unregister(ProxyConnection* connection);
+
+        ProxyHandler* m_handler;
+        DWORD m_connectTimeout;
+        Clock* m_clock;
+        // SOCKET, kept as UINT_PTR so that users don't need winsock2.h
+        UINT_PTR m_socket;
+        HANDLE m_hEvent;
+        HANDLE m_hClose;
+        HANDLE m_hDone;
+        String m_backend;
+        volatile LONG m_connections;
+        volatile LONG m_accepted;
+        volatile LONGLONG m_lastActivity;
+        volatile bool m_closing;
+        bool m_running;
+        CRITICAL_SECTION m_lock;
+        std::set<ProxyConnection*> m_live;
+};
+
+#endif /* _PROXY_H_ */
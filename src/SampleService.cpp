@@ -1,455 +1,2686 @@
-/****************************** Module Header ******************************\
-* Module Name:  SampleService.cpp
-* Project:      CppWindowsService
-* Copyright (c) Microsoft Corporation.
-*
-* Provides a sample service class that derives from the service base class -
-* CServiceBase. The sample service logs the service start and stop
-* information to the Application event log, and shows how to run the main
-* function of the service in a thread pool worker thread.
-*
-* This source is subject to the Microsoft Public License.
-* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
-* All other rights reserved.
-*
-* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
-* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
-* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#include <iostream>
-#include "SampleService.h"
-#include "ThreadPool.h"
-
-
-CSampleService::CSampleService(Descriptor *d,
-                               PCTSTR pszServiceName,
-                               BOOL fCanStop,
-                               BOOL fCanShutdown,
-                               BOOL fCanPauseContinue)
-    : CServiceBase(pszServiceName, fCanStop, fCanShutdown, fCanPauseContinue), d(d)
-{
-    m_fStopping = FALSE;
-    m_testMode = FALSE;
-    m_fStarted = FALSE;
-    dwLastError = 0;
-    
-    // Create a manual-reset event that is not signaled at first to indicate
-    // the stopped signal of the service.
-    m_hStoppedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-    if (m_hStoppedEvent == NULL)
-    {
-        throw GetLastError();
-    }
-    // Create a manual-reset event that is not signaled at first to indicate
-    // the stopped signal of the service.
-    m_hStartedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-    if (m_hStartedEvent == NULL)
-    {
-        throw GetLastError();
-    }
-}
-
-
-CSampleService::~CSampleService(void)
-{
-    if (m_hStartedEvent)
-    {
-        CloseHandle(m_hStartedEvent);
-        m_hStartedEvent = NULL;
-    }
-    if (m_hStoppedEvent)
-    {
-        CloseHandle(m_hStoppedEvent);
-        m_hStoppedEvent = NULL;
-    }
-}
-
-void CSampleService::Test()
-{
-    m_testMode = TRUE;
-    Start(0, NULL);
-    WaitForSingleObject(m_hStoppedEvent, INFINITE);
-}
-
-//
-//   FUNCTION: CSampleService::OnStart(DWORD, LPTSTR *)
-//
-//   PURPOSE: The function is executed when a Start command is sent to the
-//   service by the SCM or when the operating system starts (for a service
-//   that starts automatically). It specifies actions to take when the
-//   service starts. In this code sample, OnStart logs a service-start
-//   message to the Application log, and queues the main service function for
-//   execution in a thread pool worker thread.
-//
-//   PARAMETERS:
-//   * dwArgc   - number of command line arguments
-//   * lpszArgv - array of command line arguments
-//
-//   NOTE: A service application is designed to be long running. Therefore,
-//   it usually polls or monitors something in the system. The monitoring is
-//   set up in the OnStart method. However, OnStart does not actually do the
-//   monitoring. The OnStart method must return to the operating system after
-//   the service's operation has begun. It must not loop forever or block. To
-//   set up a simple monitoring mechanism, one general solution is to create
-//   a timer in OnStart. The timer would then raise events in your code
-//   periodically, at which time your service could do its monitoring. The
-//   other solution is to spawn a new thread to perform the main service
-//   functions, which is demonstrated in this code sample.
-//
-void CSampleService::OnStart(DWORD dwArgc, LPTSTR *lpszArgv)
-{
-    TCHAR buff[1024];
-    const HANDLE events[2] =
-    {
-        m_hStartedEvent, m_hStoppedEvent
-    };
-
-
-    // Signal the stopped event.
-    ResetEvent(m_hStoppedEvent);
-    ResetEvent(m_hStartedEvent);
-
-    // Queue the main service function for execution in a worker thread.
-    CThreadPool::QueueUserWorkItem(&CSampleService::ServiceWorkerThread, this);
-    DWORD timeout = 12000;
-    if (WaitForMultipleObjects(2, events, FALSE, timeout) != WAIT_OBJECT_0)
-    {
-        m_fStopping = TRUE;
-        _stprintf(buff, TEXT("Wait to start process failed w/err 0x%08lx"),
-                 dwLastError);
-        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
-        throw dwLastError;
-    }
-    else
-    {
-        // Log a service start message to the Application log.
-        WriteEventLogEntry(TEXT("Service started successfully"),
-                           EVENTLOG_INFORMATION_TYPE);
-    }
-}
-
-String CSampleService::GetEnvString()
-{
-    TCHAR *env = GetEnvironmentStrings();
-    if (!env)
-    {
-        return TEXT("");
-    }
-    const TCHAR *var = env;
-    size_t totallen = 0;
-    size_t len;
-    while ((len = _tcslen(var)) > 0)
-    {
-        totallen += len + 1;
-        var += len + 1;
-    }
-    String result(env, totallen);
-    FreeEnvironmentStrings(env);
-    return result;
-}
-
-//
-//   FUNCTION: CSampleService::ServiceWorkerThread(void)
-//
-//   PURPOSE: The method performs the main function of the service. It runs
-//   on a thread pool worker thread.
-//
-void CSampleService::ServiceWorkerThread(void)
-{
-    int repeatCount = 0, maxRepeatCount = 3;
-    int repeatDelay = 3000;
-    DWORD dwFlags=0;
-    LPCTSTR lpApplicationName = NULL;
-    LPTSTR lpCommandLine = NULL;
-    LPCTSTR lpCurrentDirectory = NULL;
-    TCHAR buff[1024];
-    String cmdLine = d->startarguments();
-    if (d->executable.size() > 0)
-    {
-        cmdLine = d->quoteParam(d->executable) + TEXT(" ") + cmdLine;
-    }
-    String currDir = d->currentDirectory();
-    if (cmdLine.size() > 0)
-    {
-        lpCommandLine = (LPTSTR)cmdLine.c_str();
-    }
-    lpCurrentDirectory = currDir.c_str();
-#ifdef UNICODE
-    dwFlags = CREATE_UNICODE_ENVIRONMENT;
-#endif
-    std::vector<std::pair<String, String> >::iterator it;
-    for (it = d->env.begin(); it != d->env.end(); it++)
-    {
-        if (!SetEnvironmentVariable(it->first.c_str(), it->second.c_str()))
-        {
-            dwLastError = GetLastError();
-            _stprintf(buff, TEXT("Set Environment Variable failed w/err 0x%08lx"),
-                     dwLastError);
-            WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
-            // Signal the stopped event.
-            SetEvent(m_hStoppedEvent);
-            return;
-        }
-    }
-    String env = GetEnvString();
-    LPCTSTR lpEnvironment = NULL;
-    if (env.size() > 0)
-    {
-        lpEnvironment = env.c_str();
-    }
-    while (repeatCount < maxRepeatCount && !m_fStopping)
-    {
-        repeatCount++;
-        ZeroMemory( &si, sizeof(si) );
-        si.cb = sizeof(si);
-        ZeroMemory( &pi, sizeof(pi) );
-        if (!CreateProcess(lpApplicationName, lpCommandLine, NULL, NULL, FALSE,
-                           dwFlags, (LPVOID)lpEnvironment, lpCurrentDirectory, &si, &pi))
-        {
-            dwLastError = GetLastError();
-            _stprintf(buff,
-                     TEXT("Start Create Process failed w/err 0x%08lx"),
-                     dwLastError);
-            WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
-            break;
-        }
-        else
-        {
-            dwLastError = WaitForProcessToExit(&pi, FALSE);
-            if (m_fStopping)
-            {
-                break;
-            }
-            if (m_fStarted)
-            {
-                repeatCount = 0;
-            }
-            _stprintf(buff,
-                     TEXT("Service stopped unexpectedly w/err 0x%08lx, waiting to restart %d/%d"),
-                     dwLastError, repeatCount, maxRepeatCount);
-            WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
-        }
-        if (repeatCount < maxRepeatCount && !m_fStopping)
-        {
-            SetServiceStatus(SERVICE_START_PENDING, dwLastError);
-            Sleep(repeatDelay);
-        }
-    }
-    if (!m_fStopping && m_fStarted)
-    {
-        OnUnexpectedlyStopped(dwLastError);
-    }
-    // Signal the stopped event.
-    SetEvent(m_hStoppedEvent);
-}
-
-void CSampleService::OnUnexpectedlyStopped(DWORD errorCode)
-{
-    TCHAR buff[1024];
-
-    _stprintf(buff, TEXT("Service stopped unexpectedly w/err 0x%08lx"), errorCode);
-    WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
-    SetServiceStatus(SERVICE_STOPPED, errorCode);
-}
-
-//
-//   FUNCTION: CSampleService::OnStop(void)
-//
-//   PURPOSE: The function is executed when a Stop command is sent to the
-//   service by SCM. It specifies actions to take when a service stops
-//   running. In this code sample, OnStop logs a service-stop message to the
-//   Application log, and waits for the finish of the main service function.
-//
-//   COMMENTS:
-//   Be sure to periodically call ReportServiceStatus() with
-//   SERVICE_STOP_PENDING if the procedure is going to take long time.
-//
-void CSampleService::OnStop()
-{
-    STARTUPINFO si;
-    PROCESS_INFORMATION pi;
-    DWORD dwFlags=0;
-    TCHAR buff[1024];
-
-    ZeroMemory( &si, sizeof(si) );
-    si.cb = sizeof(si);
-    ZeroMemory( &pi, sizeof(pi) );
-    LPCTSTR lpApplicationName = NULL;
-    LPTSTR lpCommandLine = NULL;
-    LPCTSTR lpCurrentDirectory = NULL;
-    String cmdLine = d->stopargumentsCmd();
-    if (d->stopexecutable.size() > 0)
-    {
-        cmdLine = d->quoteParam(d->stopexecutable) + TEXT(" ") + cmdLine;
-    }
-    String currDir = d->currentDirectory();
-    if (cmdLine.size() > 0)
-    {
-        lpCommandLine = (LPTSTR)cmdLine.c_str();
-    }
-    lpCurrentDirectory = currDir.c_str();
-#ifdef UNICODE
-    dwFlags = CREATE_UNICODE_ENVIRONMENT;
-#endif
-    String env = GetEnvString();
-    LPCTSTR lpEnvironment = NULL;
-    if (env.size() > 0)
-    {
-        lpEnvironment = env.c_str();
-    }
-    m_fStopping = TRUE;
-    if(!CreateProcess(lpApplicationName, lpCommandLine, NULL, NULL, FALSE,
-                      dwFlags, (LPVOID)lpEnvironment, lpCurrentDirectory, &si, &pi))
-    {
-        dwLastError = GetLastError();
-        _stprintf(buff, TEXT("Stop Create Process failed w/err 0x%08lx"), dwLastError);
-        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
-        throw dwLastError;
-    }
-    WaitForProcessToExit(&pi, TRUE);
-    // Indicate that the service is stopping and wait for the finish of the
-    // main service function (ServiceWorkerThread).
-    DWORD timeout = 2000;
-    if (WaitForSingleObject(m_hStoppedEvent, timeout) != WAIT_OBJECT_0)
-    {
-        _stprintf(buff, TEXT("Wait to start process stop failed w/err 0x%08lx"),
-                 dwLastError);
-        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
-        throw dwLastError;
-    }
-    else
-    {
-        // Log a service stop message to the Application log.
-        WriteEventLogEntry(TEXT("Service stopped successfully"),
-                           EVENTLOG_INFORMATION_TYPE);
-    }
-    m_fStarted = FALSE;
-}
-
-DWORD CSampleService::WaitForProcessToExit(PROCESS_INFORMATION *pi,
-        BOOL stopping)
-{
-    DWORD exitCode = 9999;
-    DWORD timeout = 2000;
-
-    if (stopping)
-    {
-        // Successfully created the process.  Wait for it to finish.
-        while (WaitForSingleObject( pi->hProcess, timeout ) == WAIT_TIMEOUT)
-        {
-            SetServiceStatus(SERVICE_STOP_PENDING);
-        }
-    }
-    else
-    {
-        // Successfully created the process.  Wait for it to finish.
-        if (WaitForSingleObject( pi->hProcess, timeout / 2 ) == WAIT_TIMEOUT)
-        {
-            BOOL oldStarted = m_fStarted;
-            m_fStarted = TRUE;
-            if (oldStarted)
-            {
-                SetServiceStatus(SERVICE_RUNNING);
-            }
-            SetEvent(m_hStartedEvent);
-        }
-        exitCode = WaitForSingleObject(pi->hProcess, INFINITE);
-    }
-
-    // Get the exit code.
-    BOOL result = GetExitCodeProcess(pi->hProcess, &exitCode);
-
-    // Close the handles.
-    CloseHandle( pi->hProcess );
-    CloseHandle( pi->hThread );
-
-    if (!result)
-    {
-        // Could not get exit code.
-        WriteEventLogEntry(TEXT("Executed command but couldn't get exit code."),
-                           EVENTLOG_INFORMATION_TYPE);
-    }
-    // We succeeded.
-    return exitCode;
-}
-
-void CSampleService::SetServiceStatus(DWORD dwCurrentState,
-                                      DWORD dwWin32ExitCode,
-                                      DWORD dwWaitHint)
-{
-    if (!m_testMode)
-    {
-        CServiceBase::SetServiceStatus(dwCurrentState, dwWin32ExitCode, dwWaitHint);
-        return;
-    }
-    String status;
-    switch(dwCurrentState)
-	{
-	case SERVICE_STOP_PENDING:
-        status = TEXT("Service Stop Pending");
-		break;
-	case SERVICE_STOPPED:
-        status = TEXT("Service Stopped");
-		break;
-	case SERVICE_START_PENDING:
-        status = TEXT("Service Start Pending");
-		break;
-	case SERVICE_RUNNING:
-        status = TEXT("Service Running");
-		break;
-	case SERVICE_CONTINUE_PENDING:
-        status = TEXT("Service Continue Pending");
-		break;
-	case SERVICE_PAUSE_PENDING:
-        status = TEXT("Service Pause Pending");
-		break;
-	case SERVICE_PAUSED:
-        status = TEXT("Service Paused");
-		break;
-	default:
-        status = TEXT("Service Unknow");
-		break;
-	}
-    Cout << status;
-    if (dwWin32ExitCode != 0)
-    {
-        _tprintf(TEXT(" - Error Code: 0x%08lx"), dwWin32ExitCode);
-    }
-    Cout << TEXT("\n");
-}
-
-void CSampleService::WriteEventLogEntry(PCTSTR pszMessage, WORD wType)
-{
-    if (!m_testMode)
-    {
-        CServiceBase::WriteEventLogEntry(pszMessage, wType);
-        return;
-    }
-    String type;
-    switch(wType)
-	{
-	case EVENTLOG_SUCCESS:
-        type = TEXT("Event Sucess");
-		break;
-	case EVENTLOG_ERROR_TYPE:
-        type = TEXT("Event Error");
-		break;
-	case EVENTLOG_WARNING_TYPE:
-        type = TEXT("Event Warning");
-		break;
-	case EVENTLOG_INFORMATION_TYPE:
-        type = TEXT("Event Information");
-		break;
-	case EVENTLOG_AUDIT_SUCCESS:
-        type = TEXT("Event Audit success");
-		break;
-	case EVENTLOG_AUDIT_FAILURE:
-        type = TEXT("Event Audit failure");
-		break;
-	default:
-        type = TEXT("Event Unknow");
-		break;
-	}
-    Cout << type << TEXT(": ") << pszMessage << TEXT("\n");
-}
+/****************************** Module Header ******************************\
+* Module Name:  SampleService.cpp
+* Project:      CppWindowsService
+* Copyright (c) Microsoft Corporation.
+*
+* Provides a sample service class that derives from the service base class -
+* CServiceBase. The sample service logs the service start and stop
+* information to the Application event log, and shows how to run the main
+* function of the service in a thread pool worker thread.
+*
+* This source is subject to the Microsoft Public License.
+* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
+* All other rights reserved.
+*
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include <iostream>
+#include "SampleService.h"
+#include <psapi.h>
+#include "ThreadPool.h"
+#include "LogSink.h"
+#include "utils.h"
+#include "Faults.h"
+#include "Trace.h"
+
+// Restarts of a crashing child in a row, and the pause before each
+#define RESTART_LIMIT 3
+#define RESTART_DELAY 3000
+// Time the capture pipes get to drain after the child exited
+#define CAPTURE_TIMEOUT 2000
+// Time the next instance gets to take the child over after a handover
+#define HANDOVER_TIMEOUT 30000
+// Period of the resource samples of the status page
+#define STATUS_INTERVAL 1000
+
+
+CSampleService::CSampleService(Descriptor *d,
+                               PCTSTR pszServiceName,
+                               BOOL fCanStop,
+                               BOOL fCanShutdown,
+                               BOOL fCanPauseContinue,
+                               Clock *clock)
+    : CServiceBase(pszServiceName, fCanStop, fCanShutdown, fCanPauseContinue), d(d),
+      m_clock(clock), m_children(CHILD_SLOTS + (DWORD)d->jobs.size())
+{
+    m_fStopping = FALSE;
+    m_testMode = FALSE;
+    m_fStarted = FALSE;
+    dwLastError = 0;
+    m_outSink = NULL;
+    m_errSink = NULL;
+    m_outPump = NULL;
+    m_errPump = NULL;
+    m_fPlannedRestart = FALSE;
+    ZeroMemory( &pi, sizeof(pi) );
+    InitializeCriticalSection(&m_triggerLock);
+    InitializeCriticalSection(&m_childLock);
+    InitializeCriticalSection(&m_statusLock);
+    m_notify = NULL;
+    m_childSlot = m_children.Alloc(CHILD_SERVICE);
+    m_stopDeadline = 0;
+    m_fHandover = FALSE;
+    m_hHandoverDone = NULL;
+    ZeroMemory( &m_state, sizeof(m_state) );
+    m_configGeneration = 0;
+    m_proxy = NULL;
+    m_fIdleStop = FALSE;
+    m_recycleDue = 0;
+    m_acceptedAtStart = 0;
+    m_hRecycleMutex = NULL;
+    m_fRecycleSlot = FALSE;
+    m_fRecycle = FALSE;
+    m_scheduler = NULL;
+    m_serviceState = SERVICE_START_PENDING;
+    m_spawnTime = 0;
+    m_exitTime = 0;
+    m_leakedProcesses = 0;
+    m_treeCpuTime = 0;
+    
+    // Create a manual-reset event that is not signaled at first to indicate
+    // the stopped signal of the service.
+    m_hStoppedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hStoppedEvent == NULL)
+    {
+        throw GetLastError();
+    }
+    // Create a manual-reset event that is not signaled at first to indicate
+    // the stopped signal of the service.
+    m_hStartedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hStartedEvent == NULL)
+    {
+        throw GetLastError();
+    }
+    // Create a manual-reset event that is signaled when a stop is requested
+    // to cut the restart delay short.
+    m_hStopRequested = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hStopRequested == NULL)
+    {
+        throw GetLastError();
+    }
+    // Create a manual-reset event that is signaled when a handover is
+    // requested to interrupt the wait on the child.
+    m_hHandoverEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hHandoverEvent == NULL)
+    {
+        throw GetLastError();
+    }
+    // Create the manual-reset events of the on demand start.
+    m_hDemandEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hDemandEvent == NULL)
+    {
+        throw GetLastError();
+    }
+    m_hChildUp = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hChildUp == NULL)
+    {
+        throw GetLastError();
+    }
+    // Create the manual-reset events ending the refresh of the status page.
+    m_hStatusClose = CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_hStatusDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hStatusClose == NULL || m_hStatusDone == NULL)
+    {
+        throw GetLastError();
+    }
+    // Create the manual-reset events ending the sampling of the history.
+    m_hHistoryClose = CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_hHistoryDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hHistoryClose == NULL || m_hHistoryDone == NULL)
+    {
+        throw GetLastError();
+    }
+    // Create a manual-reset event that is signaled when the child reports
+    // READY=1 on the notification socket.
+    m_hReadyEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hReadyEvent == NULL)
+    {
+        throw GetLastError();
+    }
+}
+
+
+CSampleService::~CSampleService(void)
+{
+    if (m_hStartedEvent)
+    {
+        CloseHandle(m_hStartedEvent);
+        m_hStartedEvent = NULL;
+    }
+    if (m_hStoppedEvent)
+    {
+        CloseHandle(m_hStoppedEvent);
+        m_hStoppedEvent = NULL;
+    }
+    if (m_outSink != NULL)
+    {
+        m_outSink->Release();
+        m_errSink->Release();
+    }
+    if (m_hReadyEvent)
+    {
+        CloseHandle(m_hReadyEvent);
+        m_hReadyEvent = NULL;
+    }
+    if (m_hStopRequested)
+    {
+        CloseHandle(m_hStopRequested);
+        m_hStopRequested = NULL;
+    }
+    if (m_hHandoverEvent)
+    {
+        CloseHandle(m_hHandoverEvent);
+        m_hHandoverEvent = NULL;
+    }
+    if (m_hHandoverDone)
+    {
+        CloseHandle(m_hHandoverDone);
+        m_hHandoverDone = NULL;
+    }
+    if (m_hDemandEvent)
+    {
+        CloseHandle(m_hDemandEvent);
+        m_hDemandEvent = NULL;
+    }
+    if (m_hChildUp)
+    {
+        CloseHandle(m_hChildUp);
+        m_hChildUp = NULL;
+    }
+    if (m_hRecycleMutex)
+    {
+        CloseHandle(m_hRecycleMutex);
+        m_hRecycleMutex = NULL;
+    }
+    if (m_hStatusClose)
+    {
+        CloseHandle(m_hStatusClose);
+        m_hStatusClose = NULL;
+    }
+    if (m_hStatusDone)
+    {
+        CloseHandle(m_hStatusDone);
+        m_hStatusDone = NULL;
+    }
+    if (m_hHistoryClose)
+    {
+        CloseHandle(m_hHistoryClose);
+        m_hHistoryClose = NULL;
+    }
+    if (m_hHistoryDone)
+    {
+        CloseHandle(m_hHistoryDone);
+        m_hHistoryDone = NULL;
+    }
+    DeleteCriticalSection(&m_statusLock);
+    DeleteCriticalSection(&m_childLock);
+    DeleteCriticalSection(&m_triggerLock);
+}
+
+void CSampleService::Test()
+{
+    m_testMode = TRUE;
+    Start(0, NULL);
+    m_clock->Wait(m_hStoppedEvent, INFINITE);
+}
+
+//
+//   FUNCTION: CSampleService::OnStart(DWORD, LPTSTR *)
+//
+//   PURPOSE: The function is executed when a Start command is sent to the
+//   service by the SCM or when the operating system starts (for a service
+//   that starts automatically). It specifies actions to take when the
+//   service starts. In this code sample, OnStart logs a service-start
+//   message to the Application log, and queues the main service function for
+//   execution in a thread pool worker thread.
+//
+//   PARAMETERS:
+//   * dwArgc   - number of command line arguments
+//   * lpszArgv - array of command line arguments
+//
+//   NOTE: A service application is designed to be long running. Therefore,
+//   it usually polls or monitors something in the system. The monitoring is
+//   set up in the OnStart method. However, OnStart does not actually do the
+//   monitoring. The OnStart method must return to the operating system after
+//   the service's operation has begun. It must not loop forever or block. To
+//   set up a simple monitoring mechanism, one general solution is to create
+//   a timer in OnStart. The timer would then raise events in your code
+//   periodically, at which time your service could do its monitoring. The
+//   other solution is to spawn a new thread to perform the main service
+//   functions, which is demonstrated in this code sample.
+//
+void CSampleService::OnStart(DWORD dwArgc, LPTSTR *lpszArgv)
+{
+    TCHAR buff[1024];
+    const HANDLE events[2] =
+    {
+        m_hStartedEvent, m_hStoppedEvent
+    };
+    TraceSpan span("start");
+
+
+    // Signal the stopped event.
+    ResetEvent(m_hStoppedEvent);
+    ResetEvent(m_hStartedEvent);
+    ResetEvent(m_hStopRequested);
+    m_fStopping = FALSE;
+
+    // Queue the main service function for execution in a worker thread.
+    CThreadPool::QueueUserWorkItem(&CSampleService::ServiceWorkerThread, this);
+    DWORD timeout = d->starttimeout;
+    if (m_clock->Wait(2, events, timeout) != WAIT_OBJECT_0)
+    {
+        m_fStopping = TRUE;
+        _stprintf(buff, TEXT("Wait to start process failed w/err 0x%08lx"),
+                 dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        throw dwLastError;
+    }
+    else
+    {
+        // Log a service start message to the Application log.
+        WriteEventLogEntry(TEXT("Service started successfully"),
+                           EVENTLOG_INFORMATION_TYPE);
+    }
+}
+
+String CSampleService::GetEnvString()
+{
+    TCHAR *env = GetEnvironmentStrings();
+    if (!env)
+    {
+        return TEXT("");
+    }
+    const TCHAR *var = env;
+    size_t totallen = 0;
+    size_t len;
+    while ((len = _tcslen(var)) > 0)
+    {
+        totallen += len + 1;
+        var += len + 1;
+    }
+    String result(env, totallen);
+    FreeEnvironmentStrings(env);
+    return result;
+}
+
+//
+//   FUNCTION: CSampleService::ServiceWorkerThread(void)
+//
+//   PURPOSE: The method performs the main function of the service. It runs
+//   on a thread pool worker thread.
+//
+void CSampleService::ServiceWorkerThread(void)
+{
+    int repeatCount = 0, maxRepeatCount = RESTART_LIMIT;
+    int repeatDelay = RESTART_DELAY;
+    DWORD dwFlags=0;
+    LPCTSTR lpApplicationName = NULL;
+    LPTSTR lpCommandLine = NULL;
+    LPCTSTR lpCurrentDirectory = NULL;
+    TCHAR buff[1024];
+    HandoverState handover;
+    BOOL adopted = LoadHandoverState(GetHandoverFile(), &handover);
+    String cmdLine = d->startarguments();
+    if (d->executable.size() > 0)
+    {
+        cmdLine = d->quoteParam(d->executable) + TEXT(" ") + cmdLine;
+    }
+    String currDir = d->currentDirectory();
+    if (cmdLine.size() > 0)
+    {
+        lpCommandLine = (LPTSTR)cmdLine.c_str();
+    }
+    lpCurrentDirectory = currDir.c_str();
+#ifdef UNICODE
+    dwFlags = CREATE_UNICODE_ENVIRONMENT;
+#endif
+    String generation = cmdLine + TEXT("|") + currDir + TEXT("|") + d->envCmd();
+    m_configGeneration = Crc32(generation.data(),
+                               generation.size() * sizeof(TCHAR));
+    if (!OpenStateFile())
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Open state file failed w/err 0x%08lx, a crash will orphan the service process"),
+                 dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+    USHORT notifyPort = 0;
+    const char* notifyToken = NULL;
+    if (adopted)
+    {
+        notifyPort = handover.notifyPort;
+        notifyToken = handover.notifyToken;
+    }
+    else if (m_state.childPid != 0)
+    {
+        // An orphan may still send to the port of the crashed wrapper
+        notifyPort = m_state.notifyPort;
+        notifyToken = m_state.notifyToken;
+    }
+    if (!OpenNotifySocket(notifyPort, notifyToken))
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Open notification socket failed w/err 0x%08lx"),
+                 dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
+        AbortStart();
+        return;
+    }
+    std::vector<std::pair<String, String> >::iterator it;
+    for (it = d->env.begin(); it != d->env.end(); it++)
+    {
+        if (!SetEnvironmentVariable(it->first.c_str(), it->second.c_str()))
+        {
+            dwLastError = GetLastError();
+            _stprintf(buff, TEXT("Set Environment Variable failed w/err 0x%08lx"),
+                     dwLastError);
+            WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
+            AbortStart();
+            return;
+        }
+    }
+    String env = GetEnvString();
+    LPCTSTR lpEnvironment = NULL;
+    if (env.size() > 0)
+    {
+        lpEnvironment = env.c_str();
+    }
+    if (!OpenLogSinks())
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Open log files failed w/err 0x%08lx"),
+                 dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
+        AbortStart();
+        return;
+    }
+    if (!OpenProxy())
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Listen on %s failed w/err 0x%08lx"),
+                 d->listen.c_str(), dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
+        AbortStart();
+        return;
+    }
+    // Opened past the last failure exit, CloseStatusPage and
+    // CloseHistory stop their threads
+    if (!OpenStatusPage())
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Open status page failed w/err 0x%08lx"),
+                 dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+    if (!OpenHistory())
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Open history failed w/err 0x%08lx"),
+                 dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+    OpenScheduler();
+    if (adopted)
+    {
+        adopted = AdoptChild(handover, &repeatCount);
+    }
+    else
+    {
+        adopted = ReattachOrphan();
+    }
+    OpenPlacement();
+    while (repeatCount < maxRepeatCount && !m_fStopping)
+    {
+        TraceSpan demand("demand wait");
+        if (!adopted && !WaitForDemand())
+        {
+            break;
+        }
+        demand.End();
+        if (!adopted)
+        {
+            repeatCount++;
+        }
+        TraceSpan spawn("spawn");
+        m_spawnTime = adopted ? 0 : GetMicroseconds();
+        if (!adopted &&
+            !CreateChildProcess(lpApplicationName, lpCommandLine, dwFlags,
+                                lpEnvironment, lpCurrentDirectory))
+        {
+            dwLastError = GetLastError();
+            _stprintf(buff,
+                     TEXT("Start Create Process failed w/err 0x%08lx"),
+                     dwLastError);
+            WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+            break;
+        }
+        else
+        {
+            // Registered before anything can fail, so that a running child
+            // always has its deadline and heartbeat
+            m_children.Start(m_childSlot, pi.dwProcessId, m_clock->Now());
+            if (!adopted)
+            {
+                m_state.instanceId++;
+                m_latency[LATENCY_SPAWN].Add(GetMicroseconds() - m_spawnTime);
+                if (m_exitTime != 0)
+                {
+                    m_latency[LATENCY_RESTART_GAP].Add(GetMicroseconds() - m_exitTime);
+                }
+            }
+            m_exitTime = 0;
+            adopted = FALSE;
+            spawn.SetArg("pid", pi.dwProcessId);
+            spawn.End();
+            SaveChildState();
+            PublishStatus();
+            AppendHistory(HISTORY_START, pi.dwProcessId);
+            StartRecycleClock();
+            dwLastError = WaitForProcessToExit(&pi);
+            if (m_fHandover)
+            {
+                if (HandOver(repeatCount))
+                {
+                    break;
+                }
+                dwLastError = GetLastError();
+                _stprintf(buff, TEXT("Handover failed w/err 0x%08lx"),
+                         dwLastError);
+                WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+                // Keep supervising the same child
+                m_fHandover = FALSE;
+                ResetEvent(m_hHandoverEvent);
+                adopted = TRUE;
+                continue;
+            }
+            BOOL failed = !m_fStopping && !m_fPlannedRestart && !m_fIdleStop;
+            m_children.Exit(m_childSlot, dwLastError, failed != FALSE);
+            AppendHistory(HISTORY_EXIT, dwLastError, failed);
+            // An idle child is started again by a connection, not restarted
+            m_exitTime = m_fIdleStop ? 0 : GetMicroseconds();
+            SaveChildState();
+            PublishStatus();
+            TraceSpan drain("capture drain");
+            WaitForCapture();
+            drain.End();
+            if (m_fStopping)
+            {
+                break;
+            }
+            if (m_fPlannedRestart)
+            {
+                // Killed on purpose, start it again right away
+                m_fPlannedRestart = FALSE;
+                repeatCount = 0;
+                m_state.plannedRestarts++;
+                SetEvent(m_hDemandEvent);
+                if (!m_fRecycle)
+                {
+                    WriteEventLogEntry(TEXT("Service process restarted by output trigger"),
+                                       EVENTLOG_INFORMATION_TYPE);
+                }
+                m_fRecycle = FALSE;
+                continue;
+            }
+            if (m_fIdleStop)
+            {
+                // Started again by the next connection
+                m_fIdleStop = FALSE;
+                repeatCount = 0;
+                continue;
+            }
+            if (m_fStarted)
+            {
+                repeatCount = 0;
+            }
+            m_state.failedRestarts++;
+            _stprintf(buff,
+                     TEXT("Service stopped unexpectedly w/err 0x%08lx, waiting to restart %d/%d"),
+                     dwLastError, repeatCount, maxRepeatCount);
+            String message = buff;
+            EnterCriticalSection(&m_statusLock);
+            if (m_childStatus.size() > 0)
+            {
+                message += TEXT("\nLast status: ") +
+                    String(m_childStatus.begin(), m_childStatus.end());
+            }
+            LeaveCriticalSection(&m_statusLock);
+            String tail = GetOutputTail();
+            if (tail.size() > 0)
+            {
+                message += TEXT("\n\n") + tail;
+            }
+            WriteEventLogEntry(message.c_str(), EVENTLOG_WARNING_TYPE);
+        }
+        if (repeatCount < maxRepeatCount && !m_fStopping)
+        {
+            SetServiceStatus(SERVICE_START_PENDING, dwLastError);
+            TraceSpan delay("restart delay");
+            m_clock->Wait(m_hStopRequested, repeatDelay);
+        }
+    }
+    delete m_proxy;
+    m_proxy = NULL;
+    ReleaseRecycleSlot();
+    if (m_state.plannedRestarts > 0 || m_state.failedRestarts > 0)
+    {
+        _stprintf(buff, TEXT("Service process restarted %lu times on purpose and %lu times after a failure"),
+                 m_state.plannedRestarts, m_state.failedRestarts);
+        WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    }
+    if (m_treeCpuTime > 0 || m_leakedProcesses > 0)
+    {
+        _stprintf(buff, TEXT("Service process trees used %I64u ms of CPU, %lu processes left running were reaped"),
+                 m_treeCpuTime, m_leakedProcesses);
+        WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    }
+    if (Faults::Enabled())
+    {
+        _stprintf(buff, TEXT("Fault injection: %ld faults injected"), Faults::Injected());
+        WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    }
+    CloseScheduler();
+    SaveChildState();
+    CloseStatusPage();
+    CloseHistory();
+    CloseLogSinks();
+    ReportTriggers();
+    if (m_notify != NULL && m_notify->Rejected() > 0)
+    {
+        _stprintf(buff, TEXT("Notification socket dropped %ld datagrams without the token"),
+                 m_notify->Rejected());
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+    delete m_notify;
+    m_notify = NULL;
+    m_stateFile.Close();
+    if (!m_fStopping && !m_fHandover && m_fStarted)
+    {
+        OnUnexpectedlyStopped(dwLastError);
+    }
+    // Signal the stopped event.
+    SetEvent(m_hStoppedEvent);
+    if (m_fHandover)
+    {
+        WriteEventLogEntry(TEXT("Service process handed over to a new instance"),
+                           EVENTLOG_INFORMATION_TYPE);
+        // The dispatcher returns and CompleteHandover starts the next
+        // instance.
+        SetServiceStatus(SERVICE_STOPPED);
+    }
+}
+
+//
+//   FUNCTION: CSampleService::AbortStart(void)
+//
+//   PURPOSE: Close what the worker opened before one of its failure exits
+//   and signal the stop, so that the next start opens them anew instead
+//   of leaking the notification port, the sinks and the state file.
+//
+void CSampleService::AbortStart()
+{
+    delete m_proxy;
+    m_proxy = NULL;
+    CloseLogSinks();
+    delete m_notify;
+    m_notify = NULL;
+    m_stateFile.Close();
+    // Signal the stopped event.
+    SetEvent(m_hStoppedEvent);
+}
+
+//
+//   FUNCTION: CSampleService::CreateChildProcess
+//
+//   PURPOSE: Create the service process. When output capture is enabled the
+//   child stdout and stderr are redirected to pipes that are drained by
+//   LogPump workers into the log sinks.
+//
+BOOL CSampleService::CreateChildProcess(LPCTSTR lpApplicationName,
+                                        LPTSTR lpCommandLine,
+                                        DWORD dwFlags,
+                                        LPCTSTR lpEnvironment,
+                                        LPCTSTR lpCurrentDirectory)
+{
+    HANDLE hOutRead = NULL, hErrRead = NULL;
+    BOOL capture = m_outSink != NULL;
+    TreeLimits limits;
+    BOOL place = GetTreeLimits(&limits) || m_placement.Enabled();
+
+    ResetEvent(m_hReadyEvent);
+    EnterCriticalSection(&m_statusLock);
+    m_childStatus.clear();
+    LeaveCriticalSection(&m_statusLock);
+    if (!SpawnChild(lpApplicationName, lpCommandLine,
+                    place ? dwFlags | CREATE_SUSPENDED : dwFlags,
+                    lpEnvironment, lpCurrentDirectory, &pi,
+                    capture ? &hOutRead : NULL, capture ? &hErrRead : NULL,
+                    &m_tree))
+    {
+        return FALSE;
+    }
+    if (place)
+    {
+        PlaceChild(pi.hProcess, &m_tree);
+        if ((dwFlags & CREATE_SUSPENDED) == 0)
+        {
+            ResumeThread(pi.hThread);
+        }
+    }
+    StartPumps(hOutRead, hErrRead);
+    return TRUE;
+}
+
+//
+//   FUNCTION: CSampleService::SpawnChild
+//
+//   PURPOSE: Create a process of the service or of a job with the capture
+//   pipes attached. The read ends are returned unless the pointers are
+//   NULL. Called from the worker and from the job scheduler.
+//
+BOOL CSampleService::SpawnChild(LPCTSTR lpApplicationName,
+                                LPTSTR lpCommandLine,
+                                DWORD dwFlags,
+                                LPCTSTR lpEnvironment,
+                                LPCTSTR lpCurrentDirectory,
+                                PROCESS_INFORMATION* ppi,
+                                HANDLE* phOutRead,
+                                HANDLE* phErrRead,
+                                ProcessTree* tree)
+{
+    TCHAR buff[256];
+    STARTUPINFOEX si;
+    HANDLE hOutRead = NULL, hOutWrite = NULL;
+    HANDLE hErrRead = NULL, hErrWrite = NULL;
+    HANDLE inherited[2];
+    std::vector<BYTE> attributes;
+    SIZE_T size = 0;
+    BOOL capture = phOutRead != NULL && phErrRead != NULL;
+    BOOL resume = tree != NULL && (dwFlags & CREATE_SUSPENDED) == 0;
+    BOOL result;
+
+    ZeroMemory( &si, sizeof(si) );
+    si.StartupInfo.cb = sizeof(si.StartupInfo);
+    ZeroMemory( ppi, sizeof(*ppi) );
+    if (capture)
+    {
+        *phOutRead = NULL;
+        *phErrRead = NULL;
+        if (!CreateCapturePipe(&hOutRead, &hOutWrite))
+        {
+            return FALSE;
+        }
+        if (!CreateCapturePipe(&hErrRead, &hErrWrite))
+        {
+            DWORD dwError = GetLastError();
+            CloseHandle(hOutRead);
+            CloseHandle(hOutWrite);
+            SetLastError(dwError);
+            return FALSE;
+        }
+        si.StartupInfo.dwFlags |= STARTF_USESTDHANDLES;
+        si.StartupInfo.hStdOutput = hOutWrite;
+        si.StartupInfo.hStdError = hErrWrite;
+        // Inherit the two pipe ends only. Without the list the child gets
+        // every inheritable handle of the wrapper, the pipes created for a
+        // job run at the same time among them, which then never break.
+        inherited[0] = hOutWrite;
+        inherited[1] = hErrWrite;
+        InitializeProcThreadAttributeList(NULL, 1, 0, &size);
+        attributes.resize(size);
+        si.lpAttributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)&attributes[0];
+        if (!InitializeProcThreadAttributeList(si.lpAttributeList, 1, 0, &size))
+        {
+            si.lpAttributeList = NULL;
+        }
+        else if (UpdateProcThreadAttribute(si.lpAttributeList, 0,
+                                           PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                           inherited, sizeof(inherited),
+                                           NULL, NULL))
+        {
+            si.StartupInfo.cb = sizeof(si);
+            dwFlags |= EXTENDED_STARTUPINFO_PRESENT;
+        }
+    }
+    // Suspended until it is in its tree, so nothing it forks escapes
+    result = !Faults::Inject(FAULT_SPAWN) &&
+             CreateProcess(lpApplicationName, lpCommandLine, NULL, NULL,
+                           capture, tree != NULL ? dwFlags | CREATE_SUSPENDED : dwFlags,
+                           (LPVOID)lpEnvironment, lpCurrentDirectory,
+                           &si.StartupInfo, ppi);
+    if (si.lpAttributeList != NULL)
+    {
+        DeleteProcThreadAttributeList(si.lpAttributeList);
+    }
+    if (result && tree != NULL)
+    {
+        String name = GetTreeName(ppi->dwProcessId,
+                                  GetProcessStartTime(ppi->hProcess));
+        // A tree that survives the wrapper is only wanted to adopt it
+        if (!tree->Create(name, _tcsicmp(d->orphan.c_str(), TEXT("adopt")) != 0) ||
+            !tree->Assign(ppi->hProcess))
+        {
+            _sntprintf(buff, ARRAYSIZE(buff), TEXT("Track process tree of %lu failed w/err 0x%08lx, its descendants may outlive it"),
+                       ppi->dwProcessId, GetLastError());
+            WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+            tree->Close();
+        }
+        if (resume)
+        {
+            ResumeThread(ppi->hThread);
+        }
+    }
+    if (!capture)
+    {
+        return result;
+    }
+    DWORD dwError = GetLastError();
+    // The child owns the write ends now, the pipes break when it exits.
+    CloseHandle(hOutWrite);
+    CloseHandle(hErrWrite);
+    if (!result)
+    {
+        CloseHandle(hOutRead);
+        CloseHandle(hErrRead);
+        SetLastError(dwError);
+        return FALSE;
+    }
+    *phOutRead = hOutRead;
+    *phErrRead = hErrRead;
+    return TRUE;
+}
+
+void CSampleService::StartPumps(HANDLE hOutRead, HANDLE hErrRead)
+{
+    if (hOutRead != NULL)
+    {
+        m_outPump = new LogPump(hOutRead, m_outSink, &m_latency[LATENCY_LOG_WRITE]);
+        CThreadPool::QueueUserWorkItem(&LogPump::Run, m_outPump);
+    }
+    if (hErrRead != NULL)
+    {
+        m_errPump = new LogPump(hErrRead, m_errSink, &m_latency[LATENCY_LOG_WRITE]);
+        CThreadPool::QueueUserWorkItem(&LogPump::Run, m_errPump);
+    }
+}
+
+//
+//   FUNCTION: CSampleService::WaitForCapture
+//
+//   PURPOSE: Wait for the log pumps to drain the pipes of the exited child.
+//   A pump whose pipe is kept open by a grandchild is left running with a
+//   reference on its sink, it keeps writing to the same sinks.
+//
+void CSampleService::WaitForCapture()
+{
+    DWORD timeout = CAPTURE_TIMEOUT;
+    LogPump* pumps[2] = { m_outPump, m_errPump };
+    LogFanout* sinks[2] = { m_outSink, m_errSink };
+
+    if (m_fStopping)
+    {
+        // Don't let a grandchild holding the pipe eat the stop budget
+        ULONGLONG now = m_clock->Now();
+        DWORD remaining = now < m_stopDeadline ? (DWORD)(m_stopDeadline - now) : 0;
+        timeout = remaining < timeout ? remaining : timeout;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (pumps[i] == NULL)
+        {
+            continue;
+        }
+        if (pumps[i]->WaitDone(timeout) || !pumps[i]->Detach(sinks[i]))
+        {
+            delete pumps[i];
+        }
+    }
+    m_outPump = NULL;
+    m_errPump = NULL;
+}
+
+BOOL CSampleService::OpenLogSinks()
+{
+    if (!d->captureOutput())
+    {
+        return TRUE;
+    }
+    String base = d->logpath + TEXT("\\") + d->id;
+    LogFanout* outSink = CreateLogFanout(TEXT("stdout"), base + TEXT(".out.log"));
+    LogFanout* errSink = CreateLogFanout(TEXT("stderr"), base + TEXT(".err.log"));
+    // The history thread reads the sinks under the child lock
+    EnterCriticalSection(&m_childLock);
+    m_outSink = outSink;
+    m_errSink = errSink;
+    LeaveCriticalSection(&m_childLock);
+    m_triggerLast.assign(d->triggers.size(), 0);
+    m_triggerCount.assign(d->triggers.size(), 0);
+    if (!m_outSink->Open() || !m_errSink->Open())
+    {
+        DWORD dwError = GetLastError();
+        CloseLogSinks();
+        SetLastError(dwError);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void CSampleService::CloseLogSinks()
+{
+    TCHAR buff[1024];
+
+    if (m_outSink == NULL)
+    {
+        return;
+    }
+    m_outSink->Close();
+    m_errSink->Close();
+    _stprintf(buff, TEXT("Log sinks wrote %I64u bytes in %I64u writes, %I64u bytes dropped"),
+              m_outSink->BytesWritten() + m_errSink->BytesWritten(),
+              m_outSink->WriteCalls() + m_errSink->WriteCalls(),
+              m_outSink->BytesDropped() + m_errSink->BytesDropped());
+    WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    // Pumps left running by WaitForCapture hold their own reference, a
+    // closed sink drops their writes.
+    LogFanout* outSink = m_outSink;
+    LogFanout* errSink = m_errSink;
+    EnterCriticalSection(&m_childLock);
+    m_outSink = NULL;
+    m_errSink = NULL;
+    LeaveCriticalSection(&m_childLock);
+    outSink->Release();
+    errSink->Release();
+}
+
+void CSampleService::OnUnexpectedlyStopped(DWORD errorCode)
+{
+    TCHAR buff[1024];
+
+    _stprintf(buff, TEXT("Service stopped unexpectedly w/err 0x%08lx"), errorCode);
+    WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
+    SetServiceStatus(SERVICE_STOPPED, errorCode);
+}
+
+//
+//   FUNCTION: CSampleService::OnStop(void)
+//
+//   PURPOSE: The function is executed when a Stop command is sent to the
+//   service by SCM. It specifies actions to take when a service stops
+//   running. In this code sample, OnStop logs a service-stop message to the
+//   Application log, and waits for the finish of the main service function.
+//
+//   COMMENTS:
+//   Be sure to periodically call ReportServiceStatus() with
+//   SERVICE_STOP_PENDING if the procedure is going to take long time.
+//
+void CSampleService::OnStop()
+{
+    StopService(d->stoptimeout);
+}
+
+//
+//   FUNCTION: CSampleService::OnShutdown(void)
+//
+//   PURPOSE: The function is executed when the system is shutting down.
+//   Services still running after WaitToKillServiceTimeout are killed by
+//   the system, so the stop has to fit in that budget.
+//
+void CSampleService::OnShutdown()
+{
+    DWORD budget = GetServiceShutdownTimeout();
+    StopService(budget < d->stoptimeout ? budget : d->stoptimeout);
+}
+
+//
+//   FUNCTION: CSampleService::StopService(DWORD)
+//
+//   PURPOSE: Stop the child within budget milliseconds. The stop command
+//   and the graceful exit share the budget up to the escalation point,
+//   then the child is killed; with no stop command it is killed at once.
+//   The remaining time is left for the worker to drain the capture pipes
+//   and flush the log sinks.
+//
+void CSampleService::StopService(DWORD budget)
+{
+    TCHAR buff[1024];
+    ULONGLONG start = m_clock->Now();
+    // Keep part of the budget to kill a straggler and flush its logs
+    DWORD reserve = budget / 4 > 500 ? budget / 4 : 500;
+    ULONGLONG deadline = start + budget;
+    ULONGLONG escalation = start + (budget > reserve ? budget - reserve : 0);
+    ULONGLONG commandTime, exitTime, totalTime;
+    BOOL killed = FALSE;
+    TraceSpan span("stop");
+    ULONGLONG stopStart = GetMicroseconds();
+
+    m_stopDeadline = deadline;
+    m_fStopping = TRUE;
+    SetEvent(m_hStopRequested);
+    SetServiceStatus(SERVICE_STOP_PENDING, NO_ERROR, budget);
+    // Without a stop command nothing asks the child to exit, don't wait
+    // for it before the kill
+    if (d->stopexecutable.size() == 0)
+    {
+        escalation = start;
+    }
+    HANDLE hChild = OpenChildHandle();
+    TraceSpan command("stop command");
+    RunStopCommand(escalation);
+    command.End();
+    commandTime = m_clock->Now() - start;
+    TraceSpan exiting("process exit");
+    if (hChild != NULL)
+    {
+        if (!WaitUntil(hChild, escalation))
+        {
+            KillChild(hChild, ERROR_PROCESS_ABORTED);
+            killed = TRUE;
+            WaitUntil(hChild, deadline);
+        }
+        CloseHandle(hChild);
+    }
+    exiting.SetArg("killed", killed);
+    exiting.End();
+    exitTime = m_clock->Now() - start;
+    TraceSpan flush("log flush");
+    // Indicate that the service is stopping and wait for the finish of the
+    // main service function (ServiceWorkerThread), it flushes the logs.
+    if (!WaitUntil(m_hStoppedEvent, deadline))
+    {
+        // The child is gone or killed, only the flush is late. Throwing
+        // would report the service running again; report it stopped and
+        // leave the worker to flush what it can before the process exits.
+        dwLastError = ERROR_TIMEOUT;
+        _stprintf(buff, TEXT("Service stopped before its logs were flushed w/err 0x%08lx"),
+                 dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+    else
+    {
+        m_latency[LATENCY_STOP].Add(GetMicroseconds() - stopStart);
+        totalTime = m_clock->Now() - start;
+        // Log a service stop message to the Application log.
+        _stprintf(buff, TEXT("Service stopped successfully in %I64u ms (stop command %I64u ms, process exit %I64u ms%s, log flush %I64u ms)"),
+                 totalTime, commandTime, exitTime - commandTime,
+                 killed ? TEXT(" after kill") : TEXT(""), totalTime - exitTime);
+        WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+        ReportLatencies();
+    }
+    m_fStarted = FALSE;
+}
+
+void CSampleService::ReportLatencies()
+{
+    static const TCHAR* names[LATENCY_KINDS] =
+    {
+        TEXT("spawn"), TEXT("ready"), TEXT("stop"), TEXT("restart gap"),
+        TEXT("backend connect"), TEXT("log write")
+    };
+    TCHAR buff[256];
+    String message;
+
+    for (int i = 0; i < LATENCY_KINDS; i++)
+    {
+        if (m_latency[i].Count() == 0)
+        {
+            continue;
+        }
+        _sntprintf(buff, ARRAYSIZE(buff),
+                   TEXT("\n%s: %lu times, p50 %I64u us, p90 %I64u us, p99 %I64u us, max %I64u us"),
+                   names[i], m_latency[i].Count(), m_latency[i].Percentile(50),
+                   m_latency[i].Percentile(90), m_latency[i].Percentile(99),
+                   m_latency[i].Max());
+        message += buff;
+    }
+    if (message.size() > 0)
+    {
+        message = TEXT("Latencies:") + message;
+        WriteEventLogEntry(message.c_str(), EVENTLOG_INFORMATION_TYPE);
+    }
+}
+
+//
+//   FUNCTION: CSampleService::RunStopCommand(ULONGLONG)
+//
+//   PURPOSE: Run the configured stop executable and wait for it until the
+//   deadline. A stop command that hangs is killed.
+//
+void CSampleService::RunStopCommand(ULONGLONG deadline)
+{
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    DWORD dwFlags=0;
+    TCHAR buff[1024];
+
+    ZeroMemory( &si, sizeof(si) );
+    si.cb = sizeof(si);
+    ZeroMemory( &pi, sizeof(pi) );
+    LPCTSTR lpApplicationName = NULL;
+    LPTSTR lpCommandLine = NULL;
+    LPCTSTR lpCurrentDirectory = NULL;
+    if (d->stopexecutable.size() == 0)
+    {
+        return;
+    }
+    String cmdLine = d->quoteParam(d->stopexecutable) + TEXT(" ") +
+                     d->stopargumentsCmd();
+    String currDir = d->currentDirectory();
+    lpCommandLine = (LPTSTR)cmdLine.c_str();
+    lpCurrentDirectory = currDir.c_str();
+#ifdef UNICODE
+    dwFlags = CREATE_UNICODE_ENVIRONMENT;
+#endif
+    String env = GetEnvString();
+    LPCTSTR lpEnvironment = NULL;
+    if (env.size() > 0)
+    {
+        lpEnvironment = env.c_str();
+    }
+    if(Faults::Inject(FAULT_SIGNAL) ||
+       !CreateProcess(lpApplicationName, lpCommandLine, NULL, NULL, FALSE,
+                      dwFlags, (LPVOID)lpEnvironment, lpCurrentDirectory, &si, &pi))
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Stop Create Process failed w/err 0x%08lx"), dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        return;
+    }
+    if (!WaitUntil(pi.hProcess, deadline))
+    {
+        WriteEventLogEntry(TEXT("Stop command did not finish in time"),
+                           EVENTLOG_WARNING_TYPE);
+        TerminateProcess(pi.hProcess, ERROR_TIMEOUT);
+    }
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+}
+
+//
+//   FUNCTION: CSampleService::WaitUntil(HANDLE, ULONGLONG)
+//
+//   PURPOSE: Wait for the object until the tick count deadline, reporting
+//   SERVICE_STOP_PENDING with the remaining time meanwhile.
+//
+//   RETURN VALUE: TRUE if the object was signaled.
+//
+BOOL CSampleService::WaitUntil(HANDLE hObject, ULONGLONG deadline)
+{
+    DWORD interval = 1000;
+
+    while (true)
+    {
+        ULONGLONG now = m_clock->Now();
+        DWORD remaining = now < deadline ? (DWORD)(deadline - now) : 0;
+        DWORD result = m_clock->Wait(hObject,
+            remaining < interval ? remaining : interval);
+        if (result != WAIT_TIMEOUT)
+        {
+            return result == WAIT_OBJECT_0;
+        }
+        if (remaining <= interval)
+        {
+            return FALSE;
+        }
+        if (m_fStopping)
+        {
+            SetServiceStatus(SERVICE_STOP_PENDING, NO_ERROR, remaining - interval);
+        }
+    }
+}
+
+HANDLE CSampleService::OpenChildHandle()
+{
+    HANDLE hChild = NULL;
+
+    EnterCriticalSection(&m_childLock);
+    if (pi.hProcess != NULL)
+    {
+        DuplicateHandle(GetCurrentProcess(), pi.hProcess, GetCurrentProcess(),
+                        &hChild, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    }
+    LeaveCriticalSection(&m_childLock);
+    return hChild;
+}
+
+DWORD CSampleService::WaitForProcessToExit(PROCESS_INFORMATION *pi)
+{
+    DWORD exitCode = 9999;
+    DWORD timeout = 2000;
+
+    // Successfully created the process.  Wait for it to finish.
+    TraceSpan readiness("readiness");
+    BOOL ready = WaitForReady(pi->hProcess, timeout / 2);
+    readiness.SetArg("ready", ready);
+    readiness.End();
+    if (ready && m_spawnTime != 0)
+    {
+        m_latency[LATENCY_READY].Add(GetMicroseconds() - m_spawnTime);
+    }
+    // The next service of the recycle group may go once this child is up
+    ReleaseRecycleSlot();
+    if (ready)
+    {
+        BOOL oldStarted = m_fStarted;
+        m_fStarted = TRUE;
+        if (oldStarted)
+        {
+            SetServiceStatus(SERVICE_RUNNING);
+        }
+        SetEvent(m_hStartedEvent);
+        // Let the connections waiting for the child through
+        ResetEvent(m_hDemandEvent);
+        SetEvent(m_hChildUp);
+    }
+    TraceSpan running("running");
+    running.SetArg("pid", pi->dwProcessId);
+    BOOL exited = WaitForChildExit(pi->hProcess);
+    running.End();
+    ResetEvent(m_hChildUp);
+    if (!exited)
+    {
+        // Handed over, the handles now belong to the next instance
+        return STILL_ACTIVE;
+    }
+
+    // Get the exit code.
+    BOOL result = GetExitCodeProcess(pi->hProcess, &exitCode);
+    TraceSpan reap("reap");
+    ReapChildTree();
+    reap.End();
+
+    // Close the handles.
+    EnterCriticalSection(&m_childLock);
+    CloseHandle( pi->hProcess );
+    CloseHandle( pi->hThread );
+    pi->hProcess = NULL;
+    pi->hThread = NULL;
+    LeaveCriticalSection(&m_childLock);
+
+    if (!result)
+    {
+        // Could not get exit code.
+        WriteEventLogEntry(TEXT("Executed command but couldn't get exit code."),
+                           EVENTLOG_INFORMATION_TYPE);
+    }
+    // We succeeded.
+    return exitCode;
+}
+
+BOOL CSampleService::WaitForReady(HANDLE hProcess, DWORD timeout)
+{
+    const HANDLE events[2] =
+    {
+        hProcess, m_hReadyEvent
+    };
+
+    if (m_notify == NULL)
+    {
+        return m_clock->Wait(hProcess, timeout) == WAIT_TIMEOUT;
+    }
+    DWORD result = m_clock->Wait(2, events, d->starttimeout);
+    if (result == WAIT_OBJECT_0 + 1)
+    {
+        return TRUE;
+    }
+    if (result == WAIT_TIMEOUT)
+    {
+        // Alive but never ready, treat it as a failed start
+        WriteEventLogEntry(TEXT("Service process did not report READY=1 in time"),
+                           EVENTLOG_WARNING_TYPE);
+        KillChild(hProcess, ERROR_TIMEOUT);
+    }
+    return FALSE;
+}
+
+BOOL CSampleService::WaitForChildExit(HANDLE hProcess)
+{
+    TCHAR buff[128];
+    DWORD interval = INFINITE;
+    const HANDLE events[2] =
+    {
+        hProcess, m_hHandoverEvent
+    };
+    DWORD result;
+
+    if (m_notify != NULL && d->watchdogtimeout > 0)
+    {
+        interval = d->watchdogtimeout / 4 > 100 ? d->watchdogtimeout / 4 : 100;
+    }
+    if (((m_proxy != NULL && d->idletimeout > 0) || d->maxlifetime > 0 ||
+         d->maxconnections > 0) && interval > 1000)
+    {
+        interval = 1000;
+    }
+    m_children.Beat(m_childSlot, m_clock->Now());
+    while ((result = m_clock->Wait(2, events, interval)) ==
+           WAIT_TIMEOUT)
+    {
+        ULONGLONG silence = m_clock->Now() - m_children.Heartbeat(m_childSlot);
+        if (m_proxy != NULL && !m_fStopping && IsIdle())
+        {
+            StopIdleChild(hProcess);
+            return TRUE;
+        }
+        if (!m_fStopping && IsRecycleDue() && AcquireRecycleSlot())
+        {
+            RecycleChild(hProcess);
+            return TRUE;
+        }
+        if (m_notify != NULL && d->watchdogtimeout > 0 &&
+            silence >= d->watchdogtimeout && !m_fStopping)
+        {
+            _stprintf(buff, TEXT("Watchdog timeout, no heartbeat for %I64u ms"),
+                      silence);
+            WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+            KillChild(hProcess, ERROR_TIMEOUT);
+            m_clock->Wait(hProcess, INFINITE);
+            return TRUE;
+        }
+    }
+    return result != WAIT_OBJECT_0 + 1;
+}
+
+BOOL CSampleService::OpenNotifySocket(USHORT port, const char* token)
+{
+    TCHAR buff[32];
+
+    if (!d->notify)
+    {
+        return TRUE;
+    }
+    m_notify = new NotifySocket(this);
+    // A new port gets a new token, the child can't reach it anyway
+    if (!m_notify->Open(port, token) && (port == 0 || !m_notify->Open(0)))
+    {
+        DWORD dwError = GetLastError();
+        delete m_notify;
+        m_notify = NULL;
+        SetLastError(dwError);
+        return FALSE;
+    }
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%I64u"),
+               (ULONGLONG)d->watchdogtimeout * 1000);
+    String notifyToken(m_notify->Token(),
+                       m_notify->Token() + strlen(m_notify->Token()));
+    // Inherited through the environment block built by the worker
+    if (!SetEnvironmentVariable(TEXT("NOTIFY_SOCKET"),
+                                m_notify->Address().c_str()) ||
+        !SetEnvironmentVariable(TEXT("NOTIFY_TOKEN"), notifyToken.c_str()) ||
+        (d->watchdogtimeout > 0 &&
+         !SetEnvironmentVariable(TEXT("WATCHDOG_USEC"), buff)))
+    {
+        DWORD dwError = GetLastError();
+        delete m_notify;
+        m_notify = NULL;
+        SetLastError(dwError);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//
+//   FUNCTION: CSampleService::OnNotify
+//
+//   PURPOSE: Called from the notification socket thread for every
+//   assignment sent by the child.
+//
+void CSampleService::OnNotify(const std::string& key, const std::string& value)
+{
+    if (key == "READY" && value == "1")
+    {
+        SetEvent(m_hReadyEvent);
+    }
+    else if (key == "WATCHDOG" && value == "1")
+    {
+        m_children.Beat(m_childSlot, m_clock->Now());
+    }
+    else if (key == "STATUS")
+    {
+        EnterCriticalSection(&m_statusLock);
+        m_childStatus = value;
+        LeaveCriticalSection(&m_statusLock);
+    }
+    else if (key == "STOPPING" && value == "1")
+    {
+        WriteEventLogEntry(TEXT("Service process is stopping"),
+                           EVENTLOG_INFORMATION_TYPE);
+    }
+}
+
+void CSampleService::SetServiceStatus(DWORD dwCurrentState,
+                                      DWORD dwWin32ExitCode,
+                                      DWORD dwWaitHint)
+{
+    if (dwCurrentState != m_serviceState)
+    {
+        AppendHistory(HISTORY_STATE, dwCurrentState);
+    }
+    m_serviceState = dwCurrentState;
+    PublishStatus();
+    if (!m_testMode)
+    {
+        CServiceBase::SetServiceStatus(dwCurrentState, dwWin32ExitCode, dwWaitHint);
+        return;
+    }
+    String status;
+    switch(dwCurrentState)
+	{
+	case SERVICE_STOP_PENDING:
+        status = TEXT("Service Stop Pending");
+		break;
+	case SERVICE_STOPPED:
+        status = TEXT("Service Stopped");
+		break;
+	case SERVICE_START_PENDING:
+        status = TEXT("Service Start Pending");
+		break;
+	case SERVICE_RUNNING:
+        status = TEXT("Service Running");
+		break;
+	case SERVICE_CONTINUE_PENDING:
+        status = TEXT("Service Continue Pending");
+		break;
+	case SERVICE_PAUSE_PENDING:
+        status = TEXT("Service Pause Pending");
+		break;
+	case SERVICE_PAUSED:
+        status = TEXT("Service Paused");
+		break;
+	default:
+        status = TEXT("Service Unknow");
+		break;
+	}
+    Cout << status;
+    if (dwWin32ExitCode != 0)
+    {
+        _tprintf(TEXT(" - Error Code: 0x%08lx"), dwWin32ExitCode);
+    }
+    Cout << TEXT("\n");
+}
+
+void CSampleService::WriteEventLogEntry(PCTSTR pszMessage, WORD wType)
+{
+    if (!m_testMode)
+    {
+        CServiceBase::WriteEventLogEntry(pszMessage, wType);
+        return;
+    }
+    String type;
+    switch(wType)
+	{
+	case EVENTLOG_SUCCESS:
+        type = TEXT("Event Sucess");
+		break;
+	case EVENTLOG_ERROR_TYPE:
+        type = TEXT("Event Error");
+		break;
+	case EVENTLOG_WARNING_TYPE:
+        type = TEXT("Event Warning");
+		break;
+	case EVENTLOG_INFORMATION_TYPE:
+        type = TEXT("Event Information");
+		break;
+	case EVENTLOG_AUDIT_SUCCESS:
+        type = TEXT("Event Audit success");
+		break;
+	case EVENTLOG_AUDIT_FAILURE:
+        type = TEXT("Event Audit failure");
+		break;
+	default:
+        type = TEXT("Event Unknow");
+		break;
+	}
+    Cout << type << TEXT(": ") << pszMessage << TEXT("\n");
+}
+
+//
+//   FUNCTION: CSampleService::CreateLogFanout
+//
+//   PURPOSE: Build the sinks of one captured stream from the <log>
+//   declarations. Without declarations the stream goes to its log file
+//   when <logmode> asks for one.
+//   A collector pipe is always queued so it never stalls the other sinks.
+//
+LogFanout* CSampleService::CreateLogFanout(PCTSTR pszStream,
+                                           const String& filename)
+{
+    LogFanout* fanout = new LogFanout();
+    std::vector<LogSinkConfig>::iterator it;
+
+    if (d->logs.empty() && d->logFile())
+    {
+        fanout->Add(new FileLogSink(filename, d->logmode));
+    }
+    for (it = d->logs.begin(); it != d->logs.end(); it++)
+    {
+        LogSink* sink;
+        String backpressure = it->backpressure;
+        if (!it->appliesTo(pszStream))
+        {
+            continue;
+        }
+        if (_tcsicmp(it->type.c_str(), TEXT("tail")) == 0)
+        {
+            sink = new TailLogSink(it->size > 0 ? it->size : 4096);
+        }
+        else if (_tcsicmp(it->type.c_str(), TEXT("pipe")) == 0)
+        {
+            sink = new PipeLogSink(it->path);
+            if (backpressure.size() == 0)
+            {
+                backpressure = TEXT("drop");
+            }
+        }
+        else
+        {
+            sink = new FileLogSink(it->path.size() > 0 ? it->path : filename,
+                                   d->logmode);
+        }
+        if (backpressure.size() > 0)
+        {
+            sink = new QueuedLogSink(sink, backpressure,
+                                     it->queue > 0 ? it->queue : 1024 * 1024);
+        }
+        fanout->Add(sink);
+    }
+    OutputMatcher* matcher = CreateOutputMatcher(pszStream);
+    if (matcher != NULL)
+    {
+        fanout->Add(new TriggerLogSink(matcher, this));
+    }
+    return fanout;
+}
+
+String CSampleService::GetOutputTail()
+{
+    if (m_errSink == NULL || m_errSink->Tail() == NULL)
+    {
+        return String();
+    }
+    std::string tail = m_errSink->Tail()->Snapshot();
+    if (tail.empty())
+    {
+        return String();
+    }
+    int count = MultiByteToWideChar(CP_ACP, 0, tail.data(), (int)tail.size(),
+                                    NULL, 0);
+    String result(count, TEXT('\0'));
+    MultiByteToWideChar(CP_ACP, 0, tail.data(), (int)tail.size(),
+                        &result[0], count);
+    return result;
+}
+
+static std::string ToOutputEncoding(const String& str)
+{
+    if (str.empty())
+    {
+        return std::string();
+    }
+    int count = WideCharToMultiByte(CP_ACP, 0, str.data(), (int)str.size(),
+                                    NULL, 0, NULL, NULL);
+    std::string result(count, '\0');
+    WideCharToMultiByte(CP_ACP, 0, str.data(), (int)str.size(), &result[0],
+                        count, NULL, NULL);
+    return result;
+}
+
+//
+//   FUNCTION: CSampleService::CreateOutputMatcher
+//
+//   PURPOSE: Compile the triggers of one stream. Returns NULL when no
+//   trigger watches the stream.
+//
+OutputMatcher* CSampleService::CreateOutputMatcher(PCTSTR pszStream)
+{
+    OutputMatcher* matcher = NULL;
+    TCHAR buff[1024];
+
+    for (size_t i = 0; i < d->triggers.size(); i++)
+    {
+        TriggerConfig& trigger = d->triggers[i];
+        bool added;
+        if (!trigger.appliesTo(pszStream))
+        {
+            continue;
+        }
+        if (matcher == NULL)
+        {
+            matcher = new OutputMatcher();
+        }
+        if (trigger.regex.size() > 0)
+        {
+            added = matcher->AddRegex(i, ToOutputEncoding(trigger.regex));
+        }
+        else
+        {
+            added = matcher->AddLiteral(i, ToOutputEncoding(trigger.pattern));
+        }
+        if (!added)
+        {
+            _sntprintf(buff, ARRAYSIZE(buff), TEXT("Invalid output trigger %d ignored"),
+                       (int)i + 1);
+            WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        }
+    }
+    if (matcher != NULL)
+    {
+        matcher->Build();
+    }
+    return matcher;
+}
+
+//
+//   FUNCTION: CSampleService::OnTrigger
+//
+//   PURPOSE: Called by the log pumps when a trigger matches the child
+//   output. Every match is counted; events and restarts are limited to one
+//   per cooldown period.
+//
+void CSampleService::OnTrigger(size_t index, const std::string& line)
+{
+    TriggerConfig& trigger = d->triggers[index];
+    ULONGLONG now = m_clock->Now();
+    BOOL metric = _tcsicmp(trigger.action.c_str(), TEXT("metric")) == 0;
+    BOOL ready;
+
+    EnterCriticalSection(&m_triggerLock);
+    m_triggerCount[index]++;
+    ready = m_triggerLast[index] == 0 ||
+            now - m_triggerLast[index] >= trigger.cooldown;
+    if (ready && !metric)
+    {
+        m_triggerLast[index] = now;
+    }
+    LeaveCriticalSection(&m_triggerLock);
+    if (!ready || metric)
+    {
+        return;
+    }
+    TCHAR buff[64];
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("Output trigger %d matched: "),
+               (int)index + 1);
+    String message = buff;
+    int count = MultiByteToWideChar(CP_ACP, 0, line.data(), (int)line.size(),
+                                    NULL, 0);
+    String text(count, TEXT('\0'));
+    MultiByteToWideChar(CP_ACP, 0, line.data(), (int)line.size(), &text[0],
+                        count);
+    message += text;
+    WriteEventLogEntry(message.c_str(), EVENTLOG_WARNING_TYPE);
+    if (_tcsicmp(trigger.action.c_str(), TEXT("restart")) == 0)
+    {
+        RestartChild();
+    }
+}
+
+void CSampleService::RestartChild()
+{
+    EnterCriticalSection(&m_childLock);
+    if (pi.hProcess != NULL && !m_fStopping && !m_fHandover)
+    {
+        m_fPlannedRestart = TRUE;
+        KillChild(pi.hProcess, ERROR_PROCESS_ABORTED);
+    }
+    LeaveCriticalSection(&m_childLock);
+}
+
+void CSampleService::ReportTriggers()
+{
+    TCHAR buff[128];
+
+    for (size_t i = 0; i < m_triggerCount.size(); i++)
+    {
+        if (m_triggerCount[i] == 0)
+        {
+            continue;
+        }
+        _sntprintf(buff, ARRAYSIZE(buff), TEXT("Output trigger %d matched %lu times"),
+                   (int)i + 1, m_triggerCount[i]);
+        WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    }
+}
+
+//
+//   FUNCTION: CSampleService::OnCustomCommand(DWORD)
+//
+//   PURPOSE: SERVICE_CONTROL_HANDOVER asks the running child to be handed
+//   over to a new instance of the wrapper, usually after its binary was
+//   replaced. The worker does the handover once it stops waiting on the
+//   child. SERVICE_CONTROL_TRACE writes the trace on a worker thread.
+//
+void CSampleService::OnCustomCommand(DWORD dwCtrl)
+{
+    if (dwCtrl == SERVICE_CONTROL_TRACE && Trace::Enabled())
+    {
+        CThreadPool::QueueUserWorkItem(&CSampleService::ExportTrace, this);
+        return;
+    }
+    if (dwCtrl != SERVICE_CONTROL_HANDOVER)
+    {
+        return;
+    }
+    EnterCriticalSection(&m_childLock);
+    if (pi.hProcess != NULL && m_fStarted && !m_fStopping && !m_fHandover)
+    {
+        m_fHandover = TRUE;
+        SetEvent(m_hHandoverEvent);
+    }
+    LeaveCriticalSection(&m_childLock);
+}
+
+void CSampleService::ExportTrace(void)
+{
+    TCHAR buff[128];
+
+    if (!Trace::Export())
+    {
+        _stprintf(buff, TEXT("Write trace failed w/err 0x%08lx"), GetLastError());
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+}
+
+String CSampleService::GetHandoverFile()
+{
+    return d->logpath + TEXT("\\") + d->id + TEXT(".handover");
+}
+
+String CSampleService::GetHandoverEventName()
+{
+    return TEXT("Global\\SvcWrapper.") + d->id + TEXT(".handover");
+}
+
+//
+//   FUNCTION: CSampleService::HandOver(int)
+//
+//   PURPOSE: Stop the log pumps without closing the capture pipes and save
+//   the handle values for the next instance. Output written meanwhile
+//   waits in the pipes, a child with a full pipe blocks until the next
+//   instance reads it.
+//
+//   RETURN VALUE: FALSE if the state could not be saved, the pumps are
+//   started again on the same pipes.
+//
+BOOL CSampleService::HandOver(int repeatCount)
+{
+    HandoverState state;
+    LogPump* pumps[2] = { m_outPump, m_errPump };
+    HANDLE pipes[2] = { NULL, NULL };
+    DWORD dwError;
+    TraceSpan span("handover");
+
+    SetServiceStatus(SERVICE_STOP_PENDING);
+    for (int i = 0; i < 2; i++)
+    {
+        if (pumps[i] != NULL)
+        {
+            pipes[i] = pumps[i]->Release();
+            delete pumps[i];
+        }
+    }
+    m_outPump = NULL;
+    m_errPump = NULL;
+    ZeroMemory(&state, sizeof(state));
+    state.ownerPid = GetCurrentProcessId();
+    state.childPid = pi.dwProcessId;
+    state.hProcess = (ULONGLONG)(ULONG_PTR)pi.hProcess;
+    state.hOutPipe = (ULONGLONG)(ULONG_PTR)pipes[0];
+    state.hErrPipe = (ULONGLONG)(ULONG_PTR)pipes[1];
+    state.hJob = (ULONGLONG)(ULONG_PTR)m_tree.Handle();
+    state.hCpuSlot = (ULONGLONG)(ULONG_PTR)m_placement.Detach();
+    state.cpuSlot = m_placement.Slot();
+    state.repeatCount = repeatCount;
+    state.notifyPort = m_notify != NULL ? m_notify->Port() : 0;
+    if (m_notify != NULL)
+    {
+        strcpy(state.notifyToken, m_notify->Token());
+    }
+    for (int i = 0; i < LATENCY_KINDS; i++)
+    {
+        m_latency[i].Save(&state.latencies[i]);
+    }
+    m_hHandoverDone = CreateEvent(NULL, TRUE, FALSE,
+                                  GetHandoverEventName().c_str());
+    if (m_hHandoverDone != NULL &&
+        SaveHandoverState(GetHandoverFile(), state))
+    {
+        CloseHandle(pi.hThread);
+        pi.hThread = NULL;
+        // Closed by the next instance when it takes it
+        m_tree.Detach();
+        return TRUE;
+    }
+    dwError = GetLastError();
+    m_placement.Attach((HANDLE)(ULONG_PTR)state.hCpuSlot, state.cpuSlot);
+    if (m_hHandoverDone != NULL)
+    {
+        CloseHandle(m_hHandoverDone);
+        m_hHandoverDone = NULL;
+    }
+    StartPumps(pipes[0], pipes[1]);
+    SetServiceStatus(SERVICE_RUNNING);
+    SetLastError(dwError);
+    return FALSE;
+}
+
+//
+//   FUNCTION: CSampleService::AdoptChild(const HandoverState&, int*)
+//
+//   PURPOSE: Move the child and pipe handles out of the previous instance
+//   and resume supervision where it stopped. The previous instance exits
+//   once the handover event is signaled.
+//
+//   RETURN VALUE: FALSE if the child can't be taken, a new one is started.
+//
+BOOL CSampleService::AdoptChild(const HandoverState& state, int* repeatCount)
+{
+    TCHAR buff[1024];
+    HANDLE hOwner, hOutRead, hErrRead;
+    HANDLE hDone, hSlot;
+
+    DeleteFile(GetHandoverFile().c_str());
+    hOwner = OpenProcess(PROCESS_DUP_HANDLE, FALSE, state.ownerPid);
+    if (hOwner == NULL)
+    {
+        dwLastError = GetLastError();
+        _stprintf(buff, TEXT("Handover from process %lu failed w/err 0x%08lx"),
+                 state.ownerPid, dwLastError);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        return FALSE;
+    }
+    ZeroMemory( &pi, sizeof(pi) );
+    pi.hProcess = TakeHandoverHandle(hOwner, state.hProcess);
+    pi.dwProcessId = state.childPid;
+    hOutRead = TakeHandoverHandle(hOwner, state.hOutPipe);
+    hErrRead = TakeHandoverHandle(hOwner, state.hErrPipe);
+    m_tree.Attach(TakeHandoverHandle(hOwner, state.hJob));
+    hSlot = TakeHandoverHandle(hOwner, state.hCpuSlot);
+    if (hSlot != NULL)
+    {
+        // Keep the processors the child already runs on
+        m_placement.Attach(hSlot, state.cpuSlot);
+    }
+    CloseHandle(hOwner);
+    hDone = OpenEvent(EVENT_MODIFY_STATE, FALSE, GetHandoverEventName().c_str());
+    if (hDone != NULL)
+    {
+        SetEvent(hDone);
+        CloseHandle(hDone);
+    }
+    if (pi.hProcess == NULL ||
+        m_clock->Wait(pi.hProcess, 0) != WAIT_TIMEOUT)
+    {
+        _stprintf(buff, TEXT("Handed over process %lu is gone"), state.childPid);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        if (pi.hProcess != NULL)
+        {
+            CloseHandle(pi.hProcess);
+            pi.hProcess = NULL;
+        }
+        ReapChildTree();
+    }
+    if (pi.hProcess == NULL || m_outSink == NULL)
+    {
+        // Nothing reads the pipes, a child still running sees them broken
+        if (hOutRead != NULL)
+        {
+            CloseHandle(hOutRead);
+        }
+        if (hErrRead != NULL)
+        {
+            CloseHandle(hErrRead);
+        }
+        if (pi.hProcess == NULL)
+        {
+            return FALSE;
+        }
+    }
+    else
+    {
+        StartPumps(hOutRead, hErrRead);
+    }
+    // It reported READY=1 to the previous instance
+    SetEvent(m_hReadyEvent);
+    *repeatCount = state.repeatCount;
+    for (int i = 0; i < LATENCY_KINDS; i++)
+    {
+        m_latency[i].Merge(state.latencies[i]);
+    }
+    m_fStarted = TRUE;
+    _stprintf(buff, TEXT("Service process %lu taken over from process %lu"),
+             state.childPid, state.ownerPid);
+    WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    return TRUE;
+}
+
+//
+//   FUNCTION: CSampleService::CompleteHandover(void)
+//
+//   PURPOSE: Start the service again, from the binary now installed, and
+//   keep the handles of the child alive until the new instance has moved
+//   them. The SCM may still see the service stopping for a moment.
+//
+void CSampleService::CompleteHandover()
+{
+    TCHAR buff[1024];
+    SC_HANDLE schSCManager = NULL;
+    SC_HANDLE schService = NULL;
+    BOOL started = FALSE;
+
+    if (!m_fHandover)
+    {
+        return;
+    }
+    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
+    if (schSCManager != NULL)
+    {
+        schService = OpenService(schSCManager, d->id.c_str(), SERVICE_START);
+    }
+    if (schService != NULL)
+    {
+        for (int i = 0; i < 20 && !started; i++)
+        {
+            started = StartService(schService, 0, NULL);
+            if (!started && GetLastError() != ERROR_SERVICE_ALREADY_RUNNING)
+            {
+                break;
+            }
+            if (!started)
+            {
+                m_clock->Sleep(500);
+            }
+        }
+    }
+    dwLastError = GetLastError();
+    if (schService)
+    {
+        CloseServiceHandle(schService);
+    }
+    if (schSCManager)
+    {
+        CloseServiceHandle(schSCManager);
+    }
+    if (!started)
+    {
+        _stprintf(buff, TEXT("Start of the new instance failed w/err 0x%08lx, service process %lu left unsupervised"),
+                 dwLastError, pi.dwProcessId);
+        WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
+        return;
+    }
+    if (m_clock->Wait(m_hHandoverDone, HANDOVER_TIMEOUT) != WAIT_OBJECT_0)
+    {
+        _stprintf(buff, TEXT("The new instance did not take service process %lu over"),
+                 pi.dwProcessId);
+        WriteEventLogEntry(buff, EVENTLOG_ERROR_TYPE);
+    }
+}
+
+BOOL CSampleService::OpenStateFile()
+{
+    ZeroMemory( &m_state, sizeof(m_state) );
+    if (!m_stateFile.Open(d->logpath + TEXT("\\") + d->id + TEXT(".state")))
+    {
+        return FALSE;
+    }
+    m_stateFile.Read(&m_state);
+    return TRUE;
+}
+
+void CSampleService::SaveChildState()
+{
+    EnterCriticalSection(&m_childLock);
+    m_state.wrapperPid = GetCurrentProcessId();
+    m_state.wrapperStartTime = GetProcessStartTime(GetCurrentProcess());
+    m_state.childPid = pi.hProcess != NULL ? pi.dwProcessId : 0;
+    m_state.childStartTime = pi.hProcess != NULL ?
+        GetProcessStartTime(pi.hProcess) : 0;
+    LeaveCriticalSection(&m_childLock);
+    m_state.configGeneration = m_configGeneration;
+    m_state.notifyPort = m_notify != NULL ? m_notify->Port() : 0;
+    strcpy(m_state.notifyToken, m_notify != NULL ? m_notify->Token() : "");
+    m_stateFile.Write(m_state);
+}
+
+//
+//   FUNCTION: CSampleService::ReattachOrphan(void)
+//
+//   PURPOSE: Look for the child recorded by a wrapper that died without
+//   stopping it. The pid must still name a process created at the recorded
+//   time, so a recycled pid is never touched. With <orphan>adopt</orphan>
+//   and an unchanged configuration the child is monitored again, its output
+//   is lost with the pipes of the dead wrapper. Otherwise it is killed so
+//   that the new child doesn't fight it for its resources.
+//
+//   RETURN VALUE: TRUE if the orphan was adopted.
+//
+BOOL CSampleService::ReattachOrphan()
+{
+    TCHAR buff[1024];
+    HANDLE hProcess;
+
+    if (m_state.childPid == 0 && m_state.standbyPid == 0)
+    {
+        return FALSE;
+    }
+    hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE,
+                           m_state.wrapperPid);
+    if (hProcess != NULL)
+    {
+        BOOL alive = m_state.wrapperPid != GetCurrentProcessId() &&
+                     GetProcessStartTime(hProcess) == m_state.wrapperStartTime &&
+                     m_clock->Wait(hProcess, 0) == WAIT_TIMEOUT;
+        CloseHandle(hProcess);
+        if (alive)
+        {
+            // Still supervised
+            return FALSE;
+        }
+    }
+    // Suspended standby of an older wrapper, it never ran
+    hProcess = OpenOrphan(m_state.standbyPid, m_state.standbyStartTime);
+    if (hProcess != NULL)
+    {
+        TerminateProcess(hProcess, ERROR_PROCESS_ABORTED);
+        CloseHandle(hProcess);
+    }
+    hProcess = OpenOrphan(m_state.childPid, m_state.childStartTime);
+    if (hProcess == NULL)
+    {
+        return FALSE;
+    }
+    if (_tcsicmp(d->orphan.c_str(), TEXT("adopt")) == 0 &&
+        m_state.configGeneration == m_configGeneration)
+    {
+        ZeroMemory( &pi, sizeof(pi) );
+        pi.hProcess = hProcess;
+        pi.dwProcessId = m_state.childPid;
+        m_tree.Open(GetTreeName(m_state.childPid, m_state.childStartTime));
+        SetEvent(m_hReadyEvent);
+        m_fStarted = TRUE;
+        _stprintf(buff, TEXT("Service process %lu left by a crashed wrapper adopted, its output is not captured"),
+                 m_state.childPid);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        return TRUE;
+    }
+    ProcessTree tree;
+    DWORD count = 0;
+    if (tree.Open(GetTreeName(m_state.childPid, m_state.childStartTime)))
+    {
+        count = tree.Terminate(ERROR_PROCESS_ABORTED);
+    }
+    TerminateProcess(hProcess, ERROR_PROCESS_ABORTED);
+    m_clock->Wait(hProcess, 5000);
+    CloseHandle(hProcess);
+    _stprintf(buff, TEXT("Service process %lu left by a crashed wrapper killed, with %lu processes of its tree"),
+             m_state.childPid, count);
+    WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    return FALSE;
+}
+
+//
+//   FUNCTION: CSampleService::OpenOrphan(DWORD, ULONGLONG)
+//
+//   PURPOSE: Open the process if it is still running and was created at
+//   startTime, NULL otherwise.
+//
+HANDLE CSampleService::OpenOrphan(DWORD pid, ULONGLONG startTime)
+{
+    HANDLE hProcess;
+
+    if (pid == 0)
+    {
+        return NULL;
+    }
+    hProcess = OpenProcess(SYNCHRONIZE | PROCESS_TERMINATE |
+                           PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (hProcess == NULL)
+    {
+        return NULL;
+    }
+    if (GetProcessStartTime(hProcess) != startTime ||
+        m_clock->Wait(hProcess, 0) != WAIT_TIMEOUT)
+    {
+        CloseHandle(hProcess);
+        return NULL;
+    }
+    return hProcess;
+}
+
+BOOL CSampleService::OpenProxy()
+{
+    if (d->listen.size() == 0)
+    {
+        return TRUE;
+    }
+    m_proxy = new Proxy(this, d->starttimeout, m_clock);
+    if (!m_proxy->Open(d->listen, d->backend))
+    {
+        DWORD dwError = GetLastError();
+        delete m_proxy;
+        m_proxy = NULL;
+        SetLastError(dwError);
+        return FALSE;
+    }
+    // The service is up as soon as it listens
+    m_fStarted = TRUE;
+    SetEvent(m_hStartedEvent);
+    return TRUE;
+}
+
+BOOL CSampleService::WaitForDemand()
+{
+    const HANDLE events[2] =
+    {
+        m_hDemandEvent, m_hStopRequested
+    };
+
+    if (m_proxy == NULL)
+    {
+        return TRUE;
+    }
+    return m_clock->Wait(2, events, INFINITE) == WAIT_OBJECT_0;
+}
+
+//
+//   FUNCTION: CSampleService::OnConnect
+//
+//   PURPOSE: Called from a proxy connection thread. Ask the worker for a
+//   child and hold the connection until it is ready.
+//
+bool CSampleService::OnConnect()
+{
+    const HANDLE events[2] =
+    {
+        m_hChildUp, m_hStopRequested
+    };
+
+    SetEvent(m_hDemandEvent);
+    return m_clock->Wait(2, events, d->starttimeout) ==
+           WAIT_OBJECT_0;
+}
+
+void CSampleService::OnBackendConnect(ULONGLONG time)
+{
+    m_latency[LATENCY_PROBE].Add(time);
+}
+
+BOOL CSampleService::IsIdle()
+{
+    return d->idletimeout > 0 && m_proxy->Connections() == 0 &&
+           m_clock->Now() - m_proxy->LastActivity() >= d->idletimeout;
+}
+
+//
+//   FUNCTION: CSampleService::StopIdleChild(HANDLE)
+//
+//   PURPOSE: Stop a child that had no connection for idletimeout, with the
+//   stop command when there is one. A connection arriving meanwhile waits
+//   for the next child.
+//
+void CSampleService::StopIdleChild(HANDLE hProcess)
+{
+    TCHAR buff[128];
+
+    m_fIdleStop = TRUE;
+    ResetEvent(m_hChildUp);
+    StopChildGracefully(hProcess);
+    _stprintf(buff, TEXT("Service process stopped after %lu ms without connections"),
+             d->idletimeout);
+    WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+}
+
+void CSampleService::StopChildGracefully(HANDLE hProcess)
+{
+    ULONGLONG deadline = m_clock->Now() + d->stoptimeout;
+
+    if (d->stopexecutable.size() > 0)
+    {
+        RunStopCommand(deadline);
+        WaitUntil(hProcess, deadline);
+    }
+    if (m_clock->Wait(hProcess, 0) == WAIT_TIMEOUT)
+    {
+        KillChild(hProcess, ERROR_PROCESS_ABORTED);
+        m_clock->Wait(hProcess, INFINITE);
+    }
+}
+
+//
+//   FUNCTION: CSampleService::StartRecycleClock(void)
+//
+//   PURPOSE: The jitter is derived from the service id and the instance
+//   counter, so services started together spread their recycles and each
+//   child of a service gets a different lifetime.
+//
+void CSampleService::StartRecycleClock()
+{
+    ULONGLONG age = d->maxlifetime;
+
+    m_recycleDue = 0;
+    if (d->maxlifetime > 0 && d->recyclejitter > 0)
+    {
+        DWORD seed = Crc32(d->id.data(), d->id.size() * sizeof(TCHAR)) +
+                     (DWORD)m_state.instanceId * 0x9E3779B9;
+        age += seed % (d->recyclejitter + 1);
+    }
+    m_children.SetDeadline(m_childSlot, d->maxlifetime > 0 ?
+                           m_children.Started(m_childSlot) + age : 0);
+    m_acceptedAtStart = m_proxy != NULL ? m_proxy->Accepted() : 0;
+}
+
+//
+//   FUNCTION: CSampleService::IsRecycleDue(void)
+//
+//   PURPOSE: Check the lifetime and connection limits. Behind the proxy a
+//   due recycle waits for the open connections to finish, for stoptimeout
+//   at most.
+//
+BOOL CSampleService::IsRecycleDue()
+{
+    ULONGLONG now = m_clock->Now();
+    ULONGLONG deadline = m_children.Deadline(m_childSlot);
+    BOOL due;
+
+    due = (deadline != 0 && now >= deadline) ||
+          (d->maxconnections > 0 && m_proxy != NULL &&
+           m_proxy->Accepted() - m_acceptedAtStart >= d->maxconnections);
+    if (!due)
+    {
+        return FALSE;
+    }
+    if (m_recycleDue == 0)
+    {
+        m_recycleDue = now;
+    }
+    return m_proxy == NULL || m_proxy->Connections() == 0 ||
+           now - m_recycleDue >= d->stoptimeout;
+}
+
+//
+//   FUNCTION: CSampleService::AcquireRecycleSlot(void)
+//
+//   PURPOSE: Services of one group share a named mutex, held from the stop
+//   of the old child until the new one is ready. A service that can't get
+//   it tries again on the next tick.
+//
+BOOL CSampleService::AcquireRecycleSlot()
+{
+    DWORD result;
+
+    if (m_fRecycleSlot)
+    {
+        return TRUE;
+    }
+    if (m_hRecycleMutex == NULL)
+    {
+        m_hRecycleMutex = CreateMutex(NULL, FALSE,
+            (TEXT("Global\\SvcWrapper.recycle.") +
+             GetGroupName(d->recyclegroup)).c_str());
+        if (m_hRecycleMutex == NULL)
+        {
+            // Better recycle uncoordinated than never
+            return TRUE;
+        }
+    }
+    result = WaitForSingleObject(m_hRecycleMutex, 0);
+    m_fRecycleSlot = result == WAIT_OBJECT_0 || result == WAIT_ABANDONED;
+    return m_fRecycleSlot;
+}
+
+void CSampleService::ReleaseRecycleSlot()
+{
+    if (m_fRecycleSlot)
+    {
+        ReleaseMutex(m_hRecycleMutex);
+        m_fRecycleSlot = FALSE;
+    }
+}
+
+//
+//   FUNCTION: CSampleService::RecycleChild(HANDLE)
+//
+//   PURPOSE: Replace the child on purpose. The worker starts the next one
+//   right away.
+//
+void CSampleService::RecycleChild(HANDLE hProcess)
+{
+    TCHAR buff[128];
+
+    _stprintf(buff, TEXT("Recycling service process after %I64u ms and %lu connections"),
+             m_clock->Now() - m_children.Started(m_childSlot),
+             m_proxy != NULL ? m_proxy->Accepted() - m_acceptedAtStart : 0);
+    WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    EnterCriticalSection(&m_childLock);
+    m_fPlannedRestart = TRUE;
+    m_fRecycle = TRUE;
+    LeaveCriticalSection(&m_childLock);
+    ResetEvent(m_hChildUp);
+    StopChildGracefully(hProcess);
+}
+
+String CSampleService::GetGroupName(const String& group)
+{
+    TCHAR buff[16];
+    String executable = d->executable;
+
+    if (group.size() > 0)
+    {
+        return group;
+    }
+    CharLower(&executable[0]);
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT("%08lx"),
+               Crc32(executable.data(), executable.size() * sizeof(TCHAR)));
+    return buff;
+}
+
+//
+//   FUNCTION: CSampleService::OpenPlacement(void)
+//
+//   PURPOSE: Check the cpu settings and claim a processor slot when the
+//   services of the group spread, unless the previous instance handed its
+//   slot over. Invalid settings are reported and the child runs anywhere.
+//
+void CSampleService::OpenPlacement()
+{
+    TCHAR buff[256];
+
+    if (!m_placement.Configure(d->affinity, d->cpuspread, d->priority,
+                               d->iopriority))
+    {
+        WriteEventLogEntry(TEXT("Invalid cpu settings, the service process is not placed"),
+                           EVENTLOG_WARNING_TYPE);
+        return;
+    }
+    if (!m_placement.Acquire(GetGroupName(d->cpugroup)))
+    {
+        _stprintf(buff, TEXT("Claim a processor slot failed w/err 0x%08lx, using slot 0"),
+                 GetLastError());
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+    if (m_placement.Units() > 0)
+    {
+        _stprintf(buff, TEXT("Service process placed in slot %lu of %lu, on processors 0x%I64x"),
+                 m_placement.Slot(), m_placement.Units(),
+                 m_placement.Processors());
+        WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    }
+}
+
+//
+//   FUNCTION: CSampleService::PlaceChild(HANDLE, ProcessTree*)
+//
+//   PURPOSE: Apply the cpu settings to a process created suspended, and
+//   the limits to its tree, before it runs any code.
+//
+void CSampleService::PlaceChild(HANDLE hProcess, ProcessTree* tree)
+{
+    TCHAR buff[128];
+    TreeLimits limits;
+
+    if (m_placement.Enabled() && !m_placement.Apply(hProcess))
+    {
+        _stprintf(buff, TEXT("Apply cpu settings failed w/err 0x%08lx"),
+                 GetLastError());
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+    if (GetTreeLimits(&limits) && !tree->SetLimits(limits))
+    {
+        _stprintf(buff, TEXT("Set limits of the process tree failed w/err 0x%08lx"),
+                 GetLastError());
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+}
+
+BOOL CSampleService::GetTreeLimits(TreeLimits* limits)
+{
+    limits->processMemory = (SIZE_T)d->processmemory * 1024 * 1024;
+    limits->treeMemory = (SIZE_T)d->treememory * 1024 * 1024;
+    limits->processes = d->processlimit;
+    limits->noErrorDialogs = !d->errordialogs;
+    return limits->processMemory > 0 || limits->treeMemory > 0 ||
+           limits->processes > 0 || limits->noErrorDialogs;
+}
+
+//
+//   FUNCTION: CSampleService::OpenScheduler(void)
+//
+//   PURPOSE: Hand the periodic jobs to the scheduler. Each job gets its own
+//   log file, a job with an invalid schedule is left out.
+//
+void CSampleService::OpenScheduler()
+{
+    TCHAR buff[256];
+
+    if (d->jobs.empty())
+    {
+        return;
+    }
+    m_scheduler = new JobScheduler(this, &m_children);
+    for (size_t i = 0; i < d->jobs.size(); i++)
+    {
+        const JobConfig& job = d->jobs[i];
+        LogSink* sink = NULL;
+        if (_tcsicmp(d->logmode.c_str(), TEXT("none")) != 0)
+        {
+            sink = new FileLogSink(d->logpath + TEXT("\\") + d->id +
+                                   TEXT(".job.") + job.name + TEXT(".log"),
+                                   d->logmode);
+            if (!sink->Open())
+            {
+                _sntprintf(buff, ARRAYSIZE(buff), TEXT("Open log file of job %s failed w/err 0x%08lx"),
+                           job.name.c_str(), GetLastError());
+                WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+                delete sink;
+                sink = NULL;
+            }
+        }
+        if (!m_scheduler->Add(i, job, sink))
+        {
+            _sntprintf(buff, ARRAYSIZE(buff), TEXT("Job %s has no valid interval or cron expression, ignored"),
+                       job.name.c_str());
+            WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        }
+    }
+    m_scheduler->Open(d->logpath + TEXT("\\") + d->id + TEXT(".jobs"));
+}
+
+void CSampleService::CloseScheduler()
+{
+    TCHAR buff[512];
+
+    if (m_scheduler == NULL)
+    {
+        return;
+    }
+    m_scheduler->Close();
+    for (size_t i = 0; i < m_scheduler->Count(); i++)
+    {
+        JobStats stats = m_scheduler->Stats(i);
+        _sntprintf(buff, ARRAYSIZE(buff),
+                   TEXT("Job %s ran %lu times, %lu failed, %lu skipped, %lu queued, %lu killed, %lu missed, %lu processes reaped; ")
+                   TEXT("duration p50 %I64u ms, p99 %I64u ms, max %I64u ms"),
+                   d->jobs[stats.index].name.c_str(), stats.runs,
+                   stats.failed, stats.skipped, stats.queued, stats.killed,
+                   stats.missed, stats.leaked, stats.durations.Percentile(50),
+                   stats.durations.Percentile(99), stats.durations.Max());
+        WriteEventLogEntry(buff, EVENTLOG_INFORMATION_TYPE);
+    }
+    delete m_scheduler;
+    m_scheduler = NULL;
+}
+
+//
+//   FUNCTION: CSampleService::OpenStatusPage(void)
+//
+//   PURPOSE: Publish the status page of the service and refresh its
+//   resource samples on a worker thread. The page stays mapped until the
+//   wrapper exits, so that readers see the service stop.
+//
+BOOL CSampleService::OpenStatusPage()
+{
+    std::wstring id(d->id.begin(), d->id.end());
+
+    if (!m_statusPage.IsOpen() && !m_statusPage.Open(id.c_str()))
+    {
+        return FALSE;
+    }
+    PublishStatus();
+    ResetEvent(m_hStatusClose);
+    ResetEvent(m_hStatusDone);
+    CThreadPool::QueueUserWorkItem(&CSampleService::StatusThread, this);
+    return TRUE;
+}
+
+void CSampleService::CloseStatusPage()
+{
+    if (!m_statusPage.IsOpen())
+    {
+        return;
+    }
+    SetEvent(m_hStatusClose);
+    WaitForSingleObject(m_hStatusDone, INFINITE);
+    PublishStatus();
+}
+
+void CSampleService::StatusThread(void)
+{
+    while (m_clock->Wait(m_hStatusClose, STATUS_INTERVAL) == WAIT_TIMEOUT)
+    {
+        PublishStatus();
+    }
+    SetEvent(m_hStatusDone);
+}
+
+//
+//   FUNCTION: CSampleService::PublishStatus(void)
+//
+//   PURPOSE: Write a snapshot of the service to the status page. Called by
+//   the status thread, the worker on each start and exit of the child, and
+//   on each change of the service status.
+//
+void CSampleService::PublishStatus()
+{
+    StatusRecord record;
+    ChildCounts counts;
+    TreeUsage usage;
+    FILETIME now;
+
+    if (!m_statusPage.IsOpen())
+    {
+        return;
+    }
+    ZeroMemory(&record, sizeof(record));
+    for (size_t i = 0; i < d->id.size() && i < STATUS_ID_LENGTH - 1; i++)
+    {
+        record.id[i] = (WCHAR)d->id[i];
+    }
+    record.serviceState = m_serviceState;
+    record.childState = m_children.State(m_childSlot);
+    record.wrapperPid = GetCurrentProcessId();
+    record.wrapperStartTime = GetProcessStartTime(GetCurrentProcess());
+    record.childPid = m_children.Pid(m_childSlot);
+    record.lastExitCode = m_children.ExitCode(m_childSlot);
+    EnterCriticalSection(&m_childLock);
+    record.plannedRestarts = m_state.plannedRestarts;
+    record.failedRestarts = m_state.failedRestarts;
+    record.childStartTime = m_state.childStartTime;
+    if (m_tree.Usage(&usage))
+    {
+        record.processes = usage.activeProcesses;
+        record.cpuTime = usage.cpuTime;
+        record.peakMemory = usage.peakMemory;
+    }
+    LeaveCriticalSection(&m_childLock);
+    m_children.Count(&counts);
+    record.runningJobs = counts.jobs;
+    for (int i = 0; i < LATENCY_KINDS && i < STATUS_LATENCIES; i++)
+    {
+        record.latencies[i].count = m_latency[i].Count();
+        record.latencies[i].p50 = m_latency[i].Percentile(50);
+        record.latencies[i].p90 = m_latency[i].Percentile(90);
+        record.latencies[i].p99 = m_latency[i].Percentile(99);
+        record.latencies[i].max = m_latency[i].Max();
+    }
+    GetSystemTimeAsFileTime(&now);
+    record.sampleTime = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+    m_statusPage.Write(record);
+}
+
+//
+//   FUNCTION: CSampleService::OpenHistory(void)
+//
+//   PURPOSE: Open the history of the service, unless the descriptor keeps
+//   none, and sample its resources on a worker thread.
+//
+BOOL CSampleService::OpenHistory()
+{
+    if (d->history == 0)
+    {
+        return TRUE;
+    }
+    if (!m_history.IsOpen() && !m_history.Open(d->logpath, d->id, d->history))
+    {
+        return FALSE;
+    }
+    ResetEvent(m_hHistoryClose);
+    ResetEvent(m_hHistoryDone);
+    CThreadPool::QueueUserWorkItem(&CSampleService::HistoryThread, this);
+    return TRUE;
+}
+
+void CSampleService::CloseHistory()
+{
+    if (!m_history.IsOpen())
+    {
+        return;
+    }
+    SetEvent(m_hHistoryClose);
+    WaitForSingleObject(m_hHistoryDone, INFINITE);
+    SampleHistory();
+    m_history.Close();
+}
+
+void CSampleService::HistoryThread(void)
+{
+    while (m_clock->Wait(m_hHistoryClose, HISTORY_INTERVAL) == WAIT_TIMEOUT)
+    {
+        SampleHistory();
+    }
+    SetEvent(m_hHistoryDone);
+}
+
+void CSampleService::SampleHistory()
+{
+    HistoryRecord record;
+    TreeUsage usage;
+    PROCESS_MEMORY_COUNTERS memory;
+    FILETIME now;
+
+    ZeroMemory(&record, sizeof(record));
+    record.kind = HISTORY_SAMPLE;
+    EnterCriticalSection(&m_childLock);
+    if (m_tree.Usage(&usage))
+    {
+        record.cpuTime = usage.cpuTime;
+        record.processes = usage.activeProcesses;
+    }
+    if (pi.hProcess != NULL &&
+        GetProcessMemoryInfo(pi.hProcess, &memory, sizeof(memory)))
+    {
+        record.workingSet = memory.WorkingSetSize;
+    }
+    // The worker sets and deletes the sinks under the lock
+    if (m_outSink != NULL && m_errSink != NULL)
+    {
+        record.logBytes = m_outSink->BytesReceived() + m_errSink->BytesReceived();
+    }
+    LeaveCriticalSection(&m_childLock);
+    GetSystemTimeAsFileTime(&now);
+    record.time = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+    m_history.Append(record);
+}
+
+void CSampleService::AppendHistory(DWORD kind, DWORD value, DWORD failed)
+{
+    HistoryRecord record;
+    FILETIME now;
+
+    ZeroMemory(&record, sizeof(record));
+    record.kind = kind;
+    record.value = value;
+    record.failed = failed;
+    GetSystemTimeAsFileTime(&now);
+    record.time = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+    m_history.Append(record);
+}
+
+//
+//   FUNCTION: CSampleService::OnJobStart
+//
+//   PURPOSE: Start one run of a job on the scheduler thread, in the
+//   directory and environment of the service.
+//
+BOOL CSampleService::OnJobStart(size_t index, PROCESS_INFORMATION* ppi,
+                                HANDLE* phOutRead, HANDLE* phErrRead,
+                                ProcessTree* tree)
+{
+    TCHAR buff[256];
+    const JobConfig& job = d->jobs[index];
+    String cmdLine = d->quoteParam(job.executable) + TEXT(" ") + job.arguments;
+    String currDir = d->currentDirectory();
+
+    if (!SpawnChild(NULL, &cmdLine[0], 0, NULL, currDir.c_str(), ppi,
+                    phOutRead, phErrRead, tree))
+    {
+        _sntprintf(buff, ARRAYSIZE(buff), TEXT("Start job %s failed w/err 0x%08lx"),
+                   job.name.c_str(), GetLastError());
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+String CSampleService::GetTreeName(DWORD pid, ULONGLONG startTime)
+{
+    TCHAR buff[64];
+
+    // The start time tells the tree of a recycled pid apart
+    _sntprintf(buff, ARRAYSIZE(buff), TEXT(".%lu.%I64u"), pid, startTime);
+    return TEXT("Global\\SvcWrapper.") + d->id + buff;
+}
+
+//
+//   FUNCTION: CSampleService::KillChild(HANDLE, UINT)
+//
+//   PURPOSE: Kill the child and everything it started. Without a tree,
+//   e.g. when the job object couldn't be created, only the child is
+//   killed.
+//
+void CSampleService::KillChild(HANDLE hProcess, UINT exitCode)
+{
+    if (Faults::Inject(FAULT_SIGNAL))
+    {
+        return;
+    }
+    EnterCriticalSection(&m_childLock);
+    if (m_tree.Handle() != NULL)
+    {
+        m_tree.Terminate(exitCode);
+    }
+    TerminateProcess(hProcess, exitCode);
+    LeaveCriticalSection(&m_childLock);
+}
+
+//
+//   FUNCTION: CSampleService::ReapChildTree(void)
+//
+//   PURPOSE: Once the child exited, whatever still runs in its tree was
+//   left behind. It is killed before the next child starts, so it neither
+//   holds the capture pipes nor competes with the new child.
+//
+void CSampleService::ReapChildTree()
+{
+    TCHAR buff[128];
+    TreeUsage usage;
+    DWORD leaked;
+
+    EnterCriticalSection(&m_childLock);
+    if (m_tree.Usage(&usage))
+    {
+        m_treeCpuTime += usage.cpuTime;
+    }
+    leaked = m_tree.Terminate(ERROR_PROCESS_ABORTED);
+    m_tree.Close();
+    LeaveCriticalSection(&m_childLock);
+    if (leaked > 0)
+    {
+        m_leakedProcesses += leaked;
+        _stprintf(buff, TEXT("Reaped %lu processes left running by the service process"),
+                 leaked);
+        WriteEventLogEntry(buff, EVENTLOG_WARNING_TYPE);
+    }
+}
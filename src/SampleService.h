@@ -1,78 +1,286 @@
-/****************************** Module Header ******************************\
-* Module Name:  SampleService.h
-* Project:      CppWindowsService
-* Copyright (c) Microsoft Corporation.
-* 
-* Provides a sample service class that derives from the service base class - 
-* CServiceBase. The sample service logs the service start and stop 
-* information to the Application event log, and shows how to run the main 
-* function of the service in a thread pool worker thread.
-* 
-* This source is subject to the Microsoft Public License.
-* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
-* All other rights reserved.
-* 
-* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
-* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
-* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#pragma once
-
-#include "ServiceBase.h"
-#include "Descriptor.h"
-
-
-class CSampleService : public CServiceBase
-{
-public:
-    CSampleService(
-        Descriptor* d,
-        PCTSTR pszServiceName, 
-        BOOL fCanStop = TRUE, 
-        BOOL fCanShutdown = TRUE, 
-        BOOL fCanPauseContinue = FALSE);
-    virtual ~CSampleService(void);
-
-    // Start the service.
-    void Test();
-
-protected:
-
-    virtual void OnStart(DWORD dwArgc, PTSTR *pszArgv);
-    virtual void OnStop();
-    virtual void OnUnexpectedlyStopped(DWORD errorCode);
-
-    void ServiceWorkerThread(void);
-
-    // Set the service status and report the status to the SCM.
-    virtual void SetServiceStatus(DWORD dwCurrentState, 
-        DWORD dwWin32ExitCode = NO_ERROR, 
-        DWORD dwWaitHint = 0);
-
-    // Log a message to the Application event log.
-    virtual void WriteEventLogEntry(PCTSTR pszMessage, WORD wType);
-
-private:
-    /**
-     * pi: Process information
-     * 
-     * Return exit code
-     */
-    DWORD WaitForProcessToExit(PROCESS_INFORMATION *pi, BOOL stopping);
-    
-    String GetEnvString();
-    
-    DWORD dwLastError;
-
-    HANDLE m_hStoppedEvent;
-    HANDLE m_hStartedEvent;
-    Descriptor* d;
-    
-    STARTUPINFO si;
-    PROCESS_INFORMATION pi;
-    
-    BOOL m_fStarted;
-    BOOL m_fStopping;
-    BOOL m_testMode;
-};
+/****************************** Module Header ******************************\
+* Module Name:  SampleService.h
+* Project:      CppWindowsService
+* Copyright (c) Microsoft Corporation.
+* 
+* Provides a sample service class that derives from the service base class - 
+* CServiceBase. The sample service logs the service start and stop 
+* information to the Application event log, and shows how to run the main 
+* function of the service in a thread pool worker thread.
+* 
+* This source is subject to the Microsoft Public License.
+* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
+* All other rights reserved.
+* 
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
+* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+#include "ServiceBase.h"
+#include "Descriptor.h"
+#include "LogSink.h"
+#include "OutputTrigger.h"
+#include "NotifySocket.h"
+#include "Handover.h"
+#include "StateFile.h"
+#include "Proxy.h"
+#include "Scheduler.h"
+#include "Placement.h"
+#include "ProcessTree.h"
+#include "Clock.h"
+#include "ChildTable.h"
+#include "StatusPage.h"
+#include "History.h"
+
+// Slot of the service process, the jobs come on top
+#define CHILD_SLOTS 1
+
+
+class CSampleService : public CServiceBase, public TriggerHandler,
+    public NotifyHandler, public ProxyHandler, public JobHandler
+{
+public:
+    CSampleService(
+        Descriptor* d,
+        PCTSTR pszServiceName, 
+        BOOL fCanStop = TRUE, 
+        BOOL fCanShutdown = TRUE, 
+        BOOL fCanPauseContinue = FALSE,
+        Clock* clock = Clock::System());
+    virtual ~CSampleService(void);
+
+    // Start the service.
+    void Test();
+
+    // Start the next instance after a handover and wait for it to take
+    // the child over. Called once the service dispatcher returned.
+    void CompleteHandover();
+
+protected:
+
+    virtual void OnStart(DWORD dwArgc, PTSTR *pszArgv);
+    virtual void OnStop();
+    virtual void OnShutdown();
+    virtual void OnCustomCommand(DWORD dwCtrl);
+    virtual void OnUnexpectedlyStopped(DWORD errorCode);
+    virtual void OnTrigger(size_t index, const std::string& line);
+    virtual void OnNotify(const std::string& key, const std::string& value);
+    virtual bool OnConnect();
+    virtual void OnBackendConnect(ULONGLONG time);
+    virtual BOOL OnJobStart(size_t index, PROCESS_INFORMATION* ppi,
+                            HANDLE* phOutRead, HANDLE* phErrRead,
+                            ProcessTree* tree);
+
+    void ServiceWorkerThread(void);
+
+    // Set the service status and report the status to the SCM.
+    virtual void SetServiceStatus(DWORD dwCurrentState, 
+        DWORD dwWin32ExitCode = NO_ERROR, 
+        DWORD dwWaitHint = 0);
+
+    // Log a message to the Application event log.
+    virtual void WriteEventLogEntry(PCTSTR pszMessage, WORD wType);
+
+private:
+    /**
+     * pi: Process information
+     * 
+     * Return exit code
+     */
+    DWORD WaitForProcessToExit(PROCESS_INFORMATION *pi);
+
+    // Stop the child within budget milliseconds, escalating to a kill.
+    void StopService(DWORD budget);
+    void RunStopCommand(ULONGLONG deadline);
+    BOOL WaitUntil(HANDLE hObject, ULONGLONG deadline);
+    // Duplicate of the child process handle, NULL if no child is running
+    HANDLE OpenChildHandle();
+
+    // Wait for the child to report READY=1, or to stay alive for timeout
+    // milliseconds when notifications are disabled.
+    BOOL WaitForReady(HANDLE hProcess, DWORD timeout);
+    // Wait for the child to exit, killing it when heartbeats stop.
+    // Returns FALSE when a handover interrupted the wait.
+    BOOL WaitForChildExit(HANDLE hProcess);
+    BOOL OpenNotifySocket(USHORT port, const char* token);
+
+    // Write the trace on demand
+    void ExportTrace(void);
+
+    String GetHandoverFile();
+    String GetHandoverEventName();
+    // Release the child and its capture pipes to the next instance
+    BOOL HandOver(int repeatCount);
+    // Take the child left by the previous instance
+    BOOL AdoptChild(const HandoverState& state, int* repeatCount);
+
+    BOOL OpenStateFile();
+    // Record the running child, or its absence, in the state file
+    void SaveChildState();
+    // Adopt or kill a child that outlived a crashed wrapper
+    BOOL ReattachOrphan();
+    HANDLE OpenOrphan(DWORD pid, ULONGLONG startTime);
+
+    BOOL OpenProxy();
+    // Wait for a connection before starting the child on demand, FALSE
+    // when the service is stopping.
+    BOOL WaitForDemand();
+    BOOL IsIdle();
+    void StopIdleChild(HANDLE hProcess);
+    // Stop command if any, then kill the child after stoptimeout
+    void StopChildGracefully(HANDLE hProcess);
+
+    // Compute when the child just started is recycled
+    void StartRecycleClock();
+    BOOL IsRecycleDue();
+    // Only one service of the recycle group recycles at a time
+    BOOL AcquireRecycleSlot();
+    void ReleaseRecycleSlot();
+    void RecycleChild(HANDLE hProcess);
+    // group, or one named after the executable when empty
+    String GetGroupName(const String& group);
+
+    // Check the cpu settings and claim the processor slot of the service
+    void OpenPlacement();
+    // Apply the cpu settings and the limits to a process created suspended
+    void PlaceChild(HANDLE hProcess, ProcessTree* tree);
+    // FALSE when the descriptor sets no limit
+    BOOL GetTreeLimits(TreeLimits* limits);
+
+    // Start the periodic jobs of the descriptor, if any
+    void OpenScheduler();
+    void CloseScheduler();
+
+    // Publish the status page and refresh it every STATUS_INTERVAL
+    BOOL OpenStatusPage();
+    void CloseStatusPage();
+    void PublishStatus();
+    void StatusThread(void);
+    // Log the percentiles of the latencies
+    void ReportLatencies();
+
+    // Record the resources of the service every HISTORY_INTERVAL, and its
+    // state changes, starts and exits
+    BOOL OpenHistory();
+    void CloseHistory();
+    void SampleHistory();
+    void HistoryThread(void);
+    void AppendHistory(DWORD kind, DWORD value, DWORD failed = 0);
+    
+    String GetEnvString();
+
+    // Create the service process with its output redirected to the sinks.
+    // SpawnChild captures the output when the pipe pointers aren't NULL,
+    // and puts the process in the tree when there is one.
+    BOOL CreateChildProcess(LPCTSTR lpApplicationName, LPTSTR lpCommandLine,
+        DWORD dwFlags, LPCTSTR lpEnvironment, LPCTSTR lpCurrentDirectory);
+    BOOL SpawnChild(LPCTSTR lpApplicationName, LPTSTR lpCommandLine,
+        DWORD dwFlags, LPCTSTR lpEnvironment, LPCTSTR lpCurrentDirectory,
+        PROCESS_INFORMATION* ppi, HANDLE* phOutRead, HANDLE* phErrRead,
+        ProcessTree* tree);
+    String GetTreeName(DWORD pid, ULONGLONG startTime);
+    // Kill the child with its whole process tree
+    void KillChild(HANDLE hProcess, UINT exitCode);
+    // Kill what the exited child left running
+    void ReapChildTree();
+    void StartPumps(HANDLE hOutRead, HANDLE hErrRead);
+
+    void WaitForCapture();
+    BOOL OpenLogSinks();
+    void CloseLogSinks();
+    LogFanout* CreateLogFanout(PCTSTR pszStream, const String& filename);
+    // Last output of the child kept by the stderr tail sink, if any
+    String GetOutputTail();
+    // Undo the opens of the worker before one of its failure exits
+    void AbortStart();
+    OutputMatcher* CreateOutputMatcher(PCTSTR pszStream);
+    void ReportTriggers();
+
+    // Kill the running child so that the worker starts it again.
+    void RestartChild();
+    
+    DWORD dwLastError;
+
+    HANDLE m_hStoppedEvent;
+    HANDLE m_hStartedEvent;
+    HANDLE m_hStopRequested;
+    ULONGLONG m_stopDeadline;
+    Descriptor* d;
+    // Every timeout of the supervision is counted on it
+    Clock* m_clock;
+    // Hot state of the service process and the job runs
+    ChildTable m_children;
+    DWORD m_childSlot;
+    
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    ProcessTree m_tree;
+    CpuPlacement m_placement;
+    ULONG m_leakedProcesses;
+    ULONGLONG m_treeCpuTime;
+    
+    LogFanout* m_outSink;
+    LogFanout* m_errSink;
+    LogPump* m_outPump;
+    LogPump* m_errPump;
+
+    CRITICAL_SECTION m_triggerLock;
+    std::vector<ULONGLONG> m_triggerLast;
+    std::vector<ULONG> m_triggerCount;
+
+    // Guards the child handles against RestartChild
+    CRITICAL_SECTION m_childLock;
+    BOOL m_fPlannedRestart;
+
+    NotifySocket* m_notify;
+    HANDLE m_hReadyEvent;
+    CRITICAL_SECTION m_statusLock;
+    std::string m_childStatus;
+
+    BOOL m_fHandover;
+    HANDLE m_hHandoverEvent;
+    HANDLE m_hHandoverDone;
+
+    StateFile m_stateFile;
+    SupervisorState m_state;
+    DWORD m_configGeneration;
+
+    Proxy* m_proxy;
+    // Set by connections waiting for the child, reset once it is up
+    HANDLE m_hDemandEvent;
+    // Signaled while a ready child can take connections
+    HANDLE m_hChildUp;
+    BOOL m_fIdleStop;
+
+    ULONGLONG m_recycleDue;
+    ULONG m_acceptedAtStart;
+    HANDLE m_hRecycleMutex;
+    BOOL m_fRecycleSlot;
+    BOOL m_fRecycle;
+
+    JobScheduler* m_scheduler;
+
+    StatusWriter m_statusPage;
+    HANDLE m_hStatusClose;
+    HANDLE m_hStatusDone;
+    // Last state reported with SetServiceStatus
+    DWORD m_serviceState;
+
+    HistoryFile m_history;
+    HANDLE m_hHistoryClose;
+    HANDLE m_hHistoryDone;
+
+    // Indexed by LatencyKind, in microseconds
+    DurationHistogram m_latency[LATENCY_KINDS];
+    // When the service process was spawned, 0 if it was adopted
+    ULONGLONG m_spawnTime;
+    // When the last service process exited, 0 when none is awaited
+    ULONGLONG m_exitTime;
+
+    BOOL m_fStarted;
+    BOOL m_fStopping;
+    BOOL m_testMode;
+};
@@ -0,0 +1,877 @@
+#include "Scheduler.h"
+#include "ThreadPool.h"
+#include "StateFile.h"
+#include "Faults.h"
+
+#define FILETIME_HOUR (60 * FILETIME_MINUTE)
+#define FILETIME_DAY (24 * FILETIME_HOUR)
+
+// A run later than this is missed and handled by the catch-up rule
+#define JOB_LATENESS FILETIME_MINUTE
+// Most runs started to catch up at once
+#define JOB_CATCHUP_MAX 100
+
+#define JOBS_MAGIC 0x534A5653
+
+// Last run of a job in the jobs file, after a JOBS_MAGIC and count header
+struct JobRecord
+{
+    DWORD nameHash;
+    ULONGLONG lastRun;
+};
+
+static ULONGLONG ToULongLong(const FILETIME& ft)
+{
+    ULARGE_INTEGER value;
+
+    value.LowPart = ft.dwLowDateTime;
+    value.HighPart = ft.dwHighDateTime;
+    return value.QuadPart;
+}
+
+static FILETIME ToFileTime(ULONGLONG value)
+{
+    FILETIME ft;
+
+    ft.dwLowDateTime = (DWORD)value;
+    ft.dwHighDateTime = (DWORD)(value >> 32);
+    return ft;
+}
+
+static ULONGLONG GetWallTime()
+{
+    FILETIME ft;
+
+    GetSystemTimeAsFileTime(&ft);
+    return ToULongLong(ft);
+}
+
+CronSchedule::CronSchedule()
+    : m_minutes(0), m_hours(0), m_days(0), m_months(0), m_weekdays(0),
+      m_anyDay(true), m_anyWeekday(true)
+{
+}
+
+bool CronSchedule::Parse(const String& expression)
+{
+    std::vector<String> fields;
+    String text = expression;
+    size_t pos = 0;
+
+    if (_tcsicmp(text.c_str(), TEXT("@hourly")) == 0)
+    {
+        text = TEXT("0 * * * *");
+    }
+    else if (_tcsicmp(text.c_str(), TEXT("@daily")) == 0)
+    {
+        text = TEXT("0 0 * * *");
+    }
+    else if (_tcsicmp(text.c_str(), TEXT("@weekly")) == 0)
+    {
+        text = TEXT("0 0 * * 0");
+    }
+    else if (_tcsicmp(text.c_str(), TEXT("@monthly")) == 0)
+    {
+        text = TEXT("0 0 1 * *");
+    }
+    else if (_tcsicmp(text.c_str(), TEXT("@yearly")) == 0)
+    {
+        text = TEXT("0 0 1 1 *");
+    }
+    while ((pos = text.find_first_not_of(TEXT(" \t"), pos)) != String::npos)
+    {
+        size_t end = text.find_first_of(TEXT(" \t"), pos);
+        if (end == String::npos)
+        {
+            end = text.size();
+        }
+        fields.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+    if (fields.size() != 5 ||
+        !ParseField(fields[0], 0, 59, &m_minutes) ||
+        !ParseField(fields[1], 0, 23, &m_hours) ||
+        !ParseField(fields[2], 1, 31, &m_days) ||
+        !ParseField(fields[3], 1, 12, &m_months) ||
+        !ParseField(fields[4], 0, 7, &m_weekdays))
+    {
+        return false;
+    }
+    // 7 is another name for Sunday
+    if (m_weekdays & (1ULL << 7))
+    {
+        m_weekdays |= 1;
+    }
+    m_anyDay = fields[2] == TEXT("*");
+    m_anyWeekday = fields[4] == TEXT("*");
+    return true;
+}
+
+bool CronSchedule::ParseField(const String& field, int min, int max,
+                              ULONGLONG* bits)
+{
+    size_t pos = 0;
+
+    *bits = 0;
+    while (pos <= field.size())
+    {
+        size_t end = field.find(TEXT(','), pos);
+        if (end == String::npos)
+        {
+            end = field.size();
+        }
+        String part = field.substr(pos, end - pos);
+        const TCHAR* p = part.c_str();
+        TCHAR* next;
+        long first = min, last = max, step = 1;
+
+        if (*p == TEXT('*'))
+        {
+            p++;
+        }
+        else
+        {
+            first = _tcstol(p, &next, 10);
+            if (next == p)
+            {
+                return false;
+            }
+            p = next;
+            last = first;
+            if (*p == TEXT('-'))
+            {
+                p++;
+                last = _tcstol(p, &next, 10);
+                if (next == p)
+                {
+                    return false;
+                }
+                p = next;
+            }
+        }
+        if (*p == TEXT('/'))
+        {
+            p++;
+            step = _tcstol(p, &next, 10);
+            if (next == p || step <= 0)
+            {
+                return false;
+            }
+            p = next;
+            // 5/15 means from 5 to the end of the range
+            if (part[0] != TEXT('*') && part.find(TEXT('-')) == String::npos)
+            {
+                last = max;
+            }
+        }
+        if (*p != 0 || first < min || last > max || first > last)
+        {
+            return false;
+        }
+        for (long value = first; value <= last; value += step)
+        {
+            *bits |= 1ULL << value;
+        }
+        pos = end + 1;
+    }
+    return *bits != 0;
+}
+
+bool CronSchedule::MatchDay(const SYSTEMTIME& st)
+{
+    bool day = (m_days >> st.wDay) & 1;
+    bool weekday = (m_weekdays >> st.wDayOfWeek) & 1;
+
+    // As in cron, a day matches either field when both are restricted
+    if (m_anyDay)
+    {
+        return weekday;
+    }
+    if (m_anyWeekday)
+    {
+        return day;
+    }
+    return day || weekday;
+}
+
+//
+//   FUNCTION: CronSchedule::Next
+//
+//   PURPOSE: Walk forward in local time, skipping a whole month, day or
+//   hour at a time when it doesn't match, so the search costs at most a
+//   few hundred steps a year.
+//
+ULONGLONG CronSchedule::Next(ULONGLONG after)
+{
+    FILETIME utc = ToFileTime(after), local;
+    SYSTEMTIME st;
+
+    if (!FileTimeToLocalFileTime(&utc, &local))
+    {
+        return 0;
+    }
+    ULONGLONG t = (ToULongLong(local) / FILETIME_MINUTE + 1) * FILETIME_MINUTE;
+    for (int i = 0; i < 100000; i++)
+    {
+        FILETIME ft = ToFileTime(t);
+        if (!FileTimeToSystemTime(&ft, &st))
+        {
+            return 0;
+        }
+        if (!((m_months >> st.wMonth) & 1))
+        {
+            st.wYear += st.wMonth == 12 ? 1 : 0;
+            st.wMonth = st.wMonth == 12 ? 1 : st.wMonth + 1;
+            st.wDay = 1;
+            st.wHour = 0;
+            st.wMinute = 0;
+            st.wSecond = 0;
+            st.wMilliseconds = 0;
+            if (!SystemTimeToFileTime(&st, &ft))
+            {
+                return 0;
+            }
+            t = ToULongLong(ft);
+            continue;
+        }
+        if (!MatchDay(st))
+        {
+            t = (t / FILETIME_DAY + 1) * FILETIME_DAY;
+            continue;
+        }
+        if (!((m_hours >> st.wHour) & 1))
+        {
+            t = (t / FILETIME_HOUR + 1) * FILETIME_HOUR;
+            continue;
+        }
+        if (!((m_minutes >> st.wMinute) & 1))
+        {
+            t += FILETIME_MINUTE;
+            continue;
+        }
+        local = ToFileTime(t);
+        if (!LocalFileTimeToFileTime(&local, &utc))
+        {
+            return 0;
+        }
+        return ToULongLong(utc);
+    }
+    // e.g. February 30
+    return 0;
+}
+
+TimerWheel::TimerWheel()
+    : m_now(0)
+{
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        for (int slot = 0; slot < WHEEL_SIZE; slot++)
+        {
+            m_slots[level][slot].next = &m_slots[level][slot];
+            m_slots[level][slot].prev = &m_slots[level][slot];
+        }
+    }
+}
+
+ULONGLONG TimerWheel::Now()
+{
+    return m_now;
+}
+
+void TimerWheel::Schedule(TimerEntry* entry, ULONGLONG due)
+{
+    Cancel(entry);
+    entry->due = due > m_now ? due : m_now + 1;
+    Insert(entry);
+}
+
+void TimerWheel::Cancel(TimerEntry* entry)
+{
+    if (entry->next == NULL)
+    {
+        return;
+    }
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+void TimerWheel::Insert(TimerEntry* entry)
+{
+    const ULONGLONG span = 1ULL << (WHEEL_BITS * WHEEL_LEVELS);
+    ULONGLONG delta = entry->due - m_now;
+    ULONGLONG due = entry->due;
+    int level = 0;
+
+    if (delta >= span)
+    {
+        // Placed again when the top level turns
+        due = m_now + span - 1;
+        delta = span - 1;
+    }
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= 1ULL << (WHEEL_BITS * (level + 1)))
+    {
+        level++;
+    }
+    TimerEntry* head =
+        &m_slots[level][(due >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1)];
+    entry->next = head;
+    entry->prev = head->prev;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+void TimerWheel::Cascade(int level)
+{
+    TimerEntry* head =
+        &m_slots[level][(m_now >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1)];
+    TimerEntry* entry = head->next;
+
+    head->next = head;
+    head->prev = head;
+    while (entry != head)
+    {
+        TimerEntry* next = entry->next;
+        Insert(entry);
+        entry = next;
+    }
+}
+
+void TimerWheel::Advance(ULONGLONG now, std::vector<TimerEntry*>& expired)
+{
+    while (m_now < now)
+    {
+        m_now++;
+        for (int level = 1; level < WHEEL_LEVELS; level++)
+        {
+            if ((m_now & ((1ULL << (WHEEL_BITS * level)) - 1)) != 0)
+            {
+                break;
+            }
+            Cascade(level);
+        }
+        TimerEntry* head = &m_slots[0][m_now & (WHEEL_SIZE - 1)];
+        while (head->next != head)
+        {
+            TimerEntry* entry = head->next;
+            Cancel(entry);
+            expired.push_back(entry);
+        }
+    }
+}
+
+JobScheduler::JobScheduler(JobHandler* handler, ChildTable* children)
+    : m_handler(handler), m_children(children), m_origin(0), m_dirty(false), m_running(false)
+{
+    m_hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    m_hClose = CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hWake == NULL || m_hClose == NULL || m_hDone == NULL)
+    {
+        throw GetLastError();
+    }
+    InitializeCriticalSection(&m_lock);
+}
+
+JobScheduler::~JobScheduler()
+{
+    std::vector<Job*>::iterator it;
+
+    Close();
+    for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+    {
+        delete *it;
+    }
+    DeleteCriticalSection(&m_lock);
+    CloseHandle(m_hWake);
+    CloseHandle(m_hClose);
+    CloseHandle(m_hDone);
+}
+
+bool JobScheduler::Add(size_t index, const JobConfig& config, LogSink* sink)
+{
+    Job* job = new Job();
+
+    if (config.interval == 0 && !job->cron.Parse(config.cron))
+    {
+        delete job;
+        delete sink;
+        return false;
+    }
+    job->slot = m_children->Alloc(CHILD_JOB);
+    if (job->slot == CHILD_NONE)
+    {
+        delete job;
+        delete sink;
+        return false;
+    }
+    job->config = config;
+    job->nameHash = Crc32(config.name.data(), config.name.size() * sizeof(TCHAR));
+    job->nextRun = 0;
+    job->lastRun = 0;
+    job->hProcess = NULL;
+    job->hWait = NULL;
+    job->runId = 0;
+    job->killing = false;
+    job->pending = 0;
+    job->sink = sink;
+    job->pumps[0] = NULL;
+    job->pumps[1] = NULL;
+    job->owner = this;
+    job->stats.index = index;
+    job->stats.runs = 0;
+    job->stats.failed = 0;
+    job->stats.skipped = 0;
+    job->stats.queued = 0;
+    job->stats.killed = 0;
+    job->stats.missed = 0;
+    job->stats.leaked = 0;
+    m_jobs.push_back(job);
+    return true;
+}
+
+//
+//   FUNCTION: JobScheduler::Open
+//
+//   PURPOSE: Schedule the next run of each job after its last recorded
+//   run, or from now for a new job. Runs missed while the service was
+//   stopped are due at once.
+//
+void JobScheduler::Open(const String& filename)
+{
+    std::vector<Job*>::iterator it;
+    ULONGLONG now = GetWallTime();
+
+    m_filename = filename;
+    m_origin = GetTickCount64();
+    Load();
+    for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+    {
+        Job* job = *it;
+        job->nextRun = NextAfter(job, job->lastRun != 0 ? job->lastRun : now);
+        Arm(job, now);
+    }
+    ResetEvent(m_hClose);
+    ResetEvent(m_hDone);
+    m_running = true;
+    CThreadPool::QueueUserWorkItem(&JobScheduler::Run, this);
+}
+
+void JobScheduler::Close()
+{
+    std::vector<Job*>::iterator it;
+
+    if (m_running)
+    {
+        SetEvent(m_hClose);
+        WaitForSingleObject(m_hDone, INFINITE);
+        m_running = false;
+    }
+    for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+    {
+        Job* job = *it;
+        m_wheel.Cancel(job);
+        if (job->hProcess != NULL)
+        {
+            job->pending = 0;
+            Kill(job);
+        }
+    }
+    m_exited.clear();
+    // Don't let a grandchild holding a pipe hold the stop
+    Drain(1000);
+    if (m_dirty)
+    {
+        Save();
+    }
+    for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+    {
+        if ((*it)->sink != NULL)
+        {
+            (*it)->sink->Close();
+            delete (*it)->sink;
+            (*it)->sink = NULL;
+        }
+    }
+}
+
+size_t JobScheduler::Count()
+{
+    return m_jobs.size();
+}
+
+const JobStats& JobScheduler::Stats(size_t job)
+{
+    return m_jobs[job]->stats;
+}
+
+void JobScheduler::Run(void)
+{
+    const HANDLE events[2] =
+    {
+        m_hClose, m_hWake
+    };
+    std::vector<TimerEntry*> expired;
+    std::vector<std::pair<Job*, DWORD> > exited;
+    std::vector<TimerEntry*>::iterator timer;
+    std::vector<std::pair<Job*, DWORD> >::iterator it;
+    DWORD result;
+
+    while (true)
+    {
+        // Tick on whole seconds since Open
+        DWORD timeout = 1000 - (DWORD)((GetTickCount64() - m_origin) % 1000);
+        result = WaitForMultipleObjects(2, events, FALSE, timeout);
+        if (result != WAIT_TIMEOUT && result != WAIT_OBJECT_0 + 1)
+        {
+            break;
+        }
+        EnterCriticalSection(&m_lock);
+        exited.swap(m_exited);
+        LeaveCriticalSection(&m_lock);
+        for (it = exited.begin(); it != exited.end(); it++)
+        {
+            // A run killed by the overlap policy is already finished
+            if (it->first->hProcess != NULL && it->first->runId == it->second)
+            {
+                Finish(it->first);
+            }
+        }
+        exited.clear();
+        m_wheel.Advance((GetTickCount64() - m_origin) / 1000, expired);
+        for (timer = expired.begin(); timer != expired.end(); timer++)
+        {
+            Fire(static_cast<Job*>(*timer));
+        }
+        expired.clear();
+        Drain(0);
+        if (m_dirty)
+        {
+            Save();
+        }
+    }
+    SetEvent(m_hDone);
+}
+
+VOID CALLBACK JobScheduler::OnExit(PVOID context, BOOLEAN timedOut)
+{
+    Job* job = (Job*)context;
+    JobScheduler* scheduler = job->owner;
+
+    EnterCriticalSection(&scheduler->m_lock);
+    scheduler->m_exited.push_back(std::make_pair(job, job->runId));
+    LeaveCriticalSection(&scheduler->m_lock);
+    SetEvent(scheduler->m_hWake);
+}
+
+ULONGLONG JobScheduler::NextAfter(Job* job, ULONGLONG after)
+{
+    if (job->config.interval > 0)
+    {
+        return after + job->config.interval * FILETIME_SECOND;
+    }
+    return job->cron.Next(after);
+}
+
+void JobScheduler::Arm(Job* job, ULONGLONG now)
+{
+    ULONGLONG delay = 0;
+
+    if (job->nextRun == 0)
+    {
+        return;
+    }
+    if (job->nextRun > now)
+    {
+        delay = (job->nextRun - now + FILETIME_SECOND - 1) / FILETIME_SECOND;
+    }
+    m_wheel.Schedule(job, m_wheel.Now() + delay);
+}
+
+//
+//   FUNCTION: JobScheduler::Fire
+//
+//   PURPOSE: Count the runs that came due since the timer was armed, late
+//   ones included when the machine slept or the service was stopped, and
+//   start them according to the catch-up rule.
+//
+void JobScheduler::Fire(Job* job)
+{
+    ULONGLONG now = GetWallTime();
+    ULONGLONG next = job->nextRun;
+    ULONG due = 0, late = 0, runs, caught = 0;
+
+    if (next > now)
+    {
+        // The clock was set back, the run isn't due yet
+        Arm(job, now);
+        return;
+    }
+    while (next != 0 && next <= now)
+    {
+        if (now - next > JOB_LATENESS)
+        {
+            late++;
+        }
+        due++;
+        job->lastRun = next;
+        if (due == JOB_CATCHUP_MAX)
+        {
+            // Give up on the older runs
+            job->lastRun = now;
+            next = NextAfter(job, now);
+            break;
+        }
+        next = NextAfter(job, next);
+    }
+    runs = due - late;
+    if (late > 0)
+    {
+        if (_tcsicmp(job->config.catchup.c_str(), TEXT("all")) == 0)
+        {
+            caught = late;
+        }
+        else if (_tcsicmp(job->config.catchup.c_str(), TEXT("none")) != 0)
+        {
+            caught = runs == 0 ? 1 : 0;
+        }
+        job->stats.missed += late - caught;
+        runs += caught;
+    }
+    job->nextRun = next;
+    m_dirty = true;
+    while (runs-- > 0)
+    {
+        Start(job);
+    }
+    Arm(job, now);
+}
+
+void JobScheduler::Start(Job* job)
+{
+    if (job->hProcess != NULL)
+    {
+        if (_tcsicmp(job->config.overlap.c_str(), TEXT("queue")) == 0)
+        {
+            job->pending++;
+            job->stats.queued++;
+            return;
+        }
+        if (_tcsicmp(job->config.overlap.c_str(), TEXT("kill")) != 0)
+        {
+            job->stats.skipped++;
+            return;
+        }
+        Kill(job);
+    }
+    Launch(job);
+}
+
+void JobScheduler::Kill(Job* job)
+{
+    job->killing = true;
+    m_children->SetState(job->slot, CHILD_STOPPING);
+    job->tree.Terminate(ERROR_PROCESS_ABORTED);
+    TerminateProcess(job->hProcess, ERROR_PROCESS_ABORTED);
+    WaitForSingleObject(job->hProcess, INFINITE);
+    Finish(job);
+}
+
+void JobScheduler::Launch(Job* job)
+{
+    PROCESS_INFORMATION pi;
+    HANDLE hPipes[2] = { NULL, NULL };
+
+    if (!m_handler->OnJobStart(job->stats.index, &pi,
+                               job->sink != NULL ? &hPipes[0] : NULL,
+                               job->sink != NULL ? &hPipes[1] : NULL,
+                               &job->tree))
+    {
+        job->stats.failed++;
+        return;
+    }
+    CloseHandle(pi.hThread);
+    job->hProcess = pi.hProcess;
+    job->runId++;
+    m_children->Start(job->slot, pi.dwProcessId, GetTickCount64());
+    job->killing = false;
+    if (!RegisterWaitForSingleObject(&job->hWait, pi.hProcess,
+                                     &JobScheduler::OnExit, job, INFINITE,
+                                     WT_EXECUTEONLYONCE))
+    {
+        // The exit could never be seen, don't leave the run unattended
+        job->tree.Terminate(ERROR_PROCESS_ABORTED);
+        job->tree.Close();
+        TerminateProcess(pi.hProcess, ERROR_PROCESS_ABORTED);
+        m_children->Exit(job->slot, ERROR_PROCESS_ABORTED, true);
+        CloseHandle(pi.hProcess);
+        job->hProcess = NULL;
+        job->hWait = NULL;
+        for (int i = 0; i < 2; i++)
+        {
+            if (hPipes[i] != NULL)
+            {
+                CloseHandle(hPipes[i]);
+            }
+        }
+        job->stats.failed++;
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (hPipes[i] != NULL)
+        {
+            job->pumps[i] = new LogPump(hPipes[i], job->sink);
+            CThreadPool::QueueUserWorkItem(&LogPump::Run, job->pumps[i]);
+        }
+    }
+}
+
+void JobScheduler::Finish(Job* job)
+{
+    DWORD exitCode = 0;
+
+    // Waits for a callback in progress, which then reports a stale run
+    UnregisterWaitEx(job->hWait, INVALID_HANDLE_VALUE);
+    job->hWait = NULL;
+    job->stats.durations.Add(GetTickCount64() - m_children->Started(job->slot));
+    job->stats.runs++;
+    GetExitCodeProcess(job->hProcess, &exitCode);
+    m_children->Exit(job->slot, exitCode, !job->killing && exitCode != 0);
+    if (job->killing)
+    {
+        job->stats.killed++;
+    }
+    else if (exitCode != 0)
+    {
+        job->stats.failed++;
+    }
+    CloseHandle(job->hProcess);
+    job->hProcess = NULL;
+    // Grandchildren of the run don't outlive it
+    job->stats.leaked += job->tree.Terminate(ERROR_PROCESS_ABORTED);
+    job->tree.Close();
+    for (int i = 0; i < 2; i++)
+    {
+        if (job->pumps[i] != NULL)
+        {
+            m_draining.push_back(job->pumps[i]);
+            job->pumps[i] = NULL;
+        }
+    }
+    if (job->pending > 0)
+    {
+        job->pending--;
+        Launch(job);
+    }
+}
+
+//
+//   FUNCTION: JobScheduler::Drain
+//
+//   PURPOSE: Delete the pumps of finished runs once their pipe is empty.
+//   With a timeout, pumps still reading after it are cut off.
+//
+void JobScheduler::Drain(DWORD timeout)
+{
+    std::vector<LogPump*>::iterator it = m_draining.begin();
+
+    while (it != m_draining.end())
+    {
+        if ((*it)->WaitDone(timeout))
+        {
+            delete *it;
+            it = m_draining.erase(it);
+        }
+        else if (timeout > 0)
+        {
+            CloseHandle((*it)->Release());
+            delete *it;
+            it = m_draining.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void JobScheduler::Load()
+{
+    HANDLE hFile;
+    DWORD header[2], bytesRead;
+    std::vector<Job*>::iterator it;
+
+    hFile = CreateFile(m_filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    if (ReadFile(hFile, header, sizeof(header), &bytesRead, NULL) &&
+        bytesRead == sizeof(header) && header[0] == JOBS_MAGIC)
+    {
+        for (DWORD i = 0; i < header[1]; i++)
+        {
+            JobRecord record;
+            if (!ReadFile(hFile, &record, sizeof(record), &bytesRead, NULL) ||
+                bytesRead != sizeof(record))
+            {
+                break;
+            }
+            for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+            {
+                if ((*it)->nameHash == record.nameHash)
+                {
+                    (*it)->lastRun = record.lastRun;
+                }
+            }
+        }
+    }
+    CloseHandle(hFile);
+}
+
+//
+//   FUNCTION: JobScheduler::Save
+//
+//   PURPOSE: Record the last run of every job, keyed by a hash of its name.
+//   Written aside and moved in place like the handover state.
+//
+void JobScheduler::Save()
+{
+    String temp = m_filename + TEXT(".tmp");
+    std::vector<char> data;
+    DWORD header[2] = { JOBS_MAGIC, (DWORD)m_jobs.size() };
+    std::vector<Job*>::iterator it;
+    HANDLE hFile;
+    DWORD written;
+    BOOL result;
+
+    m_dirty = false;
+    data.insert(data.end(), (char*)header, (char*)(header + 2));
+    for (it = m_jobs.begin(); it != m_jobs.end(); it++)
+    {
+        JobRecord record;
+        ZeroMemory(&record, sizeof(record));
+        record.nameHash = (*it)->nameHash;
+        record.lastRun = (*it)->lastRun;
+        data.insert(data.end(), (char*)&record, (char*)(&record + 1));
+    }
+    hFile = CreateFile(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    result = !Faults::Inject(FAULT_FILE) &&
+             WriteFile(hFile, &data[0], (DWORD)data.size(), &written, NULL) &&
+             written == data.size();
+    CloseHandle(hFile);
+    if (!result || !MoveFileEx(temp.c_str(), m_filename.c_str(),
+                               MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(temp.c_str());
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "strings.h"
+#include "Descriptor.h"
+#include "LogSink.h"
+#include "ProcessTree.h"
+#include "ChildTable.h"
+#include "Histogram.h"
+
+// FILETIME units
+#define FILETIME_SECOND 10000000ULL
+#define FILETIME_MINUTE (60 * FILETIME_SECOND)
+
+/**
+ * Five field cron expression: minute hour day-of-month month day-of-week,
+ * each field a list of values, ranges and steps (*, 5, 1-5, 0-59/15).
+ * Day of week 0 and 7 are Sunday. @hourly, @daily, @weekly, @monthly and
+ * @yearly are accepted too. Evaluated in local time.
+ */
+class CronSchedule
+{
+    public:
+        CronSchedule();
+
+        bool Parse(const String& expression);
+        // First matching minute after a UTC FILETIME, 0 if there is none
+        ULONGLONG Next(ULONGLONG after);
+
+    private:
+        bool ParseField(const String& field, int min, int max, ULONGLONG* bits);
+        bool MatchDay(const SYSTEMTIME& st);
+
+        ULONGLONG m_minutes;
+        ULONGLONG m_hours;
+        ULONGLONG m_days;
+        ULONGLONG m_months;
+        ULONGLONG m_weekdays;
+        bool m_anyDay;
+        bool m_anyWeekday;
+};
+
+/**
+ * Intrusive node of the timer wheel.
+ */
+struct TimerEntry
+{
+    TimerEntry* next;
+    TimerEntry* prev;
+    ULONGLONG due;
+
+    TimerEntry() : next(NULL), prev(NULL), due(0) {}
+};
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+/**
+ * Hierarchical timer wheel counting ticks. Scheduling and cancelling cost
+ * O(1), and a tick only touches the slot that expires plus, every
+ * WHEEL_SIZE ticks, one slot of an upper level that is spread below.
+ * Timers further away than the wheel span wait in the top level and are
+ * placed again each time it turns.
+ */
+class TimerWheel
+{
+    public:
+        TimerWheel();
+
+        ULONGLONG Now();
+        // A due tick already past expires on the next tick
+        void Schedule(TimerEntry* entry, ULONGLONG due);
+        void Cancel(TimerEntry* entry);
+        // Move to tick now, appending the expired timers
+        void Advance(ULONGLONG now, std::vector<TimerEntry*>& expired);
+
+    private:
+        void Insert(TimerEntry* entry);
+        void Cascade(int level);
+
+        TimerEntry m_slots[WHEEL_LEVELS][WHEEL_SIZE];
+        ULONGLONG m_now;
+};
+
+/**
+ * Counters of one job, reported when the service stops.
+ */
+struct JobStats
+{
+    // Position of the job in the descriptor
+    size_t index;
+    ULONG runs;
+    ULONG failed;
+    ULONG skipped;
+    ULONG queued;
+    ULONG killed;
+    ULONG missed;
+    // Processes left running by runs, killed when the run exited
+    ULONG leaked;
+    // Run durations in milliseconds
+    DurationHistogram durations;
+};
+
+/**
+ * Starts the runs of the jobs.
+ */
+class JobHandler
+{
+    public:
+        virtual ~JobHandler() {}
+
+        // index: position of the job in the descriptor
+        // The pipes are NULL when the output of the job is not captured.
+        // The run and its descendants go to the tree.
+        virtual BOOL OnJobStart(size_t index, PROCESS_INFORMATION* ppi,
+                                HANDLE* phOutRead, HANDLE* phErrRead,
+                                ProcessTree* tree) = 0;
+};
+
+/**
+ * Periodic jobs driven by a timer wheel ticking every second.
+ *
+ * overlap: what a run due while the previous one is still running does,
+ * skip (default) it, queue it after the previous one, or kill the
+ * previous one.
+ * catchup: what happens to runs missed by more than a minute, because the
+ * wrapper was stopped or the machine asleep: none drops them, once
+ * (default) starts a single run, all starts every run (up to 100).
+ *
+ * The last run of each job is kept in a file, so missed runs are seen
+ * across restarts of the service.
+ */
+class JobScheduler
+{
+    public:
+        // children: where the runs are kept, with a slot free for each job
+        JobScheduler(JobHandler* handler, ChildTable* children);
+        ~JobScheduler();
+
+        // False when the schedule of the job is invalid. The scheduler
+        // owns the sink, which gets the output of every run; may be NULL.
+        bool Add(size_t index, const JobConfig& config, LogSink* sink);
+        // filename: where the last run of each job is kept
+        void Open(const String& filename);
+        // Kill the running jobs and stop scheduling
+        void Close();
+
+        size_t Count();
+        const JobStats& Stats(size_t job);
+
+        void Run(void);
+
+    private:
+        struct Job : public TimerEntry
+        {
+            JobConfig config;
+            CronSchedule cron;
+            DWORD nameHash;
+            ULONGLONG nextRun;
+            ULONGLONG lastRun;
+            HANDLE hProcess;
+            ProcessTree tree;
+            HANDLE hWait;
+            DWORD runId;
+            DWORD slot;
+            bool killing;
+            ULONG pending;
+            LogSink* sink;
+            LogPump* pumps[2];
+            JobScheduler* owner;
+            JobStats stats;
+        };
+
+        static VOID CALLBACK OnExit(PVOID context, BOOLEAN timedOut);
+
+        ULONGLONG NextAfter(Job* job, ULONGLONG after);
+        void Arm(Job* job, ULONGLONG now);
+        void Fire(Job* job);
+        void Start(Job* job);
+        void Launch(Job* job);
+        void Finish(Job* job);
+        void Kill(Job* job);
+        void Drain(DWORD timeout);
+        void Load();
+        void Save();
+
+        JobHandler* m_handler;
+        ChildTable* m_children;
+        std::vector<Job*> m_jobs;
+        TimerWheel m_wheel;
+        ULONGLONG m_origin;
+        String m_filename;
+        bool m_dirty;
+        CRITICAL_SECTION m_lock;
+        std::vector<std::pair<Job*, DWORD> > m_exited;
+        std::vector<LogPump*> m_draining;
+        HANDLE m_hWake;
+        HANDLE m_hClose;
+        HANDLE m_hDone;
+        bool m_running;
+};
+
+#endif /* _SCHEDULER_H_ */
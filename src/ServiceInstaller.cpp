@@ -1,228 +1,511 @@
-/****************************** Module Header ******************************\
-* Module Name:  ServiceInstaller.cpp
-* Project:      CppWindowsService
-* Copyright (c) Microsoft Corporation.
-* 
-* The file implements functions that install and uninstall the service.
-* 
-* This source is subject to the Microsoft Public License.
-* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
-* All other rights reserved.
-* 
-* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
-* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
-* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#include <stdio.h>
-#include <windows.h>
-#include <string>
-#include <iostream>
-#include "ServiceInstaller.h"
-#include "strings.h"
-
-
-//
-//   FUNCTION: InstallService
-//
-//   PURPOSE: Install the current application as a service to the local 
-//   service control manager database.
-//
-//   PARAMETERS:
-//   * pszServiceName - the name of the service to be installed
-//   * pszDisplayName - the display name of the service
-//   * pszDescription - the description of the service
-//   * dwStartType - the service start option. This parameter can be one of 
-//     the following values: SERVICE_AUTO_START, SERVICE_BOOT_START, 
-//     SERVICE_DEMAND_START, SERVICE_DISABLED, SERVICE_SYSTEM_START.
-//   * pszDependencies - a pointer to a double null-terminated array of null-
-//     separated names of services or load ordering groups that the system 
-//     must start before this service.
-//   * pszAccount - the name of the account under which the service runs.
-//   * pszPassword - the password to the account name.
-//
-//   NOTE: If the function fails to install the service, it prints the error 
-//   in the standard output stream for users to diagnose the problem.
-//
-void InstallService(PCTSTR pszServiceName, 
-                    PCTSTR pszDisplayName, 
-                    PCTSTR pszDescription, 
-                    DWORD dwStartType,
-                    PCTSTR pszDependencies, 
-                    PCTSTR pszAccount, 
-                    PCTSTR pszPassword)
-{
-    TCHAR szPath[MAX_PATH];
-    SC_HANDLE schSCManager = NULL;
-    SC_HANDLE schService = NULL;
-    LONG openRes = !ERROR_SUCCESS;
-    HKEY hKey;
-    String sk;
-    String path;
-    LPCTSTR key;
-    LONG setRes;
-
-    if (GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath)) == 0)
-    {
-        _tprintf(TEXT("GetModuleFileName failed w/err 0x%08lx\n"), GetLastError());
-        goto Cleanup;
-    }
-    path = TEXT("\"");
-    path += szPath;
-    path += TEXT("\"");
-
-    // Open the local default service control manager database
-    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT | 
-        SC_MANAGER_CREATE_SERVICE);
-    if (schSCManager == NULL)
-    {
-        _tprintf(TEXT("OpenSCManager failed w/err 0x%08lx\n"), GetLastError());
-        goto Cleanup;
-    }
-
-    // Install the service into SCM by calling CreateService
-    schService = CreateService(
-        schSCManager,                   // SCManager database
-        pszServiceName,                 // Name of service
-        pszDisplayName,                 // Name to display
-        SERVICE_ALL_ACCESS,             // Desired access
-        SERVICE_WIN32_OWN_PROCESS,      // Service type
-        dwStartType,                    // Service start type
-        SERVICE_ERROR_NORMAL,           // Error control type
-        path.c_str(),                         // Service's binary
-        NULL,                           // No load ordering group
-        NULL,                           // No tag identifier
-        pszDependencies,                // Dependencies
-        pszAccount,                     // Service running account
-        pszPassword                     // Password of the account
-        );
-    if (schService == NULL)
-    {
-        _tprintf(TEXT("CreateService failed w/err 0x%08lx\n"), GetLastError());
-        goto Cleanup;
-    }
-    // so using a classic method to set the description. Ugly.
-    sk = TEXT("System\\CurrentControlSet\\Services\\");
-    sk += pszServiceName;
-
-    openRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, sk.c_str(), 0, KEY_ALL_ACCESS , &hKey);
-
-    if (openRes != ERROR_SUCCESS) {
-        _tprintf(TEXT("Error opening key."));
-        goto Cleanup;
-    }
-
-    key = TEXT("Description");
-
-    setRes = RegSetValueEx (hKey, key, 0, REG_SZ, (LPBYTE)pszDescription, 
-        (_tcslen(pszDescription) + 1) *2);
-
-    if (setRes != ERROR_SUCCESS) {
-        _tprintf(TEXT("Error writing to Registry."));
-        goto Cleanup;
-    }
-
-    Cout << pszServiceName << TEXT(" is installed.\n");
-
-Cleanup:
-    // Centralized cleanup for all allocated resources.
-
-    if (openRes == ERROR_SUCCESS) {
-        RegCloseKey(hKey);
-    }
-    if (schSCManager)
-    {
-        CloseServiceHandle(schSCManager);
-        schSCManager = NULL;
-    }
-    if (schService)
-    {
-        CloseServiceHandle(schService);
-        schService = NULL;
-    }
-}
-
-
-//
-//   FUNCTION: UninstallService
-//
-//   PURPOSE: Stop and remove the service from the local service control 
-//   manager database.
-//
-//   PARAMETERS: 
-//   * pszServiceName - the name of the service to be removed.
-//
-//   NOTE: If the function fails to uninstall the service, it prints the 
-//   error in the standard output stream for users to diagnose the problem.
-//
-void UninstallService(PCTSTR pszServiceName)
-{
-    SC_HANDLE schSCManager = NULL;
-    SC_HANDLE schService = NULL;
-    SERVICE_STATUS ssSvcStatus = {};
-
-    // Open the local default service control manager database
-    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
-    if (schSCManager == NULL)
-    {
-        _tprintf(TEXT("OpenSCManager failed w/err 0x%08lx\n"), GetLastError());
-        goto Cleanup;
-    }
-
-    // Open the service with delete, stop, and query status permissions
-    schService = OpenService(schSCManager, pszServiceName, SERVICE_STOP | 
-        SERVICE_QUERY_STATUS | DELETE);
-    if (schService == NULL)
-    {
-        _tprintf(TEXT("OpenService failed w/err 0x%08lx\n"), GetLastError());
-        goto Cleanup;
-    }
-
-    // Try to stop the service
-    if (ControlService(schService, SERVICE_CONTROL_STOP, &ssSvcStatus))
-    {
-        Cout << TEXT("Stopping ") << pszServiceName << TEXT(".");
-        Sleep(1000);
-
-        while (QueryServiceStatus(schService, &ssSvcStatus))
-        {
-            if (ssSvcStatus.dwCurrentState == SERVICE_STOP_PENDING)
-            {
-                _tprintf(TEXT("."));
-                Sleep(1000);
-            }
-            else break;
-        }
-
-        if (ssSvcStatus.dwCurrentState == SERVICE_STOPPED)
-        {
-            Cout << TEXT("\n") << pszServiceName << TEXT(" is stopped.\n");
-        }
-        else
-        {
-            Cout << TEXT("\n") << pszServiceName << TEXT(" failed to stop.\n");
-        }
-    }
-
-    // Now remove the service by calling DeleteService.
-    if (!DeleteService(schService))
-    {
-        _tprintf(TEXT("DeleteService failed w/err 0x%08lx\n"), GetLastError());
-        goto Cleanup;
-    }
-
-    Cout << pszServiceName << TEXT(" is removed.\n");
-
-Cleanup:
-    // Centralized cleanup for all allocated resources.
-    if (schSCManager)
-    {
-        CloseServiceHandle(schSCManager);
-        schSCManager = NULL;
-    }
-    if (schService)
-    {
-        CloseServiceHandle(schService);
-        schService = NULL;
-    }
-}
\ No newline at end of file
+/****************************** Module Header ******************************\
+* Module Name:  ServiceInstaller.cpp
+* Project:      CppWindowsService
+* Copyright (c) Microsoft Corporation.
+* 
+* The file implements functions that install and uninstall the service.
+* 
+* This source is subject to the Microsoft Public License.
+* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
+* All other rights reserved.
+* 
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
+* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#include <stdio.h>
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "ServiceInstaller.h"
+#include "Handover.h"
+#include "Trace.h"
+#include "strings.h"
+
+
+//
+//   FUNCTION: InstallService
+//
+//   PURPOSE: Install the current application as a service to the local 
+//   service control manager database.
+//
+//   PARAMETERS:
+//   * pszServiceName - the name of the service to be installed
+//   * pszDisplayName - the display name of the service
+//   * pszDescription - the description of the service
+//   * dwStartType - the service start option. This parameter can be one of 
+//     the following values: SERVICE_AUTO_START, SERVICE_BOOT_START, 
+//     SERVICE_DEMAND_START, SERVICE_DISABLED, SERVICE_SYSTEM_START.
+//   * pszDependencies - a pointer to a double null-terminated array of null-
+//     separated names of services or load ordering groups that the system 
+//     must start before this service.
+//   * pszAccount - the name of the account under which the service runs.
+//   * pszPassword - the password to the account name.
+//
+//   NOTE: If the function fails to install the service, it prints the error 
+//   in the standard output stream for users to diagnose the problem.
+//
+void InstallService(PCTSTR pszServiceName, 
+                    PCTSTR pszDisplayName, 
+                    PCTSTR pszDescription, 
+                    DWORD dwStartType,
+                    PCTSTR pszDependencies, 
+                    PCTSTR pszAccount, 
+                    PCTSTR pszPassword)
+{
+    TCHAR szPath[MAX_PATH];
+    SC_HANDLE schSCManager = NULL;
+    SC_HANDLE schService = NULL;
+    LONG openRes = !ERROR_SUCCESS;
+    HKEY hKey;
+    String sk;
+    String path;
+    LPCTSTR key;
+    LONG setRes;
+
+    if (GetModuleFileName(NULL, szPath, ARRAYSIZE(szPath)) == 0)
+    {
+        _tprintf(TEXT("GetModuleFileName failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+    path = TEXT("\"");
+    path += szPath;
+    path += TEXT("\"");
+
+    // Open the local default service control manager database
+    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT | 
+        SC_MANAGER_CREATE_SERVICE);
+    if (schSCManager == NULL)
+    {
+        _tprintf(TEXT("OpenSCManager failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    // Install the service into SCM by calling CreateService
+    schService = CreateService(
+        schSCManager,                   // SCManager database
+        pszServiceName,                 // Name of service
+        pszDisplayName,                 // Name to display
+        SERVICE_ALL_ACCESS,             // Desired access
+        SERVICE_WIN32_OWN_PROCESS,      // Service type
+        dwStartType,                    // Service start type
+        SERVICE_ERROR_NORMAL,           // Error control type
+        path.c_str(),                         // Service's binary
+        NULL,                           // No load ordering group
+        NULL,                           // No tag identifier
+        pszDependencies,                // Dependencies
+        pszAccount,                     // Service running account
+        pszPassword                     // Password of the account
+        );
+    if (schService == NULL)
+    {
+        _tprintf(TEXT("CreateService failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+    // so using a classic method to set the description. Ugly.
+    sk = TEXT("System\\CurrentControlSet\\Services\\");
+    sk += pszServiceName;
+
+    openRes = RegOpenKeyEx(HKEY_LOCAL_MACHINE, sk.c_str(), 0, KEY_ALL_ACCESS , &hKey);
+
+    if (openRes != ERROR_SUCCESS) {
+        _tprintf(TEXT("Error opening key."));
+        goto Cleanup;
+    }
+
+    key = TEXT("Description");
+
+    setRes = RegSetValueEx (hKey, key, 0, REG_SZ, (LPBYTE)pszDescription, 
+        (_tcslen(pszDescription) + 1) *2);
+
+    if (setRes != ERROR_SUCCESS) {
+        _tprintf(TEXT("Error writing to Registry."));
+        goto Cleanup;
+    }
+
+    Cout << pszServiceName << TEXT(" is installed.\n");
+
+Cleanup:
+    // Centralized cleanup for all allocated resources.
+
+    if (openRes == ERROR_SUCCESS) {
+        RegCloseKey(hKey);
+    }
+    if (schSCManager)
+    {
+        CloseServiceHandle(schSCManager);
+        schSCManager = NULL;
+    }
+    if (schService)
+    {
+        CloseServiceHandle(schService);
+        schService = NULL;
+    }
+}
+
+
+//
+//   FUNCTION: UninstallService
+//
+//   PURPOSE: Stop and remove the service from the local service control 
+//   manager database.
+//
+//   PARAMETERS: 
+//   * pszServiceName - the name of the service to be removed.
+//
+//   NOTE: If the function fails to uninstall the service, it prints the 
+//   error in the standard output stream for users to diagnose the problem.
+//
+void UninstallService(PCTSTR pszServiceName)
+{
+    SC_HANDLE schSCManager = NULL;
+    SC_HANDLE schService = NULL;
+    SERVICE_STATUS ssSvcStatus = {};
+
+    // Open the local default service control manager database
+    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
+    if (schSCManager == NULL)
+    {
+        _tprintf(TEXT("OpenSCManager failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    // Open the service with delete, stop, and query status permissions
+    schService = OpenService(schSCManager, pszServiceName, SERVICE_STOP | 
+        SERVICE_QUERY_STATUS | DELETE);
+    if (schService == NULL)
+    {
+        _tprintf(TEXT("OpenService failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    // Try to stop the service
+    if (ControlService(schService, SERVICE_CONTROL_STOP, &ssSvcStatus))
+    {
+        Cout << TEXT("Stopping ") << pszServiceName << TEXT(".");
+        Sleep(1000);
+
+        while (QueryServiceStatus(schService, &ssSvcStatus))
+        {
+            if (ssSvcStatus.dwCurrentState == SERVICE_STOP_PENDING)
+            {
+                _tprintf(TEXT("."));
+                Sleep(1000);
+            }
+            else break;
+        }
+
+        if (ssSvcStatus.dwCurrentState == SERVICE_STOPPED)
+        {
+            Cout << TEXT("\n") << pszServiceName << TEXT(" is stopped.\n");
+        }
+        else
+        {
+            Cout << TEXT("\n") << pszServiceName << TEXT(" failed to stop.\n");
+        }
+    }
+
+    // Now remove the service by calling DeleteService.
+    if (!DeleteService(schService))
+    {
+        _tprintf(TEXT("DeleteService failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    Cout << pszServiceName << TEXT(" is removed.\n");
+
+Cleanup:
+    // Centralized cleanup for all allocated resources.
+    if (schSCManager)
+    {
+        CloseServiceHandle(schSCManager);
+        schSCManager = NULL;
+    }
+    if (schService)
+    {
+        CloseServiceHandle(schService);
+        schService = NULL;
+    }
+}
+
+
+//
+//   FUNCTION: UpgradeService
+//
+//   PURPOSE: Ask the running service to hand its process over to a new 
+//   instance started from the installed binary, and wait for the new 
+//   instance to run. The service process itself is not restarted.
+//
+//   PARAMETERS: 
+//   * pszServiceName - the name of the service to be upgraded.
+//
+//   NOTE: If the function fails to upgrade the service, it prints the 
+//   error in the standard output stream for users to diagnose the problem.
+//
+void UpgradeService(PCTSTR pszServiceName)
+{
+    SC_HANDLE schSCManager = NULL;
+    SC_HANDLE schService = NULL;
+    SERVICE_STATUS ssSvcStatus = {};
+    SERVICE_STATUS_PROCESS ssp = {};
+    DWORD dwBytesNeeded;
+    DWORD dwOldProcessId;
+
+    // Open the local default service control manager database
+    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
+    if (schSCManager == NULL)
+    {
+        _tprintf(TEXT("OpenSCManager failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    // Open the service with user-defined control and query status 
+    // permissions
+    schService = OpenService(schSCManager, pszServiceName, 
+        SERVICE_USER_DEFINED_CONTROL | SERVICE_QUERY_STATUS);
+    if (schService == NULL)
+    {
+        _tprintf(TEXT("OpenService failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    if (!QueryServiceStatusEx(schService, SC_STATUS_PROCESS_INFO, 
+        (LPBYTE)&ssp, sizeof(ssp), &dwBytesNeeded) || 
+        ssp.dwCurrentState != SERVICE_RUNNING)
+    {
+        Cout << pszServiceName << TEXT(" is not running.\n");
+        goto Cleanup;
+    }
+    dwOldProcessId = ssp.dwProcessId;
+
+    if (!ControlService(schService, SERVICE_CONTROL_HANDOVER, &ssSvcStatus))
+    {
+        _tprintf(TEXT("ControlService failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    // Wait for a new process to run the service
+    Cout << TEXT("Upgrading ") << pszServiceName << TEXT(".");
+    for (int i = 0; i < 60; i++)
+    {
+        Sleep(1000);
+        if (!QueryServiceStatusEx(schService, SC_STATUS_PROCESS_INFO, 
+            (LPBYTE)&ssp, sizeof(ssp), &dwBytesNeeded))
+        {
+            break;
+        }
+        if (ssp.dwCurrentState == SERVICE_RUNNING && 
+            ssp.dwProcessId != dwOldProcessId)
+        {
+            break;
+        }
+        _tprintf(TEXT("."));
+    }
+
+    if (ssp.dwCurrentState == SERVICE_RUNNING && 
+        ssp.dwProcessId != dwOldProcessId)
+    {
+        Cout << TEXT("\n") << pszServiceName << TEXT(" is upgraded.\n");
+    }
+    else
+    {
+        Cout << TEXT("\n") << pszServiceName << TEXT(" failed to upgrade.\n");
+    }
+
+Cleanup:
+    // Centralized cleanup for all allocated resources.
+    if (schSCManager)
+    {
+        CloseServiceHandle(schSCManager);
+        schSCManager = NULL;
+    }
+    if (schService)
+    {
+        CloseServiceHandle(schService);
+        schService = NULL;
+    }
+}
+
+
+//
+//   FUNCTION: TraceService
+//
+//   PURPOSE: Ask the running service to write the spans it recorded so
+//   far to its trace file.
+//
+//   PARAMETERS: 
+//   * pszServiceName - the name of the service to be traced.
+//
+//   NOTE: If the function fails to send the request, it prints the error 
+//   in the standard output stream for users to diagnose the problem.
+//
+void TraceService(PCTSTR pszServiceName)
+{
+    SC_HANDLE schSCManager = NULL;
+    SC_HANDLE schService = NULL;
+    SERVICE_STATUS ssSvcStatus = {};
+
+    // Open the local default service control manager database
+    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
+    if (schSCManager == NULL)
+    {
+        _tprintf(TEXT("OpenSCManager failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    schService = OpenService(schSCManager, pszServiceName, 
+        SERVICE_USER_DEFINED_CONTROL);
+    if (schService == NULL)
+    {
+        _tprintf(TEXT("OpenService failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+
+    if (!ControlService(schService, SERVICE_CONTROL_TRACE, &ssSvcStatus))
+    {
+        _tprintf(TEXT("ControlService failed w/err 0x%08lx\n"), GetLastError());
+        goto Cleanup;
+    }
+    Cout << pszServiceName << TEXT(" is writing its trace.\n");
+
+Cleanup:
+    // Centralized cleanup for all allocated resources.
+    if (schSCManager)
+    {
+        CloseServiceHandle(schSCManager);
+        schSCManager = NULL;
+    }
+    if (schService)
+    {
+        CloseServiceHandle(schService);
+        schService = NULL;
+    }
+}
+
+static BOOL Contains(const std::vector<String>& names, PCTSTR pszName)
+{
+    std::vector<String>::const_iterator it;
+
+    for (it = names.begin(); it != names.end(); it++)
+    {
+        if (_tcsicmp(it->c_str(), pszName) == 0)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+
+//
+//   FUNCTION: VisitDependencies
+//
+//   PURPOSE: Depth first walk used by CheckServiceDependencies. path holds 
+//   the chain from the root service to the current dependency and visited 
+//   the services already known not to lead back to the root.
+//
+static BOOL VisitDependencies(SC_HANDLE schSCManager, 
+                              PCTSTR pszRoot, 
+                              PCTSTR pszDependencies, 
+                              std::vector<String>& path, 
+                              std::vector<String>& visited)
+{
+    for (PCTSTR dep = pszDependencies; dep != NULL && *dep; 
+         dep += _tcslen(dep) + 1)
+    {
+        if (_tcsicmp(dep, pszRoot) == 0)
+        {
+            path.push_back(dep);
+            return FALSE;
+        }
+        // Load ordering groups are resolved by the SCM itself
+        if (*dep == SC_GROUP_IDENTIFIER || Contains(visited, dep) || 
+            Contains(path, dep))
+        {
+            continue;
+        }
+        path.push_back(dep);
+        SC_HANDLE schService = OpenService(schSCManager, dep, 
+            SERVICE_QUERY_CONFIG);
+        if (schService == NULL)
+        {
+            Cout << TEXT("Dependency ") << dep << TEXT(" is not installed.\n");
+            path.pop_back();
+            continue;
+        }
+        DWORD cbNeeded = 0;
+        std::vector<BYTE> buffer;
+        QueryServiceConfig(schService, NULL, 0, &cbNeeded);
+        buffer.resize(cbNeeded > 0 ? cbNeeded : sizeof(QUERY_SERVICE_CONFIG));
+        LPQUERY_SERVICE_CONFIG config = (LPQUERY_SERVICE_CONFIG)&buffer[0];
+        BOOL result = TRUE;
+        if (QueryServiceConfig(schService, config, (DWORD)buffer.size(), 
+            &cbNeeded))
+        {
+            result = VisitDependencies(schSCManager, pszRoot, 
+                config->lpDependencies, path, visited);
+        }
+        CloseServiceHandle(schService);
+        if (!result)
+        {
+            return FALSE;
+        }
+        path.pop_back();
+        visited.push_back(dep);
+    }
+    return TRUE;
+}
+
+
+//
+//   FUNCTION: CheckServiceDependencies
+//
+//   PURPOSE: Walk the dependencies of the service through the service 
+//   control manager database and report a dependency cycle that leads back 
+//   to the service.
+//
+//   PARAMETERS:
+//   * pszServiceName - the name of the service.
+//   * pszDependencies - a pointer to a double null-terminated array of null-
+//     separated names of services or load ordering groups.
+//
+//   RETURN VALUE: FALSE if a cycle was found, TRUE otherwise.
+//
+BOOL CheckServiceDependencies(PCTSTR pszServiceName, PCTSTR pszDependencies)
+{
+    SC_HANDLE schSCManager = NULL;
+    std::vector<String> path;
+    std::vector<String> visited;
+    BOOL result = TRUE;
+
+    if (pszDependencies == NULL || *pszDependencies == TEXT('\0'))
+    {
+        return TRUE;
+    }
+
+    // Open the local default service control manager database
+    schSCManager = OpenSCManager(NULL, NULL, SC_MANAGER_CONNECT);
+    if (schSCManager == NULL)
+    {
+        _tprintf(TEXT("OpenSCManager failed w/err 0x%08lx\n"), GetLastError());
+        return TRUE;
+    }
+
+    path.push_back(pszServiceName);
+    if (!VisitDependencies(schSCManager, pszServiceName, pszDependencies, 
+        path, visited))
+    {
+        Cout << TEXT("Dependency cycle: ");
+        for (size_t i = 0; i < path.size(); i++)
+        {
+            Cout << (i > 0 ? TEXT(" -> ") : TEXT("")) << path[i];
+        }
+        Cout << TEXT("\n");
+        result = FALSE;
+    }
+
+    CloseServiceHandle(schSCManager);
+    return result;
+}
@@ -1,63 +1,113 @@
-/****************************** Module Header ******************************\
-* Module Name:  ServiceInstaller.h
-* Project:      CppWindowsService
-* Copyright (c) Microsoft Corporation.
-* 
-* The file declares functions that install and uninstall the service.
-* 
-* This source is subject to the Microsoft Public License.
-* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
-* All other rights reserved.
-* 
-* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
-* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
-* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
-\***************************************************************************/
-
-#pragma once
-
-
-//
-//   FUNCTION: InstallService
-//
-//   PURPOSE: Install the current application as a service to the local 
-//   service control manager database.
-//
-//   PARAMETERS:
-//   * pszServiceName - the name of the service to be installed
-//   * pszDisplayName - the display name of the service
-//   * pszDescription - the description of the service
-//   * dwStartType - the service start option. This parameter can be one of 
-//     the following values: SERVICE_AUTO_START, SERVICE_BOOT_START, 
-//     SERVICE_DEMAND_START, SERVICE_DISABLED, SERVICE_SYSTEM_START.
-//   * pszDependencies - a pointer to a double null-terminated array of null-
-//     separated names of services or load ordering groups that the system 
-//     must start before this service.
-//   * pszAccount - the name of the account under which the service runs.
-//   * pszPassword - the password to the account name.
-//
-//   NOTE: If the function fails to install the service, it prints the error 
-//   in the standard output stream for users to diagnose the problem.
-//
-void InstallService(PCTSTR pszServiceName, 
-                    PCTSTR pszDisplayName, 
-                    PCTSTR pszDescription, 
-                    DWORD dwStartType,
-                    PCTSTR pszDependencies, 
-                    PCTSTR pszAccount, 
-                    PCTSTR pszPassword);
-
-
-//
-//   FUNCTION: UninstallService
-//
-//   PURPOSE: Stop and remove the service from the local service control 
-//   manager database.
-//
-//   PARAMETERS: 
-//   * pszServiceName - the name of the service to be removed.
-//
-//   NOTE: If the function fails to uninstall the service, it prints the 
-//   error in the standard output stream for users to diagnose the problem.
-//
-void UninstallService(PCTSTR pszServiceName);
\ No newline at end of file
+/****************************** Module Header ******************************\
+* Module Name:  ServiceInstaller.h
+* Project:      CppWindowsService
+* Copyright (c) Microsoft Corporation.
+* 
+* The file declares functions that install and uninstall the service.
+* 
+* This source is subject to the Microsoft Public License.
+* See http://www.microsoft.com/en-us/openness/resources/licenses.aspx#MPL.
+* All other rights reserved.
+* 
+* THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+* EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED 
+* WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+\***************************************************************************/
+
+#pragma once
+
+
+//
+//   FUNCTION: InstallService
+//
+//   PURPOSE: Install the current application as a service to the local 
+//   service control manager database.
+//
+//   PARAMETERS:
+//   * pszServiceName - the name of the service to be installed
+//   * pszDisplayName - the display name of the service
+//   * pszDescription - the description of the service
+//   * dwStartType - the service start option. This parameter can be one of 
+//     the following values: SERVICE_AUTO_START, SERVICE_BOOT_START, 
+//     SERVICE_DEMAND_START, SERVICE_DISABLED, SERVICE_SYSTEM_START.
+//   * pszDependencies - a pointer to a double null-terminated array of null-
+//     separated names of services or load ordering groups that the system 
+//     must start before this service.
+//   * pszAccount - the name of the account under which the service runs.
+//   * pszPassword - the password to the account name.
+//
+//   NOTE: If the function fails to install the service, it prints the error 
+//   in the standard output stream for users to diagnose the problem.
+//
+void InstallService(PCTSTR pszServiceName, 
+                    PCTSTR pszDisplayName, 
+                    PCTSTR pszDescription, 
+                    DWORD dwStartType,
+                    PCTSTR pszDependencies, 
+                    PCTSTR pszAccount, 
+                    PCTSTR pszPassword);
+
+
+//
+//   FUNCTION: UninstallService
+//
+//   PURPOSE: Stop and remove the service from the local service control 
+//   manager database.
+//
+//   PARAMETERS: 
+//   * pszServiceName - the name of the service to be removed.
+//
+//   NOTE: If the function fails to uninstall the service, it prints the 
+//   error in the standard output stream for users to diagnose the problem.
+//
+void UninstallService(PCTSTR pszServiceName);
+
+
+//
+//   FUNCTION: UpgradeService
+//
+//   PURPOSE: Ask the running service to hand its process over to a new 
+//   instance started from the installed binary, and wait for the new 
+//   instance to run. The service process itself is not restarted.
+//
+//   PARAMETERS: 
+//   * pszServiceName - the name of the service to be upgraded.
+//
+//   NOTE: If the function fails to upgrade the service, it prints the 
+//   error in the standard output stream for users to diagnose the problem.
+//
+void UpgradeService(PCTSTR pszServiceName);
+
+
+//
+//   FUNCTION: TraceService
+//
+//   PURPOSE: Ask the running service to write its trace, see <trace>.
+//
+//   PARAMETERS: 
+//   * pszServiceName - the name of the service to be traced.
+//
+//   NOTE: If the function fails to send the request, it prints the error 
+//   in the standard output stream for users to diagnose the problem.
+//
+void TraceService(PCTSTR pszServiceName);
+
+
+//
+//   FUNCTION: CheckServiceDependencies
+//
+//   PURPOSE: Walk the dependencies of the service through the service 
+//   control manager database and report a dependency cycle that leads back 
+//   to the service.
+//
+//   PARAMETERS:
+//   * pszServiceName - the name of the service.
+//   * pszDependencies - a pointer to a double null-terminated array of null-
+//     separated names of services or load ordering groups.
+//
+//   RETURN VALUE: FALSE if a cycle was found, TRUE otherwise.
+//
+//   NOTE: The cycle and missing dependencies are printed in the standard 
+//   output stream.
+//
+BOOL CheckServiceDependencies(PCTSTR pszServiceName, PCTSTR pszDependencies);
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include <stddef.h>
+#include "StateFile.h"
+
+// Layouts of the previous versions, read so that a wrapper upgraded after a
+// crash still finds the child recorded by the old one
+struct SupervisorStateV1
+{
+    DWORD wrapperPid;
+    ULONGLONG wrapperStartTime;
+    DWORD childPid;
+    ULONGLONG childStartTime;
+    ULONGLONG instanceId;
+    DWORD configGeneration;
+    USHORT notifyPort;
+};
+
+struct SupervisorStateV2
+{
+    DWORD wrapperPid;
+    ULONGLONG wrapperStartTime;
+    DWORD childPid;
+    ULONGLONG childStartTime;
+    DWORD standbyPid;
+    ULONGLONG standbyStartTime;
+    ULONGLONG instanceId;
+    DWORD configGeneration;
+    USHORT notifyPort;
+};
+
+struct SupervisorStateV3
+{
+    DWORD wrapperPid;
+    ULONGLONG wrapperStartTime;
+    DWORD childPid;
+    ULONGLONG childStartTime;
+    DWORD standbyPid;
+    ULONGLONG standbyStartTime;
+    ULONGLONG instanceId;
+    DWORD configGeneration;
+    USHORT notifyPort;
+    ULONG plannedRestarts;
+    ULONG failedRestarts;
+};
+
+template <class T>
+struct LegacySlot
+{
+    DWORD magic;
+    DWORD version;
+    ULONGLONG sequence;
+    T state;
+    DWORD checksum;
+};
+
+// Fields every version has
+template <class T>
+static void CopySupervisorState(const T& old, SupervisorState* state)
+{
+    state->wrapperPid = old.wrapperPid;
+    state->wrapperStartTime = old.wrapperStartTime;
+    state->childPid = old.childPid;
+    state->childStartTime = old.childStartTime;
+    state->instanceId = old.instanceId;
+    state->configGeneration = old.configGeneration;
+    state->notifyPort = old.notifyPort;
+}
+
+//
+//   FUNCTION: ReadLegacySlots
+//
+//   PURPOSE: Find the newest valid slot of version in a file written with
+//   the slot layout of that version.
+//
+//   RETURN VALUE: The sequence of the slot, 0 when there is none.
+//
+template <class T>
+static ULONGLONG ReadLegacySlots(const void* data, DWORD version, T* state)
+{
+    const LegacySlot<T>* slots = (const LegacySlot<T>*)data;
+    ULONGLONG sequence = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (slots[i].magic == STATE_MAGIC && slots[i].version == version &&
+            slots[i].checksum == Crc32(&slots[i], offsetof(LegacySlot<T>, checksum)) &&
+            slots[i].sequence > sequence)
+        {
+            sequence = slots[i].sequence;
+            *state = slots[i].state;
+        }
+    }
+    return sequence;
+}
+
+StateFile::StateFile()
+    : m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL), m_slots(NULL),
+      m_sequence(0)
+{
+}
+
+StateFile::~StateFile()
+{
+    Close();
+}
+
+bool StateFile::Open(const String& filename)
+{
+    DWORD size = 2 * sizeof(Slot);
+
+    // A second open replaces the mapping instead of leaking it
+    Close();
+    m_sequence = 0;
+    m_hFile = CreateFile(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+                         FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    // A new file is extended with zeros, which no slot accepts as valid
+    m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READWRITE, 0, size,
+                                   NULL);
+    if (m_hMapping != NULL)
+    {
+        m_slots = (Slot*)MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, size);
+    }
+    if (m_slots == NULL)
+    {
+        DWORD dwError = GetLastError();
+        Close();
+        SetLastError(dwError);
+        return false;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (IsValid(m_slots[i]) && m_slots[i].sequence > m_sequence)
+        {
+            m_sequence = m_slots[i].sequence;
+        }
+    }
+    if (m_sequence == 0)
+    {
+        ReadLegacy();
+    }
+    return true;
+}
+
+//
+//   FUNCTION: StateFile::ReadLegacy(void)
+//
+//   PURPOSE: Convert the state an older version left in the file and write
+//   it back in the current layout. Fields the old version did not have
+//   stay 0.
+//
+void StateFile::ReadLegacy()
+{
+    SupervisorStateV1 v1;
+    SupervisorStateV2 v2;
+    SupervisorStateV3 v3;
+    SupervisorState state;
+    ULONGLONG sequence;
+
+    ZeroMemory(&state, sizeof(state));
+    if ((sequence = ReadLegacySlots(m_slots, 3, &v3)) != 0)
+    {
+        CopySupervisorState(v3, &state);
+        state.standbyPid = v3.standbyPid;
+        state.standbyStartTime = v3.standbyStartTime;
+        state.plannedRestarts = v3.plannedRestarts;
+        state.failedRestarts = v3.failedRestarts;
+    }
+    else if ((sequence = ReadLegacySlots(m_slots, 2, &v2)) != 0)
+    {
+        CopySupervisorState(v2, &state);
+        state.standbyPid = v2.standbyPid;
+        state.standbyStartTime = v2.standbyStartTime;
+    }
+    else if ((sequence = ReadLegacySlots(m_slots, 1, &v1)) != 0)
+    {
+        CopySupervisorState(v1, &state);
+    }
+    if (sequence != 0)
+    {
+        m_sequence = sequence;
+        Write(state);
+    }
+}
+
+void StateFile::Close()
+{
+    if (m_slots != NULL)
+    {
+        FlushViewOfFile(m_slots, 0);
+        UnmapViewOfFile(m_slots);
+        m_slots = NULL;
+    }
+    if (m_hMapping != NULL)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool StateFile::Read(SupervisorState* state)
+{
+    Slot slot;
+
+    if (m_slots == NULL || m_sequence == 0)
+    {
+        return false;
+    }
+    slot = m_slots[m_sequence % 2];
+    if (!IsValid(slot))
+    {
+        return false;
+    }
+    *state = slot.state;
+    return true;
+}
+
+void StateFile::Write(const SupervisorState& state)
+{
+    Slot slot;
+
+    if (m_slots == NULL)
+    {
+        return;
+    }
+    // Padding is part of the checksum
+    ZeroMemory(&slot, sizeof(slot));
+    slot.magic = STATE_MAGIC;
+    slot.version = STATE_VERSION;
+    slot.sequence = m_sequence + 1;
+    slot.state = state;
+    slot.checksum = Crc32(&slot, offsetof(Slot, checksum));
+    // Overwrite the older slot only
+    CopyMemory(&m_slots[slot.sequence % 2], &slot, sizeof(slot));
+    m_sequence = slot.sequence;
+    // The mapped pages outlive a crash of the process, the flush covers a
+    // crash of the system.
+    FlushViewOfFile(&m_slots[slot.sequence % 2], sizeof(slot));
+}
+
+bool StateFile::IsValid(const Slot& slot)
+{
+    return slot.magic == STATE_MAGIC && slot.version == STATE_VERSION &&
+           slot.checksum == Crc32(&slot, offsetof(Slot, checksum));
+}
+
+DWORD Crc32(const void* data, size_t size)
+{
+    const BYTE* bytes = (const BYTE*)data;
+    DWORD crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+ULONGLONG GetProcessStartTime(HANDLE hProcess)
+{
+    FILETIME creation, exit, kernel, user;
+    ULARGE_INTEGER time;
+
+    if (!GetProcessTimes(hProcess, &creation, &exit, &kernel, &user))
+    {
+        return 0;
+    }
+    time.LowPart = creation.dwLowDateTime;
+    time.HighPart = creation.dwHighDateTime;
+    return time.QuadPart;
+}
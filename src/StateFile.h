@@ -0,0 +1,78 @@
+#ifndef _STATEFILE_H_
+#define _STATEFILE_H_
+#include <windows.h>
+#include <string>
+#include "strings.h"
+#include "NotifySocket.h"
+
+#define STATE_MAGIC 0x54535653
+// Each bump keeps the previous layout readable in StateFile::ReadLegacy
+#define STATE_VERSION 4
+
+/**
+ * What the supervisor needs to find its child again after a crash.
+ * Start times are creation FILETIMEs, they tell a live process from a
+ * recycled pid.
+ */
+struct SupervisorState
+{
+    DWORD wrapperPid;
+    ULONGLONG wrapperStartTime;
+    DWORD childPid;
+    ULONGLONG childStartTime;
+    // Suspended standby kept by older wrappers, only ever killed
+    DWORD standbyPid;
+    ULONGLONG standbyStartTime;
+    // Incremented for every child started
+    ULONGLONG instanceId;
+    // Checksum of the start command, environment and directory
+    DWORD configGeneration;
+    USHORT notifyPort;
+    char notifyToken[NOTIFY_TOKEN_LENGTH + 1];
+    // Restarts on purpose (recycle, trigger) and after a failure
+    ULONG plannedRestarts;
+    ULONG failedRestarts;
+};
+
+/**
+ * Supervisor state kept in a memory mapped file, so it survives a crash of
+ * the wrapper without an explicit write. Two checksummed slots are written
+ * alternately; a torn write leaves the previous slot valid.
+ */
+class StateFile
+{
+    public:
+        StateFile();
+        ~StateFile();
+
+        // Closes the file opened before, if any
+        bool Open(const String& filename);
+        void Close();
+        // Newest valid copy of the state, false when there is none
+        bool Read(SupervisorState* state);
+        void Write(const SupervisorState& state);
+
+    private:
+        struct Slot
+        {
+            DWORD magic;
+            DWORD version;
+            ULONGLONG sequence;
+            SupervisorState state;
+            DWORD checksum;
+        };
+
+        bool IsValid(const Slot& slot);
+        void ReadLegacy();
+
+        HANDLE m_hFile;
+        HANDLE m_hMapping;
+        Slot* m_slots;
+        ULONGLONG m_sequence;
+};
+
+DWORD Crc32(const void* data, size_t size);
+// Creation time of the process, 0 on error
+ULONGLONG GetProcessStartTime(HANDLE hProcess);
+
+#endif /* _STATEFILE_H_ */
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <sddl.h>
+#include "StatusPage.h"
+
+// System and administrators control the page, other accounts may read it
+#define STATUS_PAGE_SDDL L"D:(A;;GA;;;SY)(A;;GA;;;BA)(A;;GR;;;AU)"
+// A writer holding the lock this long died in the middle of a write
+#define STATUS_TAKEOVER 1000
+#define STATUS_READ_TRIES 100000
+
+static const WCHAR* s_namespaces[2] =
+{
+    L"Global\\", L"Local\\"
+};
+
+static void GetPageName(PCWSTR ns, PCWSTR id, WCHAR* name, size_t size)
+{
+    _snwprintf(name, size, L"%s%s%s", ns, STATUS_PAGE_PREFIX, id);
+    name[size - 1] = 0;
+}
+
+StatusWriter::StatusWriter()
+    : m_hMapping(NULL), m_page(NULL)
+{
+}
+
+StatusWriter::~StatusWriter()
+{
+    Close();
+}
+
+//
+//   FUNCTION: StatusWriter::Open
+//
+//   PURPOSE: Create the page of the service, or open the one a previous
+//   instance still holds during a handover. The Global namespace needs
+//   SeCreateGlobalPrivilege, which services have; elsewhere the page is
+//   created in the Local one.
+//
+bool StatusWriter::Open(PCWSTR id)
+{
+    SECURITY_ATTRIBUTES sa;
+    PSECURITY_DESCRIPTOR sd = NULL;
+    WCHAR name[MAX_PATH];
+    DWORD dwError = ERROR_INVALID_PARAMETER;
+    bool existed = false;
+
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(STATUS_PAGE_SDDL,
+            SDDL_REVISION_1, &sd, NULL))
+    {
+        return false;
+    }
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = sd;
+    sa.bInheritHandle = FALSE;
+    for (int i = 0; i < 2 && m_hMapping == NULL; i++)
+    {
+        GetPageName(s_namespaces[i], id, name, MAX_PATH);
+        m_hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE,
+                                        0, sizeof(StatusPage), name);
+        dwError = GetLastError();
+        existed = m_hMapping != NULL && dwError == ERROR_ALREADY_EXISTS;
+    }
+    LocalFree(sd);
+    if (m_hMapping != NULL)
+    {
+        m_page = (StatusPage*)MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0,
+                                            sizeof(StatusPage));
+        dwError = GetLastError();
+    }
+    if (m_page == NULL)
+    {
+        Close();
+        SetLastError(dwError);
+        return false;
+    }
+    if (!existed || m_page->magic != STATUS_PAGE_MAGIC)
+    {
+        m_page->version = STATUS_PAGE_VERSION;
+        m_page->recordSize = sizeof(StatusRecord);
+        m_page->sequence = 0;
+        // Readers accept the page from here on
+        InterlockedExchange((volatile LONG*)&m_page->magic, STATUS_PAGE_MAGIC);
+    }
+    return true;
+}
+
+void StatusWriter::Close()
+{
+    if (m_page != NULL)
+    {
+        UnmapViewOfFile(m_page);
+        m_page = NULL;
+    }
+    if (m_hMapping != NULL)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+}
+
+bool StatusWriter::IsOpen()
+{
+    return m_page != NULL;
+}
+
+//
+//   FUNCTION: StatusWriter::Write
+//
+//   PURPOSE: Replace the record under the sequence lock. The sequence is
+//   made odd before the copy and even again after it; the interlocked
+//   operations order the copy between the two.
+//
+void StatusWriter::Write(const StatusRecord& record)
+{
+    ULONGLONG since = 0;
+    LONG sequence, locked;
+
+    if (m_page == NULL)
+    {
+        return;
+    }
+    while (true)
+    {
+        sequence = m_page->sequence;
+        if ((sequence & 1) == 0)
+        {
+            locked = sequence + 1;
+        }
+        else if (since != 0 && GetTickCount64() - since >= STATUS_TAKEOVER)
+        {
+            // Keep the sequence odd and take over the lock
+            locked = sequence + 2;
+        }
+        else
+        {
+            since = since != 0 ? since : GetTickCount64();
+            Sleep(0);
+            continue;
+        }
+        if (InterlockedCompareExchange(&m_page->sequence, locked, sequence) ==
+            sequence)
+        {
+            break;
+        }
+        since = 0;
+    }
+    m_page->record = record;
+    InterlockedExchange(&m_page->sequence, locked + 1);
+}
+
+StatusReader::StatusReader()
+    : m_hMapping(NULL), m_page(NULL)
+{
+}
+
+StatusReader::~StatusReader()
+{
+    Close();
+}
+
+bool StatusReader::Open(PCWSTR id)
+{
+    WCHAR name[MAX_PATH];
+    DWORD dwError = ERROR_FILE_NOT_FOUND;
+
+    for (int i = 0; i < 2 && m_hMapping == NULL; i++)
+    {
+        GetPageName(s_namespaces[i], id, name, MAX_PATH);
+        m_hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+        dwError = GetLastError();
+    }
+    if (m_hMapping != NULL)
+    {
+        m_page = (const StatusPage*)MapViewOfFile(m_hMapping, FILE_MAP_READ,
+                                                  0, 0, 0);
+        dwError = GetLastError();
+    }
+    if (m_page != NULL && m_page->magic != STATUS_PAGE_MAGIC)
+    {
+        dwError = ERROR_INVALID_DATA;
+        Close();
+    }
+    if (m_page == NULL)
+    {
+        Close();
+        SetLastError(dwError);
+        return false;
+    }
+    return true;
+}
+
+void StatusReader::Close()
+{
+    if (m_page != NULL)
+    {
+        UnmapViewOfFile(m_page);
+        m_page = NULL;
+    }
+    if (m_hMapping != NULL)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+}
+
+//
+//   FUNCTION: StatusReader::Read
+//
+//   PURPOSE: Copy the record, retrying until the sequence is even and the
+//   same before and after the copy. Fields of a newer writer are left out,
+//   those of an older one are zero.
+//
+bool StatusReader::Read(StatusRecord* record)
+{
+    StatusRecord copy;
+    DWORD size;
+
+    if (m_page == NULL)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    size = m_page->recordSize < sizeof(copy) ? m_page->recordSize : sizeof(copy);
+    ZeroMemory(&copy, sizeof(copy));
+    for (int i = 0; i < STATUS_READ_TRIES; i++)
+    {
+        LONG sequence = m_page->sequence;
+        if ((sequence & 1) == 0)
+        {
+            MemoryBarrier();
+            CopyMemory(&copy, (const void*)&m_page->record, size);
+            MemoryBarrier();
+            if (m_page->sequence == sequence)
+            {
+                *record = copy;
+                return true;
+            }
+        }
+        YieldProcessor();
+    }
+    SetLastError(ERROR_BUSY);
+    return false;
+}
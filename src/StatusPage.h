@@ -0,0 +1,135 @@
+#ifndef _STATUSPAGE_H_
+#define _STATUSPAGE_H_
+#include <windows.h>
+
+/*
+ * Status of a service published by its wrapper in a named shared memory
+ * page, for monitoring tools to poll without talking to the wrapper. A
+ * tool maps the page once with StatusReader, each Read then only copies
+ * memory. Only this header and StatusPage.cpp (libsvcstatus.a) are needed.
+ *
+ * The layout is fixed: a newer version only appends fields to the record
+ * and readers copy the part they know.
+ */
+
+#define STATUS_PAGE_MAGIC 0x50535653
+#define STATUS_PAGE_VERSION 2
+// The page of a service is the prefix followed by its id, in the Global
+// namespace, or in the Local one when the wrapper runs in test mode
+// without the right to create global objects
+#define STATUS_PAGE_PREFIX L"SvcWrapper.status."
+#define STATUS_ID_LENGTH 64
+// Latencies of the spawn, readiness, stop, restart gap, backend connect
+// and log sink writes, in this order
+#define STATUS_LATENCIES 6
+
+// State of the service process, as kept by the wrapper
+enum StatusChildState
+{
+    STATUS_CHILD_IDLE,
+    STATUS_CHILD_SUSPENDED,
+    STATUS_CHILD_RUNNING,
+    STATUS_CHILD_STOPPING,
+    STATUS_CHILD_EXITED
+};
+
+/**
+ * Distribution of one latency, in microseconds, since the service started
+ * and across upgrades of the wrapper.
+ */
+struct StatusLatency
+{
+    DWORD count;
+    DWORD reserved;
+    ULONGLONG p50;
+    ULONGLONG p90;
+    ULONGLONG p99;
+    ULONGLONG max;
+};
+
+/**
+ * One snapshot of a service. Times are FILETIMEs, the uptime of the
+ * service process is sampleTime - childStartTime.
+ */
+struct StatusRecord
+{
+    WCHAR id[STATUS_ID_LENGTH];
+    // SERVICE_RUNNING, SERVICE_STOP_PENDING...
+    DWORD serviceState;
+    // StatusChildState
+    DWORD childState;
+    DWORD wrapperPid;
+    // Pid of the last service process, also once it exited
+    DWORD childPid;
+    DWORD lastExitCode;
+    // Restarts on purpose (recycle, trigger) and after a failure
+    DWORD plannedRestarts;
+    DWORD failedRestarts;
+    // Processes running in the tree of the service process
+    DWORD processes;
+    ULONGLONG wrapperStartTime;
+    // 0 while no service process runs
+    ULONGLONG childStartTime;
+    ULONGLONG sampleTime;
+    // CPU time of the tree of the service process in milliseconds, and
+    // its peak committed memory in bytes
+    ULONGLONG cpuTime;
+    ULONGLONG peakMemory;
+    DWORD runningJobs;
+    DWORD reserved;
+    // Version 2
+    StatusLatency latencies[STATUS_LATENCIES];
+};
+
+struct StatusPage
+{
+    DWORD magic;
+    DWORD version;
+    // Size of the record as written
+    DWORD recordSize;
+    // Sequence lock: odd while a writer updates the record
+    volatile LONG sequence;
+    StatusRecord record;
+};
+
+/**
+ * Writer side, used by the wrapper. Writers never wait for readers; more
+ * than one writer, as during a handover, take turns on the sequence.
+ */
+class StatusWriter
+{
+    public:
+        StatusWriter();
+        ~StatusWriter();
+
+        bool Open(PCWSTR id);
+        void Close();
+        bool IsOpen();
+        void Write(const StatusRecord& record);
+
+    private:
+        HANDLE m_hMapping;
+        StatusPage* m_page;
+};
+
+/**
+ * Reader side, for monitoring tools. Read retries while a write is in
+ * progress and returns false only when the page stays locked, i.e. its
+ * writer died in the middle of a write.
+ */
+class StatusReader
+{
+    public:
+        StatusReader();
+        ~StatusReader();
+
+        bool Open(PCWSTR id);
+        void Close();
+        bool Read(StatusRecord* record);
+
+    private:
+        HANDLE m_hMapping;
+        const StatusPage* m_page;
+};
+
+#endif /* _STATUSPAGE_H_ */
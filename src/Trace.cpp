@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <vector>
+#include "Trace.h"
+
+struct TraceEvent
+{
+    const char* name;
+    const char* argName;
+    DWORD arg;
+    LONGLONG start;
+    LONGLONG end;
+};
+
+/**
+ * Ring of the spans of one thread. Only its thread writes, count is
+ * published after the span it counts.
+ */
+struct TraceBuffer
+{
+    TraceBuffer* next;
+    DWORD tid;
+    volatile LONG count;
+    TraceEvent events[TRACE_BUFFER_SPANS];
+};
+
+bool Trace::s_enabled = false;
+static DWORD s_tls = TLS_OUT_OF_INDEXES;
+// Every buffer ever created, pushed lock-free and never freed
+static TraceBuffer* volatile s_buffers = NULL;
+static LONGLONG s_origin = 0;
+static LONGLONG s_frequency = 1;
+static String s_filename;
+static CRITICAL_SECTION s_exportLock;
+
+bool Trace::Open(const String& filename)
+{
+    LARGE_INTEGER value;
+
+    if (s_enabled)
+    {
+        return true;
+    }
+    s_tls = TlsAlloc();
+    if (s_tls == TLS_OUT_OF_INDEXES)
+    {
+        return false;
+    }
+    QueryPerformanceFrequency(&value);
+    s_frequency = value.QuadPart;
+    s_origin = Now();
+    s_filename = filename;
+    InitializeCriticalSection(&s_exportLock);
+    s_enabled = true;
+    return true;
+}
+
+LONGLONG Trace::Now()
+{
+    LARGE_INTEGER value;
+
+    QueryPerformanceCounter(&value);
+    return value.QuadPart;
+}
+
+void Trace::Record(const char* name, LONGLONG start, LONGLONG end,
+                   const char* argName, DWORD arg)
+{
+    TraceBuffer* buffer = (TraceBuffer*)TlsGetValue(s_tls);
+    TraceBuffer* head;
+
+    if (buffer == NULL)
+    {
+        buffer = new TraceBuffer();
+        buffer->tid = GetCurrentThreadId();
+        buffer->count = 0;
+        do
+        {
+            head = s_buffers;
+            buffer->next = head;
+        } while (InterlockedCompareExchangePointer((PVOID volatile*)&s_buffers,
+                                                   buffer, head) != head);
+        TlsSetValue(s_tls, buffer);
+    }
+    TraceEvent& event = buffer->events[buffer->count % TRACE_BUFFER_SPANS];
+    event.name = name;
+    event.argName = argName;
+    event.arg = arg;
+    event.start = start;
+    event.end = end;
+    InterlockedExchange(&buffer->count, buffer->count + 1);
+}
+
+//
+//   FUNCTION: Trace::Export
+//
+//   PURPOSE: Write the spans of every thread as complete events ("ph":"X")
+//   in microseconds since Open. A ring written during the copy may have
+//   overwritten its oldest spans, which are left out.
+//
+bool Trace::Export()
+{
+    std::vector<TraceEvent> events;
+    std::string data;
+    char line[256];
+    HANDLE hFile;
+    DWORD written;
+    BOOL result;
+
+    if (!s_enabled)
+    {
+        return false;
+    }
+    EnterCriticalSection(&s_exportLock);
+    _snprintf(line, sizeof(line),
+              "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"args\":{\"name\":\"SvcWrapper\"}}",
+              GetCurrentProcessId());
+    data = line;
+    for (TraceBuffer* buffer = s_buffers; buffer != NULL; buffer = buffer->next)
+    {
+        LONG count = buffer->count;
+        LONG first = count > TRACE_BUFFER_SPANS ? count - TRACE_BUFFER_SPANS : 0;
+        events.clear();
+        for (LONG i = first; i < count; i++)
+        {
+            events.push_back(buffer->events[i % TRACE_BUFFER_SPANS]);
+        }
+        MemoryBarrier();
+        // Spans the thread overwrote while they were copied, and the one
+        // it may be writing
+        LONG lost = buffer->count + 1 - TRACE_BUFFER_SPANS - first;
+        for (LONG i = lost > 0 ? lost : 0; i < (LONG)events.size(); i++)
+        {
+            const TraceEvent& event = events[i];
+            int length = _snprintf(line, sizeof(line),
+                ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%I64d,\"dur\":%I64d",
+                event.name, GetCurrentProcessId(), buffer->tid,
+                (event.start - s_origin) * 1000000 / s_frequency,
+                (event.end - event.start) * 1000000 / s_frequency);
+            if (event.argName != NULL && length > 0 && length < (int)sizeof(line))
+            {
+                _snprintf(line + length, sizeof(line) - length,
+                          ",\"args\":{\"%s\":%lu}", event.argName, event.arg);
+            }
+            line[sizeof(line) - 1] = 0;
+            data += line;
+            data += "}";
+        }
+    }
+    data += "\n]}\n";
+
+    String temp = s_filename + TEXT(".tmp");
+    hFile = CreateFile(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL, NULL);
+    result = hFile != INVALID_HANDLE_VALUE &&
+             WriteFile(hFile, data.data(), (DWORD)data.size(), &written, NULL) &&
+             written == data.size();
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hFile);
+    }
+    // A trace being written never replaces the previous one
+    if (!result || !MoveFileEx(temp.c_str(), s_filename.c_str(),
+                               MOVEFILE_REPLACE_EXISTING))
+    {
+        DWORD dwError = GetLastError();
+        DeleteFile(temp.c_str());
+        LeaveCriticalSection(&s_exportLock);
+        SetLastError(dwError);
+        return false;
+    }
+    LeaveCriticalSection(&s_exportLock);
+    return true;
+}
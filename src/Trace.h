@@ -0,0 +1,80 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include <windows.h>
+#include <string>
+#include "strings.h"
+
+// Control code writing the trace of a running service
+#define SERVICE_CONTROL_TRACE 129
+// Spans kept per thread, older ones are overwritten
+#define TRACE_BUFFER_SPANS 4096
+
+/**
+ * Spans of the lifecycle phases: spawn, readiness, stop command, exit,
+ * restart delay... exported as Chrome trace JSON, which chrome://tracing
+ * and the Perfetto UI open.
+ *
+ * Each thread records into its own ring, without locks; the export reads
+ * the rings while they are written and drops the spans overwritten
+ * meanwhile. Disabled, a span costs a test of a static flag.
+ */
+class Trace
+{
+    public:
+        // Enable the tracing, the trace is written to filename
+        static bool Open(const String& filename);
+        static bool Enabled()
+        {
+            return s_enabled;
+        }
+        // QueryPerformanceCounter
+        static LONGLONG Now();
+        // name and argName must be literals, the spans keep the pointers
+        static void Record(const char* name, LONGLONG start, LONGLONG end,
+                           const char* argName, DWORD arg);
+        // Write the spans recorded so far
+        static bool Export();
+
+    private:
+        static bool s_enabled;
+};
+
+/**
+ * Span from its construction to End or its destruction.
+ */
+class TraceSpan
+{
+    public:
+        TraceSpan(const char* name)
+            : m_name(Trace::Enabled() ? name : NULL), m_argName(NULL), m_arg(0)
+        {
+            m_start = m_name != NULL ? Trace::Now() : 0;
+        }
+        ~TraceSpan()
+        {
+            End();
+        }
+
+        // Shown with the span, e.g. the pid of the process started
+        void SetArg(const char* argName, DWORD arg)
+        {
+            m_argName = argName;
+            m_arg = arg;
+        }
+        void End()
+        {
+            if (m_name != NULL)
+            {
+                Trace::Record(m_name, m_start, Trace::Now(), m_argName, m_arg);
+                m_name = NULL;
+            }
+        }
+
+    private:
+        const char* m_name;
+        const char* m_argName;
+        DWORD m_arg;
+        LONGLONG m_start;
+};
+
+#endif /* _TRACE_H_ */
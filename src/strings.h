@@ -1,13 +1,13 @@
-#ifndef _STRINGS_H_
-#define _STRINGS_H_
-#include "nsis_tchar.h"
-
-#if defined(_UNICODE) || defined(UNICODE)
-#define String std::wstring
-#define Cout std::wcout
-#else
-#define String std::string
-#define Cout std::cout
-#endif
-
+#ifndef _STRINGS_H_
+#define _STRINGS_H_
+#include "nsis_tchar.h"
+
+#if defined(_UNICODE) || defined(UNICODE)
+#define String std::wstring
+#define Cout std::wcout
+#else
+#define String std::string
+#define Cout std::cout
+#endif
+
 #endif /* _STRINGS_H_ */
\ No newline at end of file
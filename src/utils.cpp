@@ -1,42 +1,67 @@
-#include <vector>
-#include "utils.h"
-#include "strings.h"
-#include "Descriptor.h"
-
-bool CreateRecursiveDirectory(const TCHAR* path)
-{
-    String folder_name = path;
-    const TCHAR *pos = NULL, *start;
-    
-    if (folder_name[folder_name.size() - 1] != TEXT('\\'))
-    {
-        folder_name += TEXT('\\');
-    }
-    start = folder_name.c_str();
-    pos = folder_name.c_str();
-    do
-    {
-        pos = _tcschr(pos, TEXT('\\'));
-        if (pos == NULL)
-        {
-            break;
-        }
-        if (*(pos - 1) == TEXT(':'))
-        {
-            pos++;
-            continue;
-        }
-        folder_name[pos - start] = TEXT('\0');
-        if (!CreateDirectory(folder_name.c_str(), NULL))
-        {
-            DWORD dwError = GetLastError();
-            if (dwError != ERROR_ALREADY_EXISTS)
-            {
-                return false;
-            }
-        }
-        folder_name[pos - start] = TEXT('\\');
-        pos++;
-    } while(true);
-    return true;
+#include <vector>
+#include "utils.h"
+#include "strings.h"
+#include "Descriptor.h"
+
+bool CreateRecursiveDirectory(const TCHAR* path)
+{
+    String folder_name = path;
+    const TCHAR *pos = NULL, *start;
+    
+    if (folder_name[folder_name.size() - 1] != TEXT('\\'))
+    {
+        folder_name += TEXT('\\');
+    }
+    start = folder_name.c_str();
+    pos = folder_name.c_str();
+    do
+    {
+        pos = _tcschr(pos, TEXT('\\'));
+        if (pos == NULL)
+        {
+            break;
+        }
+        if (*(pos - 1) == TEXT(':'))
+        {
+            pos++;
+            continue;
+        }
+        folder_name[pos - start] = TEXT('\0');
+        if (!CreateDirectory(folder_name.c_str(), NULL))
+        {
+            DWORD dwError = GetLastError();
+            if (dwError != ERROR_ALREADY_EXISTS)
+            {
+                return false;
+            }
+        }
+        folder_name[pos - start] = TEXT('\\');
+        pos++;
+    } while(true);
+    return true;
+}
+
+DWORD GetServiceShutdownTimeout()
+{
+    HKEY hKey;
+    TCHAR value[32];
+    DWORD size = sizeof(value) - sizeof(TCHAR);
+    DWORD type;
+    DWORD timeout = 5000;
+
+    if (RegOpenKeyEx(HKEY_LOCAL_MACHINE,
+                     TEXT("SYSTEM\\CurrentControlSet\\Control"), 0, KEY_READ,
+                     &hKey) != ERROR_SUCCESS)
+    {
+        return timeout;
+    }
+    ZeroMemory(value, sizeof(value));
+    if (RegQueryValueEx(hKey, TEXT("WaitToKillServiceTimeout"), NULL, &type,
+                        (LPBYTE)value, &size) == ERROR_SUCCESS && type == REG_SZ)
+    {
+        timeout = _tcstoul(value, NULL, 10);
+    }
+    RegCloseKey(hKey);
+    // Leave some room for the SCM to see the stopped status
+    return timeout > 1000 ? timeout - 500 : timeout;
 }
\ No newline at end of file
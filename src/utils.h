@@ -1,7 +1,10 @@
-#ifndef _UTILS_H_
-#define _UTILS_H_
-#include <windows.h>
-
-bool CreateRecursiveDirectory(const TCHAR* filepath);
-
+#ifndef _UTILS_H_
+#define _UTILS_H_
+#include <windows.h>
+
+bool CreateRecursiveDirectory(const TCHAR* filepath);
+
+// Time the system gives services to stop at shutdown, in milliseconds
+DWORD GetServiceShutdownTimeout();
+
 #endif
\ No newline at end of file